@@ -0,0 +1,82 @@
+import sys
+import time
+from sim7080 import SIM7080Emulator, PtyLink, SerialLink
+
+#### CONFIGURATION ####
+
+# leave SERIAL_PORT empty to create a pty. else, the serial port wired to SIM7080_TX/SIM7080_RX of the GW
+SERIAL_PORT = ""
+BAUDRATE = 115200
+
+CONFIG = {
+    "seed": 1,                              # same seed, same injected faults
+    "imei": "860000000000001",
+    "rssi": 20,
+    "attached": False,                      # PS service already attached at start (reconnection)
+    "attach_time": 2.0,                     # seconds. AT+CGATT=1
+    "pdp_time": 0.5,                        # seconds between AT+CNACT=0,1 and +APP PDP: 0,ACTIVE
+    "ping_time": 0.08,
+    "mqtt_connect_time": 1.5,
+    "publish_time": 0.15,                   # seconds between the payload of AT+SMPUB and OK
+    "print_publishes": True,
+    "fs_read_time_per_byte": 0.0,
+    "fs_write_time": 0.02,
+    "http_connect_time": 0.8,
+    "http_request_time": 0.4,
+    "http_time_per_byte": 0.00002,          # ~50kB/s
+    # url (or file name) -> local file served by AT+HTTPTOFS and AT+SHREQ
+    "http_files": {
+        "Mesh2_0_node.bin": "../build/Mesh2_0.bin",
+    },
+    # default timing of every command
+    "default_fault": {"latency": 0.02, "jitter": 0.01},
+    # per command overrides, by command prefix. error_rate: reply ERROR, drop_rate: no reply at all
+    "faults": {
+        "AT+SMPUB": {"latency": 0.05, "jitter": 0.02, "error_rate": 0.0, "drop_rate": 0.0},
+        "AT+SMCONN": {"latency": 0.1, "error_rate": 0.0},
+        "AT+SHREAD": {"latency": 0.03, "drop_rate": 0.0},
+    },
+}
+
+CONSOLE_HELP = """commands:
+  sub <topic> <message>   incoming MQTT message (+SMSUB)
+  mqtt_drop               MQTT connection lost (+SMSTATE: 0)
+  pdp_drop                PDP deactivated (+APP PDP: 0,DEACTIVE)
+  stats                   print the counters
+  quit"""
+
+
+#### MAIN ####
+
+def main():
+    link = SerialLink(SERIAL_PORT, BAUDRATE) if SERIAL_PORT else PtyLink()
+    emulator = SIM7080Emulator(link, CONFIG)
+    emulator.start()
+    print("SIM7080 emulator on %s" % link.slave_name)
+    print(CONSOLE_HELP)
+    start_time = time.monotonic()
+
+    for line in sys.stdin:
+        words = line.split(" ", 2)
+        command = words[0].strip()
+        if command == "sub" and len(words) == 3:
+            emulator.inject_message(words[1], words[2].strip())
+        elif command == "mqtt_drop":
+            emulator.drop_mqtt()
+        elif command == "pdp_drop":
+            emulator.drop_pdp()
+        elif command == "stats":
+            print("running for %.1f s" % (time.monotonic() - start_time))
+            emulator.print_stats()
+        elif command == "quit":
+            break
+        elif command:
+            print(CONSOLE_HELP)
+
+    emulator.stop()
+    emulator.print_stats()
+    link.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,17 @@
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+
+#include <stdio.h>
+#include "esp_err.h"
+#include "esp_timer.h"
+
+// host shim of esp_log.h, in the format of the ESP-IDF console: "I (<ms>) <tag>: <message>"
+#define HOST_LOG(letter, tag, format, ...)  printf(letter " (%lld) %s: " format "\n", (long long)(esp_timer_get_time() / 1000), tag, ##__VA_ARGS__)
+
+#define ESP_LOGE(tag, format, ...)          HOST_LOG("E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...)          HOST_LOG("W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...)          HOST_LOG("I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...)          do { } while (0)
+#define ESP_LOGV(tag, format, ...)          do { } while (0)
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+
+#include <stdint.h>
+
+// host shim of esp_timer.h: micro seconds since the start of the program
+int64_t esp_timer_get_time(void);
+
+#endif
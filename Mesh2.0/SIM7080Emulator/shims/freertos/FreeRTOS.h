@@ -0,0 +1,26 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+/**
+ * host shim of the FreeRTOS API used by the SIM7080 component, on pthreads. one tick is one millisecond.
+ * the implementation is in host_shims.c
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define portMAX_DELAY           ((TickType_t)0xFFFFFFFF)
+#define portTICK_RATE_MS        1
+#define portTICK_PERIOD_MS      1
+#define pdTRUE                  1
+#define pdFALSE                 0
+#define pdPASS                  pdTRUE
+#define pdFAIL                  pdFALSE
+
+#endif
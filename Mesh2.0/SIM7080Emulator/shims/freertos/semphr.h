@@ -0,0 +1,16 @@
+#ifndef HOST_FREERTOS_SEMPHR_H
+#define HOST_FREERTOS_SEMPHR_H
+
+#include "freertos/queue.h"
+
+// as in FreeRTOS, a semaphore is a queue of items without data. a mutex starts given, and is not recursive
+typedef QueueHandle_t SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+
+#define xSemaphoreTake(semaphore, ticksToWait)  xQueueReceive((semaphore), NULL, (ticksToWait))
+#define xSemaphoreGive(semaphore)               xQueueSend((semaphore), NULL, 0)
+#define vSemaphoreDelete(semaphore)             vQueueDelete(semaphore)
+
+#endif
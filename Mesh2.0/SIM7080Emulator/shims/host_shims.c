@@ -0,0 +1,518 @@
+/**
+ * Host implementation of the FreeRTOS, esp_timer, esp_err and UART shims, on pthreads and a tty. Only what the SIM7080
+ * component uses is here: tasks are threads, queues and semaphores are bounded buffers with a condition variable, and
+ * a UART is a tty read by a thread of its own. Build: ../README.txt
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "driver/uart.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+
+//// TIME ////
+
+static struct timespec Host_Now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now;
+}
+
+static int64_t Host_StartTime(void)
+{
+    static int64_t start = 0;
+    if (start == 0)
+    {
+        struct timespec now = Host_Now();
+        start = (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+    }
+    return start;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    int64_t start = Host_StartTime();
+    struct timespec now = Host_Now();
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000 - start;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(esp_timer_get_time() / 1000);
+}
+
+// absolute time of a wait, for pthread_cond_timedwait on CLOCK_MONOTONIC
+static struct timespec Host_Deadline(TickType_t ticks)
+{
+    struct timespec deadline = Host_Now();
+    deadline.tv_sec += ticks / 1000;
+    deadline.tv_nsec += (long)(ticks % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    return deadline;
+}
+
+static void Host_InitCondition(pthread_cond_t *condition)
+{
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(condition, &attributes);
+    pthread_condattr_destroy(&attributes);
+}
+
+// wait on a condition until the deadline. portMAX_DELAY waits forever. the mutex is held
+static bool Host_Wait(pthread_cond_t *condition, pthread_mutex_t *mutex, TickType_t ticks, const struct timespec *deadline)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        pthread_cond_wait(condition, mutex);
+        return true;
+    }
+    return pthread_cond_timedwait(condition, mutex, deadline) != ETIMEDOUT;
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+        return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    default:
+        return "UNKNOWN ERROR";
+    }
+}
+
+//// TASKS ////
+
+struct HostTask
+{
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t notified;
+    uint32_t notifications;
+    TaskFunction_t function;
+    void *parameters;
+};
+
+static __thread struct HostTask *currentTask = NULL;
+
+static struct HostTask *Host_NewTask(void)
+{
+    struct HostTask *task = calloc(1, sizeof(struct HostTask));
+    if (task != NULL)
+    {
+        pthread_mutex_init(&task->mutex, NULL);
+        Host_InitCondition(&task->notified);
+    }
+    return task;
+}
+
+static void *Host_RunTask(void *argument)
+{
+    currentTask = (struct HostTask *)argument;
+    currentTask->function(currentTask->parameters);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stackDepth, void *parameters, UBaseType_t priority, TaskHandle_t *createdTask)
+{
+    struct HostTask *task = Host_NewTask();
+    if (task == NULL)
+    {
+        return pdFAIL;
+    }
+    task->function = function;
+    task->parameters = parameters;
+    if (pthread_create(&task->thread, NULL, Host_RunTask, task) != 0)
+    {
+        free(task);
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    if (createdTask != NULL)
+    {
+        *createdTask = task;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    // only a task deleting itself is supported
+    if (task == NULL || task == currentTask)
+    {
+        pthread_exit(NULL);
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec delay = {ticks / 1000, (long)(ticks % 1000) * 1000000};
+    nanosleep(&delay, NULL);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    // the main thread, and the other threads not created by xTaskCreate, become tasks when they first ask
+    if (currentTask == NULL)
+    {
+        currentTask = Host_NewTask();
+        currentTask->thread = pthread_self();
+    }
+    return currentTask;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait)
+{
+    struct HostTask *task = xTaskGetCurrentTaskHandle();
+    struct timespec deadline = Host_Deadline(ticksToWait);
+    pthread_mutex_lock(&task->mutex);
+    while (task->notifications == 0 && ticksToWait > 0 && Host_Wait(&task->notified, &task->mutex, ticksToWait, &deadline))
+    {
+    }
+    uint32_t notifications = task->notifications;
+    if (notifications > 0)
+    {
+        task->notifications = clearOnExit ? 0 : notifications - 1;
+    }
+    pthread_mutex_unlock(&task->mutex);
+    return notifications;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->mutex);
+    task->notifications++;
+    pthread_cond_broadcast(&task->notified);
+    pthread_mutex_unlock(&task->mutex);
+    return pdPASS;
+}
+
+//// QUEUES ////
+
+struct HostQueue
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    uint8_t *items;
+    UBaseType_t itemSize;
+    UBaseType_t length;
+    UBaseType_t count;
+    UBaseType_t first;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+    struct HostQueue *queue = calloc(1, sizeof(struct HostQueue));
+    if (queue == NULL)
+    {
+        return NULL;
+    }
+    queue->items = malloc(length * itemSize + 1);
+    if (queue->items == NULL)
+    {
+        free(queue);
+        return NULL;
+    }
+    queue->itemSize = itemSize;
+    queue->length = length;
+    pthread_mutex_init(&queue->mutex, NULL);
+    Host_InitCondition(&queue->changed);
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    pthread_cond_destroy(&queue->changed);
+    pthread_mutex_destroy(&queue->mutex);
+    free(queue->items);
+    free(queue);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait)
+{
+    struct timespec deadline = Host_Deadline(ticksToWait);
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->count == queue->length)
+    {
+        if (ticksToWait == 0 || !Host_Wait(&queue->changed, &queue->mutex, ticksToWait, &deadline))
+        {
+            pthread_mutex_unlock(&queue->mutex);
+            return pdFALSE;
+        }
+    }
+    if (queue->itemSize > 0)
+    {
+        memcpy(queue->items + ((queue->first + queue->count) % queue->length) * queue->itemSize, item, queue->itemSize);
+    }
+    queue->count++;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->mutex);
+    return pdTRUE;
+}
+
+static BaseType_t Host_QueueGet(QueueHandle_t queue, void *buffer, TickType_t ticksToWait, bool remove)
+{
+    struct timespec deadline = Host_Deadline(ticksToWait);
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->count == 0)
+    {
+        if (ticksToWait == 0 || !Host_Wait(&queue->changed, &queue->mutex, ticksToWait, &deadline))
+        {
+            pthread_mutex_unlock(&queue->mutex);
+            return pdFALSE;
+        }
+    }
+    if (queue->itemSize > 0 && buffer != NULL)
+    {
+        memcpy(buffer, queue->items + queue->first * queue->itemSize, queue->itemSize);
+    }
+    if (remove)
+    {
+        queue->first = (queue->first + 1) % queue->length;
+        queue->count--;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticksToWait)
+{
+    return Host_QueueGet(queue, buffer, ticksToWait, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *buffer, TickType_t ticksToWait)
+{
+    return Host_QueueGet(queue, buffer, ticksToWait, false);
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->mutex);
+    queue->count = 0;
+    queue->first = 0;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->mutex);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->mutex);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->mutex);
+    return count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    SemaphoreHandle_t mutex = xQueueCreate(1, 0);
+    if (mutex != NULL)
+    {
+        xSemaphoreGive(mutex);
+    }
+    return mutex;
+}
+
+//// UART ////
+
+typedef struct
+{
+    const char *device;
+    int fd;
+    pthread_mutex_t mutex;
+    uint8_t *buffer;                // bytes read from the tty, not read by uart_read_bytes yet
+    size_t size;
+    size_t first;
+    size_t count;
+    QueueHandle_t events;
+} HostUart_t;
+
+static HostUart_t uarts[UART_NUM_MAX];
+
+esp_err_t host_uart_attach(uart_port_t port, const char *device)
+{
+    if (port < 0 || port >= UART_NUM_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uarts[port].device = device;
+    return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config)
+{
+    return (port >= 0 && port < UART_NUM_MAX) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t uart_set_pin(uart_port_t port, int txPin, int rxPin, int rtsPin, int ctsPin)
+{
+    return (port >= 0 && port < UART_NUM_MAX) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+// reads the tty into the receive buffer, and posts an event per read as the driver does per interrupt
+static void *Host_UartReader(void *argument)
+{
+    HostUart_t *uart = (HostUart_t *)argument;
+    uint8_t data[256];
+    while (1)
+    {
+        ssize_t length = read(uart->fd, data, sizeof(data));
+        if (length <= 0)
+        {
+            if (length < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            fprintf(stderr, "%s closed\n", uart->device);
+            return NULL;
+        }
+
+        uart_event_t event = {.type = UART_DATA, .size = (size_t)length, .timeout_flag = false};
+        pthread_mutex_lock(&uart->mutex);
+        if (uart->count + length > uart->size)
+        {
+            event.type = UART_BUFFER_FULL;
+        }
+        else
+        {
+            for (ssize_t i = 0; i < length; i++)
+            {
+                uart->buffer[(uart->first + uart->count + i) % uart->size] = data[i];
+            }
+            uart->count += length;
+        }
+        pthread_mutex_unlock(&uart->mutex);
+        xQueueSend(uart->events, &event, portMAX_DELAY);
+    }
+}
+
+esp_err_t uart_driver_install(uart_port_t port, int rxBufferSize, int txBufferSize, int queueSize, QueueHandle_t *queue, int interruptFlags)
+{
+    if (port < 0 || port >= UART_NUM_MAX || uarts[port].device == NULL)
+    {
+        fprintf(stderr, "UART %d has no tty, see host_uart_attach\n", port);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    HostUart_t *uart = &uarts[port];
+    uart->fd = open(uart->device, O_RDWR | O_NOCTTY);
+    if (uart->fd < 0)
+    {
+        perror(uart->device);
+        return ESP_FAIL;
+    }
+    struct termios settings;
+    if (tcgetattr(uart->fd, &settings) == 0)
+    {
+        cfmakeraw(&settings);
+        cfsetspeed(&settings, B115200);
+        tcsetattr(uart->fd, TCSANOW, &settings);
+    }
+
+    uart->buffer = malloc(rxBufferSize);
+    uart->size = rxBufferSize;
+    uart->events = xQueueCreate(queueSize, sizeof(uart_event_t));
+    if (uart->buffer == NULL || uart->events == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    pthread_mutex_init(&uart->mutex, NULL);
+    *queue = uart->events;
+
+    pthread_t reader;
+    if (pthread_create(&reader, NULL, Host_UartReader, uart) != 0)
+    {
+        return ESP_FAIL;
+    }
+    pthread_detach(reader);
+    return ESP_OK;
+}
+
+int uart_write_bytes(uart_port_t port, const char *source, size_t size)
+{
+    size_t written = 0;
+    while (written < size)
+    {
+        ssize_t length = write(uarts[port].fd, source + written, size - written);
+        if (length < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        written += length;
+    }
+    return (int)written;
+}
+
+int uart_read_bytes(uart_port_t port, uint8_t *buffer, uint32_t length, TickType_t ticksToWait)
+{
+    // the component only reads what uart_get_buffered_data_len reported, so there is never anything to wait for
+    HostUart_t *uart = &uarts[port];
+    pthread_mutex_lock(&uart->mutex);
+    size_t copy_length = (length < uart->count) ? length : uart->count;
+    for (size_t i = 0; i < copy_length; i++)
+    {
+        buffer[i] = uart->buffer[(uart->first + i) % uart->size];
+    }
+    uart->first = (uart->first + copy_length) % uart->size;
+    uart->count -= copy_length;
+    pthread_mutex_unlock(&uart->mutex);
+    return (int)copy_length;
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t port, size_t *size)
+{
+    HostUart_t *uart = &uarts[port];
+    pthread_mutex_lock(&uart->mutex);
+    *size = uart->count;
+    pthread_mutex_unlock(&uart->mutex);
+    return ESP_OK;
+}
+
+esp_err_t uart_flush_input(uart_port_t port)
+{
+    HostUart_t *uart = &uarts[port];
+    pthread_mutex_lock(&uart->mutex);
+    uart->first = 0;
+    uart->count = 0;
+    pthread_mutex_unlock(&uart->mutex);
+    return ESP_OK;
+}
@@ -0,0 +1,542 @@
+"""
+Scripted emulator of the SIM7080 AT command subset used by the GW (SIM7080_Component and gw_src/comm/SIM7080.c).
+
+The emulator talks over a byte stream: a Linux pty (host runs of the cellular stack) or a serial port wired to the
+UART of a GW (hardware in the loop, without a modem). Latency, lost responses and ERROR replies are configurable per
+command, so the connect time, publish throughput and file copy speed can be measured reproducibly.
+"""
+import os
+import pty
+import tty
+import re
+import time
+import heapq
+import random
+import threading
+
+CRLF = b"\r\n"
+
+
+#### LINKS ####
+
+class PtyLink:
+    """ a pseudo terminal. the program under test opens slave_name like a UART """
+
+    def __init__(self):
+        self.master, slave = pty.openpty()
+        tty.setraw(slave)
+        self.slave_name = os.ttyname(slave)
+        self._slave = slave
+
+    def read(self, size):
+        try:
+            return os.read(self.master, size)
+        except OSError:
+            # the other side closed the pty
+            return b""
+
+    def write(self, data):
+        os.write(self.master, data)
+
+    def close(self):
+        os.close(self.master)
+        os.close(self._slave)
+
+
+class SerialLink:
+    """ a serial port wired to the UART of a GW (SIM7080_TX/SIM7080_RX). needs pyserial """
+
+    def __init__(self, port, baudrate):
+        import serial
+        self.port = serial.Serial(port, baudrate, timeout=0.05)
+        self.slave_name = port
+
+    def read(self, size):
+        return self.port.read(size)
+
+    def write(self, data):
+        self.port.write(data)
+
+    def close(self):
+        self.port.close()
+
+
+#### EMULATOR ####
+
+class Fault:
+    """ timing and failure settings of one command """
+
+    def __init__(self, latency=0.02, jitter=0.0, error_rate=0.0, drop_rate=0.0):
+        self.latency = latency          # seconds between the end of the command and the response
+        self.jitter = jitter            # random extra latency, up to this many seconds
+        self.error_rate = error_rate    # probability of replying ERROR instead of the normal response
+        self.drop_rate = drop_rate      # probability of losing the whole response (the GW sees a timeout)
+
+
+class SIM7080Emulator:
+
+    def __init__(self, link, config):
+        self.link = link
+        self.config = config
+        self.default_fault = Fault(**config.get("default_fault", {}))
+        self.faults = {prefix: Fault(**fault) for prefix, fault in config.get("faults", {}).items()}
+        self.random = random.Random(config.get("seed"))
+
+        # modem state
+        self.echo = True
+        self.attached = config.get("attached", False)
+        self.pdp_active = False
+        self.mqtt_connected = False
+        self.mqtt_config = {}
+        self.subscriptions = []
+        self.fs_open = False
+        self.files = dict(config.get("files", {}))      # name -> bytes, the CUSTOMER directory
+        self.http_url = None
+        self.http_connected = False
+        self.http_headers = {}
+        self.http_body = b""
+
+        # receiving
+        self._line = bytearray()
+        self._raw_expected = 0
+        self._raw = bytearray()
+        self._raw_done = None
+
+        # sending. responses are written in order by one thread
+        self._tx_heap = []
+        self._tx_sequence = 0
+        self._tx_last_due = 0.0
+        self._tx_condition = threading.Condition()
+        self._running = False
+        self.stats = {}
+        self.lock = threading.Lock()
+
+        self.handlers = [
+            ("AT+CPIN?", self.cmd_cpin),
+            ("AT+CFUN=", self.cmd_cfun),
+            ("AT+CSQ", self.cmd_csq),
+            ("AT+CGATT?", self.cmd_cgatt_query),
+            ("AT+CGATT=", self.cmd_cgatt),
+            ("AT+COPS?", self.cmd_cops),
+            ("AT+CNACT?", self.cmd_cnact_query),
+            ("AT+CNACT=", self.cmd_cnact),
+            ("AT+SNPDPID=", self.cmd_ok),
+            ("AT+SNPING4=", self.cmd_ping),
+            ("AT+GSN", self.cmd_gsn),
+            ("AT+CMEE?", self.cmd_cmee_query),
+            ("AT+CMEE=", self.cmd_ok),
+            ("AT+CSSLCFG=", self.cmd_ok),
+            ("AT+SMCONF=", self.cmd_smconf),
+            ("AT+SMSSL=", self.cmd_ok),
+            ("AT+SMSTATE?", self.cmd_smstate),
+            ("AT+SMCONN", self.cmd_smconn),
+            ("AT+SMDISC", self.cmd_smdisc),
+            ("AT+SMSUB=", self.cmd_smsub),
+            ("AT+SMPUB=", self.cmd_smpub),
+            ("AT+CFSINIT", self.cmd_cfsinit),
+            ("AT+CFSTERM", self.cmd_cfsterm),
+            ("AT+CFSGFRS?", self.cmd_cfsgfrs),
+            ("AT+CFSGFIS=", self.cmd_cfsgfis),
+            ("AT+CFSWFILE=", self.cmd_cfswfile),
+            ("AT+CFSRFILE=", self.cmd_cfsrfile),
+            ("AT+CFSDFILE=", self.cmd_cfsdfile),
+            ("AT+HTTPTOFS=", self.cmd_httptofs),
+            ("AT+SHCONF=", self.cmd_shconf),
+            ("AT+SHSSL=", self.cmd_ok),
+            ("AT+SHCONN", self.cmd_shconn),
+            ("AT+SHDISC", self.cmd_shdisc),
+            ("AT+SHSTATE?", self.cmd_shstate),
+            ("AT+SHCHEAD", self.cmd_shchead),
+            ("AT+SHAHEAD=", self.cmd_shahead),
+            ("AT+SHREQ=", self.cmd_shreq),
+            ("AT+SHREAD=", self.cmd_shread),
+            ("ATE0", self.cmd_echo_off),
+            ("ATE1", self.cmd_echo_on),
+            ("AT", self.cmd_ok),
+        ]
+        # longest prefix first, so "AT+CGATT?" wins over "AT"
+        self.handlers.sort(key=lambda handler: len(handler[0]), reverse=True)
+
+    #### RUNNING ####
+
+    def start(self):
+        self._running = True
+        threading.Thread(target=self._tx_task, daemon=True).start()
+        threading.Thread(target=self._rx_task, daemon=True).start()
+
+    def stop(self):
+        self._running = False
+        with self._tx_condition:
+            self._tx_condition.notify()
+
+    def _rx_task(self):
+        while self._running:
+            data = self.link.read(4096)
+            if not data:
+                time.sleep(0.01)
+                continue
+            self._count("rx_bytes", len(data))
+            for index in range(len(data)):
+                if self._raw_expected > 0:
+                    # payload of AT+SMPUB / AT+CFSWFILE
+                    self._raw.append(data[index])
+                    self._raw_expected -= 1
+                    if self._raw_expected == 0:
+                        done, self._raw_done = self._raw_done, None
+                        done(bytes(self._raw))
+                        self._raw.clear()
+                    continue
+
+                byte = data[index:index + 1]
+                if self.echo:
+                    self.link.write(byte)
+                if byte == b"\r":
+                    line = self._line.decode("latin-1").strip()
+                    self._line.clear()
+                    if line:
+                        self._command(line)
+                elif byte != b"\n":
+                    self._line += byte
+
+    def _tx_task(self):
+        while self._running:
+            with self._tx_condition:
+                while self._running and (not self._tx_heap or self._tx_heap[0][0] > time.monotonic()):
+                    timeout = self._tx_heap[0][0] - time.monotonic() if self._tx_heap else None
+                    self._tx_condition.wait(timeout)
+                if not self._running:
+                    return
+                _, _, data = heapq.heappop(self._tx_heap)
+            self.link.write(data)
+            self._count("tx_bytes", len(data))
+
+    def _count(self, name, amount=1):
+        with self.lock:
+            self.stats[name] = self.stats.get(name, 0) + amount
+
+    #### SENDING ####
+
+    def send(self, data, delay=0.0):
+        """ queue bytes to be written after delay seconds. the order of the queued bytes is kept """
+        with self._tx_condition:
+            due = max(time.monotonic() + delay, self._tx_last_due)
+            self._tx_last_due = due
+            heapq.heappush(self._tx_heap, (due, self._tx_sequence, data))
+            self._tx_sequence += 1
+            self._tx_condition.notify()
+
+    def send_lines(self, lines, delay=0.0):
+        self.send(b"".join(CRLF + line.encode("latin-1") + CRLF for line in lines), delay)
+
+    def urc(self, line, delay=0.0):
+        """ unsolicited message, eg: '+SMSUB: "topic","message"' """
+        self._count("urc")
+        self.send_lines([line], delay)
+
+    def _fault_of(self, line):
+        for prefix, fault in self.faults.items():
+            if line.startswith(prefix):
+                return fault
+        return self.default_fault
+
+    def _command(self, line):
+        name = next((prefix for prefix, _ in self.handlers if line.startswith(prefix)), None)
+        self._count("cmd " + (name or line))
+        if name is None:
+            self.send_lines(["ERROR"])
+            return
+
+        fault = self._fault_of(line)
+        delay = fault.latency + self.random.uniform(0.0, fault.jitter)
+        if self.random.random() < fault.drop_rate:
+            self._count("dropped")
+            return
+        if self.random.random() < fault.error_rate:
+            self._count("errors injected")
+            self.send_lines(["ERROR"], delay)
+            return
+
+        handler = dict(self.handlers)[name]
+        handler(line, delay)
+
+    def _receive_raw(self, length, done):
+        self._raw_expected = length
+        self._raw_done = done
+        if length == 0:
+            self._raw_expected = 0
+            done(b"")
+
+    #### GENERAL ####
+
+    def cmd_ok(self, line, delay):
+        self.send_lines(["OK"], delay)
+
+    def cmd_echo_off(self, line, delay):
+        self.echo = False
+        self.send_lines(["OK"], delay)
+
+    def cmd_echo_on(self, line, delay):
+        self.echo = True
+        self.send_lines(["OK"], delay)
+
+    def cmd_gsn(self, line, delay):
+        self.send_lines([self.config.get("imei", "860000000000001"), "OK"], delay)
+
+    def cmd_cmee_query(self, line, delay):
+        self.send_lines(["+CMEE: 0", "OK"], delay)
+
+    #### NETWORK ####
+
+    def cmd_cpin(self, line, delay):
+        self.send_lines(["+CPIN: READY", "OK"], delay)
+
+    def cmd_cfun(self, line, delay):
+        # the modem announces itself without a '+' before the result of the command
+        if line.endswith("=1"):
+            self.urc("SMS Ready", delay)
+        self.send_lines(["OK"], delay + 0.05)
+
+    def cmd_csq(self, line, delay):
+        self.send_lines(["+CSQ: %d,99" % self.config.get("rssi", 20), "OK"], delay)
+
+    def cmd_cgatt_query(self, line, delay):
+        self.send_lines(["+CGATT: %d" % self.attached, "OK"], delay)
+
+    def cmd_cgatt(self, line, delay):
+        self.attached = line.endswith("1")
+        self.send_lines(["OK"], delay + self.config.get("attach_time", 0.0))
+
+    def cmd_cops(self, line, delay):
+        self.send_lines(['+COPS: 0,0,"%s",7' % self.config.get("operator", "Emulated"), "OK"], delay)
+
+    def cmd_cnact_query(self, line, delay):
+        address = self.config.get("local_ip", "10.0.0.2") if self.pdp_active else "0.0.0.0"
+        self.send_lines(['+CNACT: 0,%d,"%s"' % (self.pdp_active, address), '+CNACT: 1,0,"0.0.0.0"', "OK"], delay)
+
+    def cmd_cnact(self, line, delay):
+        if not self.attached or self.pdp_active:
+            self.send_lines(["ERROR"], delay)
+            return
+        self.send_lines(["OK"], delay)
+        self.pdp_active = True
+        self.urc("+APP PDP: 0,ACTIVE", delay + self.config.get("pdp_time", 0.0))
+
+    def cmd_ping(self, line, delay):
+        if not self.pdp_active:
+            self.send_lines(["ERROR"], delay)
+            return
+        rtt = self.config.get("ping_time", 0.05)
+        self.send_lines(["+SNPING4: 1,8.8.8.8,%d" % (rtt * 1000), "OK"], delay + rtt)
+
+    #### MQTT ####
+
+    def cmd_smconf(self, line, delay):
+        match = re.match(r'AT\+SMCONF="(\w+)",\s*(.*)', line)
+        if match:
+            self.mqtt_config[match.group(1)] = match.group(2)
+        self.send_lines(["OK"], delay)
+
+    def cmd_smstate(self, line, delay):
+        self.send_lines(["+SMSTATE: %d" % self.mqtt_connected, "OK"], delay)
+
+    def cmd_smconn(self, line, delay):
+        if not self.pdp_active or self.mqtt_connected:
+            self.send_lines(["ERROR"], delay)
+            return
+        self.mqtt_connected = True
+        self.send_lines(["OK"], delay + self.config.get("mqtt_connect_time", 0.5))
+
+    def cmd_smdisc(self, line, delay):
+        self.mqtt_connected = False
+        self.subscriptions = []
+        self.send_lines(["OK"], delay)
+
+    def cmd_smsub(self, line, delay):
+        match = re.match(r'AT\+SMSUB="([^"]+)",(\d)', line)
+        if not self.mqtt_connected or not match:
+            self.send_lines(["ERROR"], delay)
+            return
+        self.subscriptions.append(match.group(1))
+        self.send_lines(["OK"], delay)
+
+    def cmd_smpub(self, line, delay):
+        match = re.match(r'AT\+SMPUB="([^"]+)",(\d+),(\d),(\d)', line)
+        if not self.mqtt_connected or not match:
+            self.send_lines(["ERROR"], delay)
+            return
+        topic, length = match.group(1), int(match.group(2))
+
+        def published(payload):
+            self._count("published messages")
+            self._count("published bytes", len(payload))
+            if self.config.get("print_publishes", True):
+                print("PUB %s %s" % (topic, payload.decode("latin-1")))
+            self.send_lines(["OK"], self.config.get("publish_time", 0.05))
+
+        # the prompt has no line ending
+        self.send(CRLF + b"> ", delay)
+        self._receive_raw(length, published)
+
+    def inject_message(self, topic, message):
+        """ an incoming MQTT message, as the SIM7080 reports it """
+        self.urc('+SMSUB: "%s","%s"' % (topic, message))
+
+    def drop_mqtt(self):
+        self.mqtt_connected = False
+        self.subscriptions = []
+        self.urc("+SMSTATE: 0")
+
+    def drop_pdp(self):
+        self.pdp_active = False
+        self.mqtt_connected = False
+        self.urc("+APP PDP: 0,DEACTIVE")
+
+    #### FILE SYSTEM ####
+
+    def cmd_cfsinit(self, line, delay):
+        reply = "ERROR" if self.fs_open else "OK"
+        self.fs_open = True
+        self.send_lines([reply], delay)
+
+    def cmd_cfsterm(self, line, delay):
+        self.fs_open = False
+        self.send_lines(["OK"], delay)
+
+    def cmd_cfsgfrs(self, line, delay):
+        used = sum(len(data) for data in self.files.values())
+        self.send_lines(["+CFSGFRS: %d,%d" % (self.config.get("fs_size", 1 << 20) - used, used), "OK"], delay)
+
+    def cmd_cfsgfis(self, line, delay):
+        match = re.match(r'AT\+CFSGFIS=\d,"([^"]+)"', line)
+        if not self.fs_open or not match or match.group(1) not in self.files:
+            self.send_lines(["ERROR"], delay)
+            return
+        self.send_lines(["+CFSGFIS: %d" % len(self.files[match.group(1)]), "OK"], delay)
+
+    def cmd_cfswfile(self, line, delay):
+        match = re.match(r'AT\+CFSWFILE=\d,"([^"]+)",(\d),(\d+),(\d+)', line)
+        if not self.fs_open or not match:
+            self.send_lines(["ERROR"], delay)
+            return
+        name, mode, length = match.group(1), int(match.group(2)), int(match.group(3))
+
+        def written(data):
+            self.files[name] = (self.files.get(name, b"") if mode == 1 else b"") + data
+            self.send_lines(["OK"], self.config.get("fs_write_time", 0.01))
+
+        self.send_lines(["DOWNLOAD"], delay)
+        self._receive_raw(length, written)
+
+    def cmd_cfsrfile(self, line, delay):
+        match = re.match(r'AT\+CFSRFILE=\d,"([^"]+)",(\d),(\d+),(\d+)', line)
+        if not self.fs_open or not match or match.group(1) not in self.files:
+            self.send_lines(["ERROR"], delay)
+            return
+        data = self.files[match.group(1)]
+        position = int(match.group(4)) if match.group(2) == "1" else 0
+        chunk = data[position:position + int(match.group(3))]
+        self._count("fs read bytes", len(chunk))
+        self.send(CRLF + b"+CFSRFILE: %d" % len(chunk) + CRLF + chunk + CRLF + b"OK" + CRLF,
+                  delay + len(chunk) * self.config.get("fs_read_time_per_byte", 0.0))
+
+    def cmd_cfsdfile(self, line, delay):
+        match = re.match(r'AT\+CFSDFILE=\d,"([^"]+)"', line)
+        if not self.fs_open or not match or self.files.pop(match.group(1), None) is None:
+            self.send_lines(["ERROR"], delay)
+            return
+        self.send_lines(["OK"], delay)
+
+    #### HTTP ####
+
+    def _download(self, url):
+        """ the body of a URL, from the files in the "http_files" configuration (url or file name -> path) """
+        files = self.config.get("http_files", {})
+        path = files.get(url) or files.get(url.rsplit("/", 1)[-1])
+        if path is None or not os.path.isfile(path):
+            return None
+        with open(path, "rb") as file:
+            return file.read()
+
+    def cmd_httptofs(self, line, delay):
+        match = re.match(r'AT\+HTTPTOFS="([^"]+)","/customer/([^"]+)"', line)
+        if not self.pdp_active or not match:
+            self.send_lines(["ERROR"], delay)
+            return
+        self.send_lines(["OK"], delay)
+        body = self._download(match.group(1))
+        if body is None:
+            self.urc("+HTTPTOFS: 404,0", delay + 0.1)
+            return
+        self.files[match.group(2)] = body
+        self.urc("+HTTPTOFS: 200,%d" % len(body), delay + len(body) * self.config.get("http_time_per_byte", 0.0))
+
+    def cmd_shconf(self, line, delay):
+        match = re.match(r'AT\+SHCONF="URL","([^"]+)"', line)
+        if match:
+            self.http_url = match.group(1)
+        self.send_lines(["OK"], delay)
+
+    def cmd_shconn(self, line, delay):
+        if not self.pdp_active or self.http_url is None or self.http_connected:
+            self.send_lines(["ERROR"], delay)
+            return
+        self.http_connected = True
+        self.send_lines(["OK"], delay + self.config.get("http_connect_time", 0.3))
+
+    def cmd_shdisc(self, line, delay):
+        reply = "OK" if self.http_connected else "ERROR"
+        self.http_connected = False
+        self.send_lines([reply], delay)
+
+    def cmd_shstate(self, line, delay):
+        self.send_lines(["+SHSTATE: %d" % self.http_connected, "OK"], delay)
+
+    def cmd_shchead(self, line, delay):
+        self.http_headers = {}
+        self.send_lines(["OK"], delay)
+
+    def cmd_shahead(self, line, delay):
+        match = re.match(r'AT\+SHAHEAD="([^"]+)","([^"]*)"', line)
+        if match:
+            self.http_headers[match.group(1)] = match.group(2)
+        self.send_lines(["OK"], delay)
+
+    def cmd_shreq(self, line, delay):
+        match = re.match(r'AT\+SHREQ="([^"]*)",(\d)', line)
+        if not self.http_connected or not match:
+            self.send_lines(["ERROR"], delay)
+            return
+        self.send_lines(["OK"], delay)
+        body = self._download(self.http_url + match.group(1))
+        if body is None:
+            self.http_body = b""
+            self.urc('+SHREQ: "GET",404,0', delay + 0.1)
+            return
+
+        # "Range: bytes=<start>-" is the only kind of range sent by the GW
+        status = 200
+        range_match = re.match(r"bytes=(\d+)-", self.http_headers.get("Range", ""))
+        if range_match:
+            body = body[int(range_match.group(1)):]
+            status = 206
+        self.http_body = body
+        self.urc('+SHREQ: "GET",%d,%d' % (status, len(body)), delay + self.config.get("http_request_time", 0.2))
+
+    def cmd_shread(self, line, delay):
+        match = re.match(r"AT\+SHREAD=(\d+),(\d+)", line)
+        if not self.http_connected or not match:
+            self.send_lines(["ERROR"], delay)
+            return
+        position, length = int(match.group(1)), int(match.group(2))
+        chunk = self.http_body[position:position + length]
+        self._count("http read bytes", len(chunk))
+        self.send_lines(["OK"], delay)
+        self.send(CRLF + b"+SHREAD: %d" % len(chunk) + CRLF + chunk,
+                  delay + len(chunk) * self.config.get("http_time_per_byte", 0.0))
+
+    #### REPORT ####
+
+    def print_stats(self):
+        with self.lock:
+            for name in sorted(self.stats):
+                print("%-32s %d" % (name, self.stats[name]))
@@ -0,0 +1,306 @@
+/**
+ * Host harness of the SIM7080 component: the receive ring framer (SIM7080_lib.c), the AT engine (SIM7080_AT.c) and
+ * the URC trie (SIM7080_URC.c) are built with the shims of shims/ and run against the emulator of main.py over its pty.
+ * Each step checks the responses the engine hands back and prints its time; the latency metrics of the engine are
+ * printed at the end. Build: README.txt
+ */
+#include <stdio.h>
+#include "SIM7080_lib.h"
+
+#define HARNESS_UART_PORT           1
+#define HARNESS_UART_BUFFER_SIZE    1024
+#define HARNESS_PIPELINE_DEPTH      4
+#define HARNESS_FILE_NAME           "harness.bin"
+#define HARNESS_FILE_SIZE           700
+#define HARNESS_PUBLISHES           20
+#define HARNESS_TOPIC               "harness/sensordata/"
+
+static const char *TAG = "SIM7080_harness";
+
+static uint32_t passed = 0;
+static uint32_t failed = 0;
+
+// unsolicited messages recognized by the trie, and how many of each came
+static SemaphoreHandle_t pdpActive = NULL;
+static uint32_t urcCount[5] = {0};
+
+static esp_err_t Harness_OnPdpActive(uint8_t *line, uint16_t length)
+{
+    urcCount[0]++;
+    xSemaphoreGive(pdpActive);
+    return ESP_OK;
+}
+
+static esp_err_t Harness_OnPdpDeactive(uint8_t *line, uint16_t length)
+{
+    urcCount[1]++;
+    return ESP_OK;
+}
+
+static esp_err_t Harness_OnMessage(uint8_t *line, uint16_t length)
+{
+    urcCount[2]++;
+    ESP_LOGI(TAG, "incoming %.*s", length, (char *)line);
+    return ESP_OK;
+}
+
+static esp_err_t Harness_OnMqttState(uint8_t *line, uint16_t length)
+{
+    urcCount[3]++;
+    return ESP_OK;
+}
+
+static esp_err_t Harness_OnOther(uint8_t *line, uint16_t length)
+{
+    urcCount[4]++;
+    return ESP_OK;
+}
+
+static const SIM7080_URC_entry_t Harness_URC_table[] = {
+    {"+APP PDP: 0,ACTIVE", Harness_OnPdpActive},
+    {"+APP PDP: 0,DEACTIVE", Harness_OnPdpDeactive},
+    {"+SMSUB:", Harness_OnMessage},
+    {"+SMSTATE:", Harness_OnMqttState},
+    {"+", Harness_OnOther},
+    {"SMS Ready", Harness_OnOther},
+};
+#define HARNESS_URC_ENTRIES (sizeof(Harness_URC_table) / sizeof(Harness_URC_table[0]))
+
+static esp_err_t Harness_PreProcess(uint8_t *line)
+{
+    return SIM7080_URC_dispatch(line, strlen((char *)line));
+}
+
+static void Harness_Check(const char *step, bool ok, int64_t start)
+{
+    ok ? passed++ : failed++;
+    printf("%-40s %s %8.1f ms\n", step, ok ? "PASS" : "FAIL", (esp_timer_get_time() - start) / 1000.0);
+}
+
+// a blocking command, with its response in a buffer of the caller
+static esp_err_t Harness_Execute(const char *message, uint32_t timeout, uint8_t *response, uint16_t responseSize)
+{
+    SIM7080_AT_cmd_t cmd = {0};
+    cmd.message         = (const uint8_t *)message;
+    cmd.length          = strlen(message);
+    cmd.timeout         = timeout;
+    cmd.response        = response;
+    cmd.response_size   = responseSize;
+    return SIM7080_AT_execute(&cmd);
+}
+
+// a command which should reply OK and a line containing expected (NULL for OK only)
+static void Harness_Step(const char *message, uint32_t timeout, const char *expected)
+{
+    uint8_t response[256];
+    int64_t start = esp_timer_get_time();
+    esp_err_t result = Harness_Execute(message, timeout, response, sizeof(response) - 1);
+    Harness_Check(message, result == ESP_OK && (expected == NULL || strstr((char *)response, expected) != NULL), start);
+}
+
+// commands written back to back, before their results: each response must reach its own command
+static void Harness_Pipeline()
+{
+    static const char *messages[HARNESS_PIPELINE_DEPTH] = {"AT+CSQ", "AT+CPIN?", "AT+COPS?", "AT+CGATT?"};
+    static const char *expected[HARNESS_PIPELINE_DEPTH] = {"+CSQ:", "+CPIN:", "+COPS:", "+CGATT:"};
+    SIM7080_AT_cmd_t cmds[HARNESS_PIPELINE_DEPTH] = {0};
+    uint8_t responses[HARNESS_PIPELINE_DEPTH][128];
+    bool ok = true;
+
+    int64_t start = esp_timer_get_time();
+    for (uint8_t i = 0; i < HARNESS_PIPELINE_DEPTH; i++)
+    {
+        cmds[i].message         = (const uint8_t *)messages[i];
+        cmds[i].length          = strlen(messages[i]);
+        cmds[i].flags           = SIM7080_AT_FLAG_PIPELINE;
+        cmds[i].timeout         = 1000;
+        cmds[i].response        = responses[i];
+        cmds[i].response_size   = sizeof(responses[i]) - 1;
+        ok &= (SIM7080_AT_start(&cmds[i]) == ESP_OK);
+    }
+    for (uint8_t i = 0; i < HARNESS_PIPELINE_DEPTH; i++)
+    {
+        ok &= (SIM7080_AT_wait(&cmds[i]) == ESP_OK);
+        ok &= (strstr((char *)responses[i], expected[i]) != NULL);
+    }
+    Harness_Check("pipeline of 4 queries", ok, start);
+}
+
+// a file written through the "DOWNLOAD" prompt, then read back as raw bytes
+static void Harness_File()
+{
+    static uint8_t contents[HARNESS_FILE_SIZE];
+    static uint8_t readBack[HARNESS_UART_BUFFER_SIZE];
+    for (uint16_t i = 0; i < HARNESS_FILE_SIZE; i++)
+    {
+        // line ends and NULs in the data must not confuse the framer
+        contents[i] = (i % 50 == 0) ? '\n' : (uint8_t)(i * 7);
+    }
+
+    Harness_Execute("AT+CFSTERM", 1000, NULL, 0);
+    Harness_Step("AT+CFSINIT", 1000, NULL);
+
+    SIM7080_FS_t file = {0};
+    file.directory  = CUSTOMER;
+    file.mode       = WRITE_DATA_FROM_BEGINNING;
+    file.file_name  = HARNESS_FILE_NAME;
+    file.start_pos  = (const char *)contents;
+    file.end_pos    = (const char *)contents + HARNESS_FILE_SIZE;
+    file.timeout    = 1000;
+    int64_t start = esp_timer_get_time();
+    Harness_Check("SIM7080_FS_write_file", SIM7080_FS_write_file(&file) == ESP_OK, start);
+
+    char message[64];
+    SIM7080_AT_cmd_t cmd = {0};
+    cmd.length      = snprintf(message, sizeof(message), "AT+CFSRFILE=%d,\"%s\",0,%d,0", CUSTOMER, HARNESS_FILE_NAME, HARNESS_FILE_SIZE);
+    cmd.message     = (const uint8_t *)message;
+    cmd.flags       = SIM7080_AT_FLAG_BINARY;
+    cmd.timeout     = 2000;
+    cmd.binary      = readBack;
+    cmd.binary_size = sizeof(readBack);
+    start = esp_timer_get_time();
+    esp_err_t result = SIM7080_AT_execute(&cmd);
+    Harness_Check("AT+CFSRFILE, raw bytes", result == ESP_OK && cmd.binary_received == HARNESS_FILE_SIZE &&
+                  memcmp(readBack, contents, HARNESS_FILE_SIZE) == 0, start);
+
+    snprintf(message, sizeof(message), "AT+CFSDFILE=%d,\"%s\"", CUSTOMER, HARNESS_FILE_NAME);
+    Harness_Step(message, 1000, NULL);
+    Harness_Step("AT+CFSTERM", 1000, NULL);
+}
+
+// a command which expires before the modem answers ("AT+CGATT=1" takes attach_time): its late result must not
+// complete the next command
+static void Harness_LateResult()
+{
+    SIM7080_AT_cmd_t cmd = {0};
+    cmd.message = (const uint8_t *)"AT+CGATT=1";
+    cmd.length  = strlen("AT+CGATT=1");
+    cmd.timeout = 300;
+    int64_t start = esp_timer_get_time();
+    Harness_Check("AT+CGATT=1 times out", SIM7080_AT_execute(&cmd) == ESP_ERR_TIMEOUT, start);
+    Harness_Step("AT+CPIN?", 5000, "+CPIN: READY");
+}
+
+// an unsolicited line without a '+' which comes while a command is in flight goes to its handler, not to the command
+static void Harness_UnprefixedUrc()
+{
+    uint8_t response[128];
+    uint8_t others = urcCount[4];
+    int64_t start = esp_timer_get_time();
+    esp_err_t result = Harness_Execute("AT+CFUN=1", 1000, response, sizeof(response) - 1);
+    Harness_Check("AT+CFUN=1 and SMS Ready", result == ESP_OK && urcCount[4] == others + 1 &&
+                  strstr((char *)response, "SMS Ready") == NULL, start);
+}
+
+// attach, PDP context (its "+APP PDP" comes through the trie) and MQTT connection
+static void Harness_Connect()
+{
+    uint8_t response[256];
+    Harness_Step("AT+CGATT=1", 10000, NULL);
+
+    int64_t start = esp_timer_get_time();
+    Harness_Execute("AT+CNACT?", 1000, response, sizeof(response) - 1);
+    if (strstr((char *)response, "+CNACT: 0,1") == NULL)
+    {
+        bool ok = (Harness_Execute("AT+CNACT=0,1", 2000, NULL, 0) == ESP_OK);
+        ok &= (xSemaphoreTake(pdpActive, 5000 / portTICK_RATE_MS) == pdTRUE);
+        Harness_Check("AT+CNACT=0,1 and +APP PDP", ok, start);
+    }
+
+    Harness_Execute("AT+SMSTATE?", 1000, response, sizeof(response) - 1);
+    if (strstr((char *)response, "+SMSTATE: 1") == NULL)
+    {
+        Harness_Step("AT+SMCONN", 10000, NULL);
+    }
+}
+
+// "AT+SMPUB", the ">" prompt (no line end) and the payload, pipelined as the GW publishes
+static void Harness_Publish()
+{
+    SIM7080_AT_cmd_t cmds[HARNESS_PIPELINE_DEPTH];
+    char messages[HARNESS_PIPELINE_DEPTH][64];
+    char payloads[HARNESS_PIPELINE_DEPTH][64];
+    uint32_t published = 0;
+    bool ok = true;
+
+    int64_t start = esp_timer_get_time();
+    for (uint32_t sent = 0; sent < HARNESS_PUBLISHES; sent += HARNESS_PIPELINE_DEPTH)
+    {
+        uint8_t batch = (HARNESS_PUBLISHES - sent < HARNESS_PIPELINE_DEPTH) ? HARNESS_PUBLISHES - sent : HARNESS_PIPELINE_DEPTH;
+        for (uint8_t i = 0; i < batch; i++)
+        {
+            memset(&cmds[i], 0, sizeof(SIM7080_AT_cmd_t));
+            int payloadLength = snprintf(payloads[i], sizeof(payloads[i]), "{\"harness\":%u}", sent + i);
+            cmds[i].length          = snprintf(messages[i], sizeof(messages[i]), "AT+SMPUB=\"%s\",%d,1,0", HARNESS_TOPIC, payloadLength);
+            cmds[i].message         = (const uint8_t *)messages[i];
+            cmds[i].flags           = SIM7080_AT_FLAG_PIPELINE;
+            cmds[i].timeout         = 3000;
+            cmds[i].payload_prefix  = ">";
+            cmds[i].payload         = (const uint8_t *)payloads[i];
+            cmds[i].payload_length  = payloadLength;
+            ok &= (SIM7080_AT_start(&cmds[i]) == ESP_OK);
+        }
+        for (uint8_t i = 0; i < batch; i++)
+        {
+            if (SIM7080_AT_wait(&cmds[i]) == ESP_OK)
+            {
+                published++;
+            }
+        }
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+    Harness_Check("20 pipelined AT+SMPUB", ok && published == HARNESS_PUBLISHES, start);
+    printf("%-40s %.1f messages/s\n", "publish throughput", published * 1000000.0 / elapsed);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        printf("usage: %s <pty of the emulator> [seconds to wait for console URCs]\n", argv[0]);
+        return 2;
+    }
+    uint32_t urcWait = (argc > 2) ? (uint32_t)atoi(argv[2]) : 0;
+
+    // 1. the modem, on the pty of the emulator
+    host_uart_attach(HARNESS_UART_PORT, argv[1]);
+    pdpActive = xSemaphoreCreateBinary();
+    SIM7080_t modem = {0};
+    modem.config.uart_port          = HARNESS_UART_PORT;
+    modem.config.uart_buffer_size   = HARNESS_UART_BUFFER_SIZE;
+    modem.config.queue_length       = 20;
+    modem.config.pipeline_depth     = HARNESS_PIPELINE_DEPTH;
+    modem.log.print_log_info        = true;
+    modem.comm.recieved_message     = malloc(HARNESS_UART_BUFFER_SIZE);
+    modem.comm.pre_process_recieved_message = Harness_PreProcess;
+    if (SIM7080_URC_build(Harness_URC_table, HARNESS_URC_ENTRIES) != ESP_OK || SIM7080_setup(&modem) != ESP_OK)
+    {
+        printf("setup failed\n");
+        return 1;
+    }
+
+    // 2. the steps of a GW start up, in order
+    Harness_Step("ATE0", 1000, NULL);
+    Harness_Step("AT", 1000, NULL);
+    Harness_Step("AT+CPIN?", 1000, "+CPIN: READY");
+    Harness_Step("AT+GSN", 1000, NULL);
+    Harness_Pipeline();
+    Harness_File();
+    Harness_LateResult();
+    Harness_UnprefixedUrc();
+    Harness_Connect();
+    Harness_Publish();
+
+    // 3. URCs typed in the console of the emulator (sub, mqtt_drop, pdp_drop)
+    if (urcWait > 0)
+    {
+        printf("waiting %u s for URCs from the emulator console\n", urcWait);
+        vTaskDelay(urcWait * 1000 / portTICK_RATE_MS);
+    }
+    printf("URCs: pdp active %u, pdp deactive %u, messages %u, mqtt state %u, other %u\n",
+           urcCount[0], urcCount[1], urcCount[2], urcCount[3], urcCount[4]);
+
+    SIM7080_AT_print_metrics();
+    printf("%u passed, %u failed\n", passed, failed);
+    return (failed == 0) ? 0 : 1;
+}
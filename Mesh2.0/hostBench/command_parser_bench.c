@@ -0,0 +1,122 @@
+/**
+ * Host benchmark of the command parsers: cJSON, as the command tasks used it before, against CommandParser_Parse.
+ * Both read cmnd, val, str and macs of each message of the corpus, and count the heap allocations. Build: README.txt
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cJSON.h"
+
+static unsigned long allocations = 0;
+
+static void *Bench_Malloc(size_t size)
+{
+    allocations++;
+    return malloc(size);
+}
+
+static void Bench_Free(void *pointer)
+{
+    free(pointer);
+}
+
+// the parser is built here, so that its heap use is counted too
+#define malloc Bench_Malloc
+#define free Bench_Free
+#include "../main/command_parser.c"
+#undef malloc
+#undef free
+
+#define BENCH_ITERATIONS 20000
+
+// commands sent by the backend (see publishingScript), as the root and the nodes get them
+static const char *corpus[] = {
+    "{\"usrID\":\"testID\",\"cmnd\":51,\"str\":\"\",\"val\":0}",
+    "{\"usrID\":\"testID\",\"cmnd\":62,\"val\":2,\"str\":\"grp1\",\"macs\":[164,207,18,1,2,3,164,207,18,1,2,4]}",
+    "{\"usrID\":\"testID\",\"cmnd\":54,\"str\":\"{\\\"grpID\\\": \\\"grp1\\\", \\\"usrID\\\": \\\"testID\\\", \\\"cmnd\\\": 1, \\\"str\\\": \\\"\\\", \\\"val\\\": 0}\",\"val\":0}",
+    "{\"usrID\":\"testID\",\"cmnd\":55,\"str\":\"5f9a2b7c1d3e4f5a6b7c8d9e\",\"val\":0}",
+    "{\"usrID\":\"testID\",\"cmnd\":61,\"val\":1,\"str\":\"https://example.com/fw/node_v2.1.bin\",\"macs\":[164,207,18,1,2,3]}",
+    "{\"usrID\": \"testID\", \"cmnd\": 2, \"str\": \"\", \"val\": 75}",
+    "{\"usrID\": \"testID\", \"cmnd\": 5, \"str\": \"a4:cf:12:01:02:05\", \"val\": 0}",
+    "{\"usrID\": \"testID\", \"cmnd\": 8, \"str\": \"a4:cf:12:01:02:05_a4:cf:12:01:02:03\", \"val\": 0}",
+    "{\"usrID\": \"testID\", \"cmnd\": 9, \"str\": \"\", \"val\": [1, 0, 1, 1]}",
+    "{\"usrID\": \"testID\", \"cmnd\": 22, \"val\": 75, \"str\": \"{\\\"address\\\": 3, \\\"command\\\": 1, \\\"address_type\\\": 0, \\\"fade_unit\\\": 0, \\\"fade_time\\\": 10}\"}",
+    "{\"usrID\": \"testID\", \"cmnd\": 23, \"val\": 0, \"str\": \"0a1b2c3d4e5f60718293a4b5c6d7e8f90a1b2c3d\"}",
+};
+#define CORPUS_SIZE (sizeof(corpus) / sizeof(corpus[0]))
+
+static volatile int sink;
+
+// what the command tasks did with cJSON before CommandParser
+static void Bench_ParseWithCJSON(const char *json)
+{
+    cJSON *root = cJSON_Parse(json);
+    cJSON *cjCommand = cJSON_GetObjectItemCaseSensitive(root, "cmnd");
+    cJSON *cjValue = cJSON_GetObjectItemCaseSensitive(root, "val");
+    cJSON *cjString = cJSON_GetObjectItemCaseSensitive(root, "str");
+    cJSON *cjMacs = cJSON_GetObjectItemCaseSensitive(root, "macs");
+    sink = cJSON_IsNumber(cjCommand) + cJSON_IsNumber(cjValue) + cJSON_IsString(cjString);
+    if (cJSON_IsArray(cjMacs) || cJSON_IsArray(cjValue))
+    {
+        cJSON *cjArray = cJSON_IsArray(cjMacs) ? cjMacs : cjValue;
+        uint8_t *bytes = Bench_Malloc(cJSON_GetArraySize(cjArray));
+        cJSON *Iterator = NULL;
+        uint8_t count = 0;
+        cJSON_ArrayForEach(Iterator, cjArray)
+        {
+            bytes[count++] = (uint8_t)Iterator->valueint;
+        }
+        sink += bytes[0];
+        Bench_Free(bytes);
+    }
+    cJSON_Delete(root);
+}
+
+static CommandMessage_t message;
+
+static void Bench_ParseWithCommandParser(const char *json)
+{
+    CommandParser_Parse(json, &message);
+    sink = message.fields;
+    CommandParser_Release(&message);
+}
+
+static double Bench_Run(void (*parse)(const char *), const char *json, double *allocationsPerMessage)
+{
+    struct timespec start, end;
+    allocations = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        parse(json);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    *allocationsPerMessage = (double)allocations / BENCH_ITERATIONS;
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / BENCH_ITERATIONS;
+}
+
+int main()
+{
+    cJSON_Hooks hooks = {Bench_Malloc, Bench_Free};
+    cJSON_InitHooks(&hooks);
+
+    double totalCJSON = 0;
+    double totalParser = 0;
+    printf("%3s %6s %12s %12s %12s %12s\n", "#", "bytes", "cJSON ns", "cJSON alloc", "parser ns", "parser alloc");
+    for (size_t i = 0; i < CORPUS_SIZE; i++)
+    {
+        double allocationsCJSON;
+        double allocationsParser;
+        double nsCJSON = Bench_Run(Bench_ParseWithCJSON, corpus[i], &allocationsCJSON);
+        double nsParser = Bench_Run(Bench_ParseWithCommandParser, corpus[i], &allocationsParser);
+        totalCJSON += nsCJSON;
+        totalParser += nsParser;
+        printf("%3zu %6zu %12.0f %12.1f %12.0f %12.1f\n", i, strlen(corpus[i]), nsCJSON, allocationsCJSON, nsParser, allocationsParser);
+    }
+    CommandParser_Metrics_t metrics;
+    CommandParser_GetMetrics(&metrics);
+    printf("average: cJSON %.0f ns, parser %.0f ns. parser fallbacks to cJSON: %u\n",
+           totalCJSON / CORPUS_SIZE, totalParser / CORPUS_SIZE, metrics.fallbacks);
+    return 0;
+}
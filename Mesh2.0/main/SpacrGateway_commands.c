@@ -36,6 +36,18 @@ CNGW_CN_Board_Info_t cn_board_info
 CN_Sensor_Configuration_t sensor_configuration[MAX_SENSORS]                         = { 0 };
 CN_DRV_Slot_t driver_slots[CABINET__DRIVER_SLOT_COUNT]                              = { 0 };
 
+// fields of the JSON of an action command, read by GW_Process_Action_Command
+typedef enum
+{
+    GW_ACTION_FIELD_ADDRESS,
+    GW_ACTION_FIELD_COMMAND,
+    GW_ACTION_FIELD_ADDRESS_TYPE,
+    GW_ACTION_FIELD_FADE_UNIT,
+    GW_ACTION_FIELD_FADE_TIME,
+    GW_ACTION_FIELD_COUNT
+} GW_ActionField_t;
+static const char *const GW_ActionFieldKeys[GW_ACTION_FIELD_COUNT] = {"address", "command", "address_type", "fade_unit", "fade_time"};
+
 
 //OTA related variables
 size_t total_received_data                  = 0;
@@ -80,6 +92,54 @@ void Send_GW_message_to_AWS(uint16_t ubyCommand, uint32_t uwValue, char *cptrStr
     SecondaryUtilities_PrepareJSONAndSendToAWS(ubyCommand, uwValue , cptrString);
 #endif
 }
+// bits of CNGW_Update_Channel_Status_Message_t.status_mask which are faults of the driver (CNDR_FAULT_Type)
+#define GW_CHANNEL_FAULT_BITS (((1u << CNGW_UPDATE_CHANNEL_STATUS_CNDR_FAULT_TYPE_END_MARKER) - 1) & \
+                               ~((1u << CNGW_UPDATE_CHANNEL_STATUS_CNDR_FAULT_TYPE_START_MARKER) - 1))
+
+/**
+ * @brief publishes the status of a channel, or of the GW itself, as a status message:
+ * {"devID":<mac>,"devType":"GW","channel":<n>,"status":<status_mask>,"fault":<fault bits>,"powerLoss":true}
+ * through the mesh the root keeps it for its snapshots, and publishes it at once if "fault" or "powerLoss" is set.
+ * a GATEWAY_SIM7080 has no aggregation, the status goes as a success message
+ * @param channel[in] channel of the CN board, negative for the GW itself (no "channel")
+ * @param status_mask[in] status_mask of the channel, 0 if there is no fault
+ * @param power_loss[in] true if the power of the GW is lost
+ */
+void Send_GW_Status_to_AWS(int16_t channel, uint32_t status_mask, bool power_loss)
+{
+    cJSON *status = cJSON_CreateObject();
+    cJSON_AddItemToObject(status, "devID", cJSON_CreateString(deviceMACStr));
+    cJSON_AddItemToObject(status, "devType", cJSON_CreateString("GW"));
+    if (channel >= 0)
+    {
+        cJSON_AddNumberToObject(status, "channel", channel);
+        cJSON_AddNumberToObject(status, "status", status_mask);
+        cJSON_AddNumberToObject(status, "fault", status_mask & GW_CHANNEL_FAULT_BITS);
+    }
+    if (power_loss)
+    {
+        cJSON_AddBoolToObject(status, "powerLoss", true);
+    }
+#ifdef IPNODE
+    NodeUtilities_SendJsonToRoot(58, 0, status);
+#else
+    char *dataToSend = cJSON_PrintUnformatted(status);
+    if (dataToSend != NULL)
+    {
+#ifdef GATEWAY_ETH
+        if (!StatusAggregator_Update(dataToSend))
+        {
+            RootUtilities_SendDataToAWS(AWS_TOPIC_SENSOR_DATA, dataToSend);
+        }
+#else
+        Send_GW_message_to_AWS(64, 0, dataToSend);
+#endif
+        free(dataToSend);
+    }
+#endif
+    cJSON_Delete(status);
+}
+
 /**
  * @brief Initialize all necessary tasks for GW
  */
@@ -212,47 +272,44 @@ bool GW_Process_Action_Command(NodeStruct_t *structNodeReceived)
         ESP_LOGI(TAG, "GW_Process_Action_Command Function Called");
     }
 
-    cJSON *json = cJSON_Parse(structNodeReceived->cptrString);
+    double fields[GW_ACTION_FIELD_COUNT];
+    uint32_t found = 0;
     // Action validity checks
-    if (json == NULL)
+    if (!CommandParser_ParseNumbers(structNodeReceived->cptrString, GW_ActionFieldKeys, GW_ACTION_FIELD_COUNT, fields, &found))
     {
         ESP_LOGE(TAG, "Action command JSON not found");
         result = false;
     }
     else
     {
-        cJSON *cjAddress = cJSON_GetObjectItemCaseSensitive(json, "address");
-        if (cJSON_IsNumber(cjAddress))
+        if (found & (1u << GW_ACTION_FIELD_ADDRESS))
         {
-            if (cjAddress->valueint >= 0 && cjAddress->valueint < NUM_DR_CHANNELS)
+            int address = CommandParser_ValueInt(fields[GW_ACTION_FIELD_ADDRESS]);
+            if (address >= 0 && address < NUM_DR_CHANNELS)
             {
                 if (structNodeReceived->dValue >= 0.00 && structNodeReceived->dValue <= 100.00)
                 {
 
-                    cJSON *cjCommand = cJSON_GetObjectItemCaseSensitive(json, "command");
-                    if (cJSON_IsNumber(cjCommand))
+                    if (found & (1u << GW_ACTION_FIELD_COMMAND))
                     {
-                        cJSON *cjAddress_type = cJSON_GetObjectItemCaseSensitive(json, "address_type");
-                        if (cJSON_IsNumber(cjAddress_type))
+                        if (found & (1u << GW_ACTION_FIELD_ADDRESS_TYPE))
                         {
-                            cJSON *cjFade_unit = cJSON_GetObjectItemCaseSensitive(json, "fade_unit");
-                            if (cJSON_IsNumber(cjFade_unit))
+                            if (found & (1u << GW_ACTION_FIELD_FADE_UNIT))
                             {
 
-                                cJSON *cjFade_time = cJSON_GetObjectItemCaseSensitive(json, "fade_time");
-                                if (cJSON_IsNumber(cjFade_time))
+                                if (found & (1u << GW_ACTION_FIELD_FADE_TIME))
                                 {
                                     LED_change_task_momentarily(CNGW_LED_CMD_BUSY, CNGW_LED_CN, LED_CHANGE_MOMENTARY_DURATION);
 
                                     CNGW_Action_Frame_t actionFrame = {0};
                                     CCP_UTIL_Get_Msg_Header(&actionFrame.header, CNGW_HEADER_TYPE_Action_Commmand, sizeof(actionFrame.message));
 
-                                    actionFrame.message.command = cjCommand->valueint;
+                                    actionFrame.message.command = CommandParser_ValueInt(fields[GW_ACTION_FIELD_COMMAND]);
                                     actionFrame.message.address.target_cabinet = cn_board_info.cn_config.cabinet_number;
-                                    actionFrame.message.address.address_type = cjAddress_type->valueint;
-                                    actionFrame.message.address.target_address = cjAddress->valueint;
-                                    actionFrame.message.action_parameters.fade_unit = cjFade_unit->valueint;
-                                    actionFrame.message.action_parameters.fade_time = cjFade_time->valueint;
+                                    actionFrame.message.address.address_type = CommandParser_ValueInt(fields[GW_ACTION_FIELD_ADDRESS_TYPE]);
+                                    actionFrame.message.address.target_address = address;
+                                    actionFrame.message.action_parameters.fade_unit = CommandParser_ValueInt(fields[GW_ACTION_FIELD_FADE_UNIT]);
+                                    actionFrame.message.action_parameters.fade_time = CommandParser_ValueInt(fields[GW_ACTION_FIELD_FADE_TIME]);
                                     actionFrame.message.action_parameters.light_level = (int)((structNodeReceived->dValue) * (2047.00) / (100.00));
                                     actionFrame.message.action_parameters.reserved = 0;
 
@@ -300,8 +357,6 @@ bool GW_Process_Action_Command(NodeStruct_t *structNodeReceived)
             ESP_LOGE(TAG, "Action command address not found");
             result = false;
         }
-
-        cJSON_Delete(json);
     }
 
     return result;
@@ -345,6 +400,14 @@ bool GW_Process_AT_Command(NodeStruct_t *structNodeReceived)
 bool Send_Response_To_AWS(CNGW_AWS_Response_t *data, uint8_t size)
 {
     uint8_t required_size = size + sizeof(cn_board_info.cn_mcu.serial) + sizeof(CNGW_AWS_Command);
+#ifdef IPNODE
+    // the node sends CBOR frames: the bytes go as they are, without the hex text
+    if (NodeUtilities_PrepareBytesAndSendToRoot(64, 0, (const uint8_t *)data, required_size))
+    {
+        LED_change_task_momentarily(CNGW_LED_CMD_BUSY, CNGW_LED_COMM, LED_CHANGE_RAPID_DURATION);
+        return true;
+    }
+#endif
     unsigned char byteArray[sizeof(CNGW_AWS_Response_t)] = {0};
     memcpy(byteArray, data, required_size);
     char hexString[required_size * 2 + 1];
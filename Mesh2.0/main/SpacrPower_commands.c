@@ -164,10 +164,8 @@ void _currentSubmissionTask()
             cJSON_AddNumberToObject(currentData, "current", (truncf(dcurrentVal * 10.0) / 10.0));
             cJSON_AddItemToObject(currentData, "devID", cJSON_CreateString(deviceMACStr));
             cJSON_AddNumberToObject(currentData, "devType", devType);
-            char *dataToSend = cJSON_PrintUnformatted(currentData);
-            NodeUtilities_PrepareJsonAndSendToRoot(58, 0, dataToSend);
+            NodeUtilities_SendJsonToRoot(58, 0, currentData);
             cJSON_Delete(currentData);
-            free(dataToSend);
         }
         vTaskDelay(1000 / portTICK_RATE_MS);
     }
@@ -391,10 +389,8 @@ bool SP_GetVoltage(NodeStruct_t *structNodeReceived)
     cJSON *nodeData = cJSON_CreateObject();
     cJSON_AddItemToObject(nodeData, "devID", cJSON_CreateString(deviceMACStr));
     cJSON_AddNumberToObject(nodeData, "voltage", ((V_out*100)/100));
-    char *dataToSend = cJSON_PrintUnformatted(nodeData);
-    NodeUtilities_PrepareJsonAndSendToRoot(60, 0, dataToSend);
+    NodeUtilities_SendJsonToRoot(60, 0, nodeData);
     cJSON_Delete(nodeData);
-    free(dataToSend);
     return true;
 }
 
@@ -0,0 +1,278 @@
+#ifdef ROOT
+#include "includes/ack_tracker.h"
+#include "includes/root_utilities.h"
+#include "esp_log.h"
+#include <string.h>
+
+/**
+ * Correlation ids of the commands to the nodes, so the nodes answer with a compact ack instead of the whole command.
+ *
+ * Before a command is written to the mesh it is given an id, written in place at the start of the command:
+ *      {"id":<id>,"cmnd":...}
+ * A node answers a command with an id with {"cmnd":64 or 65,"val":<id>,"str":"<detail>"}, whatever the size of the
+ * command. The root publishes the ack to controldata/success or fail as
+ *      {"id":<id>,"cmnd":<cmnd>,"mac":"<mac>","str":"<detail>"}
+ * ("str" only if there is a detail), or as the original command, like the nodes did before, when the backend turned
+ * the expansion on (SetAckExpansion). The expansion is kept in NVS.
+ *
+ * Each node of a write has an id of its own. A command written to several nodes carries the id of the first one, the
+ * ack of each node is found by that id and the mac of the node, and published with the id of that node.
+ *
+ * The ids are kept in a ring of ACK_TRACKER_SIZE: an ack which comes after ACK_TRACKER_SIZE newer ids is
+ * published with its id only.
+ */
+
+static const char *TAG = "AckTracker";
+
+typedef struct
+{
+    uint16_t id;                // 0 if not used
+    uint16_t writeId;           // id written in the command: the id of the first node of the write
+    int16_t command;            // cmnd of the command, -1 if it has none
+    uint8_t mac[MWIFI_ADDR_LEN];
+    char *text;                 // copy of the command, only kept when the acks are expanded. in the first entry of a write
+} AckTracker_Entry_t;
+
+static AckTracker_Entry_t entries[ACK_TRACKER_SIZE];
+static SemaphoreHandle_t trackerMutex = NULL;
+static uint16_t lastId = 0;
+static bool expand = false;
+static AckTracker_Metrics_t metrics = {0};
+
+esp_err_t AckTracker_Init()
+{
+    if (trackerMutex != NULL)
+    {
+        return ESP_OK;
+    }
+
+    trackerMutex = xSemaphoreCreateMutex();
+    if (trackerMutex == NULL)
+    {
+        ESP_LOGE(TAG, "Could not create the mutex");
+        return ESP_ERR_NO_MEM;
+    }
+
+    nvs_handle nvsHandle;
+    if (nvs_open(nvsStorage, NVS_READWRITE, &nvsHandle) == ESP_OK)
+    {
+        uint8_t value = 0;
+        if (nvs_get_u8(nvsHandle, "ackExpand", &value) == ESP_OK)
+        {
+            expand = (value != 0);
+        }
+        nvs_close(nvsHandle);
+    }
+    ESP_LOGI(TAG, "Acks published %s", expand ? "as the commands" : "compact");
+    return ESP_OK;
+}
+
+/**
+ * @brief  give a new id to each node a command is written to
+ * @param cptrCommand[in] the command, before it is tagged
+ * @param ubyptrNodeMacs[in] the nodes, MWIFI_ADDR_LEN bytes each
+ * @param count[in] number of nodes
+ * @return the id to write in the command, the one of the first node. 0 if the tracker is not initialised
+ */
+uint16_t AckTracker_Track(const char *cptrCommand, const uint8_t *ubyptrNodeMacs, uint8_t count)
+{
+    if (trackerMutex == NULL || count == 0)
+    {
+        return 0;
+    }
+    int16_t command = CommandParser_PeekCommand(cptrCommand);
+    xSemaphoreTake(trackerMutex, portMAX_DELAY);
+    uint16_t writeId = 0;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        lastId = (lastId == UINT16_MAX) ? 1 : lastId + 1;
+        AckTracker_Entry_t *entry = &entries[lastId % ACK_TRACKER_SIZE];
+        if (writeId == 0)
+        {
+            writeId = lastId;
+        }
+        free(entry->text);
+        entry->text = NULL;
+        entry->id = lastId;
+        entry->writeId = writeId;
+        entry->command = command;
+        memcpy(entry->mac, ubyptrNodeMacs + i * MWIFI_ADDR_LEN, MWIFI_ADDR_LEN);
+        metrics.tracked++;
+    }
+    AckTracker_Entry_t *first = &entries[writeId % ACK_TRACKER_SIZE];
+    if (expand && (first->text = malloc(strlen(cptrCommand) + 1)) != NULL)
+    {
+        strcpy(first->text, cptrCommand);
+    }
+    xSemaphoreGive(trackerMutex);
+    return writeId;
+}
+
+// the entry of a node for the id written in its command. the first one of the write if there is no node or it is not
+// one of the write. NULL if forgotten
+static AckTracker_Entry_t *AckTracker_Find(uint16_t writeId, const uint8_t *ubyptrNodeMac)
+{
+    AckTracker_Entry_t *first = &entries[writeId % ACK_TRACKER_SIZE];
+    if (first->id != writeId)
+    {
+        return NULL;
+    }
+    if (ubyptrNodeMac == NULL || memcmp(first->mac, ubyptrNodeMac, MWIFI_ADDR_LEN) == 0)
+    {
+        return first;
+    }
+    for (uint16_t i = 0; i < ACK_TRACKER_SIZE; i++)
+    {
+        AckTracker_Entry_t *entry = &entries[i];
+        if (entry->id != 0 && entry->writeId == writeId && memcmp(entry->mac, ubyptrNodeMac, MWIFI_ADDR_LEN) == 0)
+        {
+            return entry;
+        }
+    }
+    return first;
+}
+
+/**
+ * @brief  write the id at the start of a command, in place: {"id":<id>, takes the end of the mac of the node in the
+ *         topic, its last ',' replaces the '{' of the command
+ * @param cptrPayload[in] the topic from AWS
+ * @param cptrCommand[in, out] the command inside cptrPayload, moved to the start of the tagged command
+ * @return false if the command is not tagged: no id, empty command or not enough room before it
+ */
+bool AckTracker_Tag(char *cptrPayload, char **cptrCommand, uint16_t id)
+{
+    char *command = *cptrCommand;
+    const char *member = command + 1;
+    while (*member == ' ' || *member == '\t' || *member == '\r' || *member == '\n')
+    {
+        member++;
+    }
+    if (id == 0 || command[0] != '{' || *member == '}')
+    {
+        return false;
+    }
+    char prefix[16];
+    int length = snprintf(prefix, sizeof(prefix), "{\"id\":%u,", id);
+    if (command - cptrPayload < length - 1)
+    {
+        return false;
+    }
+    command -= length - 1;
+    memcpy(command, prefix, length);
+    *cptrCommand = command;
+    return true;
+}
+
+// detail of a node, without the characters which would have to be escaped in JSON
+static void AckTracker_CopyDetail(char *detail, const char *cptrDetail)
+{
+    size_t length = 0;
+    for (; cptrDetail != NULL && *cptrDetail != '\0' && length < ACK_TRACKER_DETAIL_SIZE - 1; cptrDetail++)
+    {
+        if ((uint8_t)*cptrDetail >= 0x20 && *cptrDetail != '"' && *cptrDetail != '\\')
+        {
+            detail[length++] = *cptrDetail;
+        }
+    }
+    detail[length] = '\0';
+}
+
+/**
+ * @brief  publish the ack of a node to the success or fail topic, compact or as the original command
+ * @param id[in] the id of the command, "val" of the ack
+ * @param cptrDetail[in] "str" of the ack, may be NULL
+ * @param ubyptrNodeMac[in] the node which answered, or to which the command could not be written. may be NULL
+ */
+void AckTracker_Publish(uint16_t id, bool success, const char *cptrDetail, const uint8_t *ubyptrNodeMac)
+{
+    AWSTopicId_t topic = success ? AWS_TOPIC_CONTROL_SUCCESS : AWS_TOPIC_CONTROL_FAIL;
+    char detail[ACK_TRACKER_DETAIL_SIZE];
+    char compact[ACK_TRACKER_COMPACT_SIZE];
+    AckTracker_CopyDetail(detail, cptrDetail);
+    int length;
+
+    if (trackerMutex != NULL)
+    {
+        xSemaphoreTake(trackerMutex, portMAX_DELAY);
+    }
+    AckTracker_Entry_t *entry = (id != 0 && trackerMutex != NULL) ? AckTracker_Find(id, ubyptrNodeMac) : NULL;
+    if (entry != NULL)
+    {
+        metrics.acked++;
+        AckTracker_Entry_t *first = &entries[entry->writeId % ACK_TRACKER_SIZE];
+        char *text = (expand && first->id == entry->writeId && first->text != NULL) ? strdup(first->text) : NULL;
+        if (text != NULL)
+        {
+            //published from a copy, the entry can be reused as soon as the mutex is released
+            metrics.expanded++;
+            xSemaphoreGive(trackerMutex);
+            RootUtilities_SendDataToAWS(topic, text);
+            free(text);
+            return;
+        }
+        length = snprintf(compact, sizeof(compact), "{\"id\":%u", entry->id);
+        if (entry->command >= 0)
+        {
+            length += snprintf(compact + length, sizeof(compact) - length, ",\"cmnd\":%d", entry->command);
+        }
+        ubyptrNodeMac = entry->mac;
+    }
+    else
+    {
+        length = snprintf(compact, sizeof(compact), "{\"id\":%u", id);
+        metrics.unknown++;
+    }
+    if (ubyptrNodeMac != NULL)
+    {
+        length += snprintf(compact + length, sizeof(compact) - length, ",\"mac\":\"" MACSTR "\"", MAC2STR(ubyptrNodeMac));
+    }
+    if (trackerMutex != NULL)
+    {
+        xSemaphoreGive(trackerMutex);
+    }
+
+    if (detail[0] != '\0')
+    {
+        length += snprintf(compact + length, sizeof(compact) - length, ",\"str\":\"%s\"", detail);
+    }
+    snprintf(compact + length, sizeof(compact) - length, "}");
+    RootUtilities_SendDataToAWS(topic, compact);
+}
+
+/**
+ * @brief  publish the acks as the original commands (true) or compact (false), kept over restarts
+ */
+esp_err_t AckTracker_SetExpansion(bool expandAcks)
+{
+    nvs_handle nvsHandle;
+    esp_err_t err = nvs_open(nvsStorage, NVS_READWRITE, &nvsHandle);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    err = nvs_set_u8(nvsHandle, "ackExpand", expandAcks ? 1 : 0);
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(nvsHandle);
+    }
+    nvs_close(nvsHandle);
+    if (err == ESP_OK)
+    {
+        //the commands tracked before keep their copy, or have none
+        expand = expandAcks;
+    }
+    return err;
+}
+
+void AckTracker_GetMetrics(AckTracker_Metrics_t *metricsCopy)
+{
+    *metricsCopy = metrics;
+}
+
+void AckTracker_PrintMetrics()
+{
+    ESP_LOGI(TAG, "tracked %u, acked %u (expanded %u), unknown ids %u",
+             metrics.tracked, metrics.acked, metrics.expanded, metrics.unknown);
+}
+
+#endif
@@ -4,10 +4,12 @@
 #include "freertos/queue.h"
 #include "esp_log.h"
 #include "includes/aws.h"
+#include "aws_iot_mqtt_client_common_internal.h"
 #include "includes/root_utilities.h"
 #include "string.h"
 #include "cJSON.h"
 static const char *TAG = "SpacrAWS";
+static char journalTopic[UPLINK_JOURNAL_MAX_TOPIC + 1];
 uint32_t uiSubscribeCounter = 0;
 //If auto re-enable for some reason doesn't get enabled we log the message
 void disconnectCallbackHandler(AWS_IoT_Client *pClient, void *data)
@@ -57,7 +59,10 @@ void iot_subscribe_callback_handler_node(AWS_IoT_Client *pClient, char *topicNam
     memset(payload, 0, topicNameLen);
     strcpy(payload, topicName);
 
-    if (xQueueSendToBack(nodeCommandQueue, &payload, (TickType_t)0) != pdPASS)
+    //the command starts after the mac of the node
+    const char *cptrCommand = strchr(payload, '{');
+    CommandLane_t lane = CommandLanes_OfCommand(cptrCommand != NULL ? CommandParser_PeekCommand(cptrCommand) : -1);
+    if (!CommandLanes_Send(nodeCommandQueue, lane, payload))
     {
         ESP_LOGE(TAG, "Queue is full");
         vPortFree(payload);
@@ -76,15 +81,23 @@ void iot_subscribe_callback_handler_root(AWS_IoT_Client *pClient, char *topicNam
 {
     // ESP_LOGI(TAG, "Root callback");
     ESP_LOGI(TAG, "%.*s\t%.*s", topicNameLen, topicName, (int)params->payloadLen, (char *)params->payload);
-    char *payload = (char *)pvPortMalloc((strlen((char *)params->payload) + 1) * sizeof(char));
-    memset(payload, 0, (int)params->payloadLen);
-    strcpy(payload, (char *)params->payload);
-    if (xQueueSendToBack(rootCommandQueue, &payload, (TickType_t)0) != pdPASS)
+    //queued like the messages from the nodes, in a buffer of rootAWSCommandPool
+    size_t length = strnlen((char *)params->payload, params->payloadLen);
+    MsgBuffer *buffer = MsgBuffer_AcquireCopy(&rootAWSCommandPool, params->payload, length, 0);
+    bool queued = false;
+    if (buffer == NULL)
+    {
+        ESP_LOGE(TAG, "No buffer for the root command");
+    }
+    else if (!(queued = CommandLanes_Send(rootCommandQueue, CommandLanes_OfCommand(CommandParser_PeekCommand((char *)buffer->data)), buffer)))
     {
         ESP_LOGE(TAG, "Queue is full");
-        vPortFree(payload);
-        //Report back to AWS here letting us know that the queue is full and to wait for the next command
-        //The queue most likely will neveer fill up but you never know
+        MsgBuffer_Release(buffer);
+    }
+    if (!queued)
+    {
+        //the command is answered as failed, so the backend can send it again
+        RootUtilities_SendBinaryToAWS(AWS_TOPIC_CONTROL_FAIL, params->payload, length);
     }
     memset((char *)params->payload, 0, (int)params->payloadLen);
     ESP_LOGI(TAG, "Stack remaining for task '%s' is %d bytes", pcTaskGetTaskName(NULL), uxTaskGetStackHighWaterMark(NULL));
@@ -102,53 +115,246 @@ void aws_subscribe_topic(const char *topic, pApplicationHandler_t handler)
     }
 }
 
-void aws_publish_topic(char *topic, IoT_Publish_Message_Params *paramsQOS1)
+//QoS1 publishes waiting for their PUBACK. the slot is kept until it is acknowledged, to be sent again if needed
+typedef struct
 {
-    ESP_LOGI(TAG, "Publishing...");
-    IoT_Error_t rc = FAILURE;
-    rc = aws_iot_mqtt_publish(&client, topic, strlen(topic), paramsQOS1);
-    if (rc == MQTT_REQUEST_TIMEOUT_ERROR)
+    MsgBuffer *slot;
+    uint16_t packetId;
+    uint8_t attempts;
+    TickType_t sentAt;
+    bool fromJournal;                           // consumed from the uplink journal on its PUBACK
+    UplinkJournal_Position_t journalPosition;
+} AWSInFlight_t;
+
+static AWSInFlight_t inFlight[AWS_PUBLISH_WINDOW];
+static uint8_t inFlightCount = 0;
+static bool journalInFlight = false;            // the oldest message of the journal is being published, it is not peeked again
+
+//QoS of each topic. high rate telemetry is published with QoS0, a lost message is replaced by the next one
+static const QoS topicQoS[AWS_TOPIC_COUNT] = {
+    [AWS_TOPIC_SENSOR_DATA] = QOS0,
+    [AWS_TOPIC_CONTROL_DATA] = QOS1,
+    [AWS_TOPIC_LOGS] = QOS1,
+    [AWS_TOPIC_CONTROL_SUCCESS] = QOS1,
+    [AWS_TOPIC_CONTROL_FAIL] = QOS1};
+
+//id of a topic read back from the uplink journal
+static bool aws_topic_id(const char *topic, AWSTopicId_t *id)
+{
+    for (uint8_t i = 0; i < AWS_TOPIC_COUNT; i++)
+    {
+        if (strcmp(topic, AWSTopics[i]) == 0)
+        {
+            *id = (AWSTopicId_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief  write a PUBLISH packet to the connection without waiting for its PUBACK. aws_iot_mqtt_publish blocks until the
+ *         PUBACK, so the packet is serialized here with the helpers of the SDK (aws_iot_mqtt_client_common_internal.h),
+ *         into its write buffer, under its write mutex like its own publishes
+ */
+static IoT_Error_t aws_send_publish(MsgBuffer *slot, QoS qos, uint8_t dup, uint16_t packetId)
+{
+    if (!aws_iot_mqtt_is_client_connected(&client))
+    {
+        return NETWORK_DISCONNECTED_ERROR;
+    }
+
+    const char *topic = AWSTopics[slot->tag];
+    size_t topicLen = strlen(topic);
+    size_t payloadLen = slot->payloadLength;
+    size_t remainingLen = 2 + topicLen + payloadLen + (qos == QOS1 ? 2 : 0);
+    if (aws_iot_mqtt_internal_get_final_packet_length_from_remaining_length(remainingLen) > client.clientData.writeBufSize)
+    {
+        return MQTT_TX_BUFFER_TOO_SHORT_ERROR;
+    }
+
+    MQTTHeader header = {0};
+    IoT_Error_t rc = aws_iot_mqtt_internal_init_header(&header, PUBLISH, qos, dup, 0);
+    if (rc != SUCCESS)
     {
-        ESP_LOGW(TAG, "QOS1 publish ack not received.");
-        rc = SUCCESS;
-        //maybe we convert this into a while loop or we return the RC to let the function know that it was not successful
+        return rc;
+    }
+#ifdef _ENABLE_THREAD_SUPPORT_
+    rc = aws_iot_mqtt_client_lock_mutex(&client, &client.clientData.tlsWriteMutex);
+    if (rc != SUCCESS)
+    {
+        return rc;
+    }
+#endif
+    unsigned char *ptr = client.clientData.writeBuf;
+    aws_iot_mqtt_internal_write_char(&ptr, header.byte);
+    ptr += aws_iot_mqtt_internal_write_len_to_buffer(ptr, (uint32_t)remainingLen);
+    aws_iot_mqtt_internal_write_utf8_string(&ptr, topic, (uint16_t)topicLen);
+    if (qos == QOS1)
+    {
+        aws_iot_mqtt_internal_write_uint_16(&ptr, packetId);
+    }
+    memcpy(ptr, slot->data, payloadLen);
+    ptr += payloadLen;
+
+    Timer timer;
+    init_timer(&timer);
+    countdown_ms(&timer, client.clientData.commandTimeoutMs);
+    rc = aws_iot_mqtt_internal_send_packet(&client, (size_t)(ptr - client.clientData.writeBuf), &timer);
+#ifdef _ENABLE_THREAD_SUPPORT_
+    aws_iot_mqtt_client_unlock_mutex(&client, &client.clientData.tlsWriteMutex);
+#endif
+    return rc;
+}
+
+/**
+ * @brief  start publishing a message. QoS1 messages are added to the window of in flight messages, QoS0 ones are done
+ *         once written. takes the ownership of the slot. a message which can not be sent is kept in the uplink journal
+ * @param journalPosition[in] where the message is in the journal if it was read from it, else NULL. it is consumed
+ *        from the journal once delivered, and stays there otherwise
+ * @return the result of writing the packet
+ */
+static IoT_Error_t aws_publish_start(MsgBuffer *slot, const UplinkJournal_Position_t *journalPosition)
+{
+    ESP_LOGD(TAG, "Publishing %s: %s", AWSTopics[slot->tag], (char *)slot->data);
+    QoS qos = topicQoS[slot->tag];
+    uint16_t packetId = (qos == QOS1) ? aws_iot_mqtt_get_next_packet_id(&client) : 0;
+    IoT_Error_t rc = aws_send_publish(slot, qos, 0, packetId);
+    if (rc != SUCCESS)
+    {
+        ESP_LOGW(TAG, "Publish failed: %d", rc);
+        //keep it for when the connection is back
+        if (journalPosition == NULL)
+        {
+            UplinkJournal_Append(AWSTopics[slot->tag], slot->data, slot->payloadLength);
+        }
+        MsgBuffer_Release(slot);
+    }
+    else if (qos == QOS1)
+    {
+        AWSInFlight_t *entry = &inFlight[inFlightCount++];
+        entry->slot = slot;
+        entry->packetId = packetId;
+        entry->attempts = 1;
+        entry->sentAt = xTaskGetTickCount();
+        entry->fromJournal = (journalPosition != NULL);
+        if (entry->fromJournal)
+        {
+            entry->journalPosition = *journalPosition;
+            journalInFlight = true;
+        }
     }
     else
     {
-        // ESP_LOGW(TAG, "QOS1 publish ack received.");
+        if (journalPosition != NULL)
+        {
+            UplinkJournal_ConsumeAt(journalPosition);
+        }
+        MsgBuffer_Release(slot);
     }
-    ESP_LOGI(TAG, "Stack remaining for task '%s' is %d bytes", pcTaskGetTaskName(NULL), uxTaskGetStackHighWaterMark(NULL));
+    return rc;
 }
 
+static void aws_publish_complete(uint16_t packetId)
+{
+    for (uint8_t i = 0; i < inFlightCount; i++)
+    {
+        if (inFlight[i].packetId == packetId)
+        {
+            if (inFlight[i].fromJournal)
+            {
+                UplinkJournal_ConsumeAt(&inFlight[i].journalPosition);
+                journalInFlight = false;
+            }
+            MsgBuffer_Release(inFlight[i].slot);
+            inFlight[i] = inFlight[--inFlightCount];
+            return;
+        }
+    }
+    //an ack of a message which was given up, or sent twice
+}
+
+/**
+ * @brief  send again, with the DUP flag, the messages without PUBACK for AWS_PUBACK_TIMEOUT.
+ *         after AWS_PUBLISH_ATTEMPTS, the message goes to the uplink journal, or stays there if it was read from it
+ */
+static void aws_publish_check_timeouts()
+{
+    TickType_t now = xTaskGetTickCount();
+    uint8_t i = 0;
+    while (i < inFlightCount)
+    {
+        AWSInFlight_t *entry = &inFlight[i];
+        if ((now - entry->sentAt) < (AWS_PUBACK_TIMEOUT / portTICK_RATE_MS))
+        {
+            i++;
+            continue;
+        }
+        if (entry->attempts < AWS_PUBLISH_ATTEMPTS &&
+            aws_send_publish(entry->slot, QOS1, 1, entry->packetId) == SUCCESS)
+        {
+            ESP_LOGW(TAG, "QOS1 publish ack not received, sending %d again", entry->packetId);
+            entry->attempts++;
+            entry->sentAt = now;
+            i++;
+            continue;
+        }
+        ESP_LOGW(TAG, "QOS1 publish %d not acknowledged, keeping it in the journal", entry->packetId);
+        if (entry->fromJournal)
+        {
+            journalInFlight = false;
+        }
+        else
+        {
+            UplinkJournal_Append(AWSTopics[entry->slot->tag], entry->slot->data, entry->slot->payloadLength);
+        }
+        MsgBuffer_Release(entry->slot);
+        inFlight[i] = inFlight[--inFlightCount];
+    }
+}
+
+/**
+ * @brief  read from the connection for up to timeout ms, completing the in flight messages on their PUBACK.
+ *         aws_iot_mqtt_yield drops the PUBACKs it reads, so it is only called when the window is empty: once the keep
+ *         alive is due no message is started until the window is empty. incoming messages are passed to the
+ *         subscribe handlers as the yield does
+ */
+static IoT_Error_t aws_read_acks(uint32_t timeout)
+{
+    Timer timer;
+    init_timer(&timer);
+    countdown_ms(&timer, timeout);
+    while (!has_timer_expired(&timer))
+    {
+        uint8_t packetType = 0;
+        IoT_Error_t rc = aws_iot_mqtt_internal_cycle_read(&client, &timer, &packetType);
+        if (rc != SUCCESS)
+        {
+            return rc;
+        }
+        if (packetType == PUBACK)
+        {
+            unsigned char type = 0;
+            unsigned char dup = 0;
+            uint16_t packetId = 0;
+            if (aws_iot_mqtt_internal_deserialize_ack(&type, &dup, &packetId, client.clientData.readBuf, client.clientData.readBufSize) == SUCCESS)
+            {
+                aws_publish_complete(packetId);
+            }
+        }
+    }
+    return SUCCESS;
+}
+
+//builds the topics of AWSTopics once, at start up and when the organization changes
 void AWS_CreateTopics()
 {
-    //SensorData topic
-    char sensData[13] = "/sensordata/";
-    sensorLogTopic = (char *)realloc(sensorLogTopic, (strlen(sensData) + strlen(orgID) + 1) * sizeof(char));
-    strcpy(sensorLogTopic, orgID);
-    strcat(sensorLogTopic, sensData);
-
-    //ControlData topic
-    char controlData[14] = "/controldata/";
-    controlLogTopic = (char *)realloc(controlLogTopic, (strlen(controlData) + strlen(orgID) + 1) * sizeof(char));
-    strcpy(controlLogTopic, orgID);
-    strcat(controlLogTopic, sensData);
-
-    //log topic
-    char logs[7] = "/logs/";
-    logTopic = (char *)realloc(logTopic, (strlen(logs) + strlen(deviceMACStr) + 1) * sizeof(char));
-    strcpy(logTopic, deviceMACStr);
-    strcat(logTopic, logs);
-
-    char controlDataS[21] = "/controldata/success";
-    controlLogTopicSuccess = (char *)realloc(controlLogTopicSuccess, (strlen(controlDataS) + strlen(orgID) + 1) * sizeof(char));
-    strcpy(controlLogTopicSuccess, orgID);
-    strcat(controlLogTopicSuccess, controlDataS);
-
-    char controlDataF[18] = "/controldata/fail";
-    controlLogTopicFail = (char *)realloc(controlLogTopicFail, (strlen(controlDataF) + strlen(orgID) + 1) * sizeof(char));
-    strcpy(controlLogTopicFail, orgID);
-    strcat(controlLogTopicFail, controlDataF);
+    snprintf(AWSTopics[AWS_TOPIC_SENSOR_DATA], AWS_TOPIC_MAX_LENGTH, "%s/sensordata/", orgID);
+    //control data has always been published on the sensor data topic
+    snprintf(AWSTopics[AWS_TOPIC_CONTROL_DATA], AWS_TOPIC_MAX_LENGTH, "%s/sensordata/", orgID);
+    snprintf(AWSTopics[AWS_TOPIC_LOGS], AWS_TOPIC_MAX_LENGTH, "%s/logs/", deviceMACStr);
+    snprintf(AWSTopics[AWS_TOPIC_CONTROL_SUCCESS], AWS_TOPIC_MAX_LENGTH, "%s/controldata/success", orgID);
+    snprintf(AWSTopics[AWS_TOPIC_CONTROL_FAIL], AWS_TOPIC_MAX_LENGTH, "%s/controldata/fail", orgID);
 }
 
 void AWS_AWSTask()
@@ -201,18 +407,33 @@ void AWS_AWSTask()
     aws_subscribe_topic(deviceTopic, iot_subscribe_callback_handler_node);
     aws_subscribe_topic(deviceMACStr, iot_subscribe_callback_handler_root);
 
-    IoT_Publish_Message_Params paramsQOS1;
-    paramsQOS1.qos = QOS1;
-    paramsQOS1.isRetained = 0;
-    AWSPub_t *stuctAWSPub;
+    MsgBuffer *slot;
+    TickType_t lastDrain = 0;
+    TickType_t lastYield = 0;
+    uint32_t published = 0;
+    bool readFailed = false;
     while ((NETWORK_ATTEMPTING_RECONNECT == rc || NETWORK_RECONNECTED == rc || SUCCESS == rc || NETWORK_RECONNECT_TIMED_OUT_ERROR == rc || NETWORK_DISCONNECTED_ERROR == rc))
     {
-        //Max time the yield function will wait for read messages
-        rc = aws_iot_mqtt_yield(&client, 100);
+        //Max time the yield function will wait for read messages. while messages are in flight, only the acks are read:
+        //the yield would drop their PUBACKs and they would be sent again
+        bool yieldDue = (xTaskGetTickCount() - lastYield) >= ((connectParams.keepAliveIntervalInSec * 1000 / 2) / portTICK_RATE_MS);
+        if (inFlightCount == 0 || readFailed || !aws_iot_mqtt_is_client_connected(&client))
+        {
+            rc = aws_iot_mqtt_yield(&client, AWS_YIELD_TIMEOUT);
+            lastYield = xTaskGetTickCount();
+            readFailed = false;
+        }
+        else if (aws_read_acks(AWS_YIELD_TIMEOUT) != SUCCESS)
+        {
+            //let the yield find out what happened to the connection
+            readFailed = true;
+            continue;
+        }
         if (NETWORK_ATTEMPTING_RECONNECT == rc)
         {
             //rc = aws_iot_mqtt_yield(&client, 1000);
             // If the client is attempting to reconnect we will skip the rest of the loop.
+            vTaskDelay(AWS_IDLE_WAIT / portTICK_RATE_MS);
             continue;
         }
         if (NETWORK_RECONNECT_TIMED_OUT_ERROR == rc || NETWORK_DISCONNECTED_ERROR == rc)
@@ -224,22 +445,97 @@ void AWS_AWSTask()
             ESP_LOGW(TAG, "Manually reconnecting");
             rc = aws_iot_mqtt_attempt_reconnect(&client);
         }
-        if (AWSPublishQueue != NULL)
+        if (AWSPublishQueue == NULL || (SUCCESS != rc && NETWORK_RECONNECTED != rc))
+        {
+            //not connected, the messages wait in the queue (and in the journal once the queue is full)
+            vTaskDelay(AWS_IDLE_WAIT / portTICK_RATE_MS);
+            continue;
+        }
+
+        aws_publish_check_timeouts();
+        if (yieldDue && inFlightCount > 0)
+        {
+            //the keep alive waits for the window to empty, no message is started meanwhile
+            continue;
+        }
+
+        //publish what is queued until the queue is empty, the window is full or the budget is spent, then read again
+        uint32_t budgetBytes = 0;
+        TickType_t budgetStart = xTaskGetTickCount();
+        while (inFlightCount < AWS_PUBLISH_WINDOW && budgetBytes < AWS_PUBLISH_BUDGET_BYTES &&
+               (xTaskGetTickCount() - budgetStart) < (AWS_PUBLISH_BUDGET_TIME / portTICK_RATE_MS) &&
+               (slot = CommandLanes_Receive(AWSPublishQueue, (TickType_t)0, NULL)) != NULL)
         {
-            if (xQueueReceive(AWSPublishQueue, &stuctAWSPub, (TickType_t)0))
+            budgetBytes += slot->payloadLength;
+            IoT_Error_t publishRc = aws_publish_start(slot, NULL);
+            if ((++published % AWS_PUBLISH_METRICS_EVERY) == 0)
             {
-                paramsQOS1.payload = (void *)stuctAWSPub->cptrPayload;
-                paramsQOS1.payloadLen = strlen(stuctAWSPub->cptrPayload);
-                ESP_LOGW(TAG, "Topic Received: %s", stuctAWSPub->cptrTopic);
-                ESP_LOGW(TAG, "Payload Received: %s", stuctAWSPub->cptrPayload);
-                aws_publish_topic(stuctAWSPub->cptrTopic, &paramsQOS1);
-                //memset(stuctAWSPub->cptrPayload, 0, strlen(stuctAWSPub->cptrPayload));
-                vPortFree(stuctAWSPub->cptrPayload);
-                vPortFree(stuctAWSPub->cptrTopic);
-                vPortFree(stuctAWSPub);
+                ESP_LOGI(TAG, "Published: %d, in flight: %d, queue high water: %d/%d, queue full: %d, dropped: %d", published, inFlightCount, AWSPublishQueueHighWater, AWS_PUBLISH_QUEUE_LENGTH, AWSPublishQueueFull, AWSPublishDropped);
+                UplinkJournal_PrintMetrics();
+                StatusAggregator_PrintMetrics();
+                AckTracker_PrintMetrics();
+                CommandLanes_PrintLatency(AWSPublishQueue);
             }
+            if (publishRc != SUCCESS)
+            {
+                //the connection is probably lost, let the yield find out before trying the next one
+                break;
+            }
+        }
+
+        if (CommandLanes_Waiting(AWSPublishQueue) > 0)
+        {
+            vTaskDelay(1); //window full or budget spent, leave this for watchdog
+            continue;
+        }
+
+        TickType_t idleWait = AWS_IDLE_WAIT / portTICK_RATE_MS;
+        if (UplinkJournal_Pending() > 0 && inFlightCount < AWS_PUBLISH_WINDOW && !journalInFlight)
+        {
+            TickType_t sinceDrain = xTaskGetTickCount() - lastDrain;
+            if (sinceDrain >= (UPLINK_JOURNAL_DRAIN_INTERVAL / portTICK_RATE_MS))
+            {
+                //the queue is empty, send the oldest message kept while the connection was down.
+                //it stays in the journal until it is acknowledged
+                lastDrain = xTaskGetTickCount();
+                //its own buffer, a message of the journal may be longer than the slots of AWSPublishPool
+                slot = MsgBuffer_AcquireHeap(UPLINK_JOURNAL_MAX_PAYLOAD + 1);
+                size_t journalLength = 0;
+                UplinkJournal_Position_t journalPosition;
+                if (slot != NULL && UplinkJournal_Peek(journalTopic, sizeof(journalTopic), (char *)slot->data, UPLINK_JOURNAL_MAX_PAYLOAD + 1, &journalLength, &journalPosition) == ESP_OK)
+                {
+                    AWSTopicId_t topic;
+                    if (aws_topic_id(journalTopic, &topic))
+                    {
+                        slot->tag = topic;
+                        slot->payloadLength = journalLength;
+                        slot->length = journalLength + 1;
+                        aws_publish_start(slot, &journalPosition);
+                        slot = NULL;
+                    }
+                    else
+                    {
+                        //a topic of another organization, or a corrupted one. it would hold back the rest of the journal
+                        ESP_LOGW(TAG, "Dropping a journal message for unknown topic %s", journalTopic);
+                        UplinkJournal_Discard(&journalPosition);
+                    }
+                }
+                MsgBuffer_Release(slot);
+                sinceDrain = 0;
+            }
+            if ((UPLINK_JOURNAL_DRAIN_INTERVAL / portTICK_RATE_MS) - sinceDrain < idleWait)
+            {
+                idleWait = (UPLINK_JOURNAL_DRAIN_INTERVAL / portTICK_RATE_MS) - sinceDrain;
+            }
+        }
+
+        if (inFlightCount > 0)
+        {
+            //the next read waits for the acks
+            continue;
         }
-        vTaskDelay(10 / portTICK_RATE_MS); //leave this for watchdog
+        //sleep until a message is queued, this also leaves time for the watchdog
+        CommandLanes_Wait(AWSPublishQueue, idleWait > 0 ? idleWait : 1);
     }
 }
 #endif
\ No newline at end of file
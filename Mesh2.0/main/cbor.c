@@ -0,0 +1,538 @@
+#include "includes/cbor.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+//*********************WRITER********************************
+
+void Cbor_InitWriter(CborWriter_t *writer, uint8_t *buffer, size_t size)
+{
+    writer->buffer = buffer;
+    writer->size = size;
+    writer->length = 0;
+    writer->overflow = false;
+}
+
+/**
+ * @brief  number of bytes written, or 0 if the buffer was too small
+ */
+size_t Cbor_WriterLength(const CborWriter_t *writer)
+{
+    return writer->overflow ? 0 : writer->length;
+}
+
+void Cbor_PutRaw(CborWriter_t *writer, const void *data, size_t length)
+{
+    if (writer->overflow || writer->size - writer->length < length)
+    {
+        writer->overflow = true;
+        return;
+    }
+    if (writer->buffer != NULL)
+    {
+        memcpy(writer->buffer + writer->length, data, length);
+    }
+    writer->length += length;
+}
+
+// the initial byte of an item and its argument, in the shortest form
+static void Cbor_PutHead(CborWriter_t *writer, uint8_t type, uint64_t value)
+{
+    uint8_t head[9];
+    size_t length;
+    head[0] = type << 5;
+    if (value < 24)
+    {
+        head[0] |= (uint8_t)value;
+        length = 1;
+    }
+    else if (value <= 0xFF)
+    {
+        head[0] |= 24;
+        head[1] = (uint8_t)value;
+        length = 2;
+    }
+    else if (value <= 0xFFFF)
+    {
+        head[0] |= 25;
+        head[1] = (uint8_t)(value >> 8);
+        head[2] = (uint8_t)value;
+        length = 3;
+    }
+    else if (value <= 0xFFFFFFFF)
+    {
+        head[0] |= 26;
+        for (uint8_t i = 0; i < 4; i++)
+        {
+            head[1 + i] = (uint8_t)(value >> (24 - 8 * i));
+        }
+        length = 5;
+    }
+    else
+    {
+        head[0] |= 27;
+        for (uint8_t i = 0; i < 8; i++)
+        {
+            head[1 + i] = (uint8_t)(value >> (56 - 8 * i));
+        }
+        length = 9;
+    }
+    Cbor_PutRaw(writer, head, length);
+}
+
+void Cbor_PutUint(CborWriter_t *writer, uint64_t value)
+{
+    Cbor_PutHead(writer, CBOR_TYPE_UINT, value);
+}
+
+void Cbor_PutInt(CborWriter_t *writer, int64_t value)
+{
+    if (value >= 0)
+    {
+        Cbor_PutHead(writer, CBOR_TYPE_UINT, (uint64_t)value);
+    }
+    else
+    {
+        Cbor_PutHead(writer, CBOR_TYPE_NEGINT, (uint64_t)(-1 - value));
+    }
+}
+
+/**
+ * @brief  whole numbers are written as integers, the others as a float if no precision is lost, else as a double
+ */
+void Cbor_PutDouble(CborWriter_t *writer, double value)
+{
+    if (value == floor(value) && fabs(value) < 9007199254740992.0)
+    {
+        Cbor_PutInt(writer, (int64_t)value);
+        return;
+    }
+
+    uint8_t item[9];
+    float single = (float)value;
+    if ((double)single == value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &single, sizeof(bits));
+        item[0] = (CBOR_TYPE_SIMPLE << 5) | 26;
+        for (uint8_t i = 0; i < 4; i++)
+        {
+            item[1 + i] = (uint8_t)(bits >> (24 - 8 * i));
+        }
+        Cbor_PutRaw(writer, item, 5);
+    }
+    else
+    {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        item[0] = (CBOR_TYPE_SIMPLE << 5) | 27;
+        for (uint8_t i = 0; i < 8; i++)
+        {
+            item[1 + i] = (uint8_t)(bits >> (56 - 8 * i));
+        }
+        Cbor_PutRaw(writer, item, 9);
+    }
+}
+
+void Cbor_PutBool(CborWriter_t *writer, bool value)
+{
+    Cbor_PutHead(writer, CBOR_TYPE_SIMPLE, value ? 21 : 20);
+}
+
+void Cbor_PutNull(CborWriter_t *writer)
+{
+    Cbor_PutHead(writer, CBOR_TYPE_SIMPLE, 22);
+}
+
+void Cbor_PutBytes(CborWriter_t *writer, const void *data, size_t length)
+{
+    Cbor_PutHead(writer, CBOR_TYPE_BYTES, length);
+    Cbor_PutRaw(writer, data, length);
+}
+
+void Cbor_PutText(CborWriter_t *writer, const char *text, size_t length)
+{
+    Cbor_PutHead(writer, CBOR_TYPE_TEXT, length);
+    Cbor_PutRaw(writer, text, length);
+}
+
+void Cbor_PutString(CborWriter_t *writer, const char *text)
+{
+    Cbor_PutText(writer, text, strlen(text));
+}
+
+// followed by count items
+void Cbor_PutArray(CborWriter_t *writer, size_t count)
+{
+    Cbor_PutHead(writer, CBOR_TYPE_ARRAY, count);
+}
+
+// followed by pairs keys and values
+void Cbor_PutMap(CborWriter_t *writer, size_t pairs)
+{
+    Cbor_PutHead(writer, CBOR_TYPE_MAP, pairs);
+}
+
+static bool Cbor_PutJsonItem(CborWriter_t *writer, const cJSON *item, uint8_t depth)
+{
+    if (depth > CBOR_MAX_DEPTH)
+    {
+        return false;
+    }
+
+    if (cJSON_IsObject(item) || cJSON_IsArray(item))
+    {
+        size_t count = 0;
+        const cJSON *child = NULL;
+        cJSON_ArrayForEach(child, item)
+        {
+            count++;
+        }
+        if (cJSON_IsObject(item))
+        {
+            Cbor_PutMap(writer, count);
+        }
+        else
+        {
+            Cbor_PutArray(writer, count);
+        }
+        cJSON_ArrayForEach(child, item)
+        {
+            if (cJSON_IsObject(item))
+            {
+                Cbor_PutString(writer, child->string);
+            }
+            if (!Cbor_PutJsonItem(writer, child, depth + 1))
+            {
+                return false;
+            }
+        }
+    }
+    else if (cJSON_IsString(item))
+    {
+        Cbor_PutString(writer, item->valuestring);
+    }
+    else if (cJSON_IsNumber(item))
+    {
+        Cbor_PutDouble(writer, item->valuedouble);
+    }
+    else if (cJSON_IsBool(item))
+    {
+        Cbor_PutBool(writer, cJSON_IsTrue(item));
+    }
+    else
+    {
+        Cbor_PutNull(writer);
+    }
+    return !writer->overflow;
+}
+
+/**
+ * @brief  write a parsed JSON value as CBOR. object keys are kept as text
+ * @return false if it did not fit, or if it is nested deeper than CBOR_MAX_DEPTH
+ */
+bool Cbor_PutJson(CborWriter_t *writer, const cJSON *item)
+{
+    return Cbor_PutJsonItem(writer, item, 0);
+}
+
+//*********************READER********************************
+
+void Cbor_InitReader(CborReader_t *reader, const uint8_t *buffer, size_t size)
+{
+    reader->buffer = buffer;
+    reader->size = size;
+    reader->offset = 0;
+    reader->error = false;
+}
+
+/**
+ * @brief  read the initial byte of an item and its argument. for byte and text strings, the content follows and is
+ *         not consumed. for simple values and floats, value holds the raw bits
+ * @return false on malformed data or unsupported indefinite lengths
+ */
+bool Cbor_ReadHead(CborReader_t *reader, uint8_t *type, uint64_t *value)
+{
+    if (reader->error || reader->offset >= reader->size)
+    {
+        reader->error = true;
+        return false;
+    }
+
+    uint8_t initial = reader->buffer[reader->offset++];
+    uint8_t info = initial & 0x1F;
+    *type = initial >> 5;
+    if (info < 24)
+    {
+        *value = info;
+        return true;
+    }
+    if (info > 27)
+    {
+        reader->error = true;
+        return false;
+    }
+
+    size_t length = (size_t)1 << (info - 24);
+    if (reader->size - reader->offset < length)
+    {
+        reader->error = true;
+        return false;
+    }
+    *value = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        *value = (*value << 8) | reader->buffer[reader->offset++];
+    }
+    return true;
+}
+
+bool Cbor_ReadUint(CborReader_t *reader, uint64_t *value)
+{
+    uint8_t type;
+    if (!Cbor_ReadHead(reader, &type, value) || type != CBOR_TYPE_UINT)
+    {
+        reader->error = true;
+        return false;
+    }
+    return true;
+}
+
+static bool Cbor_SkipItem(CborReader_t *reader, uint8_t depth)
+{
+    uint8_t type;
+    uint64_t value;
+    if (depth > CBOR_MAX_DEPTH || !Cbor_ReadHead(reader, &type, &value))
+    {
+        reader->error = true;
+        return false;
+    }
+
+    switch (type)
+    {
+    case CBOR_TYPE_BYTES:
+    case CBOR_TYPE_TEXT:
+        if (reader->size - reader->offset < value)
+        {
+            reader->error = true;
+            return false;
+        }
+        reader->offset += value;
+        return true;
+    case CBOR_TYPE_MAP:
+        value *= 2;
+        // fall through
+    case CBOR_TYPE_ARRAY:
+        for (uint64_t i = 0; i < value; i++)
+        {
+            if (!Cbor_SkipItem(reader, depth + 1))
+            {
+                return false;
+            }
+        }
+        return true;
+    case CBOR_TYPE_TAG:
+        return Cbor_SkipItem(reader, depth + 1);
+    default:
+        return true;
+    }
+}
+
+/**
+ * @brief  step over one item, with all its content
+ */
+bool Cbor_Skip(CborReader_t *reader)
+{
+    return Cbor_SkipItem(reader, 0);
+}
+
+typedef struct
+{
+    char *json;
+    size_t size;
+    size_t length;
+    bool overflow;
+} CborJsonOut_t;
+
+static void Cbor_JsonAppend(CborJsonOut_t *out, const char *text, size_t length)
+{
+    if (out->overflow || out->size - out->length <= length)
+    {
+        out->overflow = true;
+        return;
+    }
+    memcpy(out->json + out->length, text, length);
+    out->length += length;
+    out->json[out->length] = '\0';
+}
+
+// printed as cJSON does: 15 digits, or 17 if that does not give back the same number
+static void Cbor_JsonNumber(CborJsonOut_t *out, double number)
+{
+    if (!isfinite(number))
+    {
+        Cbor_JsonAppend(out, "null", 4);
+        return;
+    }
+    char text[32];
+    int length = snprintf(text, sizeof(text), "%1.15g", number);
+    if (strtod(text, NULL) != number)
+    {
+        length = snprintf(text, sizeof(text), "%1.17g", number);
+    }
+    Cbor_JsonAppend(out, text, (length > 0 && length < (int)sizeof(text)) ? length : 0);
+}
+
+static void Cbor_JsonText(CborJsonOut_t *out, const uint8_t *text, size_t length)
+{
+    Cbor_JsonAppend(out, "\"", 1);
+    size_t start = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        if (text[i] == '"' || text[i] == '\\' || text[i] < 0x20)
+        {
+            char escape[7];
+            Cbor_JsonAppend(out, (const char *)text + start, i - start);
+            snprintf(escape, sizeof(escape), (text[i] < 0x20) ? "\\u%04x" : "\\%c", text[i]);
+            Cbor_JsonAppend(out, escape, strlen(escape));
+            start = i + 1;
+        }
+    }
+    Cbor_JsonAppend(out, (const char *)text + start, length - start);
+    Cbor_JsonAppend(out, "\"", 1);
+}
+
+static bool Cbor_ToJsonItem(CborReader_t *reader, CborJsonOut_t *out, uint8_t depth, bool isKey)
+{
+    static const char hexDigits[] = "0123456789ABCDEF";
+    uint8_t type;
+    uint64_t value;
+    size_t start = reader->offset;
+    if (depth > CBOR_MAX_DEPTH || !Cbor_ReadHead(reader, &type, &value))
+    {
+        reader->error = true;
+        return false;
+    }
+
+    switch (type)
+    {
+    case CBOR_TYPE_UINT:
+    case CBOR_TYPE_NEGINT:
+    {
+        char number[24];
+        if (type == CBOR_TYPE_UINT)
+        {
+            snprintf(number, sizeof(number), isKey ? "\"%llu\"" : "%llu", (unsigned long long)value);
+        }
+        else
+        {
+            snprintf(number, sizeof(number), isKey ? "\"-%llu\"" : "-%llu", (unsigned long long)value + 1);
+        }
+        Cbor_JsonAppend(out, number, strlen(number));
+        break;
+    }
+    case CBOR_TYPE_BYTES:
+        // byte strings become upper case hex strings, as the messages were before the binary encoding
+        if (reader->size - reader->offset < value)
+        {
+            reader->error = true;
+            return false;
+        }
+        Cbor_JsonAppend(out, "\"", 1);
+        for (uint64_t i = 0; i < value; i++)
+        {
+            uint8_t byte = reader->buffer[reader->offset++];
+            char hex[2] = {hexDigits[byte >> 4], hexDigits[byte & 0x0F]};
+            Cbor_JsonAppend(out, hex, 2);
+        }
+        Cbor_JsonAppend(out, "\"", 1);
+        break;
+    case CBOR_TYPE_TEXT:
+        if (reader->size - reader->offset < value)
+        {
+            reader->error = true;
+            return false;
+        }
+        Cbor_JsonText(out, reader->buffer + reader->offset, value);
+        reader->offset += value;
+        break;
+    case CBOR_TYPE_ARRAY:
+    case CBOR_TYPE_MAP:
+        Cbor_JsonAppend(out, type == CBOR_TYPE_MAP ? "{" : "[", 1);
+        for (uint64_t i = 0; i < value; i++)
+        {
+            if (i > 0)
+            {
+                Cbor_JsonAppend(out, ",", 1);
+            }
+            if (type == CBOR_TYPE_MAP)
+            {
+                if (!Cbor_ToJsonItem(reader, out, depth + 1, true))
+                {
+                    return false;
+                }
+                Cbor_JsonAppend(out, ":", 1);
+            }
+            if (!Cbor_ToJsonItem(reader, out, depth + 1, false))
+            {
+                return false;
+            }
+        }
+        Cbor_JsonAppend(out, type == CBOR_TYPE_MAP ? "}" : "]", 1);
+        break;
+    case CBOR_TYPE_TAG:
+        // tags carry no meaning for the backend, only the tagged item is kept
+        return Cbor_ToJsonItem(reader, out, depth + 1, isKey);
+    default:
+    {
+        uint8_t info = reader->buffer[start] & 0x1F;
+        if (info == 25)
+        {
+            // half float
+            int exponent = (value >> 10) & 0x1F;
+            double mantissa = value & 0x3FF;
+            double number = (exponent == 0) ? ldexp(mantissa, -24) : ldexp(mantissa + 1024, exponent - 25);
+            Cbor_JsonNumber(out, (value & 0x8000) ? -number : number);
+        }
+        else if (info == 26)
+        {
+            uint32_t bits = (uint32_t)value;
+            float single;
+            memcpy(&single, &bits, sizeof(single));
+            Cbor_JsonNumber(out, single);
+        }
+        else if (info == 27)
+        {
+            double number;
+            memcpy(&number, &value, sizeof(number));
+            Cbor_JsonNumber(out, number);
+        }
+        else if (value == 20 || value == 21)
+        {
+            Cbor_JsonAppend(out, value == 21 ? "true" : "false", value == 21 ? 4 : 5);
+        }
+        else
+        {
+            Cbor_JsonAppend(out, "null", 4);
+        }
+        break;
+    }
+    }
+    return !out->overflow;
+}
+
+/**
+ * @brief  print one item as JSON text. map keys which are not text are printed as text, byte strings as hex text
+ * @param json[out] NUL terminated JSON text
+ * @return false if the item is malformed or the JSON text does not fit in size
+ */
+bool Cbor_ToJson(CborReader_t *reader, char *json, size_t size)
+{
+    CborJsonOut_t out = {.json = json, .size = size, .length = 0, .overflow = false};
+    if (size > 0)
+    {
+        json[0] = '\0';
+    }
+    return Cbor_ToJsonItem(reader, &out, 0, false);
+}
@@ -0,0 +1,752 @@
+#include "includes/command_parser.h"
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+
+static CommandParser_Metrics_t metrics = {0};
+
+/**
+ * @brief  same conversion as the valueint of cJSON
+ */
+int CommandParser_ValueInt(double value)
+{
+    if (value >= INT_MAX)
+        return INT_MAX;
+    if (value <= (double)INT_MIN)
+        return INT_MIN;
+    return (int)value;
+}
+
+//*********************TOKENIZER******************************
+// each function gets the position of a token and returns the position after it, or NULL if the text is not what it
+// handles. NULL does not mean the JSON is invalid, only that cJSON has to parse it
+
+static const char *CommandParser_SkipSpace(const char *p)
+{
+    // like cJSON, every control character is a space
+    while (*p != '\0' && (uint8_t)*p <= 32)
+    {
+        p++;
+    }
+    return p;
+}
+
+static bool CommandParser_IsNumberStart(char c)
+{
+    return c == '-' || (c >= '0' && c <= '9');
+}
+
+static bool CommandParser_IsNumberChar(char c)
+{
+    return (c >= '0' && c <= '9') || c == '+' || c == '-' || c == 'e' || c == 'E' || c == '.';
+}
+
+static const char *CommandParser_ReadNumber(const char *p, double *value)
+{
+    // integers of up to 15 digits are exact in a double, no need for strtod
+    const char *digits = (*p == '-') ? p + 1 : p;
+    int64_t integer = 0;
+    uint8_t count = 0;
+    while (digits[count] >= '0' && digits[count] <= '9' && count < 16)
+    {
+        integer = integer * 10 + (digits[count] - '0');
+        count++;
+    }
+    if (count > 0 && count < 16 && !CommandParser_IsNumberChar(digits[count]))
+    {
+        *value = (*p == '-') ? -(double)integer : (double)integer;
+        return digits + count;
+    }
+
+    // like cJSON: only the characters of a number are given to strtod
+    char number[32];
+    size_t length = 0;
+    while (CommandParser_IsNumberChar(p[length]))
+    {
+        if (length == sizeof(number) - 1)
+        {
+            return NULL;
+        }
+        number[length] = p[length];
+        length++;
+    }
+    number[length] = '\0';
+    char *end = NULL;
+    *value = strtod(number, &end);
+    if (end == number)
+    {
+        return NULL;
+    }
+    return p + (end - number);
+}
+
+static int CommandParser_Hex4(const char *p)
+{
+    int code = 0;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        char c = p[i];
+        code <<= 4;
+        if (c >= '0' && c <= '9')
+            code |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            code |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            code |= c - 'A' + 10;
+        else
+            return -1;
+    }
+    return code;
+}
+
+/**
+ * @brief  read a string token, unescaped into out. out NULL only skips it
+ * @param p[in] position of the opening quote
+ */
+static const char *CommandParser_ReadString(const char *p, char *out, size_t size)
+{
+    size_t length = 0;
+    p++;
+    while (*p != '"')
+    {
+        char utf8[4];
+        uint8_t utf8Length = 1;
+        utf8[0] = *p++;
+        if (utf8[0] == '\0')
+        {
+            return NULL;
+        }
+        if (utf8[0] == '\\')
+        {
+            char escaped = *p++;
+            switch (escaped)
+            {
+            case '"':
+            case '\\':
+            case '/':
+                utf8[0] = escaped;
+                break;
+            case 'b':
+                utf8[0] = '\b';
+                break;
+            case 'f':
+                utf8[0] = '\f';
+                break;
+            case 'n':
+                utf8[0] = '\n';
+                break;
+            case 'r':
+                utf8[0] = '\r';
+                break;
+            case 't':
+                utf8[0] = '\t';
+                break;
+            case 'u':
+            {
+                // a lone surrogate and NUL are left to cJSON
+                int code = CommandParser_Hex4(p);
+                if (code <= 0 || (code >= 0xDC00 && code <= 0xDFFF))
+                {
+                    return NULL;
+                }
+                p += 4;
+                if (code >= 0xD800 && code <= 0xDBFF)
+                {
+                    int low = (p[0] == '\\' && p[1] == 'u') ? CommandParser_Hex4(p + 2) : -1;
+                    if (low < 0xDC00 || low > 0xDFFF)
+                    {
+                        return NULL;
+                    }
+                    p += 6;
+                    code = 0x10000 + (((code & 0x3FF) << 10) | (low & 0x3FF));
+                }
+                if (code < 0x80)
+                {
+                    utf8[0] = (char)code;
+                }
+                else if (code < 0x800)
+                {
+                    utf8[0] = (char)(0xC0 | (code >> 6));
+                    utf8[1] = (char)(0x80 | (code & 0x3F));
+                    utf8Length = 2;
+                }
+                else if (code < 0x10000)
+                {
+                    utf8[0] = (char)(0xE0 | (code >> 12));
+                    utf8[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+                    utf8[2] = (char)(0x80 | (code & 0x3F));
+                    utf8Length = 3;
+                }
+                else
+                {
+                    utf8[0] = (char)(0xF0 | (code >> 18));
+                    utf8[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+                    utf8[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+                    utf8[3] = (char)(0x80 | (code & 0x3F));
+                    utf8Length = 4;
+                }
+            }
+            break;
+            default:
+                return NULL;
+            }
+        }
+        if (out != NULL)
+        {
+            if (length + utf8Length >= size)
+            {
+                return NULL;
+            }
+            memcpy(out + length, utf8, utf8Length);
+        }
+        length += utf8Length;
+    }
+    if (out != NULL)
+    {
+        out[length] = '\0';
+    }
+    return p + 1;
+}
+
+/**
+ * @brief  read a key, without copying it. keys with escapes are left to cJSON
+ * @param p[in] position of the opening quote
+ */
+static const char *CommandParser_ReadKey(const char *p, const char **key, size_t *keyLength)
+{
+    const char *start = ++p;
+    while (*p != '"')
+    {
+        if (*p == '\0' || *p == '\\')
+        {
+            return NULL;
+        }
+        p++;
+    }
+    *key = start;
+    *keyLength = p - start;
+    return p + 1;
+}
+
+static bool CommandParser_KeyIs(const char *key, size_t keyLength, const char *name)
+{
+    return strncmp(key, name, keyLength) == 0 && name[keyLength] == '\0';
+}
+
+static const char *CommandParser_SkipValue(const char *p, uint8_t depth);
+
+static const char *CommandParser_SkipContainer(const char *p, uint8_t depth)
+{
+    bool object = (*p == '{');
+    char close = object ? '}' : ']';
+    if (depth >= COMMAND_PARSER_MAX_DEPTH)
+    {
+        return NULL;
+    }
+    p = CommandParser_SkipSpace(p + 1);
+    if (*p == close)
+    {
+        return p + 1;
+    }
+    while (true)
+    {
+        if (object)
+        {
+            if (*p != '"' || (p = CommandParser_ReadString(p, NULL, 0)) == NULL)
+            {
+                return NULL;
+            }
+            p = CommandParser_SkipSpace(p);
+            if (*p != ':')
+            {
+                return NULL;
+            }
+            p = CommandParser_SkipSpace(p + 1);
+        }
+        if ((p = CommandParser_SkipValue(p, depth + 1)) == NULL)
+        {
+            return NULL;
+        }
+        p = CommandParser_SkipSpace(p);
+        if (*p == close)
+        {
+            return p + 1;
+        }
+        if (*p != ',')
+        {
+            return NULL;
+        }
+        p = CommandParser_SkipSpace(p + 1);
+    }
+}
+
+static const char *CommandParser_SkipValue(const char *p, uint8_t depth)
+{
+    double number;
+    switch (*p)
+    {
+    case '"':
+        return CommandParser_ReadString(p, NULL, 0);
+    case '{':
+    case '[':
+        return CommandParser_SkipContainer(p, depth);
+    case 't':
+        return (strncmp(p, "true", 4) == 0) ? p + 4 : NULL;
+    case 'f':
+        return (strncmp(p, "false", 5) == 0) ? p + 5 : NULL;
+    case 'n':
+        return (strncmp(p, "null", 4) == 0) ? p + 4 : NULL;
+    default:
+        return CommandParser_IsNumberStart(*p) ? CommandParser_ReadNumber(p, &number) : NULL;
+    }
+}
+
+/**
+ * @brief  read an array of numbers as bytes. the items which are not numbers are left out and the rest is zero
+ * @param allBytes[out] false if an item is not a number from 0 to 255
+ */
+static const char *CommandParser_ReadByteArray(const char *p, uint8_t *out, uint16_t max, uint16_t *count, bool *allBytes)
+{
+    uint16_t items = 0;
+    uint16_t numbers = 0;
+    *allBytes = true;
+    p = CommandParser_SkipSpace(p + 1);
+    bool empty = (*p == ']');
+    while (!empty)
+    {
+        if (items == max)
+        {
+            return NULL;
+        }
+        if (CommandParser_IsNumberStart(*p))
+        {
+            double number;
+            if ((p = CommandParser_ReadNumber(p, &number)) == NULL)
+            {
+                return NULL;
+            }
+            int byte = CommandParser_ValueInt(number);
+            if (byte < 0x00 || byte > 0xff)
+            {
+                *allBytes = false;
+            }
+            out[numbers++] = (uint8_t)byte;
+        }
+        else
+        {
+            if ((p = CommandParser_SkipValue(p, 1)) == NULL)
+            {
+                return NULL;
+            }
+            *allBytes = false;
+        }
+        items++;
+        p = CommandParser_SkipSpace(p);
+        if (*p == ']')
+        {
+            break;
+        }
+        if (*p != ',')
+        {
+            return NULL;
+        }
+        p = CommandParser_SkipSpace(p + 1);
+    }
+    memset(out + numbers, 0, items - numbers);
+    *count = items;
+    return p + 1;
+}
+
+//*********************MESSAGES******************************
+
+static void CommandParser_Reset(CommandMessage_t *message)
+{
+    message->fields = 0;
+    message->id = 0;
+    message->command = 0;
+    message->value = 0;
+    message->values = message->valueBuffer;
+    message->valueCount = 0;
+    message->macs = message->macBuffer;
+    message->macBytes = 0;
+    message->string = message->stringBuffer;
+    message->stringBuffer[0] = '\0';
+    message->json = NULL;
+    message->valuesAllocated = false;
+    message->macsAllocated = false;
+}
+
+static uint8_t CommandParser_FieldOfKey(const char *key, size_t keyLength)
+{
+    if (CommandParser_KeyIs(key, keyLength, "cmnd"))
+        return COMMAND_FIELD_CMND;
+    if (CommandParser_KeyIs(key, keyLength, "val"))
+        return COMMAND_FIELD_VAL;
+    if (CommandParser_KeyIs(key, keyLength, "str"))
+        return COMMAND_FIELD_STR;
+    if (CommandParser_KeyIs(key, keyLength, "macs"))
+        return COMMAND_FIELD_MACS;
+    if (CommandParser_KeyIs(key, keyLength, "id"))
+        return COMMAND_FIELD_ID;
+    return 0;
+}
+
+// the value of a member, from its first character
+static const char *CommandParser_ReadField(const char *p, uint8_t field, CommandMessage_t *message)
+{
+    double number;
+    bool allBytes;
+    switch (field)
+    {
+    case COMMAND_FIELD_CMND:
+        if (CommandParser_IsNumberStart(*p))
+        {
+            p = CommandParser_ReadNumber(p, &number);
+            message->command = CommandParser_ValueInt(number);
+            message->fields |= COMMAND_FIELD_CMND;
+            return p;
+        }
+        break;
+    case COMMAND_FIELD_ID:
+        if (CommandParser_IsNumberStart(*p))
+        {
+            p = CommandParser_ReadNumber(p, &number);
+            message->id = (uint16_t)CommandParser_ValueInt(number);
+            message->fields |= COMMAND_FIELD_ID;
+            return p;
+        }
+        break;
+    case COMMAND_FIELD_VAL:
+        if (CommandParser_IsNumberStart(*p))
+        {
+            p = CommandParser_ReadNumber(p, &message->value);
+            message->fields |= COMMAND_FIELD_VAL;
+            return p;
+        }
+        if (*p == '[')
+        {
+            p = CommandParser_ReadByteArray(p, message->valueBuffer, COMMAND_PARSER_MAX_VALUES, &message->valueCount, &allBytes);
+            message->fields |= COMMAND_FIELD_VALS;
+            return p;
+        }
+        break;
+    case COMMAND_FIELD_STR:
+        if (*p == '"')
+        {
+            p = CommandParser_ReadString(p, message->stringBuffer, sizeof(message->stringBuffer));
+            message->fields |= COMMAND_FIELD_STR;
+            return p;
+        }
+        break;
+    case COMMAND_FIELD_MACS:
+        if (*p == '[')
+        {
+            p = CommandParser_ReadByteArray(p, message->macBuffer, COMMAND_PARSER_MAX_MAC_BYTES, &message->macBytes, &allBytes);
+            if (allBytes)
+            {
+                message->fields |= COMMAND_FIELD_MACS;
+            }
+            return p;
+        }
+        break;
+    default:
+        break;
+    }
+    return CommandParser_SkipValue(p, 1);
+}
+
+static bool CommandParser_ParseWithoutCJSON(const char *cptrJson, CommandMessage_t *message)
+{
+    uint8_t seen = 0;
+    const char *p = CommandParser_SkipSpace(cptrJson);
+    if (*p != '{')
+    {
+        return false;
+    }
+    p = CommandParser_SkipSpace(p + 1);
+    if (*p == '}')
+    {
+        return true;
+    }
+    while (true)
+    {
+        const char *key;
+        size_t keyLength;
+        if (*p != '"' || (p = CommandParser_ReadKey(p, &key, &keyLength)) == NULL)
+        {
+            return false;
+        }
+        p = CommandParser_SkipSpace(p);
+        if (*p != ':')
+        {
+            return false;
+        }
+        p = CommandParser_SkipSpace(p + 1);
+
+        uint8_t field = CommandParser_FieldOfKey(key, keyLength);
+        // cJSON would use the first one of duplicate keys
+        if ((seen & field) != 0)
+        {
+            return false;
+        }
+        seen |= field;
+        if ((p = CommandParser_ReadField(p, field, message)) == NULL)
+        {
+            return false;
+        }
+
+        p = CommandParser_SkipSpace(p);
+        if (*p == '}')
+        {
+            // like cJSON_Parse, what follows the object is ignored
+            return true;
+        }
+        if (*p != ',')
+        {
+            return false;
+        }
+        p = CommandParser_SkipSpace(p + 1);
+    }
+}
+
+// copy of a cJSON array, in buffer if it fits
+static uint8_t *CommandParser_CopyArray(const cJSON *cjArray, uint8_t *buffer, uint16_t size, uint16_t *count, bool *allocated, bool *allBytes)
+{
+    int items = cJSON_GetArraySize(cjArray);
+    if (items > UINT16_MAX)
+    {
+        return NULL;
+    }
+    uint8_t *bytes = buffer;
+    if (items > size)
+    {
+        bytes = malloc(items);
+        if (bytes == NULL)
+        {
+            return NULL;
+        }
+        *allocated = true;
+    }
+    memset(bytes, 0, items);
+    uint16_t numbers = 0;
+    const cJSON *Iterator = NULL;
+    *allBytes = true;
+    cJSON_ArrayForEach(Iterator, cjArray)
+    {
+        if (cJSON_IsNumber(Iterator))
+        {
+            bytes[numbers++] = (uint8_t)Iterator->valueint;
+            if (Iterator->valueint < 0x00 || Iterator->valueint > 0xff)
+            {
+                *allBytes = false;
+            }
+        }
+        else
+        {
+            *allBytes = false;
+        }
+    }
+    *count = items;
+    return bytes;
+}
+
+static bool CommandParser_ParseWithCJSON(const char *cptrJson, CommandMessage_t *message)
+{
+    cJSON *json = cJSON_Parse(cptrJson);
+    if (json == NULL)
+    {
+        return false;
+    }
+    message->json = json;
+    bool allBytes;
+
+    cJSON *cjId = cJSON_GetObjectItemCaseSensitive(json, "id");
+    if (cJSON_IsNumber(cjId))
+    {
+        message->id = (uint16_t)cjId->valueint;
+        message->fields |= COMMAND_FIELD_ID;
+    }
+    cJSON *cjCommand = cJSON_GetObjectItemCaseSensitive(json, "cmnd");
+    if (cJSON_IsNumber(cjCommand))
+    {
+        message->command = cjCommand->valueint;
+        message->fields |= COMMAND_FIELD_CMND;
+    }
+    cJSON *cjValue = cJSON_GetObjectItemCaseSensitive(json, "val");
+    if (cJSON_IsNumber(cjValue))
+    {
+        message->value = cjValue->valuedouble;
+        message->fields |= COMMAND_FIELD_VAL;
+    }
+    else if (cJSON_IsArray(cjValue))
+    {
+        message->values = CommandParser_CopyArray(cjValue, message->valueBuffer, COMMAND_PARSER_MAX_VALUES,
+                                                  &message->valueCount, &message->valuesAllocated, &allBytes);
+        if (message->values != NULL)
+        {
+            message->fields |= COMMAND_FIELD_VALS;
+        }
+    }
+    cJSON *cjString = cJSON_GetObjectItemCaseSensitive(json, "str");
+    if (cJSON_IsString(cjString) && (cjString->valuestring != NULL))
+    {
+        message->string = cjString->valuestring;
+        message->fields |= COMMAND_FIELD_STR;
+    }
+    cJSON *cjMacs = cJSON_GetObjectItemCaseSensitive(json, "macs");
+    if (cJSON_IsArray(cjMacs))
+    {
+        message->macs = CommandParser_CopyArray(cjMacs, message->macBuffer, COMMAND_PARSER_MAX_MAC_BYTES,
+                                                &message->macBytes, &message->macsAllocated, &allBytes);
+        if (message->macs != NULL && allBytes)
+        {
+            message->fields |= COMMAND_FIELD_MACS;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief  parse a command message. CommandParser_Release has to be called once the fields are not used anymore
+ * @param cptrJson[in] NUL terminated JSON text, not modified. the fields do not point into it
+ * @param message[out] fields of the message. only the ones flagged in message->fields are set
+ * @return false if the text is not JSON
+ */
+bool CommandParser_Parse(const char *cptrJson, CommandMessage_t *message)
+{
+    CommandParser_Reset(message);
+    if (CommandParser_ParseWithoutCJSON(cptrJson, message))
+    {
+        metrics.parsed++;
+        return true;
+    }
+    CommandParser_Reset(message);
+    if (CommandParser_ParseWithCJSON(cptrJson, message))
+    {
+        metrics.fallbacks++;
+        return true;
+    }
+    metrics.invalid++;
+    return false;
+}
+
+void CommandParser_Release(CommandMessage_t *message)
+{
+    if (message->valuesAllocated)
+    {
+        free(message->values);
+    }
+    if (message->macsAllocated)
+    {
+        free(message->macs);
+    }
+    cJSON_Delete(message->json);
+    CommandParser_Reset(message);
+}
+
+/**
+ * @brief  parse a JSON object of numbers, like the action of the gateway {"address":..,"command":..}
+ * @param keys[in] the keys to read, at most 32
+ * @param values[out] the number of each key found
+ * @param found[out] bit i is set if keys[i] is a number
+ * @return false if the text is not JSON
+ */
+bool CommandParser_ParseNumbers(const char *cptrJson, const char *const *keys, uint8_t keyCount, double *values, uint32_t *found)
+{
+    uint32_t seen = 0;
+    *found = 0;
+    const char *p = CommandParser_SkipSpace(cptrJson);
+    if (*p == '{')
+    {
+        p = CommandParser_SkipSpace(p + 1);
+        if (*p == '}')
+        {
+            return true;
+        }
+        while (p != NULL)
+        {
+            const char *key;
+            size_t keyLength;
+            if (*p != '"' || (p = CommandParser_ReadKey(p, &key, &keyLength)) == NULL)
+                break;
+            p = CommandParser_SkipSpace(p);
+            if (*p != ':')
+                break;
+            p = CommandParser_SkipSpace(p + 1);
+
+            uint8_t i = 0;
+            while (i < keyCount && !CommandParser_KeyIs(key, keyLength, keys[i]))
+            {
+                i++;
+            }
+            if (i < keyCount)
+            {
+                // cJSON would use the first one of duplicate keys
+                if ((seen & (1u << i)) != 0)
+                    break;
+                seen |= (1u << i);
+            }
+            if (i < keyCount && CommandParser_IsNumberStart(*p))
+            {
+                *found |= (1u << i);
+                p = CommandParser_ReadNumber(p, &values[i]);
+            }
+            else
+            {
+                p = CommandParser_SkipValue(p, 1);
+            }
+            if (p == NULL)
+                break;
+            p = CommandParser_SkipSpace(p);
+            if (*p == '}')
+            {
+                metrics.parsed++;
+                return true;
+            }
+            if (*p != ',')
+                break;
+            p = CommandParser_SkipSpace(p + 1);
+        }
+    }
+
+    cJSON *json = cJSON_Parse(cptrJson);
+    *found = 0;
+    if (json == NULL)
+    {
+        metrics.invalid++;
+        return false;
+    }
+    for (uint8_t i = 0; i < keyCount; i++)
+    {
+        cJSON *cjItem = cJSON_GetObjectItemCaseSensitive(json, keys[i]);
+        if (cJSON_IsNumber(cjItem))
+        {
+            values[i] = cjItem->valuedouble;
+            *found |= (1u << i);
+        }
+    }
+    cJSON_Delete(json);
+    metrics.fallbacks++;
+    return true;
+}
+
+/**
+ * @brief  read only the "cmnd" of a message, e.g. to choose its queue before it is parsed
+ * @return the command, or -1 if there is none
+ */
+int CommandParser_PeekCommand(const char *cptrJson)
+{
+    static const char *const keys[] = {"cmnd"};
+    double value = 0;
+    uint32_t found = 0;
+    if (!CommandParser_ParseNumbers(cptrJson, keys, 1, &value, &found) || (found & 1) == 0)
+    {
+        return -1;
+    }
+    return CommandParser_ValueInt(value);
+}
+
+void CommandParser_GetMetrics(CommandParser_Metrics_t *metricsCopy)
+{
+    *metricsCopy = metrics;
+}
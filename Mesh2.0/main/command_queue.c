@@ -0,0 +1,230 @@
+#include "includes/command_queue.h"
+#include "includes/command_keys.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char *TAG = "CommandQueue";
+
+// upper bound of each bucket, in us. the last bucket has the rest
+static const uint32_t CommandQueue_LatencyBounds[COMMAND_QUEUE_LATENCY_BUCKETS - 1] = {
+    100, 1000, 5000, 10000, 20000, 50000, 100000, 1000000};
+
+/**
+ * @brief  create a queue of pointers, each stamped with the time it is queued
+ * @param length[in] max number of items
+ */
+QueueHandle_t CommandQueue_Create(UBaseType_t length)
+{
+    return xQueueCreate(length, sizeof(CommandQueue_Item_t));
+}
+
+/**
+ * @brief  queue an item without waiting. the caller keeps the ownership of the item if it fails
+ * @return true if it is queued
+ */
+bool CommandQueue_Send(QueueHandle_t queue, void *item)
+{
+    CommandQueue_Item_t entry = {.item = item, .queuedAt = esp_timer_get_time()};
+    return xQueueSendToBack(queue, &entry, (TickType_t)0) == pdPASS;
+}
+
+static void CommandQueue_Record(CommandQueue_Latency_t *latency, int64_t waitUs)
+{
+    uint32_t wait = (waitUs > 0) ? (uint32_t)waitUs : 0;
+    uint8_t bucket = 0;
+    while (bucket < COMMAND_QUEUE_LATENCY_BUCKETS - 1 && wait >= CommandQueue_LatencyBounds[bucket])
+    {
+        bucket++;
+    }
+    latency->buckets[bucket]++;
+    latency->count++;
+    latency->totalUs += wait;
+    if (wait > latency->maxUs)
+    {
+        latency->maxUs = wait;
+    }
+    if ((latency->count % COMMAND_QUEUE_PRINT_EVERY) == 0)
+    {
+        CommandQueue_PrintLatency(latency);
+    }
+}
+
+/**
+ * @brief  wait for an item. the task sleeps until one is queued or wait is over
+ * @param latency[in,out] histogram of the task, the wait of the item is added to it. can be NULL
+ * @return the item, NULL if none came
+ */
+void *CommandQueue_Receive(QueueHandle_t queue, TickType_t wait, CommandQueue_Latency_t *latency)
+{
+    CommandQueue_Item_t entry;
+    if (xQueueReceive(queue, &entry, wait) != pdPASS)
+    {
+        return NULL;
+    }
+    if (latency != NULL)
+    {
+        CommandQueue_Record(latency, esp_timer_get_time() - entry.queuedAt);
+    }
+    return entry.item;
+}
+
+void CommandQueue_PrintLatency(const CommandQueue_Latency_t *latency)
+{
+    if (latency->count == 0)
+    {
+        return;
+    }
+    ESP_LOGI(TAG, "%s: %d items, avg %d us, max %d us, <0.1ms %d, <1ms %d, <5ms %d, <10ms %d, <20ms %d, <50ms %d, <100ms %d, <1s %d, >=1s %d",
+             latency->name, latency->count, (uint32_t)(latency->totalUs / latency->count), latency->maxUs,
+             latency->buckets[0], latency->buckets[1], latency->buckets[2], latency->buckets[3], latency->buckets[4],
+             latency->buckets[5], latency->buckets[6], latency->buckets[7], latency->buckets[8]);
+}
+
+//*********************LANES******************************
+
+static const uint8_t CommandLanes_Weights[COMMAND_LANE_COUNT] = COMMAND_LANE_WEIGHTS;
+static const char *CommandLanes_Names[COMMAND_LANE_COUNT] = {"control", "status", "bulk"};
+
+/**
+ * @brief  create the lanes of a queue of pointers
+ * @param name[in] name of the consumer, for the latency logs
+ * @param length[in] max number of items of each lane
+ * @return the lanes, NULL if there is not enough memory
+ */
+CommandLanes_t *CommandLanes_Create(const char *name, UBaseType_t length)
+{
+    CommandLanes_t *lanes = calloc(1, sizeof(CommandLanes_t));
+    if (lanes == NULL)
+    {
+        return NULL;
+    }
+    lanes->ready = xSemaphoreCreateCounting(length * COMMAND_LANE_COUNT, 0);
+    bool created = (lanes->ready != NULL);
+    for (uint8_t lane = 0; lane < COMMAND_LANE_COUNT; lane++)
+    {
+        lanes->lanes[lane] = CommandQueue_Create(length);
+        lanes->credits[lane] = CommandLanes_Weights[lane];
+        snprintf(lanes->names[lane], sizeof(lanes->names[lane]), "%s/%s", name, CommandLanes_Names[lane]);
+        lanes->latency[lane].name = lanes->names[lane];
+        created = created && (lanes->lanes[lane] != NULL);
+    }
+    if (!created)
+    {
+        ESP_LOGE(TAG, "Could not create the lanes of %s", name);
+        // the queues are not deleted, this only happens at start up
+        free(lanes);
+        return NULL;
+    }
+    return lanes;
+}
+
+/**
+ * @brief  queue an item in a lane without waiting. the caller keeps the ownership of the item if it fails
+ * @return true if it is queued
+ */
+bool CommandLanes_Send(CommandLanes_t *lanes, CommandLane_t lane, void *item)
+{
+    if (lane >= COMMAND_LANE_COUNT || !CommandQueue_Send(lanes->lanes[lane], item))
+    {
+        return false;
+    }
+    xSemaphoreGive(lanes->ready);
+    return true;
+}
+
+/**
+ * @brief  wait for an item of any lane. the lanes are taken in order of priority, each one until its credits of the
+ *         round are spent. the credits are given again once no lane with credits has an item
+ * @param lane[out] lane of the item. can be NULL
+ * @return the item, NULL if none came
+ */
+void *CommandLanes_Receive(CommandLanes_t *lanes, TickType_t wait, CommandLane_t *lane)
+{
+    if (xSemaphoreTake(lanes->ready, wait) != pdTRUE)
+    {
+        return NULL;
+    }
+    int8_t chosen = -1;
+    for (uint8_t round = 0; round < 2 && chosen < 0; round++)
+    {
+        for (uint8_t i = 0; i < COMMAND_LANE_COUNT; i++)
+        {
+            if (lanes->credits[i] > 0 && uxQueueMessagesWaiting(lanes->lanes[i]) > 0)
+            {
+                chosen = i;
+                break;
+            }
+        }
+        if (chosen < 0)
+        {
+            // new round
+            for (uint8_t i = 0; i < COMMAND_LANE_COUNT; i++)
+            {
+                lanes->credits[i] = CommandLanes_Weights[i];
+            }
+        }
+    }
+    if (chosen < 0)
+    {
+        // can not happen with one consumer
+        return NULL;
+    }
+    lanes->credits[chosen]--;
+    if (lane != NULL)
+    {
+        *lane = chosen;
+    }
+    return CommandQueue_Receive(lanes->lanes[chosen], 0, &lanes->latency[chosen]);
+}
+
+/**
+ * @brief  sleep until an item is queued in any lane, without taking it
+ * @return true if there is an item
+ */
+bool CommandLanes_Wait(CommandLanes_t *lanes, TickType_t wait)
+{
+    if (xSemaphoreTake(lanes->ready, wait) != pdTRUE)
+    {
+        return false;
+    }
+    xSemaphoreGive(lanes->ready);
+    return true;
+}
+
+UBaseType_t CommandLanes_Waiting(CommandLanes_t *lanes)
+{
+    return uxSemaphoreGetCount(lanes->ready);
+}
+
+void CommandLanes_PrintLatency(const CommandLanes_t *lanes)
+{
+    for (uint8_t lane = 0; lane < COMMAND_LANE_COUNT; lane++)
+    {
+        CommandQueue_PrintLatency(&lanes->latency[lane]);
+    }
+}
+
+/**
+ * @brief  lane of a command or a message, by its "cmnd"
+ * @param command[in] -1 for a payload without a cmnd, like the raw data of an OTA: it goes to the bulk lane
+ */
+CommandLane_t CommandLanes_OfCommand(int command)
+{
+    switch (command)
+    {
+    case -1:
+        return COMMAND_LANE_BULK;
+    case enumRootCmndKey_PublishSensorData:
+        return COMMAND_LANE_STATUS;
+    case enumRootCmndKey_UpdateRootFW:
+    case enumRootCmndKey_MessageToAWS:      // logs
+    case enumRootCmndKey_UpdateNodeFW:
+    case enumGatewayCmndKey_GW_OTA_Begin:
+    case enumGatewayCmndKey_GW_OTA_End:
+        return COMMAND_LANE_BULK;
+    default:
+        return COMMAND_LANE_CONTROL;
+    }
+}
@@ -0,0 +1,213 @@
+#if defined(ROOT) || defined(IPNODE) || defined(GATEWAY_SIM7080)
+#include "includes/command_registry.h"
+#include "esp_log.h"
+#include <string.h>
+
+static const char *TAG = "CommandRegistry";
+
+#if defined(GATEWAY_SIM7080) && !defined(IPNODE) && !defined(ROOT)
+// a GW with SIM7080 takes the node OTA command of the root
+static bool CommandRegistry_SIM7080UpdateNodeFW(NodeStruct_t *structNodeReceived)
+{
+    return SIM7080_UpdateNodeFW(structNodeReceived) != 0;
+}
+#endif
+
+#define ROOT_COMMAND(fun, args, resp)   {.nodeTypes = COMMAND_NODE_ROOT, .sources = COMMAND_SOURCE_ANY, .arguments = (args), .response = (resp), .root_fun = (fun)}
+#define NODE_COMMAND(types, fun, args)  NODE_COMMAND_FROM(types, COMMAND_SOURCE_MESH, fun, args)
+#define NODE_COMMAND_FROM(types, sources_, fun, args) \
+    {.nodeTypes = (types), .sources = (sources_), .arguments = (args), .response = COMMAND_RESPONSE_ACK, .node_fun = (fun)}
+
+//************************COMMAND REGISTRY*******************
+static const CommandRegistry_Entry_t CommandRegistry[COMMAND_REGISTRY_SIZE] = {
+#ifdef ROOT
+    [enumRootCmndKey_RestartRoot] = ROOT_COMMAND(RestartRoot, 0, COMMAND_RESPONSE_NONE),
+    [enumRootCmndKey_TestRoot] = ROOT_COMMAND(TestRoot, 0, COMMAND_RESPONSE_ACK),
+    [enumRootCmndKey_UpdateRootFW] = ROOT_COMMAND(UpdateRootFW, COMMAND_ARG_STRING, COMMAND_RESPONSE_ACK),
+    [enumRootCmndKey_TestGroup] = ROOT_COMMAND(TestGroup, COMMAND_ARG_STRING, COMMAND_RESPONSE_ACK),
+    [enumRootCmndKey_SendGroupCmd] = ROOT_COMMAND(SendGroupCmd, COMMAND_ARG_STRING, COMMAND_RESPONSE_ACK),
+    [enumRootCmndKey_AddOrgInfo] = ROOT_COMMAND(AddOrgInfo, 0, COMMAND_RESPONSE_ACK),
+    [enumRootCmndKey_SetTopicEncoding] = ROOT_COMMAND(SetTopicEncoding, 0, COMMAND_RESPONSE_ACK),
+    [enumRootCmndKey_SetSnapshotInterval] = ROOT_COMMAND(SetSnapshotInterval, 0, COMMAND_RESPONSE_ACK),
+    [enumRootCmndKey_PublishSensorData] = ROOT_COMMAND(PublishSensorData, 0, COMMAND_RESPONSE_NONE),
+    [enumRootCmndKey_PublishControlData] = ROOT_COMMAND(PublishControlData, 0, COMMAND_RESPONSE_NONE),
+    [enumRootCmndKey_MessageToAWS] = ROOT_COMMAND(MessageToAWS, 0, COMMAND_RESPONSE_NONE),
+    [enumRootCmndKey_UpdateNodeFW] = ROOT_COMMAND(UpdateNodeFW, COMMAND_ARG_STRING | COMMAND_ARG_MACS, COMMAND_RESPONSE_ACK),
+    [enumRootCmndKey_CreateGroup] = ROOT_COMMAND(CreateGroup, COMMAND_ARG_MACS, COMMAND_RESPONSE_ACK),
+    [enumRootCmndKey_DeleteGroup] = ROOT_COMMAND(DeleteGroup, COMMAND_ARG_MACS, COMMAND_RESPONSE_ACK),
+    [enumRootCmndKey_PublishNodeControlSuccess] = ROOT_COMMAND(PublishNodeControlSuccess, 0, COMMAND_RESPONSE_NONE),
+    [enumRootCmndKey_PublishNodeControlFail] = ROOT_COMMAND(PublishNodeControlFail, 0, COMMAND_RESPONSE_NONE),
+    [enumRootCmndKey_SetAckExpansion] = ROOT_COMMAND(SetAckExpansion, 0, COMMAND_RESPONSE_ACK),
+#endif
+
+#ifdef IPNODE
+    [enumNodeCmndKey_RestartNode] = NODE_COMMAND(COMMAND_NODE_ALL, RestartNode, 0),
+    [enumNodeCmndKey_TestNode] = NODE_COMMAND(COMMAND_NODE_ALL, TestNode, 0),
+    [enumNodeCmndKey_SetNodeOutput] = NODE_COMMAND(COMMAND_NODE_ALL, SetNodeOutput, 0),
+    [enumNodeCmndKey_CreateGroup] = NODE_COMMAND(COMMAND_NODE_ALL, CreateGroup, COMMAND_ARG_STRING),
+    [enumNodeCmndKey_DeleteGroup] = NODE_COMMAND(COMMAND_NODE_ALL, DeleteGroup, COMMAND_ARG_STRING),
+    [enumNodeCmndKey_AssignSensorToSelf] = NODE_COMMAND(COMMAND_NODE_ALL, AssignSensorToSelf, COMMAND_ARG_STRING),
+    [enumNodeCmndKey_EnableOrDisableSensorAction] = NODE_COMMAND(COMMAND_NODE_ALL, EnableOrDisableSensorAction, COMMAND_ARG_STRING),
+    [enumNodeCmndKey_RemoveSensor] = NODE_COMMAND(COMMAND_NODE_ALL, RemoveSensor, COMMAND_ARG_STRING),
+    [enumNodeCmndKey_AssignSensorToNodeOrGroup] = NODE_COMMAND(COMMAND_NODE_ALL, AssignSensorToNodeOrGroup, COMMAND_ARG_STRING),
+    [enumNodeCmndKey_ChangePortPIR] = NODE_COMMAND(COMMAND_NODE_ALL, ChangePortPIR, COMMAND_ARG_STRING),
+    [enumNodeCmndKey_OverrideNodeType] = NODE_COMMAND(COMMAND_NODE_ALL, OverrideNodeType, 0),
+    [enumNodeCmndKey_RemoveNodeTypeOverride] = NODE_COMMAND(COMMAND_NODE_ALL, RemoveNodeTypeOverride, 0),
+    [enumNodeCmndKey_GetDaisyChainedCurrent] = NODE_COMMAND(COMMAND_NODE_ALL, GetDaisyChainedCurrent, 0),
+    [enumNodeCmndKey_GetFirmwareVersion] = NODE_COMMAND(COMMAND_NODE_ALL, GetFirmwareVersion, 0),
+    [enumNodeCmndKey_GetNodeOutput] = NODE_COMMAND(COMMAND_NODE_ALL, GetNodeOutput, 0),
+    [enumNodeCmndKey_GetParentRSSI] = NODE_COMMAND(COMMAND_NODE_ALL, GetParentRSSI, 0),
+    [enumNodeCmndKey_GetNodeChildren] = NODE_COMMAND(COMMAND_NODE_ALL, GetNodeChildren, 0),
+    [enumNodeCmndKey_SetUplinkEncoding] = NODE_COMMAND(COMMAND_NODE_ALL, SetUplinkEncoding, 0),
+
+    [enumContactorCmndKey_SC_SetRelays] = NODE_COMMAND(COMMAND_NODE_CONTACTOR, SC_SetRelays, COMMAND_ARG_VALUES),
+    [enumContactorCmndKey_SC_SelectADCs] = NODE_COMMAND(COMMAND_NODE_CONTACTOR, SC_SelectADCs, 0),
+    [enumContactorCmndKey_SC_SetADCPeriod] = NODE_COMMAND(COMMAND_NODE_CONTACTOR, SC_SetADCPeriod, 0),
+
+    [enumIOCmndKey_SIO_SetVoltage] = NODE_COMMAND(COMMAND_NODE_IO, SIO_SetVoltage, 0),
+    [enumIOCmndKey_SIO_SelectADCs] = NODE_COMMAND(COMMAND_NODE_IO, SIO_SelectADCs, COMMAND_ARG_VALUES),
+    [enumIOCmndKey_SIO_SetADCPeriod] = NODE_COMMAND(COMMAND_NODE_IO, SIO_SetADCPeriod, 0),
+    [enumIOCmndKey_SIO_EnableDisableSub] = NODE_COMMAND(COMMAND_NODE_IO, SIO_EnableDisableSub, 0),
+    [enumIOCmndKey_SIO_SetRelay] = NODE_COMMAND(COMMAND_NODE_IO, SIO_SetRelay, 0),
+
+    [enumPowerCmndKey_SP_SetVoltage] = NODE_COMMAND(COMMAND_NODE_POWER, SP_SetVoltage, 0),
+    [enumPowerCmndKey_SP_SetPWMPort0] = NODE_COMMAND(COMMAND_NODE_POWER, SP_SetPWMPort0, 0),
+    [enumPowerCmndKey_SP_SetPWMPort1] = NODE_COMMAND(COMMAND_NODE_POWER, SP_SetPWMPort1, 0),
+    [enumPowerCmndKey_SP_SetPWMBothPort] = NODE_COMMAND(COMMAND_NODE_POWER, SP_SetPWMBothPort, 0),
+    [enumPowerCmndKey_SP_EnableCurrentSubmission] = NODE_COMMAND(COMMAND_NODE_POWER, SP_EnableCurrentSubmission, 0),
+
+    //the OTA of the GW only comes through the mesh
+    [enumGatewayCmndKey_GW_OTA_Begin] = NODE_COMMAND(COMMAND_NODE_GATEWAY, GW_Process_OTA_Command_Begin, 0),
+    [enumGatewayCmndKey_GW_OTA_End] = NODE_COMMAND(COMMAND_NODE_GATEWAY, GW_Process_OTA_Command_End, 0),
+#endif
+
+    //GW commands, also taken from AWS by a GW with ethernet or SIM7080
+#if defined(IPNODE) || defined(GATEWAY_ETH) || defined(GATEWAY_SIM7080)
+    [enumGatewayCmndKey_GW_Action] = NODE_COMMAND_FROM(COMMAND_NODE_GATEWAY, COMMAND_SOURCE_ANY, GW_Process_Action_Command, COMMAND_ARG_STRING),
+    [enumGatewayCmndKey_GW_Query] = NODE_COMMAND_FROM(COMMAND_NODE_GATEWAY, COMMAND_SOURCE_ANY, GW_Process_Query_Command, 0),
+    [enumGatewayCmndKey_GW_AT_CMD] = NODE_COMMAND_FROM(COMMAND_NODE_GATEWAY, COMMAND_SOURCE_ANY, GW_Process_AT_Command, COMMAND_ARG_STRING),
+#endif
+
+    //a GW with SIM7080 only, without the mesh, takes the node OTA of the root from AWS
+#if defined(GATEWAY_SIM7080) && !defined(IPNODE) && !defined(ROOT)
+    [enumRootCmndKey_UpdateNodeFW] = NODE_COMMAND_FROM(COMMAND_NODE_GATEWAY, COMMAND_SOURCE_AWS, CommandRegistry_SIM7080UpdateNodeFW, COMMAND_ARG_STRING),
+#endif
+};
+//************************COMMAND REGISTRY*******************
+
+/**
+ * @brief finds the entry of a command
+ * @param ubyCommand[in] the command id
+ * @param nodeType[in] COMMAND_NODE_* of the device executing the command
+ * @param source[in] COMMAND_SOURCE_* the command came from
+ * @return the entry, or NULL if the command is not known by this node type or not taken from this source
+ */
+const CommandRegistry_Entry_t *CommandRegistry_Lookup(uint8_t ubyCommand, uint8_t nodeType, uint8_t source)
+{
+    const CommandRegistry_Entry_t *entry = &CommandRegistry[ubyCommand];
+    if ((entry->nodeTypes & nodeType) == 0 || (entry->sources & source) == 0)
+    {
+        return NULL;
+    }
+    return entry;
+}
+
+/**
+ * @brief checks that the arguments needed by the handler of a command are given
+ * @return false if the handler would fail, or would use a missing argument
+ */
+bool CommandRegistry_CheckArguments(const CommandRegistry_Entry_t *entry, const char *cptrString, const uint8_t *ubyptrValues, const uint8_t *ubyptrMacs)
+{
+    if ((entry->arguments & COMMAND_ARG_STRING) && (cptrString == NULL || cptrString[0] == '\0'))
+    {
+        ESP_LOGW(TAG, "Command without str");
+        return false;
+    }
+    if ((entry->arguments & COMMAND_ARG_VALUES) && ubyptrValues == NULL)
+    {
+        ESP_LOGW(TAG, "Command without an array in val");
+        return false;
+    }
+    if ((entry->arguments & COMMAND_ARG_MACS) && ubyptrMacs == NULL)
+    {
+        ESP_LOGW(TAG, "Command without macs");
+        return false;
+    }
+    return true;
+}
+
+// node types allowed in each range of ids
+static uint8_t CommandRegistry_RangeNodeTypes(uint8_t ubyCommand)
+{
+    if (ubyCommand < 50)
+        return COMMAND_NODE_ALL;
+    if (ubyCommand < 100)
+        return COMMAND_NODE_ROOT | COMMAND_NODE_GATEWAY;
+    if (ubyCommand < 150)
+        return COMMAND_NODE_CONTACTOR;
+    if (ubyCommand < 200)
+        return COMMAND_NODE_IO;
+    if (ubyCommand < 220)
+        return COMMAND_NODE_POWER;
+    return COMMAND_NODE_GATEWAY;
+}
+
+/**
+ * @brief checks the registry at start up: each command is in the range of its node types and has the handler
+ * of its side. The errors are logged
+ * @return true if the registry is valid
+ */
+bool CommandRegistry_Validate()
+{
+    bool valid = true;
+    uint16_t commands = 0;
+    for (uint16_t id = 0; id < COMMAND_REGISTRY_SIZE; id++)
+    {
+        const CommandRegistry_Entry_t *entry = &CommandRegistry[id];
+        if (entry->nodeTypes == 0)
+        {
+            continue;
+        }
+        commands++;
+        if (entry->sources == 0)
+        {
+            ESP_LOGE(TAG, "Command %d can not come from anywhere", id);
+            valid = false;
+        }
+        if ((entry->nodeTypes & ~CommandRegistry_RangeNodeTypes(id)) != 0)
+        {
+            ESP_LOGE(TAG, "Command %d is out of the range of its node types 0x%02x", id, entry->nodeTypes);
+            valid = false;
+        }
+#ifdef ROOT
+        if ((entry->nodeTypes & COMMAND_NODE_ROOT) && entry->root_fun == NULL)
+        {
+            ESP_LOGE(TAG, "Root command %d has no handler", id);
+            valid = false;
+        }
+#else
+        if (entry->nodeTypes & COMMAND_NODE_ROOT)
+        {
+            ESP_LOGE(TAG, "Root command %d in a node build", id);
+            valid = false;
+        }
+#endif
+#if defined(IPNODE) || defined(GATEWAY_ETH) || defined(GATEWAY_SIM7080)
+        if ((entry->nodeTypes & COMMAND_NODE_ALL) && entry->node_fun == NULL)
+        {
+            ESP_LOGE(TAG, "Node command %d has no handler", id);
+            valid = false;
+        }
+#else
+        if (entry->nodeTypes & COMMAND_NODE_ALL)
+        {
+            ESP_LOGE(TAG, "Node command %d in a root build", id);
+            valid = false;
+        }
+#endif
+    }
+    ESP_LOGI(TAG, "%d commands registered", commands);
+    return valid;
+}
+
+#endif
@@ -0,0 +1,275 @@
+#ifdef ROOT
+#include "includes/downlink_queue.h"
+#include "includes/root_utilities.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <string.h>
+
+/**
+ * Commands from AWS to the nodes, written to the mesh without blocking.
+ *
+ * A command is written at once with mwifi_root_write in non blocking mode. If the write fails, the command waits in
+ * the queue of its node and is written again after a back off, and the next commands to that node wait behind it.
+ * The commands to the other nodes keep flowing. When the first command of a node fails DOWNLINK_QUEUE_MAX_ATTEMPTS
+ * times, all the commands of the node are reported to the fail topic and the node is dead for
+ * DOWNLINK_QUEUE_DEAD_HOLDOFF: its commands fail at once instead of waiting.
+ *
+ * Only used by the task RootOperations_ProcessNodeCommands, so there is no lock.
+ */
+
+static const char *TAG = "DownlinkQueue";
+
+typedef struct
+{
+    char *cptrPayload;          // topic from AWS, freed once the command is sent or reported
+    char *cptrCommand;          // command text inside cptrPayload
+    uint16_t id;                // correlation id of the command, 0 if it has none
+} DownlinkQueue_Command_t;
+
+typedef struct
+{
+    bool used;
+    uint8_t mac[MWIFI_ADDR_LEN];
+    uint8_t attempts;           // failed writes of the first command
+    uint8_t first;
+    uint8_t count;
+    int64_t retryAt;            // esp_timer_get_time
+    int64_t deadUntil;
+    DownlinkQueue_Command_t commands[DOWNLINK_QUEUE_DEPTH];
+} DownlinkQueue_Destination_t;
+
+static DownlinkQueue_Destination_t destinations[DOWNLINK_QUEUE_MAX_DESTINATIONS];
+static DownlinkQueue_Metrics_t metrics = {0};
+
+static bool DownlinkQueue_Write(const uint8_t *ubyptrNodeMacs, uint8_t ubyNumOfNodes, const char *cptrCommand)
+{
+    mwifi_data_type_t data_type = {.communicate = MWIFI_COMMUNICATE_UNICAST, .compression = true};
+    mdf_err_t ret = mwifi_root_write(ubyptrNodeMacs, ubyNumOfNodes, &data_type, cptrCommand, strlen(cptrCommand) + 1, false);
+    if (ret != MDF_OK)
+    {
+        ESP_LOGW(TAG, "Write to " MACSTR " (%d nodes) failed: %s", MAC2STR(ubyptrNodeMacs), ubyNumOfNodes, mdf_err_to_name(ret));
+        return false;
+    }
+    metrics.sent += ubyNumOfNodes;
+    return true;
+}
+
+//a tagged command is reported as the ack of a node would be, its topic was overwritten by the id
+static void DownlinkQueue_Fail(const uint8_t *ubyptrNodeMac, char *cptrPayload, uint16_t id, bool fast)
+{
+    if (id != 0)
+    {
+        AckTracker_Publish(id, false, "unreachable", ubyptrNodeMac);
+    }
+    else
+    {
+        RootUtilities_SendDataToAWS(AWS_TOPIC_CONTROL_FAIL, cptrPayload);
+    }
+    vPortFree(cptrPayload);
+    metrics.failed++;
+    if (fast)
+    {
+        metrics.failedFast++;
+    }
+}
+
+static DownlinkQueue_Destination_t *DownlinkQueue_Find(const uint8_t *ubyptrNodeMac)
+{
+    for (uint8_t i = 0; i < DOWNLINK_QUEUE_MAX_DESTINATIONS; i++)
+    {
+        if (destinations[i].used && memcmp(destinations[i].mac, ubyptrNodeMac, MWIFI_ADDR_LEN) == 0)
+        {
+            return &destinations[i];
+        }
+    }
+    return NULL;
+}
+
+static int64_t DownlinkQueue_Backoff(uint8_t attempts)
+{
+    uint32_t delay = DOWNLINK_QUEUE_RETRY_BASE;
+    while (attempts-- > 1 && delay < DOWNLINK_QUEUE_RETRY_MAX)
+    {
+        delay *= 2;
+    }
+    if (delay > DOWNLINK_QUEUE_RETRY_MAX)
+    {
+        delay = DOWNLINK_QUEUE_RETRY_MAX;
+    }
+    return (int64_t)delay * 1000;
+}
+
+static void DownlinkQueue_Append(DownlinkQueue_Destination_t *destination, char *cptrPayload, char *cptrCommand, uint16_t id)
+{
+    DownlinkQueue_Command_t *command = &destination->commands[(destination->first + destination->count) % DOWNLINK_QUEUE_DEPTH];
+    command->cptrPayload = cptrPayload;
+    command->cptrCommand = cptrCommand;
+    command->id = id;
+    destination->count++;
+}
+
+/**
+ * @brief  write a command to a node, or queue it behind the commands of the node which are waiting.
+ *         the payload is freed once the command is sent, or reported to the fail topic
+ * @param cptrPayload[in] the topic from AWS, allocated with pvPortMalloc
+ * @param cptrCommand[in] the command text, inside cptrPayload
+ * @param id[in] the correlation id written in the command (see ack_tracker.h), 0 if it has none
+ */
+void DownlinkQueue_Send(const uint8_t *ubyptrNodeMac, char *cptrPayload, char *cptrCommand, uint16_t id)
+{
+    int64_t now = esp_timer_get_time();
+    DownlinkQueue_Destination_t *destination = DownlinkQueue_Find(ubyptrNodeMac);
+    if (destination != NULL)
+    {
+        if (destination->deadUntil > now || destination->count >= DOWNLINK_QUEUE_DEPTH)
+        {
+            DownlinkQueue_Fail(ubyptrNodeMac, cptrPayload, id, true);
+        }
+        else
+        {
+            // keep the order of the commands of the node
+            DownlinkQueue_Append(destination, cptrPayload, cptrCommand, id);
+        }
+        return;
+    }
+
+    if (DownlinkQueue_Write(ubyptrNodeMac, 1, cptrCommand))
+    {
+        vPortFree(cptrPayload);
+        return;
+    }
+
+    // the node is not reachable now, retry later
+    for (uint8_t i = 0; i < DOWNLINK_QUEUE_MAX_DESTINATIONS && destination == NULL; i++)
+    {
+        if (!destinations[i].used)
+        {
+            destination = &destinations[i];
+        }
+    }
+    if (destination == NULL)
+    {
+        ESP_LOGW(TAG, "Too many nodes with commands waiting");
+        DownlinkQueue_Fail(ubyptrNodeMac, cptrPayload, id, true);
+        return;
+    }
+    memset(destination, 0, sizeof(DownlinkQueue_Destination_t));
+    destination->used = true;
+    memcpy(destination->mac, ubyptrNodeMac, MWIFI_ADDR_LEN);
+    destination->attempts = 1;
+    destination->retryAt = now + DownlinkQueue_Backoff(1);
+    DownlinkQueue_Append(destination, cptrPayload, cptrCommand, id);
+}
+
+/**
+ * @brief  write the same command to several nodes with one write. if one of the nodes has commands waiting, or the
+ *         write fails, each command goes through DownlinkQueue_Send instead: a node which got the group write before
+ *         the failure gets the command again
+ * @param cptrPayloads[in] the topics from AWS, allocated with pvPortMalloc
+ * @param cptrCommands[in] the command text inside each payload, the same text for all of them
+ * @param ids[in] the correlation id of each command, 0 if it has none
+ * @return true if the commands were sent with one write
+ */
+bool DownlinkQueue_SendGroup(const mesh_addr_t *nodeAddrs, uint8_t ubyNumOfNodes, char **cptrPayloads, char **cptrCommands, const uint16_t *ids)
+{
+    bool waiting = false;
+    for (uint8_t i = 0; i < ubyNumOfNodes && !waiting; i++)
+    {
+        waiting = (DownlinkQueue_Find(nodeAddrs[i].addr) != NULL);
+    }
+    if (!waiting && DownlinkQueue_Write((const uint8_t *)nodeAddrs, ubyNumOfNodes, cptrCommands[0]))
+    {
+        for (uint8_t i = 0; i < ubyNumOfNodes; i++)
+        {
+            vPortFree(cptrPayloads[i]);
+        }
+        return true;
+    }
+    for (uint8_t i = 0; i < ubyNumOfNodes; i++)
+    {
+        DownlinkQueue_Send(nodeAddrs[i].addr, cptrPayloads[i], cptrCommands[i], ids[i]);
+    }
+    return false;
+}
+
+/**
+ * @brief  write the waiting commands whose back off is over, fail the nodes which are out of attempts and forget
+ *         the ones which have nothing left
+ * @return ticks until the next retry, portMAX_DELAY if no command is waiting
+ */
+TickType_t DownlinkQueue_Process()
+{
+    int64_t now = esp_timer_get_time();
+    int64_t next = INT64_MAX;
+    metrics.waiting = 0;
+    for (uint8_t i = 0; i < DOWNLINK_QUEUE_MAX_DESTINATIONS; i++)
+    {
+        DownlinkQueue_Destination_t *destination = &destinations[i];
+        if (!destination->used)
+        {
+            continue;
+        }
+        // the commands of a node which is back are written one after the other
+        while (destination->count > 0 && destination->deadUntil <= now && destination->retryAt <= now)
+        {
+            DownlinkQueue_Command_t *command = &destination->commands[destination->first];
+            if (destination->attempts > 0)
+            {
+                metrics.retried++;
+            }
+            if (DownlinkQueue_Write(destination->mac, 1, command->cptrCommand))
+            {
+                vPortFree(command->cptrPayload);
+                destination->first = (destination->first + 1) % DOWNLINK_QUEUE_DEPTH;
+                destination->count--;
+                destination->attempts = 0;
+                continue;
+            }
+            if (++destination->attempts < DOWNLINK_QUEUE_MAX_ATTEMPTS)
+            {
+                destination->retryAt = now + DownlinkQueue_Backoff(destination->attempts);
+                break;
+            }
+            // out of attempts, the node is dead for a while
+            ESP_LOGE(TAG, "Node " MACSTR " is not reachable, %d commands failed", MAC2STR(destination->mac), destination->count);
+            while (destination->count > 0)
+            {
+                DownlinkQueue_Fail(destination->mac, destination->commands[destination->first].cptrPayload, destination->commands[destination->first].id, false);
+                destination->first = (destination->first + 1) % DOWNLINK_QUEUE_DEPTH;
+                destination->count--;
+            }
+            destination->attempts = 0;
+            destination->deadUntil = now + (int64_t)DOWNLINK_QUEUE_DEAD_HOLDOFF * 1000;
+        }
+
+        if (destination->count > 0)
+        {
+            metrics.waiting++;
+            next = (destination->retryAt < next) ? destination->retryAt : next;
+        }
+        else if (destination->deadUntil <= now)
+        {
+            destination->used = false;
+        }
+    }
+
+    if (next == INT64_MAX)
+    {
+        return portMAX_DELAY;
+    }
+    TickType_t wait = (TickType_t)((next - now) / 1000 / portTICK_RATE_MS);
+    return (wait > 0) ? wait : 1;
+}
+
+void DownlinkQueue_GetMetrics(DownlinkQueue_Metrics_t *metricsCopy)
+{
+    *metricsCopy = metrics;
+}
+
+void DownlinkQueue_PrintMetrics()
+{
+    ESP_LOGI(TAG, "sent %u, retried %u, failed %u (fast %u), nodes waiting %d",
+             metrics.sent, metrics.retried, metrics.failed, metrics.failedFast, metrics.waiting);
+}
+
+#endif
@@ -14,7 +14,7 @@ void EspNow_Init()
 void EspNow_CreateEspNowQueue()
 {
     //created a queue with maxumum of 15 commands, and a item size of a char pointer
-    espNowQueue = xQueueCreate(15, sizeof(EspNowStruct *));
+    espNowQueue = CommandQueue_Create(15);
     if (espNowQueue == NULL)
     {
         ESP_LOGE(TAG, "Could not create ESP NOW queue");
@@ -65,13 +65,15 @@ void EspNow_ParseData(EspNowStruct *recv_cb, size_t *required_size, uint8_t *sen
         {
             strcpy(macOfNodeStr, deviceMACStr);
             ESP_LOGW(TAG, "Sensor data is for me");
-            char *cptrData = pvPortMalloc(recv_cb->data_len);
-            memset(cptrData, 0, recv_cb->data_len);
-            memcpy(cptrData, recv_cb->data, recv_cb->data_len);
-            if (xQueueSendToBack(nodeReadQueue, &cptrData, (TickType_t)0) != pdPASS)
+            MsgBuffer *buffer = MsgBuffer_AcquireCopy(&nodeReadPool, recv_cb->data, recv_cb->data_len, 0);
+            if (buffer == NULL)
+            {
+                ESP_LOGE(TAG, "No buffer for the sensor action");
+            }
+            else if (!CommandQueue_Send(nodeReadQueue, buffer))
             {
                 ESP_LOGE(TAG, "Queue is full");
-                vPortFree(cptrData);
+                MsgBuffer_Release(buffer);
                 //Report back to Root here letting us know that the queue is full and to wait for the next command
                 //The queue most likely will neveer fill up but you never know
             }
@@ -134,7 +136,7 @@ void EspNow_RecvCb(const uint8_t *mac_addr, const uint8_t *data, int len)
     //ESP_LOGW(TAG, "Passing to Queue");
     //ESP_LOGW(TAG, "Sensor MAc %s", recv_cb->macStr);
     //ESP_LOGI(TAG, "Leaf received, addr: " MACSTR ", data: %s\n", MAC2STR(mac_addr), (char *)data);
-    if (xQueueSendToBack(espNowQueue, &recv_cb, (TickType_t)0) != pdPASS)
+    if (!CommandQueue_Send(espNowQueue, recv_cb))
     {
         ESP_LOGE(TAG, "Queue is full");
         vPortFree(recv_cb->data);
@@ -20,18 +20,26 @@
 #include "driver/uart.h"
 #include "SIM7080_lib.h"
 #include "esp_system.h"
+#include "esp_timer.h"
+#include "gw_includes/SIM7080_provision.h"
+#include "includes/msg_buffer.h"
+#include "includes/uplink_journal.h"
 
 extern QueueHandle_t SIM7080_AWS_Tx_queue;
 extern QueueHandle_t SIM7080_AWS_Rx_queue;
+extern MsgBufferPool SIM7080_AWS_Rx_pool;
 
 // UART configuration definitions
 #define SIM7080_TX                          25
 #define SIM7080_RX                          26
 #define SIM7080_PULSE                       27
 #define UART_BUF_SIZE                       2000  //going beyond 2000 makes the ESP panic when trying to read the entire certificate
-#define UART_QUEUE_LENGTH                   2
+#define UART_QUEUE_LENGTH                   20    // UART driver events (data, overflow) waiting for the receiving task
+#define SIM7080_PIPELINE_DEPTH              2     // max AT commands written before their results arrive (only for pipeline safe commands)
 #define SIM7080_UART_PORT                   UART_NUM_1
 #define MAX_COMMUNICATION_FAILED_ATTEMPTS   10
+#define SIM7080_READY_POLL_INTERVAL         200   // AT is sent this often while waiting for the modem to respond
+#define SIM7080_READY_TIMEOUT               20000 // max time for the modem to respond after power on
 // AWS MQTT session information
 #define AWS_KEEPTIME                        60
 #define AWS_CLEAN_SESSION                   1
@@ -41,8 +49,14 @@ extern QueueHandle_t SIM7080_AWS_Rx_queue;
 #define AWS_RETAIN                          0
 #define AWS_PUB_RETAIN                      0
 #define AWS_Tx_BUFFER_SIZE                  500
+#define AWS_Rx_QUEUE_LENGTH                 5
+#define AWS_Rx_BUFFER_SIZE                  1024    // max length of a "+SMSUB:" line
+#define AWS_Tx_BATCH_SIZE                   1024    // max payload of one AT+SMPUB
+#define AWS_Tx_BATCH_MESSAGES               8       // messages taken from SIM7080_AWS_Tx_queue at once
+#define AWS_PUBLISH_METRICS_INTERVAL        50      // print the publish metrics after this many publishes (debugging only)
 // AT internet commands
 #define ATcmdC_AT                   "AT"
+#define ATcmdC_GSN                  "AT+GSN"
 #define ATcmdQ_CPIN                 "AT+CPIN?"
 #define ATcmdC_CSQ                  "AT+CSQ"
 #define ATcmdQ_CGATT                "AT+CGATT?"
@@ -67,16 +81,35 @@ extern QueueHandle_t SIM7080_AWS_Rx_queue;
 #define ATcmdC_CFSINIT              "AT+CFSINIT"
 #define ATcmdQ_CFSGFRS              "AT+CFSGFRS?"
 #define ATcmdC_CFSTERM              "AT+CFSTERM"
+#define ATcmdC_CFSGFIS_FORMAT       "AT+CFSGFIS=%d,\"%s\""
+#define ATcmdC_ECHO_OFF             "ATE0"
+#define ATcmdC_ECHO_ON              "ATE1"
 // AT AWS pubsub commands
 #define ATpubC_CTRL_SUCCESS         "/controldata/success"
 #define ATpubC_CTRL_FAIL            "/controldata/fail"
 // AT OTA commands
 #define ATcmdC_HTTPTOFS             "AT+HTTPTOFS"
+#define ATcmdC_SHCONF_BODYLEN       "AT+SHCONF=\"BODYLEN\",1024"
+#define ATcmdC_SHCONF_HEADERLEN     "AT+SHCONF=\"HEADERLEN\",350"
+#define ATcmdC_CSSLCFG_HTTP_SSLV    "AT+CSSLCFG=\"SSLVERSION\",1,3"
+#define ATcmdC_SHSSL                "AT+SHSSL=1,\"\""
+#define ATcmdC_SHCONN               "AT+SHCONN"
+#define ATcmdC_SHDISC               "AT+SHDISC"
+#define ATcmdQ_SHSTATE              "AT+SHSTATE?"
+#define ATcmdC_SHCHEAD              "AT+SHCHEAD"
 // OTA definitions
 #define SIM_OTA_FILE_NAME           "temporary.bin"
 #define SIM_OTA_MINIMUM_FILE_SIZE   2000
 #define HTTP_STATUS_CODE_OK         200
-#define UART_FS_OFFSET              75
+#define HTTP_STATUS_CODE_PARTIAL    206
+#define SIM_OTA_STREAM_DOWNLOAD             // stream the FW from the URL to ESP32 (AT+SHREQ/AT+SHREAD) instead of downloading it to the SIM7080 FS first
+#define SIM_HTTP_READ_CHUNK_SIZE    4096    // size of one AT+SHREAD. must be a multiple of 4 for the CRC
+#define SIM_HTTP_READ_TIMEOUT       10000
+#define SIM_HTTP_REQUEST_TIMEOUT    60000
+#define SIM_HTTP_MAX_RETRIES        3       // a failed download is resumed with a "Range" request this many times
+#define SIM_FS_READ_CHUNK_SIZE      10240   // max size of one AT+CFSRFILE read
+#define SIM_FS_READ_COMMAND_SIZE    64
+#define SIM_FS_READ_TIMEOUT         5000
 
 
 
@@ -137,8 +170,36 @@ typedef enum SIM7080_AWS_status
 
 }SIM7080_AWS_status;
 
+// one "AT+SMPUB" of SIM7080_send_AWS_messages
+typedef struct SIM7080_publish_t
+{
+    SIM7080_AT_cmd_t cmd;
+    char command[50];
+    const char *payload;
+    char *batch;                            // the JSON array, if the publish holds more than one message
+    size_t length;
+    uint8_t messages;
+    uint8_t indexes[AWS_Tx_BATCH_MESSAGES]; // the messages of the publish, as indexes in msgs
+    bool success;
+    bool started;
+
+}SIM7080_publish_t;
+
+typedef struct SIM7080_publish_metrics_t
+{
+    uint32_t publishes;
+    uint32_t messages;
+    uint32_t bytes;
+    uint32_t failures;
+    int64_t latency_total;                  // from queueing the "AT+SMPUB" until its final "OK", in micro seconds
+    int64_t latency_min;
+    int64_t latency_max;
+
+}SIM7080_publish_metrics_t;
+
 esp_err_t init_SIM7080();
 esp_err_t Execute_AT_CMD(char * command, uint8_t num_commands);
+esp_err_t SIM7080_Submit_AT_CMD(char *command);
 esp_err_t SIM7080_Process_Type_01_Data(uint8_t *data);
 esp_err_t SIM7080_Process_Type_02_Data(uint8_t *data);
 esp_err_t ping_google();
@@ -147,9 +208,12 @@ esp_err_t SIM7080_Clear_Queues();
 void get_SIM_connected_to_internet(void *pvParameters);
 SIM7080_AWS_status get_SIM_connected_to_AWS();
 esp_err_t SIM7080_msg_preprocessor(uint8_t* recvbuf);
+esp_err_t SIM7080_init_URC_handlers();
 void SIM7080_Connect_to_Internet_And_AWS(void *timer);
 esp_err_t SIM7080_Retry_Connect_to_Internet_And_AWS_After_Delay(uint16_t delay);
 esp_err_t SIM7080_send_AWS_message(char *msg, bool success);
+esp_err_t SIM7080_send_AWS_messages(char **msgs, const bool *success, uint8_t count, bool *sent);
+void SIM7080_print_publish_metrics();
 
 // The below functions will only be needed when the GW is acting as only SIM7080 driven unit.
 // (if IPNODE is defined, the OTA information must be sent via IPNODE)
@@ -159,6 +223,7 @@ void SIM7080_UpgradeNodeCenceFirmware(NodeStruct_t *structNodeReceived);
 esp_err_t SIM7080_copy_bytes_from_SIM_to_ESP();
 uint8_t* SIM7080_get_bytes_from_file(char* file_name, uint16_t read_size, uint32_t read_position);
 esp_err_t SIM7080_download_file_to_SIM_from_URL(char * url);
+esp_err_t SIM7080_stream_file_from_URL_to_ESP(char *url);
 uint32_t SIM7080_get_file_size(uint8_t directory, char* file_name);
 esp_err_t SIM7080_delete_file(uint8_t directory, char* file_name);
 #endif
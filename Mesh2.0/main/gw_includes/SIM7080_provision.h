@@ -0,0 +1,42 @@
+/**
+ ******************************************************************************
+ *	Copyright (c) 2024 CencePower Inc
+ ******************************************************************************
+ * @file	: SIM7080_provision.h
+ * @author	: Yasiru Benaragama
+ * @date	: 16 Feb 2024
+ * @brief	: fingerprint of what is provisioned on the SIM7080 (certificates,
+ * SSL conversions), kept in NVS so the steps can be skipped on reconnect
+ ******************************************************************************
+ *
+ ******************************************************************************
+ */
+#ifdef GATEWAY_SIM7080
+#ifndef SIM7080_PROVISION_H
+#define SIM7080_PROVISION_H
+#include "includes/SpacrGateway_commands.h"
+#include "nvs.h"
+
+#define SIM7080_PROVISION_NVS_KEY           "sim_prov"
+#define SIM7080_PROVISION_VERSION           1       // change to invalidate the fingerprints of older firmware
+#define SIM7080_PROVISION_IMEI_SIZE         20
+#define SIM7080_PROVISION_HASH_SIZE         32
+
+typedef struct SIM7080_provision_t
+{
+    uint8_t version;
+    char imei[SIM7080_PROVISION_IMEI_SIZE];                 // the modem the fingerprint belongs to
+    uint8_t cert_hash[SIM7080_PROVISION_HASH_SIZE];         // SHA256 of the certificates uploaded to the SIM7080 FS
+    uint8_t ssl_hash[SIM7080_PROVISION_HASH_SIZE];          // SHA256 of the certificates converted with AT+CSSLCFG="CONVERT"
+
+} SIM7080_provision_t;
+
+esp_err_t SIM7080_provision_load(const char *imei);
+bool SIM7080_provision_loaded();
+bool SIM7080_provision_certs_uploaded();
+bool SIM7080_provision_ssl_converted();
+esp_err_t SIM7080_provision_set_certs_uploaded(bool uploaded);
+esp_err_t SIM7080_provision_set_ssl_converted(bool converted);
+
+#endif
+#endif
@@ -74,6 +74,7 @@ esp_err_t update_ota_data_length_to_be_expected(size_t data);
 esp_err_t ota_begin();
 esp_err_t process_ota_data(uint8_t *data, size_t data_len);
 esp_err_t ota_write_data(const uint8_t *data, size_t size);
+void ota_set_streamed_crc(uint32_t crc);
 
 #endif
 #endif
@@ -20,7 +20,10 @@ static bool print_all_incoming_information  = false;
 static bool print_all_incoming_information  = false;
 #endif
 
+// the task is created by the first request and kept afterwards, blocked until the next one. it is never deleted, so
+// the handle can be notified at any time
 TaskHandle_t ConfigTask;
+static volatile bool request_running = false;
 static bool exit_task = false;
 static bool resume_task = false;
 static uint8_t next_expected_command = 0;
@@ -70,8 +73,14 @@ void Request_Configuration_information()
     ESP_LOGI(TAG, "Request_Configuration_information from mainboard ...");
     if (ConfigTask == NULL)
     {
+        request_running = true;
         xTaskCreate(configuration_request_loop, "configuration_request_loop", 2047, NULL, 10, &ConfigTask);
     }
+    else if (!request_running)
+    {
+        request_running = true;
+        xTaskNotifyGive(ConfigTask);
+    }
     else
     {
         ESP_LOGE(TAG, "The task is already running!");
@@ -81,59 +90,76 @@ void Request_Configuration_information()
 
 void configuration_request_loop(void *pvParameters)
 {
-    exit_task = false;
-    resume_task = true;
-    next_expected_slot = 0;
-    next_expected_command = 0;
-    next_expected_command = CNGW_CONFIG_CMD_Config_General_Info;
-    TickType_t beginningTick = xTaskGetTickCount();
-    TickType_t currentTick = xTaskGetTickCount();
-    TickType_t lastRequestTick = currentTick;
-
-    if(print_all_incoming_information)
-    {
-        timeout_ticks = 7800;
-    }
-    else
-    {
-        timeout_ticks = 1800;
-    }
-
     while (1)
     {
-        currentTick = xTaskGetTickCount();
-        if (currentTick - beginningTick > timeout_ticks)
+        exit_task = false;
+        resume_task = true;
+        next_expected_slot = 0;
+        next_expected_command = 0;
+        next_expected_command = CNGW_CONFIG_CMD_Config_General_Info;
+        TickType_t beginningTick = xTaskGetTickCount();
+        TickType_t currentTick = xTaskGetTickCount();
+        TickType_t lastRequestTick = currentTick;
+
+        if(print_all_incoming_information)
         {
-            ESP_LOGE(TAG, "configuration request loop timeout");
-            Send_GW_message_to_AWS(65, 0, "configuration request loop timeout");
-            exit_task = true;
+            timeout_ticks = 7800;
         }
-        if (currentTick - lastRequestTick > 100)
+        else
         {
-            ESP_LOGW(TAG, "Resending previous message...");
-            resume_task = true;
+            timeout_ticks = 1800;
         }
 
-        if (resume_task && !exit_task)
+        while (1)
         {
-            CNGW_Config_Request_Frame_t Frame;
-            CCP_UTIL_Get_Msg_Header(&Frame.header, CNGW_HEADER_TYPE_Configuration_Request_Command, sizeof(Frame.message));
-            Frame.message.command = next_expected_command;
-            Frame.message.slot = next_expected_slot;
-            Frame.message.crc = CCP_UTIL_Get_Crc8(0, (uint8_t *)&(Frame.message), sizeof(Frame.message) - sizeof(Frame.message.crc));
-            consume_GW_message((uint8_t *)&Frame);
-            resume_task = false;
-            lastRequestTick = currentTick;
+            currentTick = xTaskGetTickCount();
+            if (currentTick - beginningTick > timeout_ticks)
+            {
+                ESP_LOGE(TAG, "configuration request loop timeout");
+                Send_GW_message_to_AWS(65, 0, "configuration request loop timeout");
+                exit_task = true;
+            }
+            if (currentTick - lastRequestTick > 100)
+            {
+                ESP_LOGW(TAG, "Resending previous message...");
+                resume_task = true;
+            }
+
+            if (resume_task && !exit_task)
+            {
+                CNGW_Config_Request_Frame_t Frame;
+                CCP_UTIL_Get_Msg_Header(&Frame.header, CNGW_HEADER_TYPE_Configuration_Request_Command, sizeof(Frame.message));
+                Frame.message.command = next_expected_command;
+                Frame.message.slot = next_expected_slot;
+                Frame.message.crc = CCP_UTIL_Get_Crc8(0, (uint8_t *)&(Frame.message), sizeof(Frame.message) - sizeof(Frame.message.crc));
+                consume_GW_message((uint8_t *)&Frame);
+                resume_task = false;
+                lastRequestTick = currentTick;
+            }
+
+            if (exit_task)
+            {
+                ESP_LOGI(TAG, "Exiting the configuration request loop");
+                break;
+            }
+
+            // sleeps until the next message of the mainboard is handled, or it is time to resend or to time out
+            TickType_t elapsedTicks = xTaskGetTickCount() - lastRequestTick;
+            TickType_t waitTicks = (elapsedTicks > 100) ? 1 : 101 - elapsedTicks;
+            TickType_t remainingTicks = beginningTick + timeout_ticks + 1 - xTaskGetTickCount();
+            if ((int32_t)remainingTicks > 0 && remainingTicks < waitTicks)
+            {
+                waitTicks = remainingTicks;
+            }
+            ulTaskNotifyTake(pdTRUE, waitTicks);
         }
 
-        if (exit_task)
+        // a late message of the mainboard may still notify the task, only a new request starts it again
+        request_running = false;
+        while (!request_running)
         {
-            ESP_LOGI(TAG, "Exiting the configuration request loop");
-            ConfigTask = NULL;
-            vTaskDelete(ConfigTask);
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
         }
-
-        vTaskDelay(10 / portTICK_RATE_MS);
     }
 }
 
@@ -594,6 +620,10 @@ void Handle_Configuration_Information_Message(const uint8_t *recvbuf)
         }
         
         resume_task = true;
+        if (ConfigTask != NULL)
+        {
+            xTaskNotifyGive(ConfigTask);
+        }
     }
 }
 #endif
\ No newline at end of file
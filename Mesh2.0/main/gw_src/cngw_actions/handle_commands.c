@@ -120,8 +120,17 @@ size_t Parse_1_Frame(uint8_t *packet, size_t dataSize)
                         ESP_LOGI(TAG, "status_mask: %u", frame.message.status_mask); // bitwise
                         printBits(frame.message.status_mask);
                     }
-                    //  save information to the cn_board_info
-                    cn_board_info.channel_status[frame.message.address.target_address] = frame.message;
+                    //  save information to the cn_board_info, and publish the status of the channel when it changes
+                    if (frame.message.address.target_address < NUM_DR_CHANNELS)
+                    {
+                        CNGW_Update_Channel_Status_Message_t *channel_status = &cn_board_info.channel_status[frame.message.address.target_address];
+                        bool changed = (channel_status->command_type != CNGW_UPDATE_CMD_Status || channel_status->status_mask != frame.message.status_mask);
+                        *channel_status = frame.message;
+                        if (changed)
+                        {
+                            Send_GW_Status_to_AWS(frame.message.address.target_address, frame.message.status_mask, false);
+                        }
+                    }
                 }
             }
             else if (frame.message.command_type == CNGW_UPDATE_CMD_Attribute)
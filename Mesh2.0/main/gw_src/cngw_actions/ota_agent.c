@@ -611,6 +611,19 @@ static bool print_all_frame_info        = true;
 #else
 static bool print_all_frame_info        = false;
 #endif
+static uint32_t ota_agent_streamed_crc  = 0;
+static bool ota_agent_streamed_crc_valid = false;
+
+/**
+ * @brief stores the CRC of the FW calculated while it was written to memory, so it does not need to be read back from flash
+ *  only valid until the next call of update_ota_data_length_to_be_expected
+ * @param crc[in] the CRC (CENSE_CRC32_Accumulate) of the whole FW
+ */
+void ota_set_streamed_crc(uint32_t crc)
+{
+    ota_agent_streamed_crc          = crc;
+    ota_agent_streamed_crc_valid    = true;
+}
 
 /**
  * @brief SIM7080 begins the OTA FW update process
@@ -704,6 +717,7 @@ esp_err_t update_ota_data_length_to_be_expected(size_t data)
     // 2. Update global variables with required values
     ota_agent_core_data_length = data;
     ota_agent_core_total_received_data_len = 0;
+    ota_agent_streamed_crc_valid = false;
 
     // 3. begin erasing the required sectors
     // 3.1. calculate the number of sectors required for the erase operation
@@ -851,7 +865,8 @@ bool SIM7080_do_Mainboard_OTA()
     // once we know how to encrypt the FW, we can add the proper CRC value here, which the target MCUs will check as a final validation. 
     if (ota_agent_core_target_MCU != CNGW_FIRMWARE_BINARY_TYPE_sw_mcu)
     {
-        binary_file.binary_full_crc = calculate_total_crc(binary_file.initial_ptr , binary_file.binary_size);
+        // the CRC may already be calculated while the FW was streamed to memory
+        binary_file.binary_full_crc = ota_agent_streamed_crc_valid ? ota_agent_streamed_crc : calculate_total_crc(binary_file.initial_ptr , binary_file.binary_size);
     }
     else
     {
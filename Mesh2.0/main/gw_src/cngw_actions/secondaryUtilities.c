@@ -15,6 +15,7 @@
 
 #if defined(GATEWAY_SIM7080) || defined(GATEWAY_ETH)
 #include "gw_includes/secondaryUtilities.h"
+#include "includes/command_registry.h"
 static const char *TAG = "sec_utilities";
 #ifdef GW_DEBUGGING
 static bool Print_Info = true;
@@ -25,102 +26,155 @@ static bool Print_Info = false;
 #ifdef GATEWAY_SIM7080
 
 /**
- * @brief helper function to obtain valueInt from cjVals to arrvals
+ * @brief checks a message taken from the queue SIM7080_AWS_Tx_queue and finds its topic
+ * @param pBuffer[in] the message
+ * @param success[out] true if it is a success message, false if it is a fail message
+ * @return the message to be published, or NULL if it must be dropped
  */
-static void SIM7080_ParseArrVal(cJSON *cjVals, uint8_t *arrvals)
+static char *SIM7080_AWS_Tx_check_message(char *pBuffer, bool *success)
 {
-    cJSON *Iterator = NULL;
-    uint8_t count = 0;
-    cJSON_ArrayForEach(Iterator, cjVals)
+    char *message = NULL;
+    cJSON *json = cJSON_Parse(pBuffer);
+    cJSON *cjCommand = cJSON_GetObjectItemCaseSensitive(json, "cmnd");
+
+    // check for validity of the contents. 64 is a success message, 65 is a fail message
+    if (cJSON_IsNumber(cjCommand) && (cjCommand->valueint == 64 || cjCommand->valueint == 65))
     {
-        if (cJSON_IsNumber(Iterator))
+        *success = (cjCommand->valueint == 64);
+        if (Print_Info)
+        {
+            ESP_LOGI(TAG, "Sending %s message to AWS: %s", *success ? "SUCCESS" : "FAIL", pBuffer);
+        }
+
+        // only send the message if it is within the valid size
+        if (strlen(pBuffer) <= AWS_Tx_BUFFER_SIZE)
         {
-            arrvals[count] = (uint8_t)Iterator->valueint;
-            count++;
+            message = pBuffer;
+        }
+        else
+        {
+            if(Print_Info)
+            {
+                ESP_LOGE(TAG, "Tx buffer size exceeds the allowed limit");
+            }
+            *success = false;
+            message = "{\nTx buffer size exceeds the allowed limit\n}";
         }
     }
+
+    cJSON_Delete(json);
+    return message;
 }
 
+static char journal_topic[UPLINK_JOURNAL_MAX_TOPIC + 1];
+static char journal_payload[UPLINK_JOURNAL_MAX_PAYLOAD + 1];
+
 /**
  * @brief Task which handles sending response to AWS with SIM7080 interface
- * loops continuously. if there is a message in the queue SIM7080_AWS_Tx_queue, then:
- * gets the message from the queue
- * create a NodeStruct_t struct out of it
- * call function SIM7080_send_AWS_message based on whether it is a success ort a fail message
+ * blocks until there is a message in the queue SIM7080_AWS_Tx_queue, then:
+ * gets the message from the queue, together with up to AWS_Tx_BATCH_MESSAGES which are already waiting
+ * checks each message and finds whether it is a success or a fail message
+ * call function SIM7080_send_AWS_messages, which batches and pipelines the publishes
+ * 
+ * while the SIM is not connected to AWS, or if the publish fails, the messages are kept in the uplink journal.
+ * once connected, the queue is polled every UPLINK_JOURNAL_DRAIN_INTERVAL and the oldest message of the journal
+ * is sent whenever the queue is empty. A message is removed from the journal only after it is published
  */
 void SIM7080_AWS_Tx_task(void *pvParameters)
 {
-    char *pBuffer = NULL;
+    char *pBuffer[AWS_Tx_BATCH_MESSAGES];
+    char *messages[AWS_Tx_BATCH_MESSAGES];
+    bool success[AWS_Tx_BATCH_MESSAGES];
+    bool sent[AWS_Tx_BATCH_MESSAGES];
+    uint32_t batches = 0;
+
+    while (SIM7080_AWS_Tx_queue == NULL)
+    {
+        vTaskDelay(100 / portTICK_RATE_MS);
+    }
+
     while (true)
     {
-        // check if there is any messages in the queue
-        if (SIM7080_AWS_Tx_queue != NULL)
+        uint8_t received = 0;
+        uint8_t count = 0;
+        bool from_journal = false;
+        bool connected = SIM_Get_Context()->connected_to_AWS;
+        TickType_t wait = (connected && UplinkJournal_Pending() > 0) ? (UPLINK_JOURNAL_DRAIN_INTERVAL / portTICK_RATE_MS) : portMAX_DELAY;
+
+        // 1. wait for a message, then take the ones which are already queued behind it. if the queue stays empty, take the oldest message of the journal
+        if (xQueueReceive(SIM7080_AWS_Tx_queue, &pBuffer[received], wait) == pdTRUE)
         {
-            // get the message to the pBuffer mem location
-            if (xQueueReceive(SIM7080_AWS_Tx_queue, &pBuffer, (TickType_t)0))
+            received++;
+            while (received < AWS_Tx_BATCH_MESSAGES && xQueueReceive(SIM7080_AWS_Tx_queue, &pBuffer[received], (TickType_t)0) == pdTRUE)
             {
-                // create the struct
-                NodeStruct_t *structNodeReceived = malloc(sizeof(NodeStruct_t));
-                cJSON *json = cJSON_Parse(pBuffer);
-                cJSON *cjCommand = cJSON_GetObjectItemCaseSensitive(json, "cmnd");
-
-                // check for validity of the contents
-                if (cJSON_IsNumber(cjCommand))
-                {
-                    // if it is a success message
-                    if (cjCommand->valueint == 64)
-                    {
-                        if (Print_Info)
-                        {
-                            ESP_LOGI(TAG, "Sending SUCCESS message to AWS: %s", pBuffer);
-                        }
+                received++;
+            }
+        }
+        else if (UplinkJournal_Peek(journal_topic, sizeof(journal_topic), journal_payload, sizeof(journal_payload), NULL, NULL) == ESP_OK)
+        {
+            pBuffer[received++] = journal_payload;
+            from_journal = true;
+        }
+        else
+        {
+            continue;
+        }
 
-                        // only send the message if it is within the valid size
-                        if (strlen(pBuffer) <= AWS_Tx_BUFFER_SIZE)
-                        {
-                            SIM7080_send_AWS_message(pBuffer, true);
-                        }
-                        else
-                        {
-                            if(Print_Info)
-                            {
-                                ESP_LOGE(TAG, "Tx buffer size exceeds the allowed limit");
-                            }
+        // 2. check the messages
+        for (uint8_t i = 0; i < received; i++)
+        {
+            messages[count] = SIM7080_AWS_Tx_check_message(pBuffer[i], &success[count]);
+            if (messages[count] != NULL)
+            {
+                count++;
+            }
+        }
 
-                            SIM7080_send_AWS_message("{\nTx buffer size exceeds the allowed limit\n}", false);
-                        }
-                    }
+        // 3. publish them. if there is no connection to AWS, do not wait for the publish to time out
+        esp_err_t status = ESP_OK;
+        if (count > 0)
+        {
+            connected = SIM_Get_Context()->connected_to_AWS;
+            memset(sent, 0, sizeof(sent));
+            status = (connected || !UplinkJournal_IsAvailable()) ? SIM7080_send_AWS_messages(messages, success, count, sent) : ESP_FAIL;
+            if (Print_Info && (++batches % AWS_PUBLISH_METRICS_INTERVAL) == 0)
+            {
+                SIM7080_print_publish_metrics();
+                UplinkJournal_PrintMetrics();
+            }
+        }
 
-                    // if it is a fail message
-                    else if (cjCommand->valueint == 65)
-                    {
-                        if (Print_Info)
-                        {
-                            ESP_LOGI(TAG, "Sending FAIL message to AWS: %s", pBuffer);
-                        }
+        // 4. a message from the journal stays there until it is sent. new messages which were not sent go to the journal,
+        //    the ones of the batch which were published are not journaled again
+        if (from_journal)
+        {
+            if (status == ESP_OK)
+            {
+                UplinkJournal_Consume();
+            }
+            else
+            {
+                // the message is kept, wait for the next poll before retrying
+                vTaskDelay(UPLINK_JOURNAL_DRAIN_INTERVAL / portTICK_RATE_MS);
+            }
+            continue;
+        }
 
-                        // only send the message if it is within the valid size
-                        if (strlen(pBuffer) <= AWS_Tx_BUFFER_SIZE)
-                        {
-                            SIM7080_send_AWS_message(pBuffer, false);
-                        }
-                        else
-                        {
-                            if(Print_Info)
-                            {
-                                ESP_LOGE(TAG, "Tx buffer size exceeds the allowed limit");
-                            }
-                            SIM7080_send_AWS_message("{\nTx buffer size exceeds the allowed limit\n}", false);
-                        }
-                    }
+        if (status != ESP_OK)
+        {
+            for (uint8_t i = 0; i < count; i++)
+            {
+                if (!sent[i])
+                {
+                    UplinkJournal_Append("", messages[i], strlen(messages[i]));
                 }
-                
-                cJSON_Delete(json);
-                free(structNodeReceived);
-                vPortFree(pBuffer);
             }
         }
-        vTaskDelay(10 / portTICK_RATE_MS); // Leave this for watchdog
+
+        for (uint8_t i = 0; i < received; i++)
+        {
+            vPortFree(pBuffer[i]);
+        }
     }
 }
 
@@ -136,77 +190,55 @@ void SIM7080_AWS_Tx_task(void *pvParameters)
  */
 void SIM7080_CommandExecutionTask(void *arg)
 {
+    static CommandQueue_Latency_t latency = COMMAND_QUEUE_LATENCY_INIT("SIM7080CommandExecution");
+    static CommandMessage_t commandMessage;
+    MsgBuffer *message = NULL;
     char *cptrNodeData = NULL;
-    bool isArray = false;
+    NodeStruct_t structNodeReceived;
     while (true)
     {
         if (SIM7080_AWS_Rx_queue != NULL)
         {
-            if (xQueueReceive(SIM7080_AWS_Rx_queue, &cptrNodeData, (TickType_t)0))
+            //sleeps until a command comes
+            if ((message = CommandQueue_Receive(SIM7080_AWS_Rx_queue, portMAX_DELAY, &latency)) != NULL)
             {
-                NodeStruct_t *structNodeReceived = malloc(sizeof(NodeStruct_t));
-                cJSON *json = cJSON_Parse(cptrNodeData);
-
-                if (json == NULL)
+                // the JSON part of the "+SMSUB:" line, NUL terminated in the pooled buffer
+                cptrNodeData = (char *)&message->data[message->payloadOffset];
+                if (!CommandParser_Parse(cptrNodeData, &commandMessage))
                 {
-                    const char *error_ptr = cJSON_GetErrorPtr();
-                    if (error_ptr != NULL)
-                    {
-                        ESP_LOGE(TAG, "Error while parsing SIM7080_CommandExecutionTask");
-                    }
+                    ESP_LOGE(TAG, "Error while parsing SIM7080_CommandExecutionTask");
                     SecondaryUtilities_PrepareJSONAndSendToAWS(65, 0, cptrNodeData);
                 }
-                else
+                else if (COMMAND_FIELDS_HAVE(&commandMessage, COMMAND_FIELD_CMND | COMMAND_FIELD_STR) &&
+                         (commandMessage.fields & (COMMAND_FIELD_VAL | COMMAND_FIELD_VALS)))
                 {
-                    // Parse data
-                    cJSON *cjCommand = cJSON_GetObjectItemCaseSensitive(json, "cmnd");
-                    if (cJSON_IsNumber(cjCommand))
+                    structNodeReceived.ubyCommand = commandMessage.command;
+                    structNodeReceived.dValue = commandMessage.value;
+                    structNodeReceived.arrValues = (commandMessage.fields & COMMAND_FIELD_VALS) ? commandMessage.values : NULL;
+                    structNodeReceived.arrValueSize = commandMessage.valueCount;
+                    structNodeReceived.cptrString = commandMessage.string;
+                    bool returnVal = SecondaryUtilities_ValidateAndExecuteCommand(&structNodeReceived);
+                    if (returnVal)
                     {
-                        structNodeReceived->ubyCommand = cjCommand->valueint;
-                        cJSON *cjValue = cJSON_GetObjectItemCaseSensitive(json, "val");
-                        if (cJSON_IsNumber(cjValue) || cJSON_IsArray(cjValue))
-                        {
-                            structNodeReceived->dValue = cjValue->valuedouble;
-                            structNodeReceived->arrValueSize = 0;
-                            if (cJSON_IsArray(cjValue))
-                            {
-                                isArray = true;
-                                structNodeReceived->arrValueSize = cJSON_GetArraySize(cjValue);
-                                structNodeReceived->arrValues = malloc(cJSON_GetArraySize(cjValue) * sizeof(uint8_t));
-                                SIM7080_ParseArrVal(cjValue, structNodeReceived->arrValues);
-                            }
-                            cJSON *cjString = cJSON_GetObjectItemCaseSensitive(json, "str");
-                            if (cJSON_IsString(cjString))
-                            {
-                                structNodeReceived->cptrString = cjString->valuestring;
-                                bool returnVal = SecondaryUtilities_ValidateAndExecuteCommand(structNodeReceived);
-                                if (returnVal)
-                                {
-                                    SecondaryUtilities_PrepareJSONAndSendToAWS(64, 0, cptrNodeData);
-                                }
-                                else
-                                {
-                                    SecondaryUtilities_PrepareJSONAndSendToAWS(65, 0, cptrNodeData);
-                                }
-                                goto NodeOperations_CommandExecutionTask_End;
-                            }
-                        }
+                        SecondaryUtilities_PrepareJSONAndSendToAWS(64, 0, cptrNodeData);
                     }
-
+                    else
+                    {
                         SecondaryUtilities_PrepareJSONAndSendToAWS(65, 0, cptrNodeData);
+                    }
                 }
-            NodeOperations_CommandExecutionTask_End:
-                cJSON_Delete(json);
-                vPortFree(cptrNodeData);
-                free(structNodeReceived);
-                if (isArray)
+                else
                 {
-                    free(structNodeReceived->arrValues);
-                    isArray = false;
+                    SecondaryUtilities_PrepareJSONAndSendToAWS(65, 0, cptrNodeData);
                 }
+                CommandParser_Release(&commandMessage);
+                MsgBuffer_Release(message);
             }
         }
-        vTaskDelay(10 / portTICK_RATE_MS); //Leave this for watchdog
+        else
+        {
+            vTaskDelay(100 / portTICK_RATE_MS); //the queue is not created yet
+        }
     }
 }
 
@@ -238,17 +270,19 @@ void SecondaryUtilities_PrepareJSONAndSendToAWS(uint16_t ubyCommand, uint32_t uw
             {
                 ESP_LOGE(TAG, "SIM7080_AWS_Tx_queue Queue is full");
             }
+            // keep the message until the queue is drained
+            UplinkJournal_Append("", payload, strlen(payload));
             vPortFree(payload);
         }
     }
 #else
     if(ubyCommand == 64)
     {
-        RootUtilities_SendDataToAWS(controlLogTopicSuccess, payload);
+        RootUtilities_SendDataToAWS(AWS_TOPIC_CONTROL_SUCCESS, payload);
     }
     else
     {
-        RootUtilities_SendDataToAWS(controlLogTopicFail, payload);
+        RootUtilities_SendDataToAWS(AWS_TOPIC_CONTROL_FAIL, payload);
     }
 
     vPortFree(payload);
@@ -259,67 +293,23 @@ void SecondaryUtilities_PrepareJSONAndSendToAWS(uint16_t ubyCommand, uint32_t uw
 
 bool SecondaryUtilities_ValidateAndExecuteCommand(NodeStruct_t *structNodeReceived)
 {
-    bool result = false;
-    
     if (Print_Info)
     {
         ESP_LOGI(TAG, "Command Received: %d", structNodeReceived->ubyCommand);
     }
 
-    switch(structNodeReceived->ubyCommand)
+    //only the GW commands which are allowed from AWS. the node commands and the OTA of the GW come through the mesh
+    const CommandRegistry_Entry_t *entry = CommandRegistry_Lookup(structNodeReceived->ubyCommand, COMMAND_NODE_GATEWAY, COMMAND_SOURCE_AWS);
+    if (entry == NULL)
     {
-#ifndef IPNODE
-#ifdef GATEWAY_SIM7080
-        // only for a GW defined as SIM7080
-        case 61:
-        {
-            // OTA command
-            result = SIM7080_UpdateNodeFW(structNodeReceived);
-
-        }break;
-#endif
-#endif
-        case 220:
-        {
-            //action command
-            result = GW_Process_Action_Command(structNodeReceived);
-        }
-        break;
-        case 221:
-        {
-            //query command
-            result = GW_Process_Query_Command(structNodeReceived);
-        }
-        break;
-
-        case 222:
-        {
-            //OTA begin command (for NODE)
-            result = false;
-        }
-        break;
-
-        case 224:
-        {
-            //OTA END command (for NODE)
-            result = false;
-        }
-        break;
-
-        case 225:
-        {
-            //AT command
-            result = GW_Process_AT_Command(structNodeReceived);
-        }
-        break;
-        default:
-        {
-            ESP_LOGE(TAG, "Incorrect Command Received.");
-        }
-        break;
+        ESP_LOGE(TAG, "Incorrect Command Received.");
+        return false;
     }
-
-    return result;
+    if (!CommandRegistry_CheckArguments(entry, structNodeReceived->cptrString, structNodeReceived->arrValues, NULL))
+    {
+        return false;
+    }
+    return entry->node_fun(structNodeReceived);
 }
 
 #endif
\ No newline at end of file
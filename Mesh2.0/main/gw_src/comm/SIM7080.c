@@ -27,9 +27,11 @@ TaskHandle_t SIM7080_internet_handler;
 TimerHandle_t SIM7080_internet_reconnection_handler;
 QueueHandle_t SIM7080_AWS_Tx_queue;
 QueueHandle_t SIM7080_AWS_Rx_queue;
+MsgBufferPool SIM7080_AWS_Rx_pool;
 uint8_t recieved_data_from_SIM7080[UART_BUF_SIZE];
-bool temp_block_SIM7080_msg_preprocessor = false;
 int SIM7080_OTA_data_recieved_length     = 0;
+SIM7080_publish_metrics_t SIM7080_publish_metrics = {0};
+static bool SIM7080_reset_on_next_session = false;
 char *substring_end;
 char *substring_start;
 
@@ -52,6 +54,7 @@ esp_err_t init_SIM7080()
     GW_SIM7080.config.wakeup_pin        = SIM7080_PULSE;
     GW_SIM7080.config.uart_buffer_size  = UART_BUF_SIZE;
     GW_SIM7080.config.queue_length      = UART_QUEUE_LENGTH;
+    GW_SIM7080.config.pipeline_depth    = SIM7080_PIPELINE_DEPTH;
     GW_SIM7080.config.uart_port         = SIM7080_UART_PORT;
     GW_SIM7080.log.print_Tx_info        = Print_Info;
     GW_SIM7080.log.print_Rx_info        = Print_Info;
@@ -60,6 +63,13 @@ esp_err_t init_SIM7080()
     GW_SIM7080.comm.pre_process_recieved_message = SIM7080_msg_preprocessor;
     GW_SIM7080.is_busy                  = false;
 
+    result = SIM7080_init_URC_handlers();
+    if(result !=ESP_OK)
+    {
+        ESP_LOGE(TAG, "Error building the URC table");
+        return ESP_FAIL;
+    }
+
     result = SIM7080_setup(&GW_SIM7080);
     if(result !=ESP_OK)
     {
@@ -78,9 +88,9 @@ esp_err_t init_SIM7080()
         return ESP_FAIL;
     }
 
-    // 5. created a recieve queue with maxumum of 5 commands
-    SIM7080_AWS_Rx_queue = xQueueCreate(5, sizeof(char *));
-    if (SIM7080_AWS_Rx_queue == NULL)
+    // 5. created a recieve queue with maxumum of 5 commands. the commands are kept in pooled buffers, one more than the queue for the command being executed
+    SIM7080_AWS_Rx_queue = CommandQueue_Create(AWS_Rx_QUEUE_LENGTH);
+    if (SIM7080_AWS_Rx_queue == NULL || MsgBuffer_InitPool(&SIM7080_AWS_Rx_pool, "SIM7080_AWS_Rx", AWS_Rx_QUEUE_LENGTH + 1, AWS_Rx_BUFFER_SIZE) != ESP_OK)
     {
         ESP_LOGE(TAG, "Could not create SIM AWS Rx queue");
         return ESP_FAIL;
@@ -89,7 +99,10 @@ esp_err_t init_SIM7080()
     // 6. create task to execute commands
     xTaskCreate(SIM7080_CommandExecutionTask, "SIM7080_CommandExecutionTask", 5120, NULL, 4, NULL);
 
-    // 7. create tasks to send messages to aws
+    // 7. open the journal which keeps the messages to aws while the SIM has no connection. without it, they are dropped
+    UplinkJournal_Init();
+
+    // 8. create tasks to send messages to aws
     xTaskCreate(SIM7080_AWS_Tx_task, "SIM7080_AWS_Tx_task", 3000, NULL, 5, NULL);
 
     return result;
@@ -130,213 +143,149 @@ void SIM7080_Connect_to_Internet_And_AWS(void *timer)
 }
 
 /**
- * @brief       decodes and filter out incoming information from SIM module. The number of "\r\n" is 2
- * @param data  pointer to the information
+ * @brief  find the positions of "\r\n" in a response, without copying it
+ * @param data[in] the response. must be NUL terminated
+ * @param br_positions[out] the positions found
+ * @param max_occurances[in] size of br_positions. the search stops here
+ * @return number of "\r\n" found. 0 if the response does not begin with a header
  */
-esp_err_t SIM7080_Process_Type_01_Data(uint8_t *data)
+static uint8_t SIM7080_Find_Line_Breaks(const uint8_t *data, uint16_t *br_positions, uint8_t max_occurances)
 {
-    // 1. initialize function specific variables
     uint8_t number_br_occurances = 0;
-    uint8_t br_positions[4] = {0};
+    const char *start = (const char *)data;
 
-    // 2. identify the position of the begining of the message
-    char *start = (char *)data;
-
-    // 3. from the beginning to the end of the message, increment the position in steps of 2 and calculate the number of times "\r\n" occurs.
-    // record this number as the number of br occurances. Also, record these indexes as well
-    while ((start = strstr(start, "\r\n")) != NULL)
+    // from the beginning to the end of the message, record the indexes where "\r\n" occurs
+    while (number_br_occurances < max_occurances && (start = strstr(start, "\r\n")) != NULL)
     {
-        br_positions[number_br_occurances] = (int)(start - (char *)data);
-        number_br_occurances++;
-        // for safety, stop the iteration at 4 max occurances
-        if (number_br_occurances == 4)
-        {
-            break;
-        }
+        br_positions[number_br_occurances++] = (uint16_t)(start - (const char *)data);
         start += 2;
     }
 
-    // 4. if there were no "\r\n" occurances, then set the number of occurances to zero
-    if (br_positions[0] == 0)
+    // if the response begins with "\r\n", there is no header
+    if (number_br_occurances > 0 && br_positions[0] == 0)
     {
         number_br_occurances = 0;
     }
+    return number_br_occurances;
+}
 
-    // 5. make sure the recieved data has only 2 /r/n.
-    if (number_br_occurances != 2)
+/**
+ * @brief  check if the status part of a response is "OK"
+ * @return ESP_OK if it is
+ */
+static esp_err_t SIM7080_Check_Status(const uint8_t *status, uint16_t status_length)
+{
+    // before checking, make sure the length of the status is atleast 2 bytes
+    if (status_length >= 2 && status[0] == 'O' && status[1] == 'K')
     {
-        return ESP_FAIL;
+        return ESP_OK;
     }
+    return ESP_FAIL;
+}
 
-    // 5. handle decoding according to the number of "\r\n" occurances found
-
-    // initialize and assign values to header, response, status variables
-    uint8_t header_start_pos = 0;
-    uint8_t header_end_pos = br_positions[0];
-    uint8_t status_start_pos = br_positions[0] + 2;
-    uint8_t status_end_pos = br_positions[1];
-    uint8_t *header = (uint8_t *)malloc((header_end_pos - header_start_pos) * sizeof(uint8_t));
-    uint8_t *status = (uint8_t *)malloc((status_end_pos - status_start_pos) * sizeof(uint8_t));
-
-    // check for successful memory allocation
-    if (header == NULL || status == NULL)
+/**
+ * @brief       decodes and filter out incoming information from SIM module. The number of "\r\n" is 2
+ *  the parts of the response are located in place, nothing is copied
+ * @param data  pointer to the information
+ */
+esp_err_t SIM7080_Process_Type_01_Data(uint8_t *data)
+{
+    // 1. find the "\r\n" occurances. make sure the recieved data has only 2 /r/n
+    uint16_t br_positions[4] = {0};
+    if (SIM7080_Find_Line_Breaks(data, br_positions, 4) != 2)
     {
-        ESP_LOGE(TAG, "Error allocating dynamic memory");
-        free(header);
-        free(status);
         return ESP_FAIL;
     }
 
-    // copy data to dynamic memory
-    memcpy(header, &data[header_start_pos], (header_end_pos - header_start_pos));
-    memcpy(status, &data[status_start_pos], (status_end_pos - status_start_pos));
+    // 2. locate header and status
+    uint16_t header_length      = br_positions[0];
+    uint16_t status_start_pos   = br_positions[0] + 2;
+    uint16_t status_length      = br_positions[1] - status_start_pos;
 
     // print data if needed
     if (Print_Info)
     {
-        printf("Rx data below:\nHEADER:\t\t");
-        for (uint8_t i = 0; i < (header_end_pos - header_start_pos); i++)
-        {
-            printf("%c", header[i]);
-        }
-
-        printf("\nSTATUS:\t\t");
-        for (uint8_t i = 0; i < (status_end_pos - status_start_pos); i++)
-        {
-            printf("%c", status[i]);
-        }
-        printf("\n");
-    }
-
-    // checking of the response from SIM module is an "OK" command
-    // before checking, make sure the length of the status array is atleast 2 bytes
-    esp_err_t result = ESP_FAIL;
-    if (status_end_pos - status_start_pos >= 2)
-    {
-        // the uint8_t values of ASCII "OK" is 79 and 75. therefore comparing the integer values directly
-        if (status[0] == 79 && status[1] == 75)
-        {
-            result = ESP_OK;
-        }
+        printf("Rx data below:\nHEADER:\t\t%.*s\nSTATUS:\t\t%.*s\n", header_length, (char *)data, status_length, (char *)&data[status_start_pos]);
     }
 
-    // free memory resources
-    free(header);
-    free(status);
-
-    return result;
+    // 3. checking of the response from SIM module is an "OK" command
+    return SIM7080_Check_Status(&data[status_start_pos], status_length);
 }
 
 /**
  * @brief        decodes and filter out incoming information from SIM module. The number of "\r\n" is 4
+ *  the parts of the response are located in place, nothing is copied
  * @param data   pointer to the information
  */
 esp_err_t SIM7080_Process_Type_02_Data(uint8_t *data)
 {
-    // 1. initialize function specific variables
-    uint8_t number_br_occurances = 0;
-    uint8_t br_positions[4] = {0};
-
-    // 2. identify the position of the begining of the message
-    char *start = (char *)data;
-
-    // 3. from the beginning to the end of the message, increment the position in steps of 2 and calculate the number of times "\r\n" occurs.
-    // record this number as the number of br occurances. Also, record these indexes as well
-    while ((start = strstr(start, "\r\n")) != NULL)
+    // 1. find the "\r\n" occurances. make sure the recieved data has only 4 /r/n
+    uint16_t br_positions[4] = {0};
+    if (SIM7080_Find_Line_Breaks(data, br_positions, 4) != 4)
     {
-        br_positions[number_br_occurances] = (int)(start - (char *)data);
-        number_br_occurances++;
-        // for safety, stop the iteration at 4 max occurances
-        if (number_br_occurances == 4)
-        {
-            break;
-        }
-        start += 2;
+        return ESP_FAIL;
     }
 
-    // 4. if there were no "\r\n" occurances, then set the number of occurances to zero
-    if (br_positions[0] == 0)
-    {
-        number_br_occurances = 0;
-    }
+    // 2. locate header, response and status
+    uint16_t header_length      = br_positions[0];
+    uint16_t response_start_pos = br_positions[0] + 2;
+    uint16_t response_length    = br_positions[1] - response_start_pos;
+    uint16_t status_start_pos   = br_positions[2] + 2;
+    uint16_t status_length      = br_positions[3] - status_start_pos;
 
-    // 5. make sure the recieved data has only 4 /r/n.
-    if (number_br_occurances != 4)
+    // print data if needed
+    if (Print_Info)
     {
-        return ESP_FAIL;
+        printf("Rx data below:\nHEADER:\t\t%.*s\nRESPONSE:\t%.*s\nSTATUS:\t\t%.*s\n", header_length, (char *)data,
+               response_length, (char *)&data[response_start_pos], status_length, (char *)&data[status_start_pos]);
     }
 
-    // 5. handle decoding according to the number of "\r\n" occurances found
+    // 3. checking of the response from SIM module is an "OK" command
+    return SIM7080_Check_Status(&data[status_start_pos], status_length);
+}
+
 
-    // initialize and assign values to header, response, status variables
-    uint8_t header_start_pos = 0;
-    uint8_t header_end_pos = br_positions[0];
-    uint8_t response_start_pos = br_positions[0] + 2;
-    uint8_t response_end_pos = br_positions[1];
-    uint8_t status_start_pos = br_positions[2] + 2;
-    uint8_t status_end_pos = br_positions[3];
-    uint8_t *header = (uint8_t *)malloc((header_end_pos - header_start_pos) * sizeof(uint8_t));
-    uint8_t *response = (uint8_t *)malloc((response_end_pos - response_start_pos) * sizeof(uint8_t));
-    uint8_t *status = (uint8_t *)malloc((status_end_pos - status_start_pos) * sizeof(uint8_t));
 
-    // check for successful memory allocation
-    if (header == NULL || response == NULL || status == NULL)
-    {
-        ESP_LOGE(TAG, "Error allocating dynamic memory");
-        free(header);
-        free(response);
-        free(status);
-        return ESP_FAIL;
-    }
+/**
+ * @brief  completion of a command sent by SIM7080_Submit_AT_CMD. frees the resources of the command
+ */
+static void SIM7080_Submitted_AT_CMD_Done(SIM7080_AT_cmd_t *cmd)
+{
+    free(cmd);
+}
 
-    // copy data to dynamic memory
-    memcpy(header, &data[header_start_pos], (header_end_pos - header_start_pos));
-    memcpy(response, &data[response_start_pos], (response_end_pos - response_start_pos));
-    memcpy(status, &data[status_start_pos], (status_end_pos - status_start_pos));
+/**
+ * @brief  queue a command to the SIM module without waiting for the response
+ * @param command[in] the command. it is copied, so the caller can free it right after
+ * @return ESP_OK if queued
+ */
+esp_err_t SIM7080_Submit_AT_CMD(char *command)
+{
+    size_t command_length = strlen(command);
 
-    // print data if needed
-    if (Print_Info)
+    // 1. the command and its text share one allocation, which is freed on completion
+    SIM7080_AT_cmd_t *cmd = (SIM7080_AT_cmd_t *)calloc(1, sizeof(SIM7080_AT_cmd_t) + command_length);
+    if (cmd == NULL)
     {
-        printf("Rx data below:\nHEADER:\t\t");
-        for (uint8_t i = 0; i < (header_end_pos - header_start_pos); i++)
-        {
-            printf("%c", header[i]);
-        }
-        printf("\nRESPONSE:\t");
-        for (uint8_t i = 0; i < (response_end_pos - response_start_pos); i++)
-        {
-            printf("%c", response[i]);
-        }
-        printf("\nSTATUS:\t\t");
-        for (uint8_t i = 0; i < (status_end_pos - status_start_pos); i++)
-        {
-            printf("%c", status[i]);
-        }
-        printf("\n");
+        ESP_LOGE(TAG, "dynamic memory allocation error");
+        return ESP_FAIL;
     }
+    memcpy((uint8_t *)(cmd + 1), command, command_length);
 
-    // checking of the response from SIM module is an "OK" command
-    // before checking, make sure the length of the status array is atleast 2 bytes
-    esp_err_t result = ESP_FAIL;
-    if (status_end_pos - status_start_pos >= 2)
+    // 2. queue the command
+    cmd->message    = (uint8_t *)(cmd + 1);
+    cmd->length     = command_length;
+    cmd->timeout    = 30000;
+    cmd->callback   = SIM7080_Submitted_AT_CMD_Done;
+    if (SIM7080_AT_submit(cmd) != ESP_OK)
     {
-        // the uint8_t values of ASCII "OK" is 79 and 75. therefore comparing the integer values directly
-        if (status[0] == 79 && status[1] == 75)
-        {
-            result = ESP_OK;
-        }
+        free(cmd);
+        return ESP_FAIL;
     }
 
-    // free memory resources
-    free(header);
-    free(response);
-    free(status);
-
-    return result;
+    return ESP_OK;
 }
 
-
-
 /**
  * @brief  consume messages comming from AWS to validate to be sent to SIM module
  * if the expected number of commands is 0, success message sent to AWS
@@ -349,8 +298,15 @@ esp_err_t Execute_AT_CMD(char *command, uint8_t num_commands)
     LED_change_task_momentarily(CNGW_LED_CMD_BUSY, CNGW_LED_COMM, LED_CHANGE_MOMENTARY_DURATION);
     if (num_commands == 0)
     {   
-        consume_SIM7080_message((uint8_t *)command, strlen(command));
-        Send_GW_message_to_AWS(64, 0, "Command sent to SIM");
+        // fire and forget. the engine owns a copy of the command until the modem replies
+        if (SIM7080_Submit_AT_CMD(command) == ESP_OK)
+        {
+            Send_GW_message_to_AWS(64, 0, "Command sent to SIM");
+        }
+        else
+        {
+            Send_GW_message_to_AWS(65, 0, "failed to send command to SIM");
+        }
     }
     else
     {
@@ -371,38 +327,123 @@ esp_err_t Execute_AT_CMD(char *command, uint8_t num_commands)
 }
 
 /**
- * @brief  Uploads the Certificates to the SIM module
+ * @brief  poll the SIM module with AT until it responds. replaces waiting a fixed time after a reset
+ * @param timeout[in] max time to wait, in milliseconds
+ * @return ESP_OK if the modem responded, else ESP_ERR_TIMEOUT
+ */
+static esp_err_t SIM7080_wait_until_ready(uint32_t timeout)
+{
+    int64_t deadline = esp_timer_get_time() + (int64_t)timeout * 1000;
+    do
+    {
+        if (send_msg_receive_polling((uint8_t *)ATcmdC_AT, strlen(ATcmdC_AT), 1, SIM7080_READY_POLL_INTERVAL) == ESP_OK)
+        {
+            // message recieved, now check if it is decodable properly
+            if (SIM7080_Process_Type_01_Data((uint8_t *)recieved_data_from_SIM7080) == ESP_OK)
+            {
+                return ESP_OK;
+            }
+            vTaskDelay(SIM7080_READY_POLL_INTERVAL / portTICK_PERIOD_MS);
+        }
+    } while (esp_timer_get_time() < deadline);
+
+    return ESP_ERR_TIMEOUT;
+}
+
+/**
+ * @brief  load the provision fingerprint of the attached modem from NVS. the modem is identified by its IMEI
+ * @return ESP_OK if success
+ */
+static esp_err_t SIM7080_load_provision()
+{
+    char imei[SIM7080_PROVISION_IMEI_SIZE] = {0};
+    uint8_t length = 0;
+
+    if (SIM7080_provision_loaded())
+    {
+        return ESP_OK;
+    }
+
+    // 1. query the IMEI. the response is the echo, followed by a line of digits
+    if (send_msg_receive_polling((uint8_t *)ATcmdC_GSN, strlen(ATcmdC_GSN), 1, 1000) != ESP_OK)
+    {
+        return ESP_FAIL;
+    }
+
+    // 2. copy the first run of digits
+    for (char *c = (char *)recieved_data_from_SIM7080; *c != '\0' && length < sizeof(imei) - 1; c++)
+    {
+        if (*c >= '0' && *c <= '9')
+        {
+            imei[length++] = *c;
+        }
+        else if (length > 0)
+        {
+            break;
+        }
+    }
+    if (length == 0)
+    {
+        ESP_LOGE(TAG, "failed to read the IMEI");
+        return ESP_FAIL;
+    }
+
+    return SIM7080_provision_load(imei);
+}
+
+/**
+ * @brief  check if a file in the SIM7080 FS has the expected size. the FS must be initialized (AT+CFSINIT)
+ * @param file_name[in] name of the file in the CUSTOMER directory
+ * @param expected_size[in] expected size in bytes
+ * @return true if the file exists and has the expected size
+ */
+static bool SIM7080_FS_file_has_size(const char *file_name, uint32_t expected_size)
+{
+    char command[SIM_FS_READ_COMMAND_SIZE];
+    uint32_t file_size = 0;
+
+    snprintf(command, sizeof(command), ATcmdC_CFSGFIS_FORMAT, CUSTOMER, file_name);
+    if (send_msg_receive_polling((uint8_t *)command, strlen(command), 1, 1000) != ESP_OK)
+    {
+        return false;
+    }
+    if (sscanf((char *)recieved_data_from_SIM7080, "%*[^:]: %u", &file_size) != 1)
+    {
+        return false;
+    }
+    return file_size == expected_size;
+}
+
+/**
+ * @brief  Uploads the Certificates to the SIM module. the upload is skipped if the provision fingerprint in NVS shows that
+ * the certificates of this FW are already in the SIM module, and the files are still there
  * @return ESP_OK
  */
 esp_err_t Send_Certs_To_SIM()
 {
     // 1. define and load data to local variables
     esp_err_t status                      = ESP_FAIL;
-    uint8_t connection_attempts           = 0;
+    bool upload_needed                    = true;
     const char * File_locations_Start[]   = {(const char *)aws_root_ca_sim_pem_start,   (const char *)certificate_pem_crt_start,    (const char *)private_pem_key_start};
     const char * File_locations_End[]     = {(const char *)aws_root_ca_sim_pem_end,     (const char *)certificate_pem_crt_end,      (const char *)private_pem_key_end};
     const char * File_name[]              = {"rootCA.pem",                              "deviceCert.crt",                           "devicePKey.key"};
     SIM7080_FS_t CertFile = {0};
 
-    // 2. sometimes, the SIM7080 will not respond for the first few messages. therefore, in a loop, send AT check till success or connection_attempts exceeds 20
-    while (status == ESP_FAIL && connection_attempts < 20)
-    {
-        if(send_msg_receive_polling((uint8_t *)ATcmdC_AT, strlen(ATcmdC_AT), 1, 1000) == ESP_OK)
-        {
-            // message recieved, now check if it is decodable properly
-            status = SIM7080_Process_Type_01_Data((uint8_t *)recieved_data_from_SIM7080);
-        }
-
-        connection_attempts ++;
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
-    }
+    // 2. sometimes, the SIM7080 will not respond for the first few messages. therefore, poll with AT till it responds
+    status = SIM7080_wait_until_ready(SIM7080_READY_TIMEOUT);
     if(status != ESP_OK)
     {
         ESP_LOGE(TAG, "Failed to recieve message from SIM7080");
         return status;
     }
 
-    // 3. initialize the FS in the SIM module 
+    // 3. load what was provisioned to this modem before
+    if (SIM7080_load_provision() != ESP_OK)
+    {
+        ESP_LOGW(TAG, "provision fingerprint not available. uploading the certificates");
+    }
+
+    // 4. initialize the FS in the SIM module 
     status = send_msg_receive_polling((uint8_t *)ATcmdC_CFSINIT, strlen(ATcmdC_CFSINIT), 1, 1000);
     if(status != ESP_OK)
     {
@@ -410,8 +451,23 @@ esp_err_t Send_Certs_To_SIM()
         return status;
     }
 
-    // 4. for each type of file needed to be uploaded, loop
-    for (uint8_t i = 0; i < 3; i++)
+    // 5. if the certificates were uploaded before, make sure the files were not removed since
+    if (SIM7080_provision_certs_uploaded())
+    {
+        upload_needed = false;
+        for (uint8_t i = 0; i < 3; i++)
+        {
+            if (!SIM7080_FS_file_has_size(File_name[i], File_locations_End[i] - File_locations_Start[i]))
+            {
+                ESP_LOGW(TAG, "certificate %s is missing in the SIM module", File_name[i]);
+                upload_needed = true;
+                break;
+            }
+        }
+    }
+
+    // 6. for each type of file needed to be uploaded, loop
+    for (uint8_t i = 0; i < 3 && upload_needed; i++)
     {
         // load information to the struct
         CertFile.directory                  = CUSTOMER;
@@ -427,11 +483,21 @@ esp_err_t Send_Certs_To_SIM()
         if (status != ESP_OK)
         {
             ESP_LOGE(TAG, "Failed to write the certificate %s to the SIM module", File_name[i]);
+            SIM7080_provision_set_certs_uploaded(false);
             return status;
         }
     }
 
-    // 5. deinit  the FS in the SIM module
+    if (upload_needed)
+    {
+        SIM7080_provision_set_certs_uploaded(true);
+    }
+    else
+    {
+        ESP_LOGI(TAG, "certificates already in the SIM module");
+    }
+
+    // 7. deinit  the FS in the SIM module
     status = send_msg_receive_polling((uint8_t *)ATcmdC_CFSTERM, strlen(ATcmdC_CFSTERM), 1, 1000);
     if(status != ESP_OK)
     {
@@ -442,7 +508,7 @@ esp_err_t Send_Certs_To_SIM()
 }
 
 /**
- * @brief  clear out the queue which handles the recieved messages from SIM7080
+ * @brief  clear out the queue of commands waiting to be sent to the SIM7080
  * @return status 
  */
 esp_err_t SIM7080_Clear_Queues()
@@ -455,19 +521,12 @@ esp_err_t SIM7080_Clear_Queues()
         return ESP_FAIL;
     }
 
-    
-    BaseType_t queueStatus;
-    BaseType_t queueEmpty = pdFALSE;
-    uint8_t recieve_message[GW_SIM7080.config.uart_buffer_size];
-    // 2. clear  recieve queue
-    while (queueEmpty == pdFALSE)
-    {
-        queueStatus = xQueueReceive(GW_SIM7080.comm.Recieve_queue, recieve_message, 0);
 
-        if(queueStatus == pdFALSE)
-        {
-            queueEmpty = pdTRUE;
-        }
+    // 2. drop the commands which are not yet sent to the SIM
+    uint8_t removed = SIM7080_AT_flush();
+    if (removed > 0)
+    {
+        ESP_LOGW(TAG, "Removed %d pending commands", removed);
     }
 
     return ESP_OK;
@@ -505,6 +564,15 @@ void SIM7080_UpgradeNodeCenceFirmware(NodeStruct_t *structNodeReceived)
     //3. notify user of OTA pre-preparation
     LED_assign_task(CNGW_LED_CMD_FW_UPDATE_PRE_PREPARATION, CNGW_LED_COMM);  
 
+#ifdef SIM_OTA_STREAM_DOWNLOAD
+    // 4 - 7. stream the FW from the URL directly to the ESP32 memory (this includes the memory erase and the function process_ota_data)
+    status = SIM7080_stream_file_from_URL_to_ESP(structNodeReceived->cptrString);
+    if(status != ESP_OK)
+    {
+        error_string = "Failed to stream binary file from the given URL to ESP32";
+        goto EXIT;
+    }
+#else
     // 4. download the FW from the URL
     status = SIM7080_download_file_to_SIM_from_URL(structNodeReceived->cptrString);
     if(status != ESP_OK)
@@ -531,6 +599,7 @@ void SIM7080_UpgradeNodeCenceFirmware(NodeStruct_t *structNodeReceived)
         error_string = "Failed to copy bytes from SIM7080 to ESP32";
         goto EXIT;
     }
+#endif
 
     // 8. change the state of the LED
     LED_assign_task(CNGW_LED_CMD_IDLE, CNGW_LED_COMM);
@@ -573,8 +642,10 @@ void SIM7080_UpgradeNodeCenceFirmware(NodeStruct_t *structNodeReceived)
 
 EXIT:
 
+#ifndef SIM_OTA_STREAM_DOWNLOAD
     // delete the temporary file from SIM7080 memory
     SIM7080_delete_file(3, SIM_OTA_FILE_NAME);
+#endif
 
     if (status == ESP_FAIL)
     {
@@ -652,7 +723,7 @@ esp_err_t SIM7080_download_file_to_SIM_from_URL(char *url)
 
     // 2. Use sprintf to format cmd with required variables and send the command. after, free the resources
     sprintf(command, "%s=\"%s\",\"/customer/%s\"", ATcmdC_HTTPTOFS, url, SIM_OTA_FILE_NAME);
-    status = send_msg_receive_polling((uint8_t *)command, strlen(command), 2, 90000);
+    status = send_msg_receive_until((uint8_t *)command, strlen(command), "+HTTPTOFS:", 90000);
     free(command);
 
     // 3. check if a feedback is recieved from the SIM7080
@@ -689,45 +760,388 @@ esp_err_t SIM7080_download_file_to_SIM_from_URL(char *url)
                     ESP_LOGW(TAG, "status_code: %d, SIM7080_OTA_data_recieved_length: %d", status_code, SIM7080_OTA_data_recieved_length);
                     // all checks upto now is OK. Now executing step 5
                 }
-                else
+                else
+                {
+                    ESP_LOGE(TAG, "Improper data recieved from SIM7080");
+                    status = ESP_FAIL;
+                    goto EXIT;
+                }
+
+            }
+            else
+            {
+                ESP_LOGE(TAG, "Improper data recieved from SIM7080");
+                status = ESP_FAIL;
+                goto EXIT;
+            }
+        }
+        else
+        {
+            // the feedback data is not of a successful command execution
+            ESP_LOGE(TAG, "Improper data recieved from SIM7080");
+            status = ESP_FAIL;
+            goto EXIT;
+        }
+    }
+    else
+    {
+        ESP_LOGE(TAG, "Error in downloading the file");
+        goto EXIT;
+    }
+
+    // 4. proper data recieved. Now verify the size of the file
+     if(SIM7080_get_file_size(3, SIM_OTA_FILE_NAME) != SIM7080_OTA_data_recieved_length)
+     {
+        ESP_LOGE(TAG, "File size mismatch");
+        status = ESP_FAIL;
+        goto EXIT;
+     }
+
+EXIT:
+
+    return status;
+}
+
+/**
+ * @brief executes one AT command of the HTTP(S) client and waits for its result
+ * @param command[in] the command
+ * @param final_prefix[in] (optional) the line which completes the command, instead of "OK"
+ * @param timeout[in] timeout in milliseconds
+ * @param response[out] (optional) buffer for the response
+ * @param response_size[in] size of the response buffer
+ * @return ESP_OK if the modem replied with the expected final result
+ */
+static esp_err_t SIM7080_HTTP_execute(const char *command, const char *final_prefix, uint32_t timeout, uint8_t *response, uint16_t response_size)
+{
+    SIM7080_AT_cmd_t cmd    = {0};
+    cmd.message             = (const uint8_t *)command;
+    cmd.length              = strlen(command);
+    cmd.timeout             = timeout;
+    cmd.final_prefix        = final_prefix;
+    cmd.response            = response;
+    cmd.response_size       = response_size;
+    esp_err_t status = SIM7080_AT_execute(&cmd);
+    if (status != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Command error at :%s (%s)", command, esp_err_to_name(status));
+    }
+    return status;
+}
+
+/**
+ * @brief closes the connection of the HTTP(S) client of the SIM7080, if there is one
+ */
+static void SIM7080_HTTP_disconnect()
+{
+    char response[64] = {0};
+    if (SIM7080_HTTP_execute(ATcmdQ_SHSTATE, NULL, 1000, (uint8_t *)response, sizeof(response) - 1) == ESP_OK && strstr(response, "+SHSTATE: 1") != NULL)
+    {
+        SIM7080_HTTP_execute(ATcmdC_SHDISC, NULL, 1000, NULL, 0);
+    }
+}
+
+/**
+ * @brief connects the HTTP(S) client of the SIM7080 to the server of the URL and sends a GET request for the file
+ * @param url[in] the URL of the file
+ * @param range_start[in] the first byte of the file to be recieved. if not 0, a "Range" header is added to the request
+ * @param status_code[out] HTTP status code of the response
+ * @param content_length[out] the size of the response body, held by the SIM7080 until it is read with AT+SHREAD
+ * @return ESP_OK if the server responded
+ */
+static esp_err_t SIM7080_HTTP_request(char *url, uint32_t range_start, int *status_code, uint32_t *content_length)
+{
+    esp_err_t status        = ESP_FAIL;
+    char response[128]      = {0};
+
+    // 1. split the URL to the server ("https://host:port") and the path of the file
+    char *host = strstr(url, "://");
+    if (host == NULL)
+    {
+        return ESP_FAIL;
+    }
+    host += 3;
+    char *path = strchr(host, '/');
+    size_t server_length = (path != NULL) ? (size_t)(path - url) : strlen(url);
+    size_t host_length = strcspn(host, ":/");
+    bool https = (strncmp(url, "https://", 8) == 0);
+
+    // 2. create the dynamic memory to hold the AT commands
+    char *command = (char *)malloc(strlen(url) + 64);
+    if (command == NULL)
+    {
+        ESP_LOGE(TAG, "dynamic memory allocation error");
+        return ESP_FAIL;
+    }
+
+    // 3. close the previous connection
+    SIM7080_HTTP_disconnect();
+
+    // 4. configure the server and the SSL context
+    sprintf(command, "AT+SHCONF=\"URL\",\"%.*s\"", (int)server_length, url);
+    if (SIM7080_HTTP_execute(command, NULL, 1000, NULL, 0) != ESP_OK ||
+        SIM7080_HTTP_execute(ATcmdC_SHCONF_BODYLEN, NULL, 1000, NULL, 0) != ESP_OK ||
+        SIM7080_HTTP_execute(ATcmdC_SHCONF_HEADERLEN, NULL, 1000, NULL, 0) != ESP_OK)
+    {
+        goto EXIT;
+    }
+    if (https)
+    {
+        sprintf(command, "AT+CSSLCFG=\"SNI\",1,\"%.*s\"", (int)host_length, host);
+        if (SIM7080_HTTP_execute(ATcmdC_CSSLCFG_HTTP_SSLV, NULL, 1000, NULL, 0) != ESP_OK ||
+            SIM7080_HTTP_execute(command, NULL, 1000, NULL, 0) != ESP_OK ||
+            SIM7080_HTTP_execute(ATcmdC_SHSSL, NULL, 1000, NULL, 0) != ESP_OK)
+        {
+            goto EXIT;
+        }
+    }
+
+    // 5. connect to the server
+    if (SIM7080_HTTP_execute(ATcmdC_SHCONN, NULL, SIM_HTTP_REQUEST_TIMEOUT, NULL, 0) != ESP_OK)
+    {
+        goto EXIT;
+    }
+
+    // 6. set the headers. resume from range_start if part of the file is already recieved
+    if (SIM7080_HTTP_execute(ATcmdC_SHCHEAD, NULL, 1000, NULL, 0) != ESP_OK)
+    {
+        goto EXIT;
+    }
+    if (range_start > 0)
+    {
+        sprintf(command, "AT+SHAHEAD=\"Range\",\"bytes=%u-\"", range_start);
+        if (SIM7080_HTTP_execute(command, NULL, 1000, NULL, 0) != ESP_OK)
+        {
+            goto EXIT;
+        }
+    }
+
+    // 7. send the GET request. the response is +SHREQ: "GET",<status code>,<content length>
+    sprintf(command, "AT+SHREQ=\"%s\",1", (path != NULL) ? path : "/");
+    if (SIM7080_HTTP_execute(command, "+SHREQ:", SIM_HTTP_REQUEST_TIMEOUT, (uint8_t *)response, sizeof(response) - 1) != ESP_OK)
+    {
+        goto EXIT;
+    }
+    char *pointer_to_data = strstr(response, "+SHREQ: ");
+    if (pointer_to_data == NULL || sscanf(pointer_to_data, "+SHREQ: \"GET\",%d,%u", status_code, content_length) != 2)
+    {
+        ESP_LOGE(TAG, "Improper data recieved from SIM7080");
+        goto EXIT;
+    }
+    ESP_LOGW(TAG, "status_code: %d, content_length: %u, range_start: %u", *status_code, *content_length, range_start);
+    status = ESP_OK;
+
+EXIT:
+    free(command);
+    return status;
+}
+
+/**
+ * @brief prepares (but does not send) a read command of the body of the last HTTP response
+ * @param cmd[out] the command to be prepared
+ * @param command[out] buffer for the text of the command (SIM_FS_READ_COMMAND_SIZE bytes)
+ * @param read_size[in] The amount of bytes to be read
+ * @param read_position[in] The position in the body from which the data begins to be read
+ * @param buffer[out] The buffer for the bytes. must hold read_size bytes
+ */
+static void SIM7080_prepare_HTTP_read_command(SIM7080_AT_cmd_t *cmd, char *command, uint32_t read_size, uint32_t read_position, uint8_t *buffer)
+{
+    memset(cmd, 0, sizeof(SIM7080_AT_cmd_t));
+    cmd->length         = snprintf(command, SIM_FS_READ_COMMAND_SIZE, "AT+SHREAD=%u,%u", read_position, read_size);
+    cmd->message        = (uint8_t *)command;
+    cmd->flags          = SIM7080_AT_FLAG_BINARY;
+    cmd->final_prefix   = "+SHREAD:";
+    cmd->timeout        = SIM_HTTP_READ_TIMEOUT;
+    cmd->binary         = buffer;
+    cmd->binary_size    = read_size;
+}
+
+/**
+ * @brief reads the body of the last HTTP response and writes it to the ESP32 memory.
+ * two buffers are used. while one chunk is written to flash, the read of the other is already queued
+ * @param chunk[in] two buffers of SIM_HTTP_READ_CHUNK_SIZE bytes
+ * @param request_pos[in] the position in the file where the body of the response begins
+ * @param current_pos[in,out] the position in the file up to which the data is written to ESP32
+ * @param total_size[in] the size of the file
+ * @param crc[out] the CRC of the data up to current_pos
+ * @return ESP_OK if the file is written up to total_size
+ */
+static esp_err_t SIM7080_HTTP_read_body(uint8_t *chunk[2], uint32_t request_pos, uint32_t *current_pos, uint32_t total_size, uint32_t *crc)
+{
+    esp_err_t status        = ESP_OK;
+    uint32_t next_read_pos  = *current_pos;
+    uint8_t slot            = 0;
+    char command[2][SIM_FS_READ_COMMAND_SIZE];
+    SIM7080_AT_cmd_t read_cmd[2];
+    bool in_flight[2]       = {false, false};
+
+    // 1. queue the reads of the first two chunks. the engine writes the second once the first is complete
+    for (uint8_t i = 0; i < 2 && next_read_pos < total_size; i++)
+    {
+        uint32_t read_size = total_size - next_read_pos;
+        read_size = (read_size > SIM_HTTP_READ_CHUNK_SIZE) ? SIM_HTTP_READ_CHUNK_SIZE : read_size;
+        SIM7080_prepare_HTTP_read_command(&read_cmd[i], command[i], read_size, next_read_pos - request_pos, chunk[i]);
+        if (SIM7080_AT_start(&read_cmd[i]) != ESP_OK)
+        {
+            status = ESP_FAIL;
+            goto DRAIN;
+        }
+        in_flight[i] = true;
+        next_read_pos += read_size;
+    }
+
+    // 2. write the chunks to flash in order. once a buffer is written, it is reused for the next read
+    while (*current_pos < total_size)
+    {
+        status = SIM7080_AT_wait(&read_cmd[slot]);
+        in_flight[slot] = false;
+        if (status != ESP_OK || read_cmd[slot].binary_length != read_cmd[slot].binary_size || read_cmd[slot].binary_received != read_cmd[slot].binary_size)
+        {
+            ESP_LOGE(TAG, "Error in getting bytes from SIM7080 at position %u", *current_pos);
+            status = ESP_FAIL;
+            goto DRAIN;
+        }
+
+        status = process_ota_data(chunk[slot], read_cmd[slot].binary_received);
+        if (status != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Error in writing bytes to ESP32 at position %u", *current_pos);
+            goto DRAIN;
+        }
+        *crc = CENSE_CRC32_Accumulate((uint32_t *)chunk[slot], read_cmd[slot].binary_received >> 2U);
+        *current_pos += read_cmd[slot].binary_received;
+
+        if (next_read_pos < total_size)
+        {
+            uint32_t read_size = total_size - next_read_pos;
+            read_size = (read_size > SIM_HTTP_READ_CHUNK_SIZE) ? SIM_HTTP_READ_CHUNK_SIZE : read_size;
+            SIM7080_prepare_HTTP_read_command(&read_cmd[slot], command[slot], read_size, next_read_pos - request_pos, chunk[slot]);
+            if (SIM7080_AT_start(&read_cmd[slot]) != ESP_OK)
+            {
+                status = ESP_FAIL;
+                goto DRAIN;
+            }
+            in_flight[slot] = true;
+            next_read_pos += read_size;
+        }
+        slot ^= 1;
+    }
+
+DRAIN:
+    // 3. the commands and buffers must not be released while a read is still queued
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        if (in_flight[i])
+        {
+            SIM7080_AT_wait(&read_cmd[i]);
+        }
+    }
+    return status;
+}
+
+/**
+ * @brief streams a file from the given URL directly to the ESP32 memory, without storing it in the SIM7080 FS. does the following steps in brief:
+ * send a GET request with the HTTP(S) client of the SIM7080 and check the status code and file size
+ * clear the required memory in ESP32
+ * read the response body in chunks (AT+SHREAD) and write each chunk to ESP32 while calculating the CRC
+ * if the connection breaks, request the rest of the file with a "Range" header and continue from where it stopped
+ * @param url[in] URL to download the fW from
+ * @return the status of the operation
+ */
+esp_err_t SIM7080_stream_file_from_URL_to_ESP(char *url)
+{
+    ESP_LOGI(TAG, "Attempting connection to URL: %s", url);
+    esp_err_t status                    = ESP_FAIL;
+    int status_code                     = 0;
+    uint32_t content_length             = 0;
+    uint32_t current_pos                = 0;
+    uint32_t crc                        = 0;
+    uint8_t retries                     = 0;
+    uint8_t *chunk[2]                   = {NULL, NULL};
+    int64_t start_time                  = esp_timer_get_time();
+    SIM7080_OTA_data_recieved_length    = 0;
+
+    // 1. allocate the two chunk buffers
+    chunk[0] = (uint8_t *)malloc(SIM_HTTP_READ_CHUNK_SIZE);
+    chunk[1] = (uint8_t *)malloc(SIM_HTTP_READ_CHUNK_SIZE);
+    if (chunk[0] == NULL || chunk[1] == NULL)
+    {
+        ESP_LOGE(TAG, "Dynamic memory allocation error");
+        goto EXIT;
+    }
+
+    while (1)
+    {
+        // 2. request the file, or the remaining part of it
+        status = SIM7080_HTTP_request(url, current_pos, &status_code, &content_length);
+        if (status == ESP_OK)
+        {
+            if (current_pos == 0)
+            {
+                // 3. check the validity of the file and clear the required memory size
+                if (status_code != HTTP_STATUS_CODE_OK)
+                {
+                    ESP_LOGE(TAG, "HTTP status code is not OK");
+                    status = ESP_FAIL;
+                    goto EXIT;
+                }
+                if (content_length < SIM_OTA_MINIMUM_FILE_SIZE)
                 {
-                    ESP_LOGE(TAG, "Improper data recieved from SIM7080");
+                    ESP_LOGE(TAG, "Recieved data size is too low for it to be a binary file");
                     status = ESP_FAIL;
                     goto EXIT;
                 }
+                SIM7080_OTA_data_recieved_length = content_length;
 
+                LED_assign_task(CNGW_LED_CMD_FW_UPDATE, CNGW_LED_COMM);
+                status = update_ota_data_length_to_be_expected(SIM7080_OTA_data_recieved_length);
+                if (status != ESP_OK)
+                {
+                    ESP_LOGE(TAG, "Failed to erase the ESP32 memory");
+                    goto EXIT;
+                }
+                CENSE_CRC32_Reset(NULL);
             }
-            else
+            else if (status_code != HTTP_STATUS_CODE_PARTIAL || content_length != SIM7080_OTA_data_recieved_length - current_pos)
             {
-                ESP_LOGE(TAG, "Improper data recieved from SIM7080");
+                // the server does not support resuming. the data in ESP32 memory can not be continued
+                ESP_LOGE(TAG, "Server did not accept the range request");
                 status = ESP_FAIL;
                 goto EXIT;
             }
+
+            // 4. write the response body to ESP32 memory
+            status = SIM7080_HTTP_read_body(chunk, current_pos, &current_pos, SIM7080_OTA_data_recieved_length, &crc);
+            if (status == ESP_OK)
+            {
+                break;
+            }
         }
-        else
+
+        // 5. resume the download
+        if (++retries > SIM_HTTP_MAX_RETRIES)
         {
-            // the feedback data is not of a successful command execution
-            ESP_LOGE(TAG, "Improper data recieved from SIM7080");
+            ESP_LOGE(TAG, "Error in downloading the file");
             status = ESP_FAIL;
             goto EXIT;
         }
-    }
-    else
-    {
-        ESP_LOGE(TAG, "Error in downloading the file");
-        goto EXIT;
+        ESP_LOGW(TAG, "Download interrupted at %u bytes. retry %d of %d", current_pos, retries, SIM_HTTP_MAX_RETRIES);
     }
 
-    // 4. proper data recieved. Now verify the size of the file
-     if(SIM7080_get_file_size(3, SIM_OTA_FILE_NAME) != SIM7080_OTA_data_recieved_length)
-     {
-        ESP_LOGE(TAG, "File size mismatch");
-        status = ESP_FAIL;
-        goto EXIT;
-     }
+    // 6. the CRC is already known, so the FW does not need to be read back from flash
+    ota_set_streamed_crc(crc);
 
-EXIT:
+    // 7. report the throughput
+    int64_t elapsed_ms = (esp_timer_get_time() - start_time) / 1000;
+    uint32_t throughput = (elapsed_ms > 0) ? (uint32_t)(((int64_t)current_pos * 1000) / elapsed_ms) : 0;
+    char report[80];
+    snprintf(report, sizeof(report), "SIM7080 streamed %u bytes in %u ms (%u B/s)", current_pos, (uint32_t)elapsed_ms, throughput);
+    ESP_LOGW(TAG, "%s", report);
+    Send_GW_message_to_AWS(64, 0, report);
 
+EXIT:
+    SIM7080_HTTP_disconnect();
+    free(chunk[0]);
+    free(chunk[1]);
     return status;
 }
 
@@ -824,6 +1238,26 @@ EXIT:
     return file_size;
 }
 
+/**
+ * @brief prepares (but does not send) a read command of the contents of a file. the raw bytes are copied to the given buffer by the AT engine
+ * @param cmd[out] the command to be prepared
+ * @param command[out] buffer for the text of the command (SIM_FS_READ_COMMAND_SIZE bytes)
+ * @param file_name[in] The name of the file
+ * @param read_size[in] The amount of bytes to be read
+ * @param read_position[in] The position of the file from which the data begins to be read
+ * @param buffer[out] The buffer for the bytes. must hold read_size bytes
+ */
+static void SIM7080_prepare_read_command(SIM7080_AT_cmd_t *cmd, char *command, char *file_name, uint16_t read_size, uint32_t read_position, uint8_t *buffer)
+{
+    memset(cmd, 0, sizeof(SIM7080_AT_cmd_t));
+    cmd->length         = snprintf(command, SIM_FS_READ_COMMAND_SIZE, "AT+CFSRFILE=3,\"%s\",1,%d,%d", file_name, read_size, read_position);
+    cmd->message        = (uint8_t *)command;
+    cmd->flags          = SIM7080_AT_FLAG_BINARY | SIM7080_AT_FLAG_PIPELINE;
+    cmd->timeout        = SIM_FS_READ_TIMEOUT;
+    cmd->binary         = buffer;
+    cmd->binary_size    = read_size;
+}
+
 /**
  * @brief gets the contents of a file in bytes
  * @param file_name[in] The name of the file
@@ -833,76 +1267,33 @@ EXIT:
  */
 uint8_t* SIM7080_get_bytes_from_file(char* file_name, uint16_t read_size, uint32_t read_position)
 {
-    // 1. create the AT command to fetch the data and send the command to SIM7080
-    size_t command_length = strlen("AT+CFSRFILE=3,\"") + strlen(file_name) + strlen("\",1,,") + 10 + 10; // Assuming maximum 10 digits for read_size and read_position
-    char *command_read_bytes = (char *)malloc(command_length);
-    if (command_read_bytes == NULL) 
+    // 1. allocate memory for an array of uint8_t
+    uint8_t * array = (uint8_t*)malloc(read_size * sizeof(uint8_t));
+    if (array == NULL)
     {
         ESP_LOGE(TAG, "Dynamic memory allocation error");
         return NULL;
     }
-    sprintf(command_read_bytes, "AT+CFSRFILE=3,\"%s\",1,%d,%d", file_name, read_size, read_position);
-    esp_err_t status = send_msg_receive_polling((uint8_t *)command_read_bytes, strlen(command_read_bytes), 1, 1000);
-    free(command_read_bytes);
-    if (status != ESP_OK)
+
+    // 2. read the bytes. the AT engine parses the length in the "+CFSRFILE: <length>" header and copies the raw bytes to the array
+    char command[SIM_FS_READ_COMMAND_SIZE];
+    SIM7080_AT_cmd_t cmd;
+    SIM7080_prepare_read_command(&cmd, command, file_name, read_size, read_position, array);
+    if (SIM7080_AT_execute(&cmd) != ESP_OK)
     {
         ESP_LOGE(TAG, "Command error");
+        free(array);
         return NULL;
     }
-    
-    // 2. we have recieved data. Now try reading it. get the location of the starting byte position and the count
-    const char *target          = "+CFSRFILE: ";
-    char *pointer_to_data       = strstr((char *)recieved_data_from_SIM7080, target);
-    int amount_of_bytes_read    = 0;
-    int index                   = -1;
-    int index_shift             = 0;
-
-    if (pointer_to_data != NULL)
-    {
-        index = pointer_to_data - (char *)recieved_data_from_SIM7080 + strlen(target);
-        if (sscanf(pointer_to_data + strlen(target), "%d", &amount_of_bytes_read) == 1)
-        {
-            if (amount_of_bytes_read >= 0 && amount_of_bytes_read < 10)
-            {
-                index_shift = 4;
-            }
-            else if (amount_of_bytes_read >= 10 && amount_of_bytes_read < 100)
-            {
-                index_shift = 5;
-            }
-            else if (amount_of_bytes_read >= 100 && amount_of_bytes_read < UART_BUF_SIZE)
-            {
-                index_shift = 6;
-            }
 
-            index += index_shift;
-        }
-        else
-        {
-            ESP_LOGE(TAG, "Could not get the length of bytes read");
-            return NULL;
-        }
-    }
-    if (amount_of_bytes_read != read_size)
+    // 3. check the amount of bytes recieved
+    if (cmd.binary_length != read_size || cmd.binary_received != read_size)
     {
         ESP_LOGE(TAG, "Mismatch in the amount of bytes read");
+        free(array);
         return NULL;
     }
 
-    // 3. correct amount of bytes recieved. proceed with the logic. allocate memory for an array of uint8_t
-    uint8_t * array = (uint8_t*)malloc(read_size * sizeof(uint8_t));
-    if (array == NULL)
-    {
-        ESP_LOGE(TAG, "Dynamic memory allocation error");
-        return NULL;
-    }
-
-    // 4. copy the required data from SIM module
-    for (int i = index; i < index + amount_of_bytes_read; i++)
-    {
-        array[i - index] = recieved_data_from_SIM7080[i];
-    }
-
     return array;
 }
 
@@ -910,22 +1301,32 @@ uint8_t* SIM7080_get_bytes_from_file(char* file_name, uint16_t read_size, uint32
 /**
  * @brief copies information from the file named SIM_OTA_FILE_NAME to the ESP32 memory.
  * before this function is called, the AOT process should be initialized and global variables such as SIM7080_OTA_data_recieved_length must be properly filled
+ * reads are done in chunks of SIM_FS_READ_CHUNK_SIZE (the max of AT+CFSRFILE) into two buffers. while one chunk is written to flash,
+ * the read of the next chunk is already in flight
  * @return ESP_OK if successful, else ESP_FAIL
  */
 esp_err_t SIM7080_copy_bytes_from_SIM_to_ESP()
 {
-    // 0. check integrity of variables
-    if(UART_BUF_SIZE < (UART_FS_OFFSET + 100))
+    esp_err_t status                                = ESP_FAIL;
+    uint32_t next_read_pos                          = 0;
+    uint32_t current_file_pos                       = 0;
+    uint8_t slot                                    = 0;
+    uint8_t *chunk[2]                               = {NULL, NULL};
+    char command[2][SIM_FS_READ_COMMAND_SIZE];
+    SIM7080_AT_cmd_t read_cmd[2];
+    bool in_flight[2]                               = {false, false};
+    SIM7080_AT_cmd_t echo_cmd                       = {0};
+    int64_t start_time                              = esp_timer_get_time();
+
+    // 1. allocate the two chunk buffers
+    chunk[0] = (uint8_t *)malloc(SIM_FS_READ_CHUNK_SIZE);
+    chunk[1] = (uint8_t *)malloc(SIM_FS_READ_CHUNK_SIZE);
+    if (chunk[0] == NULL || chunk[1] == NULL)
     {
-        // the UART BUF size is not enough to handle file transfers
-        ESP_LOGE(TAG, "UART_BUF_SIZE insufficient");
+        ESP_LOGE(TAG, "Dynamic memory allocation error");
         goto EXIT;
     }
 
-    esp_err_t status                = ESP_FAIL;
-    uint16_t packet_size            = UART_BUF_SIZE - UART_FS_OFFSET;
-    uint32_t current_file_pos       = 0;
-
     // 2. open FS
     status = send_msg_receive_polling((uint8_t *)ATcmdC_CFSINIT, strlen(ATcmdC_CFSINIT), 1, 1000);
     if (status != ESP_OK)
@@ -934,177 +1335,324 @@ esp_err_t SIM7080_copy_bytes_from_SIM_to_ESP()
         goto EXIT;
     }
 
-    // 2. stop all debug messages from the library
+    // 3. turn the echo off. with reads in flight, the echo of the next command would land in the middle of the raw bytes
+    echo_cmd.message    = (uint8_t *)ATcmdC_ECHO_OFF;
+    echo_cmd.length     = strlen(ATcmdC_ECHO_OFF);
+    echo_cmd.timeout    = 1000;
+    status = SIM7080_AT_execute(&echo_cmd);
+    if (status != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Command error at :%s", ATcmdC_ECHO_OFF);
+        goto CLOSE;
+    }
+
+    // 4. stop all debug messages from the library
     set_log_status(false, false, false);
 
-    // 5. read file chunk by chunk
-    while (current_file_pos < SIM7080_OTA_data_recieved_length)
+    // 5. start the reads of the first two chunks
+    for (uint8_t i = 0; i < 2 && next_read_pos < SIM7080_OTA_data_recieved_length; i++)
     {
-        // do the preliminary checks before reading chunk
-        if (status == ESP_FAIL)
+        uint32_t read_size = SIM7080_OTA_data_recieved_length - next_read_pos;
+        read_size = (read_size > SIM_FS_READ_CHUNK_SIZE) ? SIM_FS_READ_CHUNK_SIZE : read_size;
+        SIM7080_prepare_read_command(&read_cmd[i], command[i], SIM_OTA_FILE_NAME, read_size, next_read_pos, chunk[i]);
+        if (SIM7080_AT_start(&read_cmd[i]) != ESP_OK)
         {
-            goto EXIT;
+            status = ESP_FAIL;
+            goto DRAIN;
         }
+        in_flight[i] = true;
+        next_read_pos += read_size;
+    }
 
-        // read chunk
-        uint8_t *binary_chunk = SIM7080_get_bytes_from_file(SIM_OTA_FILE_NAME, packet_size, current_file_pos);
-        if (binary_chunk != NULL)
+    // 6. write the chunks to flash in order. once a buffer is written, it is reused for the next read
+    while (current_file_pos < SIM7080_OTA_data_recieved_length)
+    {
+        status = SIM7080_AT_wait(&read_cmd[slot]);
+        in_flight[slot] = false;
+        if (status != ESP_OK || read_cmd[slot].binary_length != read_cmd[slot].binary_size || read_cmd[slot].binary_received != read_cmd[slot].binary_size)
         {
-            // copy the recieved bytes to ESP32 memory
-            process_ota_data(binary_chunk, packet_size);
+            ESP_LOGE(TAG, "Error in getting bytes from SIM7080 at position %u", current_file_pos);
+            status = ESP_FAIL;
+            goto DRAIN;
+        }
 
-           // increment loop variables
-            current_file_pos += packet_size;
+        // copy the recieved bytes to ESP32 memory. the read of the other buffer is in flight meanwhile
+        status = process_ota_data(chunk[slot], read_cmd[slot].binary_received);
+        if (status != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Error in writing bytes to ESP32 at position %u", current_file_pos);
+            goto DRAIN;
+        }
+        current_file_pos += read_cmd[slot].binary_received;
 
-            if(current_file_pos + packet_size > SIM7080_OTA_data_recieved_length)
+        // start the read of the next chunk into the buffer just written
+        if (next_read_pos < SIM7080_OTA_data_recieved_length)
+        {
+            uint32_t read_size = SIM7080_OTA_data_recieved_length - next_read_pos;
+            read_size = (read_size > SIM_FS_READ_CHUNK_SIZE) ? SIM_FS_READ_CHUNK_SIZE : read_size;
+            SIM7080_prepare_read_command(&read_cmd[slot], command[slot], SIM_OTA_FILE_NAME, read_size, next_read_pos, chunk[slot]);
+            if (SIM7080_AT_start(&read_cmd[slot]) != ESP_OK)
             {
-                // this happens in the last chunk of bytes
-                packet_size = SIM7080_OTA_data_recieved_length - current_file_pos;
+                status = ESP_FAIL;
+                goto DRAIN;
             }
-
-            // free resources
-            free(binary_chunk);
+            in_flight[slot] = true;
+            next_read_pos += read_size;
         }
-        else
+        slot ^= 1;
+    }
+
+DRAIN:
+    // 7. the commands and buffers must not be released while a read is still in flight
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        if (in_flight[i])
         {
-            ESP_LOGE(TAG, "Error in getting bytes from SIM7080.");
-            status = ESP_FAIL;
+            SIM7080_AT_wait(&read_cmd[i]);
         }
-
     }
 
-    // 6. resume all debug messages from the library
+    // 8. resume all debug messages from the library and turn the echo back on
     set_log_status(Print_Info, Print_Info, Print_Info);
+    echo_cmd.message    = (uint8_t *)ATcmdC_ECHO_ON;
+    echo_cmd.length     = strlen(ATcmdC_ECHO_ON);
+    SIM7080_AT_execute(&echo_cmd);
 
-    // 7. close FS
-    status = send_msg_receive_polling((uint8_t *)ATcmdC_CFSTERM, strlen(ATcmdC_CFSTERM), 1, 1000);
-    if (status != ESP_OK)
+    // 9. report the throughput
+    if (status == ESP_OK)
+    {
+        int64_t elapsed_ms = (esp_timer_get_time() - start_time) / 1000;
+        uint32_t throughput = (elapsed_ms > 0) ? (uint32_t)(((int64_t)current_file_pos * 1000) / elapsed_ms) : 0;
+        char report[80];
+        snprintf(report, sizeof(report), "SIM7080 copied %u bytes in %u ms (%u B/s)", current_file_pos, (uint32_t)elapsed_ms, throughput);
+        ESP_LOGW(TAG, "%s", report);
+        Send_GW_message_to_AWS(64, 0, report);
+    }
+
+CLOSE:
+    // 10. close FS
+    if (send_msg_receive_polling((uint8_t *)ATcmdC_CFSTERM, strlen(ATcmdC_CFSTERM), 1, 1000) != ESP_OK)
     {
         ESP_LOGE(TAG, "Command error at :%s", ATcmdC_CFSTERM);
-        goto EXIT;
+        status = ESP_FAIL;
     }
 
 EXIT:
-    set_log_status(Print_Info, Print_Info, Print_Info); 
+    set_log_status(Print_Info, Print_Info, Print_Info);
+    free(chunk[0]);
+    free(chunk[1]);
     return status;
 }
 
 #endif
 
 /**
- * @brief The intermediate function which is used to check for patterns in the incoming messages from SIM7080
- *  If the recieving message has a recognized pattern, then appropriate steps are taken accordingly
- * @return ESP_OK if there is no pattern found. ESP_FAIL if there is a pattern found
- * @note by setting temp_block_SIM7080_msg_preprocessor to true, you can skip any pattern checking for one run
+ * @brief handles "+SMSUB:" (incoming MQTT message). the line is: +SMSUB: "<topic>","<JSON>"
+ *  the topic and the JSON part are located as offsets in the line, and the line is copied once to a pooled buffer which is queued to be executed
+ * @return ESP_FAIL, as the pattern is found
  */
-esp_err_t SIM7080_msg_preprocessor(uint8_t *recvbuf)
+static esp_err_t SIM7080_URC_MQTT_message(uint8_t *recvbuf, uint16_t recvbuf_length)
 {
-    esp_err_t result = ESP_OK;
+    // 1. check for the position in the incoming string which has the "{" character
+    substring_start = memchr((char *)recvbuf, '{', recvbuf_length);
 
-    // 1. check if command is set to ignore the pre_processor
-    if (temp_block_SIM7080_msg_preprocessor)
+    // 2. locate the topic, between the first pair of '"' before the JSON. if there is none, the topic is empty
+    uint16_t topic_search_length    = (substring_start != NULL) ? (uint8_t *)substring_start - recvbuf : recvbuf_length;
+    const uint8_t *topic_start      = memchr(recvbuf, '"', topic_search_length);
+    const uint8_t *topic_end        = (topic_start != NULL) ? memchr(topic_start + 1, '"', recvbuf + topic_search_length - topic_start - 1) : NULL;
+    if (topic_end == NULL)
     {
-        temp_block_SIM7080_msg_preprocessor = false;
-        return result;
+        topic_start = recvbuf;
+        topic_end   = recvbuf + 1;
     }
 
-    // 2. check 01: "+SMSUB:" (incoming MQTT message)
-    if (SIM7080_Strcmp_Data(recvbuf, GW_SIM7080.config.uart_buffer_size, "+SMSUB:") == ESP_OK)
+    if (substring_start != NULL)
     {
-        // check for the position in the incoming string which has the "{" character
-        substring_start = strstr((char *)recvbuf, "{");
+        // check for the position where the JSON string ends (beginning from the "{")
+        substring_end   = (char *)recvbuf + recvbuf_length - 1;
 
-        if (substring_start != NULL)
+        while (substring_end > substring_start && *substring_end != '}')
         {
-            // check for the position where the JSON string ends (beginning from the "{")
-            size_t substring_length     = strlen(substring_start);
-            substring_end   = substring_start + substring_length - 1;
+            substring_end--;
+        }
 
-            while (substring_end > substring_start && *substring_end != '}')
-            {
-                substring_end--;
-            }
+        // the beginning and ending positions of the JSON string is found
+        if (*substring_end == '}')
+        {
+#ifdef IPNODE
+            // if NODE is available, add the incoming command to it for it to be executed, in a buffer of nodeReadPool
+            size_t new_length   = substring_end - substring_start + 1;
+            MsgBuffer *buffer   = MsgBuffer_AcquireCopy(&nodeReadPool, substring_start, new_length, 0);
 
-            // the beginning and ending positions of the JSON string is found
-            if (*substring_end == '}')
+            if (buffer != NULL)
             {
-                size_t new_length           = substring_end - substring_start + 1;
-                char *truncated_substring   = (char *)pvPortMalloc((new_length + 1) * sizeof(char));
-
-                if (truncated_substring != NULL)
+                if (!CommandQueue_Send(nodeReadQueue, buffer))
                 {
-                    strncpy(truncated_substring, substring_start, new_length);
-                    truncated_substring[new_length] = '\0';
-#ifdef IPNODE
-                    // if NODE is available, add the incoming command to it for it to be executed
-                    if (xQueueSendToBack(nodeReadQueue, &truncated_substring, (TickType_t)0) != pdPASS)
-                    {
-                        ESP_LOGE(TAG, "Queue is full");
-                        vPortFree(truncated_substring);
-                    }
-#else
-                    // node is not available. so the commands are handled by the secondary utilities
-                    if (xQueueSendToBack(SIM7080_AWS_Rx_queue, &truncated_substring, (TickType_t)0) != pdPASS)
-                    {
-                        ESP_LOGE(TAG, "Queue is full");
-                        vPortFree(truncated_substring);
-                    }
-#endif
+                    ESP_LOGE(TAG, "Queue is full");
+                    MsgBuffer_Release(buffer);
                 }
-                else
+            }
+            else
+            {
+                ESP_LOGE(TAG, "No buffer for the command");
+            }
+#else
+            // node is not available. so the commands are handled by the secondary utilities
+            MsgBuffer *message = (recvbuf_length < AWS_Rx_BUFFER_SIZE) ? MsgBuffer_Acquire(&SIM7080_AWS_Rx_pool, 0) : NULL;
+
+            if (message != NULL)
+            {
+                // one copy of the line. the topic and the JSON are NUL terminated in place
+                memcpy(message->data, recvbuf, recvbuf_length);
+                message->length         = recvbuf_length;
+                message->topicOffset    = topic_start + 1 - recvbuf;
+                message->topicLength    = topic_end - topic_start - 1;
+                message->payloadOffset  = (uint8_t *)substring_start - recvbuf;
+                message->payloadLength  = substring_end - substring_start + 1;
+                message->data[message->topicOffset + message->topicLength]      = '\0';
+                message->data[message->payloadOffset + message->payloadLength]  = '\0';
+
+                if (!CommandQueue_Send(SIM7080_AWS_Rx_queue, message))
                 {
-                    ESP_LOGE(TAG, "Error allocating memory");
+                    ESP_LOGE(TAG, "Queue is full");
+                    MsgBuffer_Release(message);
                 }
             }
             else
             {
-                ESP_LOGE(TAG, "Did not recieve a proper AWS command");
+                ESP_LOGE(TAG, "No buffer for the AWS command (%d bytes)", recvbuf_length);
             }
+#endif
+        }
+        else
+        {
+            ESP_LOGE(TAG, "Did not recieve a proper AWS command");
         }
-
-        LED_change_task_momentarily(CNGW_LED_CMD_BUSY, CNGW_LED_COMM, LED_CHANGE_MOMENTARY_DURATION);
-        result = ESP_FAIL;
     }
 
-    // 3. check 02: "+SMSTATE: 0" (disconnected from MQTT)
-    else if(SIM7080_Strcmp_Data(recvbuf, GW_SIM7080.config.uart_buffer_size, "+SMSTATE: 0") == ESP_OK)
-    {
-        ESP_LOGE(TAG, "Disconnected from the MQTT");
-        LED_assign_task(CNGW_LED_CMD_ERROR, CNGW_LED_COMM);
-        set_internet_status(false);
-        SIM7080_Retry_Connect_to_Internet_And_AWS_After_Delay(500);
-        result = ESP_FAIL;
+    LED_change_task_momentarily(CNGW_LED_CMD_BUSY, CNGW_LED_COMM, LED_CHANGE_MOMENTARY_DURATION);
+    return ESP_FAIL;
+}
 
-    } 
+/**
+ * @brief handles "+SMSTATE: 0" (disconnected from MQTT)
+ * @return ESP_FAIL, as the pattern is found
+ */
+static esp_err_t SIM7080_URC_MQTT_disconnected(uint8_t *recvbuf, uint16_t recvbuf_length)
+{
+    ESP_LOGE(TAG, "Disconnected from the MQTT");
+    LED_assign_task(CNGW_LED_CMD_ERROR, CNGW_LED_COMM);
+    set_internet_status(false);
+    SIM7080_Retry_Connect_to_Internet_And_AWS_After_Delay(500);
+    return ESP_FAIL;
+}
 
-    // 4. check 03: "+APP PDP: 0,DEACTIVE" (internet connection lost)
-    else if(SIM7080_Strcmp_Data(recvbuf, GW_SIM7080.config.uart_buffer_size, "+APP PDP: 0,DEACTIVE") == ESP_OK) 
-    {
-        ESP_LOGE(TAG, "Internet connection lost");
-        LED_assign_task(CNGW_LED_CMD_ERROR, CNGW_LED_COMM);
-        set_internet_status(false);
-        SIM7080_Retry_Connect_to_Internet_And_AWS_After_Delay(500);
-        result = ESP_FAIL;
+/**
+ * @brief handles "+APP PDP: 0,DEACTIVE" (internet connection lost)
+ * @return ESP_FAIL, as the pattern is found
+ */
+static esp_err_t SIM7080_URC_PDP_deactivated(uint8_t *recvbuf, uint16_t recvbuf_length)
+{
+    ESP_LOGE(TAG, "Internet connection lost");
+    LED_assign_task(CNGW_LED_CMD_ERROR, CNGW_LED_COMM);
+    set_internet_status(false);
+    SIM7080_Retry_Connect_to_Internet_And_AWS_After_Delay(500);
+    return ESP_FAIL;
+}
 
-    } 
+// the unsolicited messages recognized by SIM7080_msg_preprocessor. to handle a new message, add its prefix and handler here
+static const SIM7080_URC_entry_t SIM7080_URC_table[] =
+{
+    {"+SMSUB:",                 SIM7080_URC_MQTT_message},
+    {"+SMSTATE: 0",             SIM7080_URC_MQTT_disconnected},
+    {"+APP PDP: 0,DEACTIVE",    SIM7080_URC_PDP_deactivated},
+};
 
-    return result;
+/**
+ * @brief builds the matcher of SIM7080_URC_table. must be called before SIM7080_setup
+ * @return ESP_OK if success, else ESP_FAIL
+ */
+esp_err_t SIM7080_init_URC_handlers()
+{
+    return SIM7080_URC_build(SIM7080_URC_table, sizeof(SIM7080_URC_table) / sizeof(SIM7080_URC_table[0]));
 }
 
-
 /**
  * @brief The intermediate function which is used to check for patterns in the incoming messages from SIM7080
- *  If the recieving message has a recognized pattern, then appropriate steps are taken accordingly
+ *  If the recieving message has a recognized pattern (SIM7080_URC_table), then appropriate steps are taken accordingly.
+ *  all the patterns are matched in one pass over the beginning of the line
  * @return ESP_OK if there is no pattern found. ESP_FAIL if there is a pattern found
- * @note by setting temp_block_SIM7080_msg_preprocessor to true, you can skip any pattern checking for one run
+ * @note only unsolicited lines reach this function. responses to a command in flight (eg: "+SMSTATE: 0" for "AT+SMSTATE?") are given to the command
  */
-esp_err_t SIM7080_send_AWS_message(char *msg, bool success)
+esp_err_t SIM7080_msg_preprocessor(uint8_t *recvbuf)
 {
-    //char message[AWS_Tx_BUFFER_SIZE] = {0};
-    
-    //strncpy(message, msg, message_size);
+    return SIM7080_URC_dispatch(recvbuf, strlen((char *)recvbuf));
+}
+
+
+/**
+ * @brief records the result of one publish in SIM7080_publish_metrics
+ * @param cmd[in] the completed "AT+SMPUB" command
+ * @param messages[in] number of messages in the publish
+ */
+static void SIM7080_record_publish(const SIM7080_AT_cmd_t *cmd, uint8_t messages)
+{
+    int64_t latency = cmd->done_time - cmd->submit_time;
+    SIM7080_publish_metrics.publishes++;
+    SIM7080_publish_metrics.messages += messages;
+    SIM7080_publish_metrics.bytes += cmd->payload_length;
+    SIM7080_publish_metrics.failures += (cmd->result == ESP_OK) ? 0 : 1;
+    SIM7080_publish_metrics.latency_total += latency;
+    if (SIM7080_publish_metrics.publishes == 1 || latency < SIM7080_publish_metrics.latency_min)
+    {
+        SIM7080_publish_metrics.latency_min = latency;
+    }
+    if (latency > SIM7080_publish_metrics.latency_max)
+    {
+        SIM7080_publish_metrics.latency_max = latency;
+    }
+
+    if (Print_Info)
+    {
+        ESP_LOGI(TAG, "publish of %d message(s), %d bytes: %s in %lld ms", messages, cmd->payload_length, esp_err_to_name(cmd->result), latency / 1000);
+    }
+}
+
+/**
+ * @brief  prints the publish metrics collected since the start
+ */
+void SIM7080_print_publish_metrics()
+{
+    SIM7080_publish_metrics_t *m = &SIM7080_publish_metrics;
+    ESP_LOGI(TAG, "publishes: %u, messages: %u, bytes: %u, failures: %u, latency avg/min/max: %lld/%lld/%lld ms",
+             m->publishes, m->messages, m->bytes, m->failures, (m->publishes > 0) ? (m->latency_total / m->publishes) / 1000 : 0,
+             m->latency_min / 1000, m->latency_max / 1000);
+}
+
+/**
+ * @brief publishes messages to the control data topics through the SIM7080.
+ *  messages to the same topic are batched in to one JSON array ("[msg1,msg2]") of up to AWS_Tx_BATCH_SIZE bytes. a message
+ *  which does not share its publish is sent as it is. the publishes are pipelined: the next "AT+SMPUB" is written right after
+ *  the payload of the previous one, without waiting for its final "OK" (which for QoS 1 only arrives with the PUBACK)
+ * @param msgs[in] the messages to be published (JSON objects)
+ * @param success[in] for each message, true to publish to the success topic, false to publish to the fail topic
+ * @param count[in] number of messages (max AWS_Tx_BATCH_MESSAGES)
+ * @param sent[out] (optional) for each message, true if the SIM7080 accepted the publish holding it. a failed publish
+ *  does not undo the ones before, so the caller keeps only the messages which were not sent
+ * @return ESP_OK if the SIM7080 accepted all the messages
+ */
+esp_err_t SIM7080_send_AWS_messages(char **msgs, const bool *success, uint8_t count, bool *sent)
+{
+    SIM7080_publish_t publishes[AWS_Tx_BATCH_MESSAGES];
+    uint8_t publish_count   = 0;
+    esp_err_t result        = ESP_OK;
     GW_SIM7080 = *SIM_Get_Context();
 
+    if (sent != NULL)
+    {
+        memset(sent, 0, count * sizeof(bool));
+    }
+
     // 1. check if SIM7080 is intialized
     if (!GW_SIM7080.intialized)
     {
@@ -1117,55 +1665,120 @@ esp_err_t SIM7080_send_AWS_message(char *msg, bool success)
         ESP_LOGE(TAG, "SIM no internet connection");
         return ESP_FAIL;
     }
+    count = (count > AWS_Tx_BATCH_MESSAGES) ? AWS_Tx_BATCH_MESSAGES : count;
 
-    size_t message_size = strnlen(msg, AWS_Tx_BUFFER_SIZE - 1);
-    char *command = (char *)malloc(50 * sizeof(char));
-    char * ATpubC_CTRL = ATpubC_CTRL_FAIL;
-    if(success)
+    // 3. group the messages per topic, keeping their order within the topic
+    for (uint8_t topic = 0; topic < 2; topic++)
     {
-        ATpubC_CTRL = ATpubC_CTRL_SUCCESS;
-    }
+        bool topic_success = (topic == 0);
+        SIM7080_publish_t *publish = NULL;
 
-    if (command != NULL)
-    {
-        sprintf(command, "AT+SMPUB=\"%s\",%d,%d,%d", (uint8_t *)ATpubC_CTRL, message_size, AWS_PUB_QOS, AWS_PUB_RETAIN);
-        if (send_msg_receive_polling((uint8_t *)command, (16 + strlen(ATpubC_CTRL) + snprintf(NULL, 0, "%d", message_size)), 1, 1000) == ESP_OK)
+        for (uint8_t i = 0; i < count; i++)
         {
-            free(command);
-            if (SIM7080_Strcmp_Data((uint8_t *)recieved_data_from_SIM7080, GW_SIM7080.config.uart_buffer_size, ">") == ESP_OK)
+            if (success[i] != topic_success)
+            {
+                continue;
+            }
+            size_t message_size = strnlen(msgs[i], AWS_Tx_BUFFER_SIZE - 1);
+
+            // 3.1. add the message to the open publish if it fits. "[" "," and "]" are added to the message
+            if (publish != NULL && publish->length + message_size + 3 <= AWS_Tx_BATCH_SIZE)
             {
-                if (send_msg_receive_polling((uint8_t *)msg, message_size, 2, 6000) == ESP_OK)
+                if (publish->batch == NULL)
                 {
-                    if (SIM7080_Strcmp_Data((uint8_t *)recieved_data_from_SIM7080, GW_SIM7080.config.uart_buffer_size, "OK") == ESP_OK)
-                    {
-                        return ESP_OK;
-                    }
-                    else
+                    publish->batch = (char *)malloc(AWS_Tx_BATCH_SIZE);
+                    if (publish->batch != NULL)
                     {
-                        ESP_LOGE(TAG, "Message sending failed");
-                        return ESP_FAIL;
+                        publish->batch[0] = '[';
+                        memcpy(publish->batch + 1, publish->payload, publish->length);
+                        publish->length++;
+                        publish->payload = publish->batch;
                     }
                 }
-                else
+                if (publish->batch != NULL)
                 {
-                    ESP_LOGE(TAG, "SIM failed to respond");
-                    return ESP_FAIL;
+                    publish->batch[publish->length++] = ',';
+                    memcpy(publish->batch + publish->length, msgs[i], message_size);
+                    publish->length += message_size;
+                    publish->indexes[publish->messages++] = i;
+                    continue;
                 }
             }
+
+            // 3.2. else open a new publish with the message as its payload
+            publish             = &publishes[publish_count++];
+            memset(publish, 0, sizeof(SIM7080_publish_t));
+            publish->payload    = msgs[i];
+            publish->length     = message_size;
+            publish->indexes[0] = i;
+            publish->messages   = 1;
+            publish->success    = topic_success;
         }
-        else
+    }
+
+    // 4. start the publishes. the payload is written by the AT engine as soon as the ">" prompt arrives
+    for (uint8_t i = 0; i < publish_count; i++)
+    {
+        SIM7080_publish_t *publish = &publishes[i];
+        if (publish->batch != NULL)
         {
-            free(command);
-            ESP_LOGE(TAG, "SIM failed to respond");
-            return ESP_FAIL;
+            publish->batch[publish->length++] = ']';
         }
+
+        publish->cmd.length         = snprintf(publish->command, sizeof(publish->command), "AT+SMPUB=\"%s\",%d,%d,%d",
+                                               publish->success ? ATpubC_CTRL_SUCCESS : ATpubC_CTRL_FAIL, publish->length, AWS_PUB_QOS, AWS_PUB_RETAIN);
+        publish->cmd.message        = (uint8_t *)publish->command;
+        publish->cmd.flags          = SIM7080_AT_FLAG_PIPELINE;
+        publish->cmd.timeout        = 7000;
+        publish->cmd.payload_prefix = ">";
+        publish->cmd.payload        = (uint8_t *)publish->payload;
+        publish->cmd.payload_length = publish->length;
+        publish->started            = (SIM7080_AT_start(&publish->cmd) == ESP_OK);
     }
-    else
+
+    // 5. wait for the final "OK" of each publish
+    for (uint8_t i = 0; i < publish_count; i++)
     {
-        ESP_LOGE(TAG, "Error allocating dynamic memory");
+        SIM7080_publish_t *publish = &publishes[i];
+        esp_err_t status = publish->started ? SIM7080_AT_wait(&publish->cmd) : ESP_FAIL;
+        if (publish->started)
+        {
+            SIM7080_record_publish(&publish->cmd, publish->messages);
+        }
+
+        if (status == ESP_ERR_TIMEOUT)
+        {
+            ESP_LOGE(TAG, "SIM failed to respond");
+            result = ESP_FAIL;
+        }
+        else if (status != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Message sending failed");
+            result = ESP_FAIL;
+        }
+        else if (sent != NULL)
+        {
+            for (uint8_t j = 0; j < publish->messages; j++)
+            {
+                sent[publish->indexes[j]] = true;
+            }
+        }
+        free(publish->batch);
     }
 
-    return ESP_FAIL;
+    return result;
+}
+
+/**
+ * @brief publishes a message to the control data topic through the SIM7080. "AT+SMPUB", the ">" prompt, the payload
+ *  and the final "OK" are handled as one command by the AT engine
+ * @param msg[in] the message to be published
+ * @param success[in] true to publish to the success topic, false to publish to the fail topic
+ * @return ESP_OK if the SIM7080 accepted the message
+ */
+esp_err_t SIM7080_send_AWS_message(char *msg, bool success)
+{
+    return SIM7080_send_AWS_messages(&msg, &success, 1, NULL);
 }
 
 
@@ -1194,8 +1807,8 @@ esp_err_t ping_google()
  * AWS_CONFIG_RETAIN            : Update the option of retain the session (set to 1)
  * AWS_SSL_VERSION              : Update the SSL version to type 3
  * AWS_SSL_IGNORERTC            : Set the RTC to be ignored
- * AWS_SSL_CONVERT2             : SSL conversion type 2
- * AWS_SSL_CONVERT1             : SSL conversion type 1 
+ * AWS_SSL_CONVERT2             : SSL conversion type 2 (skipped if the provision fingerprint shows the certificates are already converted)
+ * AWS_SSL_CONVERT1             : SSL conversion type 1 (skipped if the provision fingerprint shows the certificates are already converted)
  * AWS_SMSSL                    : Set the certificates which will be used in the attempting connection
  * AWS_CONNECT                  : Connect to MQTT server
  * AWS_SUBSCRIBE                : Subscribe to MQTT topics
@@ -1223,7 +1836,13 @@ SIM7080_AWS_status get_SIM_connected_to_AWS()
         return status;
     }
 
-    // 3. begin steps in connecting to AWS
+    // 3. load what was provisioned to this modem before. without it, every step is executed
+    if (SIM7080_load_provision() != ESP_OK)
+    {
+        ESP_LOGW(TAG, "provision fingerprint not available");
+    }
+
+    // 4. begin steps in connecting to AWS
     SIM7080_AWS session_instance = AWS_PING_SERVER;
     bool exit_loop = false;
     while (!exit_loop)
@@ -1255,8 +1874,6 @@ SIM7080_AWS_status get_SIM_connected_to_AWS()
 
         case AWS_CHECK_MQTT_STATUS:
         {
-            temp_block_SIM7080_msg_preprocessor = true;
-
             if (send_msg_receive_polling((uint8_t *)ATcmdQ_SMSTATE, strlen(ATcmdQ_SMSTATE), 1, 1000) == ESP_OK)
             {
                 if (SIM7080_Strcmp_Data((uint8_t *)recieved_data_from_SIM7080, GW_SIM7080.config.uart_buffer_size, "+SMSTATE: 0") == ESP_OK)
@@ -1457,7 +2074,8 @@ SIM7080_AWS_status get_SIM_connected_to_AWS()
             {
                 if (SIM7080_Strcmp_Data((uint8_t *)recieved_data_from_SIM7080, GW_SIM7080.config.uart_buffer_size, "OK") == ESP_OK)
                 {
-                    session_instance = AWS_SSL_CONVERT2;
+                    // the converted certificates are kept by the SIM module
+                    session_instance = SIM7080_provision_ssl_converted() ? AWS_SMSSL : AWS_SSL_CONVERT2;
                 }
                 else
                 {
@@ -1500,6 +2118,7 @@ SIM7080_AWS_status get_SIM_connected_to_AWS()
             {
                 if (SIM7080_Strcmp_Data((uint8_t *)recieved_data_from_SIM7080, GW_SIM7080.config.uart_buffer_size, "OK") == ESP_OK)
                 {
+                    SIM7080_provision_set_ssl_converted(true);
                     session_instance = AWS_SMSSL;
                 }
                 else
@@ -1548,6 +2167,8 @@ SIM7080_AWS_status get_SIM_connected_to_AWS()
                 }
                 else
                 {
+                    // the certificates may have been changed in the SIM module. convert them again next time
+                    SIM7080_provision_set_ssl_converted(false);
                     status = AWS_STATUS_SERVER_CONNECTION_ERROR;
                     session_instance = AWS_SESSION_FAILURE;
                 }
@@ -1613,27 +2234,35 @@ SIM7080_AWS_status get_SIM_connected_to_AWS()
  * AT
  * AT+CPIN?     :   Check SIM card status
  * AT+CSQ       :   Check RF signal (rssi, ber bit error rate)
- * AT+CGATT?    :   Check PS service. 1 indicates PS has attached.
+ * AT+CGATT?    :   Check PS service. 1 indicates PS has attached. if already attached, the next step is AT+CNACT?
  * AT+CGATT=1   :   Attach or detach from GPRS service.
  * AT+COPS?     :   Query network info, operator and network mode 9, NB-IOT network
  * AT+CGNAPN    :   Query CAT-M or NB-IOT network after the successful registration of APN
  * AT+CNACT=0,1 :   open wireless connection param 0 is PDP index, param 1 means active
- * AT+CNACT?    :   Get local IP
+ * AT+CNACT?    :   Get local IP. if PDP index 0 is not active yet, it is opened with AT+CNACT=0,1 and polled till active
  * AT+SNPDPID=0 :   Select PDP index for PING as 0
  * AT+PING      :   Ping google to check proper internet connectivity
  * finally, trigger function which connects to AWS
  * if the response is a fail at any point in the sequence, the command sequence begins again at AT check.
  * if there are successive restarts, the task exits with fail after 5 successive failures
+ * the SIM module is only power cycled if it does not respond, or if the previous attempt failed
  */
 void get_SIM_connected_to_internet(void *pvParameters)
 {
     SIM7080_INTERNET state = SESSION_RESET;
     uint8_t failed_attempts = 0;
-    uint16_t delay_between_commands = 2000;
-    // start by reseting the SIM module
+    uint16_t delay_between_commands = 20;
+    bool wireless_connection_opened = false;
     LED_assign_task(CNGW_LED_CMD_CONN_PENDING, CNGW_LED_COMM);
-    Reset_SIM7080();
-    vTaskDelay(delay_between_commands / portTICK_PERIOD_MS);
+
+    // start by reseting the SIM module, unless it is already running. the reset pulse toggles the power of a running module
+    if (SIM7080_reset_on_next_session || SIM7080_wait_until_ready(SIM7080_READY_POLL_INTERVAL) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Resetting SIM module");
+        Reset_SIM7080();
+        SIM7080_wait_until_ready(SIM7080_READY_TIMEOUT);
+    }
+    SIM7080_reset_on_next_session = false;
 
     while (1)
     {
@@ -1744,8 +2373,16 @@ void get_SIM_connected_to_internet(void *pvParameters)
             {
                 if (SIM7080_Process_Type_02_Data((uint8_t *)recieved_data_from_SIM7080) == ESP_OK)
                 {
-                    // proceed to attache GPRS service
-                    state = ATTACH_GPRS_SERVICE;
+                    if (SIM7080_Strcmp_Data((uint8_t *)recieved_data_from_SIM7080, GW_SIM7080.config.uart_buffer_size, "+CGATT: 1") == ESP_OK)
+                    {
+                        // already attached (reconnection). check the wireless connection directly
+                        state = GET_LOCAL_IP;
+                    }
+                    else
+                    {
+                        // proceed to attache GPRS service
+                        state = ATTACH_GPRS_SERVICE;
+                    }
                 }
                 else
                 { // response from Modem is ERROR
@@ -1841,6 +2478,7 @@ void get_SIM_connected_to_internet(void *pvParameters)
                     // get list of local IP addresses
                     state = GET_LOCAL_IP;
                 }
+                wireless_connection_opened = true;
             }
             else
             {
@@ -1853,8 +2491,23 @@ void get_SIM_connected_to_internet(void *pvParameters)
         {
             if (send_msg_receive_polling((uint8_t *)ATcmdQ_CNACT, strlen(ATcmdQ_CNACT), 1, 1000) == ESP_OK)
             {
-                // proceed to setting the PDP index
-                state = SET_PDP_INDEX;
+                if (SIM7080_Strcmp_Data((uint8_t *)recieved_data_from_SIM7080, GW_SIM7080.config.uart_buffer_size, "+CNACT: 0,1") == ESP_OK)
+                {
+                    // proceed to setting the PDP index
+                    state = SET_PDP_INDEX;
+                    delay_between_commands = 20;
+                }
+                else if (!wireless_connection_opened)
+                {
+                    // PDP index 0 is not active. open the wireless connection
+                    state = OPEN_WIRELESS_CONNECTION;
+                }
+                else
+                {
+                    // the wireless connection is being activated. poll again
+                    failed_attempts++;
+                    delay_between_commands = SIM7080_READY_POLL_INTERVAL * 2;
+                }
             }
             else
             {
@@ -1910,6 +2563,7 @@ void get_SIM_connected_to_internet(void *pvParameters)
         case SESSION_FAILURE:
         {
             ESP_LOGE(TAG, "SIM failed to connect to internet");
+            SIM7080_reset_on_next_session = true;
             LED_assign_task(CNGW_LED_CMD_ERROR,CNGW_LED_COMM);
             set_internet_status(false);
             SIM7080_internet_handler = NULL;
@@ -1929,6 +2583,11 @@ void get_SIM_connected_to_internet(void *pvParameters)
             Send_GW_message_to_AWS(64, 0, "SIM7080 connected to internet");
             SIM7080_AWS_status AWS_result = get_SIM_connected_to_AWS();
 
+            if (Print_Info)
+            {
+                SIM7080_AT_print_metrics();
+            }
+
             if (AWS_result == AWS_STATUS_SUCCESS)
             {
                 ESP_LOGI(TAG, "SIM connected to AWS");
@@ -1950,6 +2609,7 @@ void get_SIM_connected_to_internet(void *pvParameters)
             else
             {
                 ESP_LOGE(TAG, "SIM failed to connect to AWS");
+                SIM7080_reset_on_next_session = true;
                 set_AWS_status(false);
                 LED_assign_task(CNGW_LED_CMD_ERROR, CNGW_LED_COMM);
                 SIM7080_internet_handler = NULL;
@@ -0,0 +1,184 @@
+/**
+ ******************************************************************************
+ *	Copyright (c) 2024 CencePower Inc
+ ******************************************************************************
+ * @file	: SIM7080_provision.c
+ * @author	: Yasiru Benaragama
+ * @date	: 16 Feb 2024
+ * @brief	: fingerprint of what is provisioned on the SIM7080 (certificates,
+ * SSL conversions), kept in NVS so the steps can be skipped on reconnect
+ ******************************************************************************
+ *
+ ******************************************************************************
+ */
+#ifdef GATEWAY_SIM7080
+#include "gw_includes/SIM7080_provision.h"
+static const char *TAG = "SIM7080_provision";
+
+// local variables
+static SIM7080_provision_t SIM7080_provision                            = {0};
+static uint8_t SIM7080_provision_cert_hash[SIM7080_PROVISION_HASH_SIZE]  = {0};
+static bool SIM7080_provision_is_loaded                                 = false;
+
+/**
+ * @brief  calculate the SHA256 of the certificates embedded in the FW, in the order they are uploaded to the SIM7080
+ * @param hash[out] SIM7080_PROVISION_HASH_SIZE bytes
+ */
+static void SIM7080_provision_calculate_cert_hash(uint8_t *hash)
+{
+    struct SHA256_CTX_t ctx;
+    CENSE_Sha256_Start(&ctx);
+    CENSE_Sha256_Update(&ctx, aws_root_ca_sim_pem_start, aws_root_ca_sim_pem_end - aws_root_ca_sim_pem_start);
+    CENSE_Sha256_Update(&ctx, certificate_pem_crt_start, certificate_pem_crt_end - certificate_pem_crt_start);
+    CENSE_Sha256_Update(&ctx, private_pem_key_start, private_pem_key_end - private_pem_key_start);
+    CENSE_Sha256_Final(&ctx, hash);
+}
+
+/**
+ * @brief  write the fingerprint to NVS
+ * @return ESP_OK if success
+ */
+static esp_err_t SIM7080_provision_save()
+{
+    nvs_handle nvsHandle;
+    esp_err_t status = nvs_open(nvsStorage, NVS_READWRITE, &nvsHandle);
+    if (status != ESP_OK)
+    {
+        ESP_LOGE(TAG, "failed to open NVS");
+        return status;
+    }
+
+    status = nvs_set_blob(nvsHandle, SIM7080_PROVISION_NVS_KEY, &SIM7080_provision, sizeof(SIM7080_provision));
+    if (status == ESP_OK)
+    {
+        status = nvs_commit(nvsHandle);
+    }
+    nvs_close(nvsHandle);
+
+    if (status != ESP_OK)
+    {
+        ESP_LOGE(TAG, "failed to save the provision fingerprint");
+    }
+    return status;
+}
+
+/**
+ * @brief  load the fingerprint from NVS. the fingerprint is discarded if it was written by an older format, or for another modem
+ * @param imei[in] IMEI of the modem attached to the GW (AT+GSN)
+ * @return ESP_OK if success
+ */
+esp_err_t SIM7080_provision_load(const char *imei)
+{
+    // 1. the certificates do not change while the FW runs
+    SIM7080_provision_calculate_cert_hash(SIM7080_provision_cert_hash);
+
+    // 2. read the fingerprint
+    nvs_handle nvsHandle;
+    size_t length = sizeof(SIM7080_provision);
+    bool valid = false;
+    if (nvs_open(nvsStorage, NVS_READWRITE, &nvsHandle) == ESP_OK)
+    {
+        if (nvs_get_blob(nvsHandle, SIM7080_PROVISION_NVS_KEY, &SIM7080_provision, &length) == ESP_OK && length == sizeof(SIM7080_provision))
+        {
+            valid = true;
+        }
+        nvs_close(nvsHandle);
+    }
+
+    // 3. check if it belongs to this modem
+    if (valid && SIM7080_provision.version == SIM7080_PROVISION_VERSION &&
+        strncmp(SIM7080_provision.imei, imei, SIM7080_PROVISION_IMEI_SIZE) == 0)
+    {
+        SIM7080_provision_is_loaded = true;
+        return ESP_OK;
+    }
+
+    // 4. start over with an empty fingerprint
+    ESP_LOGW(TAG, "no provision fingerprint for modem %s", imei);
+    memset(&SIM7080_provision, 0, sizeof(SIM7080_provision));
+    SIM7080_provision.version = SIM7080_PROVISION_VERSION;
+    strncpy(SIM7080_provision.imei, imei, SIM7080_PROVISION_IMEI_SIZE - 1);
+    SIM7080_provision_is_loaded = true;
+    return SIM7080_provision_save();
+}
+
+/**
+ * @brief  check if SIM7080_provision_load was called
+ * @return true if loaded
+ */
+bool SIM7080_provision_loaded()
+{
+    return SIM7080_provision_is_loaded;
+}
+
+/**
+ * @brief  check if the certificates of this FW are already uploaded to the SIM7080 FS
+ * @return true if uploaded
+ */
+bool SIM7080_provision_certs_uploaded()
+{
+    return SIM7080_provision_is_loaded && memcmp(SIM7080_provision.cert_hash, SIM7080_provision_cert_hash, SIM7080_PROVISION_HASH_SIZE) == 0;
+}
+
+/**
+ * @brief  check if the certificates of this FW are already converted (AT+CSSLCFG="CONVERT") in the SIM7080
+ * @return true if converted
+ */
+bool SIM7080_provision_ssl_converted()
+{
+    return SIM7080_provision_is_loaded && memcmp(SIM7080_provision.ssl_hash, SIM7080_provision_cert_hash, SIM7080_PROVISION_HASH_SIZE) == 0;
+}
+
+/**
+ * @brief  record the result of uploading the certificates. new files always have to be converted again
+ * @param uploaded[in] true if the certificates of this FW were uploaded, false to invalidate the record
+ * @return ESP_OK if success
+ */
+esp_err_t SIM7080_provision_set_certs_uploaded(bool uploaded)
+{
+    if (!SIM7080_provision_is_loaded)
+    {
+        return ESP_FAIL;
+    }
+
+    if (uploaded)
+    {
+        memcpy(SIM7080_provision.cert_hash, SIM7080_provision_cert_hash, SIM7080_PROVISION_HASH_SIZE);
+    }
+    else
+    {
+        memset(SIM7080_provision.cert_hash, 0, SIM7080_PROVISION_HASH_SIZE);
+    }
+    memset(SIM7080_provision.ssl_hash, 0, SIM7080_PROVISION_HASH_SIZE);
+    return SIM7080_provision_save();
+}
+
+/**
+ * @brief  record the result of the SSL conversion of the certificates
+ * @param converted[in] true if the certificates of this FW were converted, false to invalidate the record
+ * @return ESP_OK if success
+ */
+esp_err_t SIM7080_provision_set_ssl_converted(bool converted)
+{
+    if (!SIM7080_provision_is_loaded)
+    {
+        return ESP_FAIL;
+    }
+
+    if (converted == SIM7080_provision_ssl_converted())
+    {
+        return ESP_OK;
+    }
+
+    if (converted)
+    {
+        memcpy(SIM7080_provision.ssl_hash, SIM7080_provision_cert_hash, SIM7080_PROVISION_HASH_SIZE);
+    }
+    else
+    {
+        memset(SIM7080_provision.ssl_hash, 0, SIM7080_PROVISION_HASH_SIZE);
+    }
+    return SIM7080_provision_save();
+}
+
+#endif
@@ -180,6 +180,7 @@ void power_failure_handle_sequence()
 #else
     SecondaryUtilities_PrepareJSONAndSendToAWS(65, 0, hexString);
 #endif
+    Send_GW_Status_to_AWS(-1, 0, true);
 
 }
 #endif
\ No newline at end of file
@@ -77,6 +77,7 @@ extern CN_Sensor_Configuration_t sensor_configuration[MAX_SENSORS];
 extern CN_DRV_Slot_t driver_slots[CABINET__DRIVER_SLOT_COUNT];
 
 extern void Send_GW_message_to_AWS(uint16_t ubyCommand, uint32_t uwValue, char *cptrString);
+extern void Send_GW_Status_to_AWS(int16_t channel, uint32_t status_mask, bool power_loss);
 extern void Initialize_Gateway();
 extern bool GW_Process_Action_Command(NodeStruct_t *structNodeReceived);
 extern bool GW_Process_AT_Command(NodeStruct_t *structNodeReceived);
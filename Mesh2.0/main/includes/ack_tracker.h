@@ -0,0 +1,33 @@
+#ifdef ROOT
+#ifndef ACK_TRACKER_H
+#define ACK_TRACKER_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+#include <stdbool.h>
+
+// ids of the nodes waiting for the ack of a command, one per node of a write. the oldest ones are forgotten, their
+// ack is published with the id only. room for a few writes of ROOT_COALESCE_MAX_NODES
+#define ACK_TRACKER_SIZE                128
+#define ACK_TRACKER_DETAIL_SIZE         32      // max length of the detail of an ack
+#define ACK_TRACKER_COMPACT_SIZE        128     // {"id":<id>,"cmnd":<cmnd>,"mac":"<mac>","str":"<detail>"}
+
+typedef struct
+{
+    uint32_t tracked;           // nodes given an id for a command
+    uint32_t acked;             // acks with an id known by the tracker
+    uint32_t expanded;          // of them, published as the original command
+    uint32_t unknown;           // acks with an id which was forgotten
+} AckTracker_Metrics_t;
+
+extern esp_err_t AckTracker_Init();
+extern uint16_t AckTracker_Track(const char *cptrCommand, const uint8_t *ubyptrNodeMacs, uint8_t count);
+extern bool AckTracker_Tag(char *cptrPayload, char **cptrCommand, uint16_t id);
+extern void AckTracker_Publish(uint16_t id, bool success, const char *cptrDetail, const uint8_t *ubyptrNodeMac);
+extern esp_err_t AckTracker_SetExpansion(bool expand);
+extern void AckTracker_GetMetrics(AckTracker_Metrics_t *metricsCopy);
+extern void AckTracker_PrintMetrics();
+
+#endif
+#endif
@@ -16,6 +16,15 @@ extern const uint8_t certificate_pem_crt_end[] asm("_binary_certificate_pem_crt_
 extern const uint8_t private_pem_key_start[] asm("_binary_private_pem_key_start");
 extern const uint8_t private_pem_key_end[] asm("_binary_private_pem_key_end");
 
+#define AWS_YIELD_TIMEOUT 20            // ms the yield waits for incoming messages
+#define AWS_IDLE_WAIT 100               // ms the task waits for a message to publish before yielding again
+#define AWS_PUBLISH_BUDGET_BYTES 8192   // max payload bytes published between two yields
+#define AWS_PUBLISH_BUDGET_TIME 200     // max ms spent publishing between two yields
+#define AWS_PUBLISH_METRICS_EVERY 500   // log the publish metrics after this many publishes
+#define AWS_PUBLISH_WINDOW 8            // max QoS1 publishes waiting for their PUBACK
+#define AWS_PUBACK_TIMEOUT 5000         // ms before a QoS1 publish is sent again with the DUP flag
+#define AWS_PUBLISH_ATTEMPTS 3          // a QoS1 publish not acknowledged after this many sends goes to the uplink journal
+
 AWS_IoT_Client client;
 IoT_Client_Init_Params mqttInitParams;
 IoT_Client_Connect_Params connectParams;
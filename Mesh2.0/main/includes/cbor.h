@@ -0,0 +1,78 @@
+#ifndef CBOR_H
+#define CBOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "cJSON.h"
+
+/**
+ * Compact binary encoding (CBOR, RFC 8949) of the messages to the root and to AWS.
+ * The writer and the reader work on a buffer given by the caller and never allocate. A writer on a NULL buffer only
+ * counts the length, to size the buffer of a message before encoding it.
+ * Only definite lengths are used. Decoder for the backend: Mesh2.0/uplinkDecoder
+ */
+
+// major types
+#define CBOR_TYPE_UINT      0
+#define CBOR_TYPE_NEGINT    1
+#define CBOR_TYPE_BYTES     2
+#define CBOR_TYPE_TEXT      3
+#define CBOR_TYPE_ARRAY     4
+#define CBOR_TYPE_MAP       5
+#define CBOR_TYPE_TAG       6
+#define CBOR_TYPE_SIMPLE    7
+
+#define CBOR_MAX_DEPTH      8
+
+/**
+ * uplink frame: a map of these keys, in this order. cmnd and val are left out when the message has none.
+ * data is a text, a byte string, or a map/array converted from a JSON text
+ */
+#define UPLINK_FRAME_KEY_CMND   0
+#define UPLINK_FRAME_KEY_VAL    1
+#define UPLINK_FRAME_KEY_DATA   2
+#define UPLINK_FRAME_IS_CBOR(firstByte) (((firstByte) >> 5) == CBOR_TYPE_MAP)
+
+// encoding of the messages of a node, and of each AWS topic of the root. set by the backend, JSON by default
+#define UPLINK_ENCODING_JSON    0
+#define UPLINK_ENCODING_CBOR    1
+
+typedef struct
+{
+    uint8_t *buffer;
+    size_t size;
+    size_t length;
+    bool overflow;          // something did not fit. the content is not usable
+} CborWriter_t;
+
+typedef struct
+{
+    const uint8_t *buffer;
+    size_t size;
+    size_t offset;
+    bool error;             // malformed or truncated data
+} CborReader_t;
+
+extern void Cbor_InitWriter(CborWriter_t *writer, uint8_t *buffer, size_t size);
+extern size_t Cbor_WriterLength(const CborWriter_t *writer);
+extern void Cbor_PutUint(CborWriter_t *writer, uint64_t value);
+extern void Cbor_PutInt(CborWriter_t *writer, int64_t value);
+extern void Cbor_PutDouble(CborWriter_t *writer, double value);
+extern void Cbor_PutBool(CborWriter_t *writer, bool value);
+extern void Cbor_PutNull(CborWriter_t *writer);
+extern void Cbor_PutBytes(CborWriter_t *writer, const void *data, size_t length);
+extern void Cbor_PutText(CborWriter_t *writer, const char *text, size_t length);
+extern void Cbor_PutString(CborWriter_t *writer, const char *text);
+extern void Cbor_PutArray(CborWriter_t *writer, size_t count);
+extern void Cbor_PutMap(CborWriter_t *writer, size_t pairs);
+extern void Cbor_PutRaw(CborWriter_t *writer, const void *data, size_t length);
+extern bool Cbor_PutJson(CborWriter_t *writer, const cJSON *item);
+
+extern void Cbor_InitReader(CborReader_t *reader, const uint8_t *buffer, size_t size);
+extern bool Cbor_ReadHead(CborReader_t *reader, uint8_t *type, uint64_t *value);
+extern bool Cbor_ReadUint(CborReader_t *reader, uint64_t *value);
+extern bool Cbor_Skip(CborReader_t *reader);
+extern bool Cbor_ToJson(CborReader_t *reader, char *json, size_t size);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef COMMAND_KEYS_H
+#define COMMAND_KEYS_H
+
+/**
+ * ids ("cmnd") of the commands which both the root and the node builds name: the root commands are sent to the root
+ * by the nodes, the gateway commands are forwarded to the gateway by the root
+ */
+
+enum enumRootCmndKey
+{
+    /************ ROOT NODE COMMANDS ************/
+    enumRootCmndKey_RestartRoot = 50,
+    enumRootCmndKey_TestRoot = 51,
+    enumRootCmndKey_UpdateRootFW = 52, //Test this
+    enumRootCmndKey_TestGroup = 53,
+    enumRootCmndKey_SendGroupCmd = 54,
+    enumRootCmndKey_AddOrgInfo = 55,
+    enumRootCmndKey_SetTopicEncoding = 56,
+    enumRootCmndKey_SetSnapshotInterval = 57,
+    enumRootCmndKey_PublishSensorData = 58,
+    enumRootCmndKey_PublishControlData = 59,
+    enumRootCmndKey_MessageToAWS = 60,
+    enumRootCmndKey_UpdateNodeFW = 61, //test this
+    enumRootCmndKey_CreateGroup = 62,
+    enumRootCmndKey_DeleteGroup = 63,
+    enumRootCmndKey_PublishNodeControlSuccess = 64,
+    enumRootCmndKey_PublishNodeControlFail = 65,
+    enumRootCmndKey_SetAckExpansion = 66,
+    /************ TOTAL NUMBER OF COMMANDS ************/
+    enumRootCmndKey_TotalNumOfCommands = 17
+};
+
+//GW required changes: define the GW node commands here
+enum enumGWCmndKey
+{
+    /************ GATEWAY NODE COMMANDS ************/
+    enumGatewayCmndKey_GW_Action = 220,
+    enumGatewayCmndKey_GW_Query = 221,
+    enumGatewayCmndKey_GW_OTA_Begin = 222,
+    enumGatewayCmndKey_GW_OTA_End = 224,
+    enumGatewayCmndKey_GW_AT_CMD = 225,
+    enumGatewayCmndKey_TotalNumOfCommands = 6
+};
+
+#endif
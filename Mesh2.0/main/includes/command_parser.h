@@ -0,0 +1,66 @@
+#ifndef COMMAND_PARSER_H
+#define COMMAND_PARSER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "cJSON.h"
+
+/**
+ * Parser of the command messages {"id":<number>,"cmnd":<number>,"val":<number or array>,"str":<text>,"macs":[<bytes>]}.
+ * The JSON text is read in one pass straight into a CommandMessage_t, without building a cJSON tree and without
+ * using the heap. Other keys are skipped. A message it can not hold (text or arrays too long, unusual escapes,
+ * duplicate keys, deep nesting) is parsed again with cJSON, so every valid JSON is still accepted.
+ * Benchmark against cJSON: Mesh2.0/hostBench
+ */
+
+#define COMMAND_PARSER_STRING_SIZE      512
+#define COMMAND_PARSER_MAX_VALUES       64
+#define COMMAND_PARSER_MAX_MAC_BYTES    (64 * 6)
+#define COMMAND_PARSER_MAX_DEPTH        8
+
+// fields found in a message, with the expected type
+#define COMMAND_FIELD_CMND              0x01
+#define COMMAND_FIELD_VAL               0x02    // val is a number
+#define COMMAND_FIELD_VALS              0x04    // val is an array
+#define COMMAND_FIELD_STR               0x08
+#define COMMAND_FIELD_MACS              0x10    // macs is an array of numbers from 0 to 255
+#define COMMAND_FIELD_ID                0x20    // correlation id given by the root, see ack_tracker.h
+#define COMMAND_FIELDS_HAVE(message, mask) ((((message)->fields) & (mask)) == (mask))
+
+typedef struct
+{
+    uint8_t fields;             // COMMAND_FIELD_*
+    uint16_t id;                // id, 0 if the message has none
+    int command;                // cmnd, as cJSON valueint
+    double value;               // val if it is a number, else 0
+    uint8_t *values;            // val if it is an array, each number cast to uint8_t
+    uint16_t valueCount;        // number of items of the val array
+    uint8_t *macs;
+    uint16_t macBytes;          // number of items of the macs array
+    char *string;               // str, NUL terminated
+    // storage of the fields when read without cJSON
+    char stringBuffer[COMMAND_PARSER_STRING_SIZE];
+    uint8_t valueBuffer[COMMAND_PARSER_MAX_VALUES];
+    uint8_t macBuffer[COMMAND_PARSER_MAX_MAC_BYTES];
+    // only used when parsed by cJSON, freed by CommandParser_Release
+    cJSON *json;
+    bool valuesAllocated;
+    bool macsAllocated;
+} CommandMessage_t;
+
+typedef struct
+{
+    uint32_t parsed;            // read without cJSON
+    uint32_t fallbacks;         // parsed by cJSON
+    uint32_t invalid;           // not a JSON object
+} CommandParser_Metrics_t;
+
+extern bool CommandParser_Parse(const char *cptrJson, CommandMessage_t *message);
+extern void CommandParser_Release(CommandMessage_t *message);
+extern bool CommandParser_ParseNumbers(const char *cptrJson, const char *const *keys, uint8_t keyCount, double *values, uint32_t *found);
+extern int CommandParser_PeekCommand(const char *cptrJson);
+extern int CommandParser_ValueInt(double value);
+extern void CommandParser_GetMetrics(CommandParser_Metrics_t *metricsCopy);
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+/**
+ * queues between the tasks which receive commands and messages and the tasks which execute them. The consumer blocks
+ * on the queue instead of polling it, and each item is stamped when it is queued, to keep a histogram of the time it
+ * waited
+ */
+
+#define COMMAND_QUEUE_LATENCY_BUCKETS   9
+#define COMMAND_QUEUE_PRINT_EVERY       100     // log the histogram of a task after this many items
+
+typedef struct
+{
+    void *item;
+    int64_t queuedAt;           // esp_timer_get_time
+} CommandQueue_Item_t;
+
+// wait of the items received by one task. upper bounds of the buckets are in CommandQueue_LatencyBounds
+typedef struct
+{
+    const char *name;
+    uint32_t buckets[COMMAND_QUEUE_LATENCY_BUCKETS];
+    uint32_t count;
+    uint32_t maxUs;
+    uint64_t totalUs;
+} CommandQueue_Latency_t;
+
+#define COMMAND_QUEUE_LATENCY_INIT(taskName) {.name = (taskName)}
+
+/**
+ * lanes of a queue: control (commands, acks), status (sensor data and status reports) and bulk (OTA, logs).
+ * each lane is a queue of its own, so a command never waits behind bulk traffic. when several lanes have items, the
+ * consumer takes up to COMMAND_LANE_WEIGHTS items of each lane in turn, so the bulk lane still moves.
+ * one consumer per CommandLanes_t
+ */
+typedef enum
+{
+    COMMAND_LANE_CONTROL = 0,
+    COMMAND_LANE_STATUS,
+    COMMAND_LANE_BULK,
+    COMMAND_LANE_COUNT
+} CommandLane_t;
+
+#define COMMAND_LANE_WEIGHTS            {8, 3, 1}
+
+typedef struct
+{
+    QueueHandle_t lanes[COMMAND_LANE_COUNT];
+    SemaphoreHandle_t ready;                            // counts the items of all the lanes
+    uint8_t credits[COMMAND_LANE_COUNT];                // items the lane can still give in this round
+    CommandQueue_Latency_t latency[COMMAND_LANE_COUNT];
+    char names[COMMAND_LANE_COUNT][24];
+} CommandLanes_t;
+
+extern QueueHandle_t CommandQueue_Create(UBaseType_t length);
+extern bool CommandQueue_Send(QueueHandle_t queue, void *item);
+extern void *CommandQueue_Receive(QueueHandle_t queue, TickType_t wait, CommandQueue_Latency_t *latency);
+extern void CommandQueue_PrintLatency(const CommandQueue_Latency_t *latency);
+
+extern CommandLanes_t *CommandLanes_Create(const char *name, UBaseType_t length);
+extern bool CommandLanes_Send(CommandLanes_t *lanes, CommandLane_t lane, void *item);
+extern void *CommandLanes_Receive(CommandLanes_t *lanes, TickType_t wait, CommandLane_t *lane);
+extern bool CommandLanes_Wait(CommandLanes_t *lanes, TickType_t wait);
+extern UBaseType_t CommandLanes_Waiting(CommandLanes_t *lanes);
+extern void CommandLanes_PrintLatency(const CommandLanes_t *lanes);
+extern CommandLane_t CommandLanes_OfCommand(int command);
+
+#endif
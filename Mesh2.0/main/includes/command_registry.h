@@ -0,0 +1,77 @@
+#if defined(ROOT) || defined(IPNODE) || defined(GATEWAY_SIM7080)
+#ifndef COMMAND_REGISTRY_H
+#define COMMAND_REGISTRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "command_keys.h"
+#ifdef ROOT
+#include "root_utilities.h"
+#endif
+#if defined(IPNODE) || defined(GATEWAY_ETH) || defined(GATEWAY_SIM7080)
+#include "SpacrGateway_commands.h"
+#endif
+
+/**
+ * Registry of all the commands of the build, indexed by the command id ("cmnd").
+ * Each entry gives the handler, the node types which accept the command, the arguments the handler needs and
+ * whether the command is answered with a success or a fail message. The table is built at compile time and checked
+ * once at start up by CommandRegistry_Validate.
+ *
+ * ranges of the ids:  0 - 49   base node commands, all node types
+ *                    50 - 99   root commands
+ *                   100 - 149  SpacrContactor
+ *                   150 - 199  SpacrIO
+ *                   200 - 219  SpacrPower
+ *                   220 - 255  SpacrGateway
+ */
+
+#define COMMAND_REGISTRY_SIZE           256
+
+// node types accepting a command
+#define COMMAND_NODE_ROOT               0x01
+#define COMMAND_NODE_POWER              0x02    // devType 1
+#define COMMAND_NODE_IO                 0x04    // devType 2
+#define COMMAND_NODE_CONTACTOR          0x08    // devType 3
+#define COMMAND_NODE_GATEWAY            0x10    // devType 4
+#define COMMAND_NODE_ALL                (COMMAND_NODE_POWER | COMMAND_NODE_IO | COMMAND_NODE_CONTACTOR | COMMAND_NODE_GATEWAY)
+// node type of a devType. 0 (not known yet) accepts nothing
+#define COMMAND_NODE_TYPE(devType)      ((((devType) >= 1) && ((devType) <= 4)) ? (1 << (devType)) : 0)
+
+// where a command may come from
+#define COMMAND_SOURCE_MESH             0x01    // from the root, or from a node to the root
+#define COMMAND_SOURCE_AWS              0x02    // straight from AWS, to the root or to a GW with ethernet or SIM7080
+#define COMMAND_SOURCE_ANY              (COMMAND_SOURCE_MESH | COMMAND_SOURCE_AWS)
+
+// arguments checked before the handler is called
+#define COMMAND_ARG_STRING              0x01    // str is not empty
+#define COMMAND_ARG_VALUES              0x02    // val is an array
+#define COMMAND_ARG_MACS                0x04    // macs of the targets are given
+
+// answer to a command
+typedef enum
+{
+    COMMAND_RESPONSE_ACK = 0,   // success or fail message, depending on the result of the handler
+    COMMAND_RESPONSE_NONE,      // no message, the handler answers by itself
+} CommandResponse_t;
+
+typedef struct
+{
+    uint8_t nodeTypes;          // COMMAND_NODE_*, 0 if the id is not used
+    uint8_t sources;            // COMMAND_SOURCE_*
+    uint8_t arguments;          // COMMAND_ARG_*
+    CommandResponse_t response;
+#ifdef ROOT
+    uint8_t (*root_fun)(uint32_t uwValue, char *cptrString, uint8_t *ubyptrMacs);
+#endif
+#if defined(IPNODE) || defined(GATEWAY_ETH) || defined(GATEWAY_SIM7080)
+    bool (*node_fun)(NodeStruct_t *structNodeReceived);
+#endif
+} CommandRegistry_Entry_t;
+
+extern const CommandRegistry_Entry_t *CommandRegistry_Lookup(uint8_t ubyCommand, uint8_t nodeType, uint8_t source);
+extern bool CommandRegistry_CheckArguments(const CommandRegistry_Entry_t *entry, const char *cptrString, const uint8_t *ubyptrValues, const uint8_t *ubyptrMacs);
+extern bool CommandRegistry_Validate();
+
+#endif
+#endif
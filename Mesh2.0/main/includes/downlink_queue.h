@@ -0,0 +1,34 @@
+#ifdef ROOT
+#ifndef DOWNLINK_QUEUE_H
+#define DOWNLINK_QUEUE_H
+
+#include "freertos/FreeRTOS.h"
+#include "mwifi.h"
+
+// nodes with commands waiting at the same time. a node is tracked only while its commands fail
+#define DOWNLINK_QUEUE_MAX_DESTINATIONS     16
+#define DOWNLINK_QUEUE_DEPTH                4       // commands waiting for one node, the next ones fail
+// retries of the first command of a node: DOWNLINK_QUEUE_RETRY_BASE, doubled at each failure up to DOWNLINK_QUEUE_RETRY_MAX
+#define DOWNLINK_QUEUE_RETRY_BASE           100     // ms
+#define DOWNLINK_QUEUE_RETRY_MAX            2000    // ms
+#define DOWNLINK_QUEUE_MAX_ATTEMPTS         5
+// a node whose command failed all its attempts is dead for this time: its commands fail at once
+#define DOWNLINK_QUEUE_DEAD_HOLDOFF         10000   // ms
+
+typedef struct
+{
+    uint32_t sent;
+    uint32_t retried;           // attempts after the first one
+    uint32_t failed;            // commands reported to the fail topic
+    uint32_t failedFast;        // of them, commands to a dead node or which did not fit in a queue
+    uint8_t waiting;            // nodes with commands waiting
+} DownlinkQueue_Metrics_t;
+
+extern void DownlinkQueue_Send(const uint8_t *ubyptrNodeMac, char *cptrPayload, char *cptrCommand, uint16_t id);
+extern bool DownlinkQueue_SendGroup(const mesh_addr_t *nodeAddrs, uint8_t ubyNumOfNodes, char **cptrPayloads, char **cptrCommands, const uint16_t *ids);
+extern TickType_t DownlinkQueue_Process();
+extern void DownlinkQueue_GetMetrics(DownlinkQueue_Metrics_t *metricsCopy);
+extern void DownlinkQueue_PrintMetrics();
+
+#endif
+#endif
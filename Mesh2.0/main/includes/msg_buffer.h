@@ -0,0 +1,47 @@
+#ifndef MSG_BUFFER_H
+#define MSG_BUFFER_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_err.h"
+
+/**
+ * one message in a buffer of a MsgBufferPool. The buffer is shared by pointer between producers and consumers,
+ * and goes back to its pool when the last holder calls MsgBuffer_Release
+ */
+typedef struct MsgBuffer
+{
+    struct MsgBufferPool *pool; // NULL for a buffer of MsgBuffer_AcquireHeap
+    uint8_t refs;
+    uint8_t tag;                // set by the user of the pool, eg: the id of the topic of the message
+    uint16_t length;            // bytes used in data
+    uint16_t topicOffset;       // (optional) part of data which names the message, eg: the MQTT topic
+    uint16_t topicLength;
+    uint16_t payloadOffset;     // part of data for the consumer. NUL terminated if it is text
+    uint16_t payloadLength;
+    uint8_t data[];             // bufferSize bytes of the pool
+} MsgBuffer;
+
+/**
+ * fixed number of equally sized buffers, allocated once. Acquiring and releasing never touches the heap
+ */
+typedef struct MsgBufferPool
+{
+    const char *name;
+    uint16_t bufferSize;
+    uint8_t count;
+    uint8_t *storage;
+    QueueHandle_t freeBuffers;  // pointers to the buffers which are not held by anyone
+    uint8_t highWater;          // max number of buffers held at once
+    uint32_t exhausted;         // number of times MsgBuffer_Acquire found no free buffer
+} MsgBufferPool;
+
+extern esp_err_t MsgBuffer_InitPool(MsgBufferPool *pool, const char *name, uint8_t count, uint16_t bufferSize);
+extern MsgBuffer *MsgBuffer_Acquire(MsgBufferPool *pool, TickType_t wait);
+extern MsgBuffer *MsgBuffer_AcquireCopy(MsgBufferPool *pool, const void *data, size_t length, TickType_t wait);
+extern MsgBuffer *MsgBuffer_AcquireHeap(size_t bufferSize);
+extern void MsgBuffer_Retain(MsgBuffer *buffer);
+extern void MsgBuffer_Release(MsgBuffer *buffer);
+extern uint8_t MsgBuffer_InUse(MsgBufferPool *pool);
+
+#endif
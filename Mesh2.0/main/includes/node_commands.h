@@ -12,12 +12,6 @@ typedef struct
     char *cptrString;
 } NodeStruct_t;
 
-typedef struct
-{
-    uint8_t ubyKey;
-    bool (*node_fun)(NodeStruct_t *structNodeReceived);
-} NodeCmnds_t;
-
 extern bool RestartNode(NodeStruct_t *structNodeReceived);
 extern bool TestNode(NodeStruct_t *structNodeReceived);
 extern bool SetNodeOutput(NodeStruct_t *structNodeReceived);
@@ -35,6 +29,7 @@ extern bool GetFirmwareVersion(NodeStruct_t *structNodeReceived);
 extern bool GetNodeOutput(NodeStruct_t *structNodeReceived);
 extern bool GetParentRSSI(NodeStruct_t *structNodeReceived);
 bool GetNodeChildren(NodeStruct_t *structNodeReceived);
+extern bool SetUplinkEncoding(NodeStruct_t *structNodeReceived);
 
 #endif
 #endif
\ No newline at end of file
@@ -3,6 +3,7 @@
 #define NODE_UTILITIES_H
 
 #include "utilities.h"
+#include "command_keys.h"
 #include "node_commands.h"
 #include "SpacrIO_commands.h"
 #include "SpacrPower_commands.h"
@@ -10,6 +11,8 @@
 //#include "espnow_ota.h"
 //GW required changes: include the GW header file
 #include "SpacrGateway_commands.h"
+#include "cbor.h"
+#include "msg_buffer.h"
 
 enum enumNodeCmndKey
 {
@@ -31,7 +34,8 @@ enum enumNodeCmndKey
     enumNodeCmndKey_GetNodeOutput = 14,
     enumNodeCmndKey_GetParentRSSI = 15,
     enumNodeCmndKey_GetNodeChildren = 16,
-    enumNodeCmndKey_TotalNumOfCommands = 18
+    enumNodeCmndKey_SetUplinkEncoding = 17,
+    enumNodeCmndKey_TotalNumOfCommands = 19
 
 };
 enum enumContactorCmndKey
@@ -65,30 +69,22 @@ enum enumPowerCmndKey
     enumPowerCmndKey_TotalNumOfCommands = 6
 };
 
-//GW required changes: define the GW node commands here
-enum enumGWCmndKey
-{
-    /************ GATEWAY NODE COMMANDS ************/
-    enumGatewayCmndKey_GW_Action = 220,
-    enumGatewayCmndKey_GW_Query = 221,
-    enumGatewayCmndKey_GW_OTA_Begin = 222,
-    enumGatewayCmndKey_GW_OTA_End = 224,
-    enumGatewayCmndKey_GW_AT_CMD = 225,
-    enumGatewayCmndKey_TotalNumOfCommands = 6
-};
-
-//GW required changes: GW commands starts from number 220
-#define GATEWAY_NODE_COMMAND_RANGE_STARTS 220
-#define POWER_NODE_COMMAND_RANGE_STARTS 200
-#define IO_NODE_COMMAND_RANGE_STARTS 150
-#define CONTACTOR_NODE_COMMAND_RANGE_STARTS 100
-#define COMMAND_VALUE_SPAN 50
-#define BASE_NODE_COMMAND_RANGE_STARTS 0
-
 extern uint8_t nodeOutputPin;
 extern uint8_t devType;
 extern QueueHandle_t nodeReadQueue;
-extern QueueHandle_t rootSendQueue;
+//commands from the root, ESP-NOW and the SIM7080, queued in nodeReadQueue as buffers of nodeReadPool: the payload is
+//the command, NUL terminated. the node read task receives straight into a buffer
+#define NODE_READ_POOL_SIZE 8
+extern MsgBufferPool nodeReadPool;
+extern CommandLanes_t *rootSendQueue;
+extern uint8_t uplinkEncoding;
+
+//a message in rootSendQueue: a JSON text with its NUL, or a CBOR frame (see cbor.h)
+typedef struct
+{
+    uint16_t length;
+    uint8_t data[];
+} RootSendFrame_t;
 
 void NodeUtilities_overrideNodeType(uint8_t nodeType);
 void NodeUtilities_initiatePowerNode();
@@ -98,6 +94,9 @@ void NodeUtilities_initiateContactor();
 void NodeUtilities_initiateGatewayNode();
 extern void NodeUtilities_WhoAmI();
 extern void NodeUtilities_PrepareJsonAndSendToRoot(uint16_t ubyCommand, uint32_t uwValue, char *cptrString);
+extern void NodeUtilities_SendJsonToRoot(uint16_t ubyCommand, uint32_t uwValue, const cJSON *json);
+extern void NodeUtilities_SendAckToRoot(bool success, uint16_t id, char *cptrCommand, const char *cptrDetail);
+extern bool NodeUtilities_PrepareBytesAndSendToRoot(uint16_t ubyCommand, uint32_t uwValue, const uint8_t *ubyptrData, size_t length);
 extern bool NodeUtilities_LoadAllNodeGroups();
 extern void NodeUtilities_CreateQueues();
 extern bool NodeUtilities_ValidateAndExecuteCommand(NodeStruct_t *structNodeReceived);
@@ -108,7 +107,6 @@ extern uint32_t NodeUtilities_ReadMilliVolts(uint8_t gpio, uint8_t samples, esp_
 extern void NodeUtilities_InitialiseAndSetNodeOutput();
 void NodeUtilities_SendDataToGroup(uint8_t *ubyGroupMacAddr, char *cptrDataToSend);
 extern void NodeUtilities_SendToNode(uint8_t *macOfNode, char *dataToSend);
-extern void NodeUtilities_ParseArrVal(cJSON *cjVals, uint8_t *arrvals);
 
 #endif
 #endif
\ No newline at end of file
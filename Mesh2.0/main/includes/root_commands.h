@@ -3,6 +3,7 @@
 #define ROOT_COMMANDS_H
 
 #include "root_utilities.h"
+#include "command_keys.h"
 
 extern uint8_t PublishSensorData(uint32_t uwValue, char *cptrString, uint8_t *ubyptrNodeMacs);
 extern uint8_t PublishControlData(uint32_t uwValue, char *cptrString, uint8_t *ubyptrNodeMacs);
@@ -18,27 +19,9 @@ extern uint8_t AddOrgInfo(uint32_t uwValue, char *cptrString, uint8_t *ubyptrMac
 extern uint8_t MessageToAWS(uint32_t uwValue, char *cptrString, uint8_t *ubyptrMacs);
 extern uint8_t PublishNodeControlSuccess(uint32_t uwValue, char *cptrString, uint8_t *ubyptrMacs);
 extern uint8_t PublishNodeControlFail(uint32_t uwValue, char *cptrString, uint8_t *ubyptrMacs);
-
-enum enumRootCmndKey
-{
-    /************ ROOT NODE COMMANDS ************/
-    enumRootCmndKey_RestartRoot = 50,
-    enumRootCmndKey_TestRoot = 51,
-    enumRootCmndKey_UpdateRootFW = 52, //Test this
-    enumRootCmndKey_TestGroup = 53,
-    enumRootCmndKey_SendGroupCmd = 54,
-    enumRootCmndKey_AddOrgInfo = 55,
-    enumRootCmndKey_PublishSensorData = 58,
-    enumRootCmndKey_PublishControlData = 59,
-    enumRootCmndKey_MessageToAWS = 60,
-    enumRootCmndKey_UpdateNodeFW = 61, //test this
-    enumRootCmndKey_CreateGroup = 62,
-    enumRootCmndKey_DeleteGroup = 63,
-    enumRootCmndKey_PublishNodeControlSuccess = 64,
-    enumRootCmndKey_PublishNodeControlFail = 65,
-    /************ TOTAL NUMBER OF COMMANDS ************/
-    enumRootCmndKey_TotalNumOfCommands = 14
-};
+extern uint8_t SetTopicEncoding(uint32_t uwValue, char *cptrString, uint8_t *ubyptrMacs);
+extern uint8_t SetSnapshotInterval(uint32_t uwValue, char *cptrString, uint8_t *ubyptrMacs);
+extern uint8_t SetAckExpansion(uint32_t uwValue, char *cptrString, uint8_t *ubyptrMacs);
 
 #endif
 #endif
\ No newline at end of file
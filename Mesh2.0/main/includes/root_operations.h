@@ -5,10 +5,19 @@
 
 #include "root_utilities.h"
 #include "utilities.h"
+#include "downlink_queue.h"
 
-extern QueueHandle_t nodeCommandQueue;
-extern QueueHandle_t rootCommandQueue;
-extern QueueHandle_t AWSPublishQueue;
+//commands to nodes with the same command text go in one write: when another command is waiting behind the first one,
+//the ones queued within ROOT_COALESCE_WINDOW_MS of it
+#define ROOT_COALESCE_WINDOW_MS 10      //rounded down to ticks, 0 only takes the commands which are already queued
+#define ROOT_COALESCE_MAX_NODES 32
+
+extern CommandLanes_t *nodeCommandQueue;
+extern CommandLanes_t *rootCommandQueue;
+extern CommandLanes_t *AWSPublishQueue;
+extern UBaseType_t AWSPublishQueueHighWater;
+extern uint32_t AWSPublishQueueFull;
+extern uint32_t AWSPublishDropped;
 extern void RootOperations_ProcessNodeCommands();
 extern void RootOperations_RootGroupReadTask(void *arg);
 extern void RootOperations_ProcessRootCommands();
@@ -6,28 +6,43 @@
 #include "utilities.h"
 #include "root_commands.h"
 #include "esp_https_ota.h"
+#include "uplink_journal.h"
+#include "status_aggregator.h"
+#include "ack_tracker.h"
+#include "routing_index.h"
+#include "msg_buffer.h"
+#include "cbor.h"
 
 extern char orgID[25];
-extern char *logTopic;
-extern char *sensorLogTopic;
-extern char *controlLogTopic;
-extern char *controlLogTopicSuccess;
-extern char *controlLogTopicFail;
-
-#define COMMAND_VALUE_SPAN 50
-#define ROOT_NODE_COMMAND_RANGE_STARTS 50
-
-typedef struct
+//topics of the messages to AWS. built once by AWS_CreateTopics, messages refer to them by id
+typedef enum
 {
-   uint8_t ubyKey;
-   uint8_t (*root_fun)(uint32_t uwValue, char *cptrString, uint8_t *ubyptrMacs);
-} RootCmnds_t;
+   AWS_TOPIC_SENSOR_DATA,
+   AWS_TOPIC_CONTROL_DATA,
+   AWS_TOPIC_LOGS,
+   AWS_TOPIC_CONTROL_SUCCESS,
+   AWS_TOPIC_CONTROL_FAIL,
+   AWS_TOPIC_COUNT
+} AWSTopicId_t;
+#define AWS_TOPIC_MAX_LENGTH 64
+extern char AWSTopics[AWS_TOPIC_COUNT][AWS_TOPIC_MAX_LENGTH];
+//UPLINK_ENCODING_JSON or UPLINK_ENCODING_CBOR for each topic
+extern uint8_t AWSTopicEncoding[AWS_TOPIC_COUNT];
 
-typedef struct
-{
-   char *cptrTopic;
-   char *cptrPayload;
-} AWSPub_t;
+//messages to AWS are queued in slots of AWSPublishPool: the payload is in the data of the slot, the topic id in its tag.
+//the slots fit the usual messages, a longer one (up to a message of the mesh) gets a buffer from the heap
+#define AWS_PUBLISH_QUEUE_LENGTH 25
+#define AWS_PUBLISH_PAYLOAD_SIZE 768
+extern MsgBufferPool AWSPublishPool;
+//messages from the nodes, queued in rootCommandQueue as buffers of rootReadPool: the payload is the text of the
+//message, NUL terminated. the root read task receives straight into a buffer, after the mac of the node which sent
+//it, kept as the topic of the buffer (MWIFI_ADDR_LEN bytes)
+#define ROOT_READ_POOL_SIZE 16
+extern MsgBufferPool rootReadPool;
+//root commands from AWS, queued the same way without a mac. a pool of their own, so the status messages of the nodes
+//can not hold all the buffers
+#define ROOT_AWS_COMMAND_POOL_SIZE 4
+extern MsgBufferPool rootAWSCommandPool;
 // TODO: #55 @sagar448 @cambrian-dk struct for passing around data is unnecessary, can be removed
 typedef struct
 {
@@ -37,12 +52,15 @@ typedef struct
 } MeshStruct_t;
 
 extern void RootUtilities_loadOrgInfo();
+extern void RootUtilities_LoadTopicEncoding();
 extern void RootUtilities_CreateQueues();
 extern bool RootUtilities_ParseNodeAddressAndData(MeshStruct_t *structRootWrite, char *cptrRcvdData);
-extern void RootUtilities_SendDataToAWS(char *cptrTopic, char *cptrPayload);
+extern void RootUtilities_SendDataToAWS(AWSTopicId_t topic, char *cptrPayload);
+extern void RootUtilities_SendJsonToAWS(AWSTopicId_t topic, const cJSON *json);
+extern void RootUtilities_SendBinaryToAWS(AWSTopicId_t topic, const void *vptrPayload, size_t length);
+extern bool RootUtilities_ProcessUplinkFrame(const uint8_t *ubyptrFrame, size_t size, const uint8_t *ubyptrSourceMac);
 extern void RootUtilities_PrepareJsonAndSendDataToGroup(uint16_t ubyCommand, uint32_t uwValue, char *cptrString, MeshStruct_t *structRootWrite);
 uint8_t RootUtilities_ValidateAndExecuteCommand(uint8_t ubyCommand, uint32_t uwValue, char *cptrString, uint8_t *ubyptrMacs);
-extern uint8_t *RootUtilities_ParseMacAddress(cJSON *cjMacs, uint8_t *ubyptrNodeMacs);
 extern esp_err_t RootUtilities_httpEventHandler(esp_http_client_event_t *evt);
 extern bool RootUtilities_SendStatusUpdate(char *devID, uint8_t status);
 extern bool RootUtilities_RootWrite(MeshStruct_t *structRootWrite);
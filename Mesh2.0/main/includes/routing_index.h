@@ -0,0 +1,36 @@
+#ifdef ROOT
+#ifndef ROUTING_INDEX_H
+#define ROUTING_INDEX_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+// hash set of the MACs of the routing table, to verify the targets of the commands without copying the table
+#define ROUTING_INDEX_MAX_NODES             CONFIG_MWIFI_CAPACITY_NUM
+#define ROUTING_INDEX_SLOTS                 1024    // power of two, at least 2 * ROUTING_INDEX_MAX_NODES
+#define ROUTING_INDEX_RECONCILE_INTERVAL    60      // seconds after which the set is built again, even without a routing table event
+
+#if ROUTING_INDEX_SLOTS < 2 * ROUTING_INDEX_MAX_NODES
+#error "ROUTING_INDEX_SLOTS is too small for CONFIG_MWIFI_CAPACITY_NUM"
+#endif
+
+typedef struct
+{
+    uint32_t generation;        // number of times the set was built
+    uint32_t events;            // routing table changes since start up
+    uint32_t reconciliations;   // builds done because ROUTING_INDEX_RECONCILE_INTERVAL was over
+    uint32_t lookups;
+    uint32_t misses;            // MACs which were not in the routing table
+    uint16_t nodes;
+} RoutingIndex_Metrics_t;
+
+extern esp_err_t RoutingIndex_Init();
+extern void RoutingIndex_Invalidate();
+extern bool RoutingIndex_Contains(const uint8_t *ubyptrMac);
+extern uint32_t RoutingIndex_Generation();
+extern void RoutingIndex_GetMetrics(RoutingIndex_Metrics_t *metrics);
+
+#endif
+#endif
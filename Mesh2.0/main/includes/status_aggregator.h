@@ -0,0 +1,45 @@
+#ifdef ROOT
+#ifndef STATUS_AGGREGATOR_H
+#define STATUS_AGGREGATOR_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+// latest state kept per node (devID), type of message (devType or cmnd) and channel. the table only holds the keys,
+// the messages are allocated at their length
+#define STATUS_AGGREGATOR_CHANNELS_PER_NODE 2       // entries per node on average
+#define STATUS_AGGREGATOR_MAX_ENTRIES       (CONFIG_MWIFI_CAPACITY_NUM * STATUS_AGGREGATOR_CHANNELS_PER_NODE)
+#define STATUS_AGGREGATOR_MAX_BYTES         (64 * 1024)     // memory taken by the kept messages, the next ones are passed through
+#define STATUS_AGGREGATOR_KEY_LENGTH        48
+#define STATUS_AGGREGATOR_ENTRY_SIZE        192     // max length of a status message which is aggregated
+
+// snapshots
+// seconds between snapshots. 0: every status is published as it comes. off until the backend sets an interval, since
+// the snapshot envelope is a different format on the sensor data topic which it has to read first
+#define STATUS_AGGREGATOR_DEFAULT_INTERVAL  0
+#define STATUS_AGGREGATOR_MAX_INTERVAL      3600
+#define STATUS_AGGREGATOR_POLL_INTERVAL     1000    // max ms between two StatusAggregator_Poll, a snapshot may be that late
+
+typedef struct
+{
+    uint32_t updates;           // status messages kept for the next snapshot
+    uint32_t replaced;          // updates which replaced one not published yet
+    uint32_t urgent;            // published at once because they were flagged as urgent
+    uint32_t passedThrough;     // published at once because they have no devID, are too long or the table is full
+    uint32_t snapshots;         // messages published with the changed states
+    uint32_t bytes;             // memory taken by the keys and messages in the table
+    uint16_t entries;           // nodes, types and channels in the table
+} StatusAggregator_Metrics_t;
+
+extern esp_err_t StatusAggregator_Init();
+extern bool StatusAggregator_Update(const char *cptrMessage);
+extern void StatusAggregator_Poll();
+extern esp_err_t StatusAggregator_SetInterval(uint32_t seconds);
+extern uint32_t StatusAggregator_GetInterval();
+extern void StatusAggregator_GetMetrics(StatusAggregator_Metrics_t *metrics);
+extern void StatusAggregator_PrintMetrics();
+
+#endif
+#endif
@@ -0,0 +1,55 @@
+#if defined(ROOT) || defined(GATEWAY_SIM7080)
+#ifndef UPLINK_JOURNAL_H
+#define UPLINK_JOURNAL_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+#include "esp_partition.h"
+
+// flash layout
+#define UPLINK_JOURNAL_PARTITION_LABEL      "reserved"      // the unused data partition of partitions.csv, fielded devices have it
+#define UPLINK_JOURNAL_MAX_SIZE             (64 * 1024)     // taken from the start of the partition, the rest stays free
+#define UPLINK_JOURNAL_SECTOR_SIZE          4096
+#define UPLINK_JOURNAL_MAX_TOPIC            64
+#define UPLINK_JOURNAL_MAX_PAYLOAD          1536            // a message from the mesh (MWIFI_PAYLOAD_LEN) fits
+
+// draining
+#define UPLINK_JOURNAL_TTL                  (24 * 60 * 60)  // seconds of powered on time a message is kept. time while powered off is not counted
+#define UPLINK_JOURNAL_DRAIN_INTERVAL       200             // ms between the messages drained from the journal after a reconnect
+
+typedef struct
+{
+    uint32_t appended;
+    uint32_t drained;
+    uint32_t expired;           // dropped because they were older than UPLINK_JOURNAL_TTL
+    uint32_t overwritten;       // dropped because the journal was full
+    uint32_t corrupted;         // dropped because of a CRC error or an interrupted write
+    uint32_t discarded;         // dropped by the sender, which could not deliver them
+    uint32_t erases;
+    uint32_t pending;           // messages waiting in the journal
+} UplinkJournal_Metrics_t;
+
+// a message returned by UplinkJournal_Peek, to consume it once it is delivered
+typedef struct
+{
+    uint16_t sector;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t crc;
+} UplinkJournal_Position_t;
+
+extern esp_err_t UplinkJournal_Init();
+extern bool UplinkJournal_IsAvailable();
+extern esp_err_t UplinkJournal_Append(const char *cptrTopic, const void *vptrPayload, size_t payloadLength);
+extern esp_err_t UplinkJournal_Peek(char *cptrTopic, size_t topicSize, char *cptrPayload, size_t payloadSize, size_t *ptrPayloadLength,
+                                    UplinkJournal_Position_t *ptrPosition);
+extern esp_err_t UplinkJournal_Consume();
+extern esp_err_t UplinkJournal_ConsumeAt(const UplinkJournal_Position_t *position);
+extern esp_err_t UplinkJournal_Discard(const UplinkJournal_Position_t *position);
+extern uint32_t UplinkJournal_Pending();
+extern void UplinkJournal_GetMetrics(UplinkJournal_Metrics_t *metrics);
+extern void UplinkJournal_PrintMetrics();
+
+#endif
+#endif
@@ -16,6 +16,8 @@
 #include "esp_event_loop.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "command_queue.h"
+#include "command_parser.h"
 
 #define MESH_ID "Work1"
 #define MESH_PASSWORD "914E2A2F"
@@ -27,10 +29,11 @@ extern char deviceMACStr[18];
 
 extern void Utilities_InitializeNVS();
 extern void Utilities_GetDeviceMac(char *macStr);
+extern const char *Utilities_ParseMac(const char *strmac, uint8_t *mac);
 extern bool Utilities_StringToMac(const char *strmac, uint8_t *mac);
 extern bool Utilities_MacToString(const uint8_t *mac, char *strmac, size_t size);
 extern bool Utilities_MacToStringShortVersion(const uint8_t *mac, char *strmac, size_t size);
 extern bool Utilities_StringToMacShortVersion(const char *strmac, uint8_t *mac);
 extern bool Utilities_ValidateHexString(char *grpID, int length);
-extern bool Utilities_ValidateMacAddress(char *macAdd);
+extern bool Utilities_ValidateMacAddress(const char *macAdd);
 extern void print_system_info_timercb(void *timer);
@@ -8,6 +8,7 @@
 #include "includes/node_operations.h"
 #include "includes/root_operations.h"
 #include "includes/aws.h"
+#include "includes/command_registry.h"
 
 // load init_GW for the below two cases
 #if defined(GATEWAY_ETH) || defined(GATEWAY_SIM7080)
@@ -29,6 +30,7 @@ void InitisaliseMisc()
 void RootTasks()
 {
     RootUtilities_loadOrgInfo();
+    RootUtilities_LoadTopicEncoding();
     xTaskCreate(AWS_AWSTask, "aws_task", 5120, NULL, 4, NULL);
     xTaskCreate(RootOperations_RootGroupReadTask, "RootGroupReadTask", 2048, NULL, 4, NULL);
     xTaskCreate(RootOperations_ProcessNodeCommands, "ProcessNodeCmnds", 4096, NULL, 4, NULL);
@@ -60,6 +62,7 @@ void app_main()
     esp_log_level_set(TAG, ESP_LOG_DEBUG);
     // need queues here for the mesh setup
     InitisaliseMisc();
+    CommandRegistry_Validate();
 
 // device is configured as a root (can be a GW ETH)
 #ifdef ROOT
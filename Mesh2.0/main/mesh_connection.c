@@ -40,10 +40,15 @@ static mdf_err_t event_loop_cb(mdf_event_loop_t event, void *ctx)
         MDF_LOGI("total_num: %d", esp_mesh_get_total_node_num());
         // MDF_LOGI("device joined: %s", mesh_event_child_connected_t->mac[0])
         // MDF_LOGI("device joined: %s", mesh_event_child_connected_t->mac[1])
+#ifdef ROOT
+        RoutingIndex_Invalidate();
+#endif
         break;
     case MDF_EVENT_MWIFI_ROUTING_TABLE_REMOVE:
         MDF_LOGI("total_num: %d", esp_mesh_get_total_node_num());
-        // if (esp_mesh_is_root()){}
+#ifdef ROOT
+        RoutingIndex_Invalidate();
+#endif
         break;
 
     case MDF_EVENT_MWIFI_PARENT_DISCONNECTED:
@@ -85,14 +90,12 @@ static mdf_err_t event_loop_cb(mdf_event_loop_t event, void *ctx)
             // 1 for connections and vice versa
             cJSON_AddNumberToObject(connectionData, "status", 1);
 
-            char *payload = cJSON_PrintUnformatted(connectionData);
 #ifdef ROOT
-            RootUtilities_SendDataToAWS(logTopic, payload);
+            RootUtilities_SendJsonToAWS(AWS_TOPIC_LOGS, connectionData);
 #elif IPNODE
-            NodeUtilities_PrepareJsonAndSendToRoot(60, 0, payload);
+            NodeUtilities_SendJsonToRoot(60, 0, connectionData);
 #endif
             cJSON_Delete(connectionData);
-            free(payload);
         }
         break;
     }
@@ -117,15 +120,13 @@ static mdf_err_t event_loop_cb(mdf_event_loop_t event, void *ctx)
             // 0 for disconnections and vice versa
             cJSON_AddNumberToObject(connectionData, "status", 0);
 
-            char *payload = cJSON_PrintUnformatted(connectionData);
             // RootUtilities_SubmitRootMeshConnectionData(payload);
 #ifdef ROOT
-            RootUtilities_SendDataToAWS(logTopic, payload);
+            RootUtilities_SendJsonToAWS(AWS_TOPIC_LOGS, connectionData);
 #elif IPNODE
-            NodeUtilities_PrepareJsonAndSendToRoot(60, 0, payload);
+            NodeUtilities_SendJsonToRoot(60, 0, connectionData);
 #endif
             cJSON_Delete(connectionData);
-            free(payload);
         }
         break;
     }
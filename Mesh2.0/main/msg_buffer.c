@@ -0,0 +1,173 @@
+#include "includes/msg_buffer.h"
+#include "esp_log.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "MsgBuffer";
+
+static portMUX_TYPE msgBufferLock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief  allocate the buffers of a pool. called once, at start up
+ * @param pool[out] the pool
+ * @param name[in] name of the pool, for logs
+ * @param count[in] number of buffers
+ * @param bufferSize[in] bytes of data in each buffer
+ * @return ESP_OK if success, else ESP_ERR_NO_MEM
+ */
+esp_err_t MsgBuffer_InitPool(MsgBufferPool *pool, const char *name, uint8_t count, uint16_t bufferSize)
+{
+    size_t stride = (sizeof(MsgBuffer) + bufferSize + 3) & ~3;
+
+    memset(pool, 0, sizeof(MsgBufferPool));
+    pool->name = name;
+    pool->bufferSize = bufferSize;
+    pool->count = count;
+    pool->storage = (uint8_t *)calloc(count, stride);
+    pool->freeBuffers = xQueueCreate(count, sizeof(MsgBuffer *));
+    if (pool->storage == NULL || pool->freeBuffers == NULL)
+    {
+        ESP_LOGE(TAG, "Could not allocate the %s pool", name);
+        free(pool->storage);
+        pool->storage = NULL;
+        if (pool->freeBuffers != NULL)
+        {
+            vQueueDelete(pool->freeBuffers);
+            pool->freeBuffers = NULL;
+        }
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        MsgBuffer *buffer = (MsgBuffer *)(pool->storage + i * stride);
+        buffer->pool = pool;
+        xQueueSendToBack(pool->freeBuffers, &buffer, 0);
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief  take a free buffer from a pool. the caller holds the only reference
+ * @param pool[in] the pool
+ * @param wait[in] ticks to wait for a buffer to be released, if all are held
+ * @return the buffer, or NULL if the pool has no free buffer
+ */
+MsgBuffer *MsgBuffer_Acquire(MsgBufferPool *pool, TickType_t wait)
+{
+    MsgBuffer *buffer = NULL;
+    if (pool->freeBuffers == NULL || xQueueReceive(pool->freeBuffers, &buffer, wait) != pdTRUE)
+    {
+        portENTER_CRITICAL(&msgBufferLock);
+        pool->exhausted++;
+        portEXIT_CRITICAL(&msgBufferLock);
+        return NULL;
+    }
+
+    buffer->refs = 1;
+    buffer->tag = 0;
+    buffer->length = 0;
+    buffer->topicOffset = 0;
+    buffer->topicLength = 0;
+    buffer->payloadOffset = 0;
+    buffer->payloadLength = 0;
+
+    uint8_t inUse = MsgBuffer_InUse(pool);
+    portENTER_CRITICAL(&msgBufferLock);
+    if (inUse > pool->highWater)
+    {
+        pool->highWater = inUse;
+    }
+    portEXIT_CRITICAL(&msgBufferLock);
+    return buffer;
+}
+
+/**
+ * @brief  take a free buffer and copy a message in it as its payload, followed by a NUL. for the producers which can
+ *         not read straight into the buffer
+ * @param wait[in] ticks to wait for a buffer to be released, if all are held
+ * @return the buffer, or NULL if the pool has no free buffer or the message does not fit
+ */
+MsgBuffer *MsgBuffer_AcquireCopy(MsgBufferPool *pool, const void *data, size_t length, TickType_t wait)
+{
+    if (length >= pool->bufferSize)
+    {
+        ESP_LOGE(TAG, "Message of %d bytes too long for the %s pool", length, pool->name);
+        return NULL;
+    }
+    MsgBuffer *buffer = MsgBuffer_Acquire(pool, wait);
+    if (buffer == NULL)
+    {
+        return NULL;
+    }
+    memcpy(buffer->data, data, length);
+    buffer->data[length] = '\0';
+    buffer->length = length + 1;
+    buffer->payloadLength = length;
+    return buffer;
+}
+
+/**
+ * @brief  allocate a buffer outside of the pools, for the rare message which is longer than the buffers of its pool.
+ *         it is used and released like the others, the last MsgBuffer_Release frees it
+ * @param bufferSize[in] bytes of data
+ * @return the buffer, or NULL if the heap has no room for it
+ */
+MsgBuffer *MsgBuffer_AcquireHeap(size_t bufferSize)
+{
+    MsgBuffer *buffer = (MsgBuffer *)calloc(1, sizeof(MsgBuffer) + bufferSize);
+    if (buffer == NULL)
+    {
+        ESP_LOGE(TAG, "Could not allocate a buffer of %d bytes", bufferSize);
+        return NULL;
+    }
+    buffer->refs = 1;
+    return buffer;
+}
+
+/**
+ * @brief  add a holder to a buffer, eg: before giving the same buffer to a second consumer
+ */
+void MsgBuffer_Retain(MsgBuffer *buffer)
+{
+    portENTER_CRITICAL(&msgBufferLock);
+    buffer->refs++;
+    portEXIT_CRITICAL(&msgBufferLock);
+}
+
+/**
+ * @brief  drop a holder of a buffer. the last one returns the buffer to its pool
+ */
+void MsgBuffer_Release(MsgBuffer *buffer)
+{
+    if (buffer == NULL)
+    {
+        return;
+    }
+
+    portENTER_CRITICAL(&msgBufferLock);
+    uint8_t refs = --buffer->refs;
+    portEXIT_CRITICAL(&msgBufferLock);
+
+    if (refs == 0)
+    {
+        if (buffer->pool == NULL)
+        {
+            free(buffer);
+            return;
+        }
+        xQueueSendToBack(buffer->pool->freeBuffers, &buffer, 0);
+    }
+}
+
+/**
+ * @brief  number of buffers of a pool which are held
+ */
+uint8_t MsgBuffer_InUse(MsgBufferPool *pool)
+{
+    if (pool->freeBuffers == NULL)
+    {
+        return 0;
+    }
+    return pool->count - uxQueueMessagesWaiting(pool->freeBuffers);
+}
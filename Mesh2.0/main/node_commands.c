@@ -18,10 +18,8 @@ bool TestNode(NodeStruct_t *structNodeReceived)
     cJSON *nodeData = cJSON_CreateObject();
     cJSON_AddItemToObject(nodeData, "devID", cJSON_CreateString(deviceMACStr));
     cJSON_AddNumberToObject(nodeData, "status", 1);
-    char *dataToSend = cJSON_PrintUnformatted(nodeData);
-    NodeUtilities_PrepareJsonAndSendToRoot(60, 0, dataToSend);
+    NodeUtilities_SendJsonToRoot(60, 0, nodeData);
     cJSON_Delete(nodeData);
-    free(dataToSend);
     return true;
 }
 
@@ -341,12 +339,16 @@ bool AssignSensorToNodeOrGroup(NodeStruct_t *structNodeReceived)
 {
     //macofSensor_mac:of:Node/mac:of:group
     ESP_LOGI(TAG, "AssignSensorToNodeOrGroup");
-    char *token;
-    char macOfSensor[13];
-    //Getting the mac address in string of the sensor
-    token = strtok(structNodeReceived->cptrString, "_");
-    strcpy(macOfSensor, token);
-    token = strtok(NULL, "_");
+    char macOfSensor[13] = "";
+    //Getting the mac address in string of the sensor, the node/group mac follows the '_'
+    char *token = strchr(structNodeReceived->cptrString, '_');
+    if (token == NULL || (token - structNodeReceived->cptrString) >= sizeof(macOfSensor))
+    {
+        ESP_LOGI(TAG, "String is not sensorMac_nodeOrGroupMac");
+        return false;
+    }
+    memcpy(macOfSensor, structNodeReceived->cptrString, token - structNodeReceived->cptrString);
+    token++;
     uint8_t nodeMac[6] = {0};
     // validate string mac
     if (!Utilities_ValidateHexString(macOfSensor, 12))
@@ -360,15 +362,13 @@ bool AssignSensorToNodeOrGroup(NodeStruct_t *structNodeReceived)
         ESP_LOGI(TAG, "Node/Group MAC is not valid MAC address");
         return false;
     }
-    //Convert string mac short version to uint8_t mac address
-    //Converting string to mac does not work with the missing ':'
     Utilities_StringToMac(token, nodeMac);
 
     nvs_handle nvsHandle;
     if (nvs_open(nvsStorage, NVS_READWRITE, &nvsHandle) != ESP_OK)
         return false;
     size_t sensorActionSize = 0;
-    if (nvs_get_blob(nvsHandle, structNodeReceived->cptrString, NULL, &sensorActionSize) != ESP_OK)
+    if (nvs_get_blob(nvsHandle, macOfSensor, NULL, &sensorActionSize) != ESP_OK)
     {
         ESP_LOGI(TAG, "Sensor not assigned to node");
         nvs_close(nvsHandle);
@@ -530,9 +530,7 @@ bool GetParentRSSI(NodeStruct_t *structNodeReceived)
     }
     cJSON_AddNumberToObject(cJRssi, "parentRssi", mwifi_get_parent_rssi());
     cJSON_AddItemToObject(cJRssi, "devID", cJSON_CreateString(deviceMACStr));
-    char *dataToSend = cJSON_PrintUnformatted(cJRssi);
-    NodeUtilities_PrepareJsonAndSendToRoot(60, 0, dataToSend);
-    free(dataToSend);
+    NodeUtilities_SendJsonToRoot(60, 0, cJRssi);
     cJSON_Delete(cJRssi);
     return true;
 }
@@ -562,12 +560,33 @@ bool GetNodeChildren(NodeStruct_t *structNodeReceived)
             cJSON_AddItemToArray(arrayNode, cJSON_CreateString((char *)(wifi_sta_list.sta[i].mac)));
         }
         cJSON_AddItemToObject(cJChildMacs, "childNodes", arrayNode);
-        char *dataToSend = cJSON_PrintUnformatted(cJChildMacs);
-        NodeUtilities_PrepareJsonAndSendToRoot(60, 0, dataToSend);
-        free(dataToSend);
+        NodeUtilities_SendJsonToRoot(60, 0, cJChildMacs);
         cJSON_Delete(cJChildMacs);
         return true;
     }
 }
 
+//dValue 1 sends the messages to the root as CBOR frames, 0 as JSON. kept over restarts
+bool SetUplinkEncoding(NodeStruct_t *structNodeReceived)
+{
+    ESP_LOGI(TAG, "SetUplinkEncoding Function Called");
+    uint8_t encoding = ((uint8_t)structNodeReceived->dValue == UPLINK_ENCODING_CBOR) ? UPLINK_ENCODING_CBOR : UPLINK_ENCODING_JSON;
+    nvs_handle nvsHandle;
+    if (nvs_open(nvsStorage, NVS_READWRITE, &nvsHandle) != ESP_OK)
+        return false;
+    if (nvs_set_u8(nvsHandle, "uplinkEnc", encoding) != ESP_OK)
+    {
+        nvs_close(nvsHandle);
+        return false;
+    }
+    if (nvs_commit(nvsHandle) != ESP_OK)
+    {
+        nvs_close(nvsHandle);
+        return false;
+    }
+    nvs_close(nvsHandle);
+    uplinkEncoding = encoding;
+    return true;
+}
+
 #endif
\ No newline at end of file
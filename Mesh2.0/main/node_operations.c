@@ -5,103 +5,71 @@ static const char *TAG = "NodeOperations";
 
 void NodeOperations_CommandExecutionTask(void *arg)
 {
+    static CommandQueue_Latency_t latency = COMMAND_QUEUE_LATENCY_INIT("NodeCommandExecution");
+    static CommandMessage_t message;
+    MsgBuffer *buffer = NULL;
     char *cptrNodeData = NULL;
-    bool isArray = false;
+    NodeStruct_t structNodeReceived;
     while (true)
     {
         if (nodeReadQueue != NULL)
         {
-            if (xQueueReceive(nodeReadQueue, &cptrNodeData, (TickType_t)0))
+            //sleeps until a command comes
+            if ((buffer = CommandQueue_Receive(nodeReadQueue, portMAX_DELAY, &latency)) != NULL)
             {
-                NodeStruct_t *structNodeReceived = malloc(sizeof(NodeStruct_t));
-                cJSON *json = cJSON_Parse(cptrNodeData);
+                //parsed and executed from the buffer it was read into
+                cptrNodeData = (char *)buffer->data + buffer->payloadOffset;
                 //GW required changes: OTA data does not come in the form of JSON. therefore the data is parsed to GW OTA function.
                 //If the function does not expect OTA data, it returns immediately.
                 bool OTA_data = GW_Process_OTA_Command_Data(cptrNodeData);
-                if (json == NULL)
+                if (!CommandParser_Parse(cptrNodeData, &message))
                 {
-                    const char *error_ptr = cJSON_GetErrorPtr();
-                    if (error_ptr != NULL)
-                    {
-                        if (!OTA_data)
-                        {
-                            ESP_LOGE(TAG, "Error while parsing NodeOperations_CommandExecutionTask");
-                        }
-                    }
                     if (!OTA_data)
                     {
+                        ESP_LOGE(TAG, "Error while parsing NodeOperations_CommandExecutionTask");
                         NodeUtilities_PrepareJsonAndSendToRoot(65, 0, cptrNodeData);
                     }
                 }
-                else
+                else if (COMMAND_FIELDS_HAVE(&message, COMMAND_FIELD_CMND | COMMAND_FIELD_STR) &&
+                         (message.fields & (COMMAND_FIELD_VAL | COMMAND_FIELD_VALS)))
                 {
-                    // Parse data
-                    cJSON *cjCommand = cJSON_GetObjectItemCaseSensitive(json, "cmnd");
-                    if (cJSON_IsNumber(cjCommand))
-                    {
-                        structNodeReceived->ubyCommand = cjCommand->valueint;
-                        cJSON *cjValue = cJSON_GetObjectItemCaseSensitive(json, "val");
-                        if (cJSON_IsNumber(cjValue) || cJSON_IsArray(cjValue))
-                        {
-                            structNodeReceived->dValue = cjValue->valuedouble;
-                            structNodeReceived->arrValueSize = 0;
-                            if (cJSON_IsArray(cjValue))
-                            {
-                                isArray = true;
-                                structNodeReceived->arrValueSize = cJSON_GetArraySize(cjValue);
-                                structNodeReceived->arrValues = malloc(cJSON_GetArraySize(cjValue) * sizeof(uint8_t));
-                                NodeUtilities_ParseArrVal(cjValue, structNodeReceived->arrValues);
-                            }
-                            cJSON *cjString = cJSON_GetObjectItemCaseSensitive(json, "str");
-                            if (cJSON_IsString(cjString))
-                            {
-                                structNodeReceived->cptrString = cjString->valuestring;
-                                bool returnVal = NodeUtilities_ValidateAndExecuteCommand(structNodeReceived);
-                                if (returnVal)
-                                {
-                                    NodeUtilities_PrepareJsonAndSendToRoot(64, 0, cptrNodeData);
-                                }
-                                else
-                                {
-                                    NodeUtilities_PrepareJsonAndSendToRoot(65, 0, cptrNodeData);
-                                }
-                                goto NodeOperations_CommandExecutionTask_End;
-                            }
-                        }
-                    }
-                    // GW required changes: sometimes OTA data is mis-represented as JSON formatted, even though it is not.
-                    // therefore, first check if the current data is OTA related, and if so, then dont send information to AWS
-                    if (!OTA_data)
-                    {
-                        NodeUtilities_PrepareJsonAndSendToRoot(65, 0, cptrNodeData);
-                    }
+                    structNodeReceived.ubyCommand = message.command;
+                    structNodeReceived.dValue = message.value;
+                    structNodeReceived.arrValues = (message.fields & COMMAND_FIELD_VALS) ? message.values : NULL;
+                    structNodeReceived.arrValueSize = message.valueCount;
+                    structNodeReceived.cptrString = message.string;
+                    bool returnVal = NodeUtilities_ValidateAndExecuteCommand(&structNodeReceived);
+                    NodeUtilities_SendAckToRoot(returnVal, message.id, cptrNodeData, "");
                 }
-            NodeOperations_CommandExecutionTask_End:
-                cJSON_Delete(json);
-                vPortFree(cptrNodeData);
-                free(structNodeReceived);
-                if (isArray)
+                // GW required changes: sometimes OTA data is mis-represented as JSON formatted, even though it is not.
+                // therefore, first check if the current data is OTA related, and if so, then dont send information to AWS
+                else if (!OTA_data)
                 {
-                    free(structNodeReceived->arrValues);
-                    isArray = false;
+                    NodeUtilities_SendAckToRoot(false, message.id, cptrNodeData, "fields");
                 }
+                CommandParser_Release(&message);
+                MsgBuffer_Release(buffer);
             }
         }
-        vTaskDelay(10 / portTICK_RATE_MS); //Leave this for watchdog
+        else
+        {
+            vTaskDelay(100 / portTICK_RATE_MS); //the queue is not created yet
+        }
     }
 }
 
 void NodeOperations_RootSendTask(void *arg)
 {
-    char *rootSendData = NULL;
+    RootSendFrame_t *rootSendData = NULL;
     while (true)
     {
         if (rootSendQueue != NULL)
         {
-            if (xQueueReceive(rootSendQueue, &rootSendData, (TickType_t)0))
+            //sleeps until a message comes. acks are sent before the sensor data and the logs
+            if ((rootSendData = CommandLanes_Receive(rootSendQueue, portMAX_DELAY, NULL)) != NULL)
             {
                 mwifi_data_type_t data_type = {.communicate = MWIFI_COMMUNICATE_UNICAST, .compression = true};
-                mdf_err_t ret = mwifi_write(NULL, &data_type, rootSendData, strlen(rootSendData) + 1, true);
+                mdf_err_t ret = mwifi_write(NULL, &data_type, rootSendData->data, rootSendData->length, true);
                 //TODO@sagar448 #16 handling error if the mwifi write function did not successfully send!
                 if (ret == MDF_OK)
                 {
@@ -115,14 +83,18 @@ void NodeOperations_RootSendTask(void *arg)
                 vPortFree(rootSendData);
             }
         }
-        vTaskDelay(10 / portTICK_RATE_MS); //Leave this for watchdog
+        else
+        {
+            vTaskDelay(100 / portTICK_RATE_MS); //the queue is not created yet
+        }
     }
 }
 
 void NodeOperations_NodeReadTask(void *arg)
 {
     mdf_err_t ret = MDF_OK;
-    char *data = MDF_MALLOC(MWIFI_PAYLOAD_LEN);
+    MsgBuffer *buffer = NULL;
+    char *data = NULL;
     size_t size = MWIFI_PAYLOAD_LEN;
     mwifi_data_type_t data_type = {0x0};
     uint8_t src_addr[MWIFI_ADDR_LEN] = {0x0};
@@ -135,8 +107,15 @@ void NodeOperations_NodeReadTask(void *arg)
             //ESP_LOGI(TAG, "Here ");
             continue;
         }
+        //the command is read straight into a buffer of nodeReadPool, which is queued as it is. while all the buffers
+        //are held the task waits for one, and the commands wait in the mesh
+        if (buffer == NULL && (buffer = MsgBuffer_Acquire(&nodeReadPool, portMAX_DELAY)) == NULL)
+        {
+            vTaskDelay(100 / portTICK_RATE_MS); //the pool is not created yet
+            continue;
+        }
+        data = (char *)buffer->data;
         size = MWIFI_PAYLOAD_LEN;
-        memset(data, 0, MWIFI_PAYLOAD_LEN);
         ret = mwifi_read(src_addr, &data_type, data, &size, portMAX_DELAY);
         MDF_ERROR_CONTINUE(ret != MDF_OK, "mwifi_read, ret: %s", mdf_err_to_name(ret));
         if (data_type.upgrade)
@@ -147,14 +126,20 @@ void NodeOperations_NodeReadTask(void *arg)
         }
         else
         {
+            data[size] = '\0';
+            buffer->length = size + 1;
+            buffer->payloadLength = size;
             MDF_LOGI("Receive [NODE] addr: " MACSTR ", size: %d, data: %s",
                      MAC2STR(src_addr), size, data);
-            char *cptrData = (char *)pvPortMalloc((size + 1) * sizeof(char));
-            memcpy(cptrData, data, size);
-            if (xQueueSendToBack(nodeReadQueue, &cptrData, (TickType_t)0) != pdPASS)
+            //the buffer is released by the consumer
+            if (CommandQueue_Send(nodeReadQueue, buffer))
+            {
+                buffer = NULL;
+            }
+            else
             {
                 ESP_LOGE(TAG, "Queue is full");
-                vPortFree(cptrData);
+                //the buffer is used for the next command
                 //Report back to Root here letting us know that the queue is full and to wait for the next command
                 //The queue most likely will neveer fill up but you never know
             }
@@ -162,18 +147,20 @@ void NodeOperations_NodeReadTask(void *arg)
         }
     }
     MDF_LOGW("Note read task is exiting");
-    MDF_FREE(data);
+    MsgBuffer_Release(buffer);
     vTaskDelete(NULL);
 }
 
 void NodeOperations_ProcessEspNowCommands()
 {
+    static CommandQueue_Latency_t latency = COMMAND_QUEUE_LATENCY_INIT("ProcessEspNow");
     EspNowStruct *recv_cb;
     while (true)
     {
         if (espNowQueue != NULL)
         {
-            if (xQueueReceive(espNowQueue, &recv_cb, (TickType_t)0))
+            //sleeps until a message comes
+            if ((recv_cb = CommandQueue_Receive(espNowQueue, portMAX_DELAY, &latency)) != NULL)
             {
                 Sensor_SendPendingMessage(recv_cb);
                 size_t requiredSize = 0;
@@ -210,9 +197,7 @@ void NodeOperations_ProcessEspNowCommands()
                             else
                             {
                                 cJSON_AddItemToObject(json, "macOfNode", cJSON_CreateString(macOfNodeStr));
-                                char *dataToSend = cJSON_PrintUnformatted(json);
-                                NodeUtilities_PrepareJsonAndSendToRoot(59, 0, dataToSend);
-                                free(dataToSend);
+                                NodeUtilities_SendJsonToRoot(59, 0, json);
                                 cJSON_Delete(json);
                             }
                         }
@@ -224,7 +209,10 @@ void NodeOperations_ProcessEspNowCommands()
                 //ESP_LOGE(TAG, "MEMORY HEAP SIZE: %d", xPortGetFreeHeapSize());
             }
         }
-        vTaskDelay(10 / portTICK_RATE_MS); //Leave this for watchdog
+        else
+        {
+            vTaskDelay(100 / portTICK_RATE_MS); //the queue is not created yet
+        }
     }
 }
 
@@ -1,111 +1,45 @@
 #ifdef IPNODE
 #include "includes/node_utilities.h"
-
-//************************COMMAND MAPPING FOR NODE*******************
-NodeCmnds_t NodeCommand[enumNodeCmndKey_TotalNumOfCommands] = {
-    {254, NULL},
-    {enumNodeCmndKey_RestartNode, RestartNode},
-    {enumNodeCmndKey_TestNode, TestNode},
-    {enumNodeCmndKey_SetNodeOutput, SetNodeOutput},
-    {enumNodeCmndKey_CreateGroup, CreateGroup},
-    {enumNodeCmndKey_DeleteGroup, DeleteGroup},
-    {enumNodeCmndKey_AssignSensorToSelf, AssignSensorToSelf},
-    {enumNodeCmndKey_EnableOrDisableSensorAction, EnableOrDisableSensorAction},
-    {enumNodeCmndKey_RemoveSensor, RemoveSensor},
-    {enumNodeCmndKey_ChangePortPIR, ChangePortPIR},
-    {enumNodeCmndKey_AssignSensorToNodeOrGroup, AssignSensorToNodeOrGroup},
-    {enumNodeCmndKey_OverrideNodeType, OverrideNodeType},
-    {enumNodeCmndKey_RemoveNodeTypeOverride, RemoveNodeTypeOverride},
-    {enumNodeCmndKey_GetDaisyChainedCurrent, GetDaisyChainedCurrent},
-    {enumNodeCmndKey_GetFirmwareVersion, GetFirmwareVersion},
-    {enumNodeCmndKey_GetNodeOutput, GetNodeOutput},
-    {enumNodeCmndKey_GetParentRSSI, GetParentRSSI},
-    {enumNodeCmndKey_GetNodeChildren, GetNodeChildren}};
-
-//GW required changes: Match commands for the GW
-NodeCmnds_t GWCommand[enumGatewayCmndKey_TotalNumOfCommands] = {
-    {254, NULL},
-    {enumGatewayCmndKey_GW_Action, GW_Process_Action_Command},
-    {enumGatewayCmndKey_GW_Query, GW_Process_Query_Command},
-    {enumGatewayCmndKey_GW_OTA_Begin, GW_Process_OTA_Command_Begin},
-    {enumGatewayCmndKey_GW_OTA_End, GW_Process_OTA_Command_End},
-    {enumGatewayCmndKey_GW_AT_CMD, GW_Process_AT_Command}
-    };
-
-NodeCmnds_t SPCommand[enumPowerCmndKey_TotalNumOfCommands] = {
-    {254, NULL},
-    {enumPowerCmndKey_SP_SetVoltage, SP_SetVoltage},
-    {enumPowerCmndKey_SP_SetPWMPort0, SP_SetPWMPort0},
-    {enumPowerCmndKey_SP_SetPWMPort1, SP_SetPWMPort1},
-    {enumPowerCmndKey_SP_SetPWMBothPort, SP_SetPWMBothPort},
-    {enumPowerCmndKey_SP_EnableCurrentSubmission, SP_EnableCurrentSubmission}};
-
-NodeCmnds_t SIOCommand[enumIOCmndKey_TotalNumOfCommands] = {
-    {254, NULL},
-    {enumIOCmndKey_SIO_SetVoltage, SIO_SetVoltage},
-    {enumIOCmndKey_SIO_SelectADCs, SIO_SelectADCs},
-    {enumIOCmndKey_SIO_SetADCPeriod, SIO_SetADCPeriod},
-    {enumIOCmndKey_SIO_EnableDisableSub, SIO_EnableDisableSub},
-    {enumIOCmndKey_SIO_SetRelay, SIO_SetRelay}};
-
-NodeCmnds_t SCCommand[enumContactorCmndKey_TotalNumOfCommands] = {
-    {254, NULL},
-    {enumContactorCmndKey_SC_SetRelays, SC_SetRelays},
-    {enumContactorCmndKey_SC_SelectADCs, SC_SelectADCs},
-    {enumContactorCmndKey_SC_SetADCPeriod, SC_SetADCPeriod}};
-//************************COMMAND MAPPING FOR NODE*******************
+#include "includes/command_registry.h"
 
 static const char *TAG = "NodeUtilities";
 
-static uint8_t ubyNodeCommandStartValue = 0;
-NodeCmnds_t *structptrCommand;
-uint8_t ubyNumOfCommands = 0;
-uint8_t ubyBaseNodeNumOfCommands = 0;
-
 uint8_t nodeOutputPin = 23;
 uint8_t devType = 0;
 
 QueueHandle_t nodeReadQueue;
-QueueHandle_t rootSendQueue;
+MsgBufferPool nodeReadPool;
+CommandLanes_t *rootSendQueue;
+uint8_t uplinkEncoding = UPLINK_ENCODING_JSON;
 
 bool NodeUtilities_ValidateAndExecuteCommand(NodeStruct_t *structNodeReceived)
 {
     ESP_LOGI(TAG, "Command Received: %d", structNodeReceived->ubyCommand);
-    if (structNodeReceived->ubyCommand < (BASE_NODE_COMMAND_RANGE_STARTS + COMMAND_VALUE_SPAN))
+    const CommandRegistry_Entry_t *entry = CommandRegistry_Lookup(structNodeReceived->ubyCommand, COMMAND_NODE_TYPE(devType), COMMAND_SOURCE_MESH);
+    if (entry == NULL)
     {
-        for (uint8_t ubyIndex = 1; ubyIndex <= ubyBaseNodeNumOfCommands; ubyIndex++)
-        {
-            if (NodeCommand[ubyIndex].ubyKey == structNodeReceived->ubyCommand)
-            {
-                return NodeCommand[ubyIndex].node_fun(structNodeReceived);
-            }
-        }
+        ESP_LOGW(TAG, "Incorrect Command Received.");
+        return false;
     }
-    else if ((structNodeReceived->ubyCommand >= ubyNodeCommandStartValue) && (structNodeReceived->ubyCommand < (ubyNodeCommandStartValue + COMMAND_VALUE_SPAN)))
+    if (!CommandRegistry_CheckArguments(entry, structNodeReceived->cptrString, structNodeReceived->arrValues, NULL))
     {
-        for (uint8_t ubyIndex = 1; ubyIndex <= ubyNumOfCommands; ubyIndex++)
-        {
-            if (structptrCommand[ubyIndex].ubyKey == structNodeReceived->ubyCommand)
-            {
-                return structptrCommand[ubyIndex].node_fun(structNodeReceived);
-            }
-        }
+        return false;
     }
-    ESP_LOGW(TAG, "Incorrect Command Received.");
-    return false;
+    return entry->node_fun(structNodeReceived);
 }
 
 void NodeUtilities_CreateQueues()
 {
-    //created a queue with maxumum of 70 commands, and a item size of a char pointer
-    nodeReadQueue = xQueueCreate(70, sizeof(char *));
-    if (nodeReadQueue == NULL)
+    //created a queue with maxumum of 70 commands, and a item size of a MsgBuffer pointer
+    nodeReadQueue = CommandQueue_Create(70);
+    if (nodeReadQueue == NULL || MsgBuffer_InitPool(&nodeReadPool, "NodeRead", NODE_READ_POOL_SIZE, MWIFI_PAYLOAD_LEN + 1) != ESP_OK)
     {
         ESP_LOGE(TAG, "Could not create node read queue");
         //need to restart and let the backend know
     }
 
-    rootSendQueue = xQueueCreate(20, sizeof(char *));
+    //acks go ahead of the sensor data and the logs
+    rootSendQueue = CommandLanes_Create("RootSend", 20);
     if (rootSendQueue == NULL)
     {
         ESP_LOGE(TAG, "Could not create Root Send queue");
@@ -161,29 +95,198 @@ adc1_channel_t NodeUtilities_AdcChannelLookup(uint8_t gpio)
     }
 }
 
-void NodeUtilities_PrepareJsonAndSendToRoot(uint16_t ubyCommand, uint32_t uwValue, char *cptrString)
+static void NodeUtilities_QueueFrameToRoot(RootSendFrame_t *frame, uint16_t ubyCommand)
+{
+    if (!CommandLanes_Send(rootSendQueue, CommandLanes_OfCommand(ubyCommand), frame))
+    {
+        ESP_LOGE(TAG, "Queue is full");
+        vPortFree(frame);
+    }
+}
+
+static void NodeUtilities_PutCborFrame(CborWriter_t *writer, uint16_t ubyCommand, uint32_t uwValue, const cJSON *json, const char *cptrString)
 {
+    Cbor_PutMap(writer, 3);
+    Cbor_PutUint(writer, UPLINK_FRAME_KEY_CMND);
+    Cbor_PutUint(writer, ubyCommand);
+    Cbor_PutUint(writer, UPLINK_FRAME_KEY_VAL);
+    Cbor_PutUint(writer, uwValue);
+    Cbor_PutUint(writer, UPLINK_FRAME_KEY_DATA);
+    if (json != NULL)
+    {
+        if (!Cbor_PutJson(writer, json))
+        {
+            writer->overflow = true;
+        }
+    }
+    else
+    {
+        Cbor_PutString(writer, cptrString);
+    }
+}
+
+/**
+ * @brief  encode a message as a CBOR frame, its data written from the cJSON object, else kept as the text
+ * @param json[in] the message, or NULL to send cptrString
+ * @return the frame, allocated at its length, or NULL if it does not fit a message of the mesh
+ */
+static RootSendFrame_t *NodeUtilities_EncodeCborFrame(uint16_t ubyCommand, uint32_t uwValue, const cJSON *json, const char *cptrString)
+{
+    CborWriter_t writer;
+    Cbor_InitWriter(&writer, NULL, MWIFI_PAYLOAD_LEN);
+    NodeUtilities_PutCborFrame(&writer, ubyCommand, uwValue, json, cptrString);
+    size_t frameSize = Cbor_WriterLength(&writer);
+    if (frameSize == 0)
+    {
+        return NULL;
+    }
+
+    RootSendFrame_t *frame = (RootSendFrame_t *)pvPortMalloc(sizeof(RootSendFrame_t) + frameSize);
+    if (frame == NULL)
+    {
+        return NULL;
+    }
+    Cbor_InitWriter(&writer, frame->data, frameSize);
+    NodeUtilities_PutCborFrame(&writer, ubyCommand, uwValue, json, cptrString);
+    frame->length = Cbor_WriterLength(&writer);
+    if (frame->length == 0)
+    {
+        vPortFree(frame);
+        return NULL;
+    }
+    return frame;
+}
+
+// the message to the root only, as a CBOR frame or the JSON {"cmnd":<ubyCommand>,"val":<uwValue>,"str":<cptrString>}
+static void NodeUtilities_SendTextToRoot(uint16_t ubyCommand, uint32_t uwValue, const char *cptrString)
+{
+    if (uplinkEncoding == UPLINK_ENCODING_CBOR)
+    {
+        RootSendFrame_t *frame = NodeUtilities_EncodeCborFrame(ubyCommand, uwValue, NULL, cptrString);
+        if (frame != NULL)
+        {
+            NodeUtilities_QueueFrameToRoot(frame, ubyCommand);
+            return;
+        }
+    }
+
     cJSON *response = cJSON_CreateObject();
     cJSON_AddNumberToObject(response, "cmnd", ubyCommand);
     cJSON_AddNumberToObject(response, "val", uwValue);
     cJSON_AddItemToObject(response, "str", cJSON_CreateString(cptrString));
     char *dataToSend = cJSON_PrintUnformatted(response);
-    char *payload = (char *)pvPortMalloc((strlen(dataToSend) + 1) * sizeof(char));
-    memset(payload, 0, strlen(dataToSend) + 1);
-    strcpy(payload, dataToSend);
+    size_t length = strlen(dataToSend) + 1;
+    RootSendFrame_t *frame = (RootSendFrame_t *)pvPortMalloc(sizeof(RootSendFrame_t) + length);
+    if (frame != NULL)
+    {
+        frame->length = length;
+        memcpy(frame->data, dataToSend, length);
+        NodeUtilities_QueueFrameToRoot(frame, ubyCommand);
+    }
+
+    free(dataToSend);
+    cJSON_Delete(response);
+}
+
+void NodeUtilities_PrepareJsonAndSendToRoot(uint16_t ubyCommand, uint32_t uwValue, char *cptrString)
+{
     // If SIM module is connected, then send the data to it
 #ifdef GATEWAY_SIM7080
     SecondaryUtilities_PrepareJSONAndSendToAWS(ubyCommand, uwValue, cptrString);
 #endif
+    NodeUtilities_SendTextToRoot(ubyCommand, uwValue, cptrString);
+}
 
-    if (xQueueSendToBack(rootSendQueue, &payload, (TickType_t)0) != pdPASS)
+/**
+ * @brief  send a message built as a cJSON object to the root. a node which sends CBOR encodes it straight from the
+ *         object, the text is only printed for JSON
+ * @param json[in] the message, still owned by the caller
+ */
+void NodeUtilities_SendJsonToRoot(uint16_t ubyCommand, uint32_t uwValue, const cJSON *json)
+{
+#ifndef GATEWAY_SIM7080
+    // the SIM7080 uplink takes the text as well
+    if (uplinkEncoding == UPLINK_ENCODING_CBOR)
     {
-        ESP_LOGE(TAG, "Queue is full");
-        vPortFree(payload);
+        RootSendFrame_t *frame = NodeUtilities_EncodeCborFrame(ubyCommand, uwValue, json, NULL);
+        if (frame != NULL)
+        {
+            NodeUtilities_QueueFrameToRoot(frame, ubyCommand);
+            return;
+        }
     }
+#endif
 
+    char *dataToSend = cJSON_PrintUnformatted(json);
+    if (dataToSend == NULL)
+    {
+        ESP_LOGE(TAG, "Could not print the message");
+        return;
+    }
+    NodeUtilities_PrepareJsonAndSendToRoot(ubyCommand, uwValue, dataToSend);
     free(dataToSend);
-    cJSON_Delete(response);
+}
+
+/**
+ * @brief  answer a command with a success (64) or fail (65) message to the root. a command with a correlation id from
+ *         the root is answered with a compact ack {"cmnd":64,"val":<id>,"str":"<detail>"}, the others are echoed whole
+ * @param id[in] "id" of the command, 0 if it has none
+ * @param cptrCommand[in] the command, echoed if it has no id
+ * @param cptrDetail[in] short reason sent with the ack, "" if none
+ */
+void NodeUtilities_SendAckToRoot(bool success, uint16_t id, char *cptrCommand, const char *cptrDetail)
+{
+    uint16_t ubyCommand = success ? 64 : 65;
+    if (id == 0)
+    {
+        NodeUtilities_PrepareJsonAndSendToRoot(ubyCommand, 0, cptrCommand);
+        return;
+    }
+    // only the AckTracker of the root knows the command of the id, it publishes the ack. a GATEWAY_SIM7080 does not
+    // send the compact ack to AWS itself
+    NodeUtilities_SendTextToRoot(ubyCommand, id, cptrDetail);
+}
+
+/**
+ * @brief  send binary data to the root as a CBOR frame, without the hex text of the JSON messages.
+ *         the root publishes it as the hex JSON message on the topics which are not CBOR
+ * @return false if the node sends JSON, the caller sends the data as hex text instead
+ */
+bool NodeUtilities_PrepareBytesAndSendToRoot(uint16_t ubyCommand, uint32_t uwValue, const uint8_t *ubyptrData, size_t length)
+{
+#ifdef GATEWAY_SIM7080
+    // the SIM7080 uplink takes JSON only, the data goes to both as hex text
+    return false;
+#else
+    if (uplinkEncoding != UPLINK_ENCODING_CBOR)
+    {
+        return false;
+    }
+
+    size_t frameSize = length + 16;
+    RootSendFrame_t *frame = (RootSendFrame_t *)pvPortMalloc(sizeof(RootSendFrame_t) + frameSize);
+    if (frame == NULL)
+    {
+        return false;
+    }
+    CborWriter_t writer;
+    Cbor_InitWriter(&writer, frame->data, frameSize);
+    Cbor_PutMap(&writer, 3);
+    Cbor_PutUint(&writer, UPLINK_FRAME_KEY_CMND);
+    Cbor_PutUint(&writer, ubyCommand);
+    Cbor_PutUint(&writer, UPLINK_FRAME_KEY_VAL);
+    Cbor_PutUint(&writer, uwValue);
+    Cbor_PutUint(&writer, UPLINK_FRAME_KEY_DATA);
+    Cbor_PutBytes(&writer, ubyptrData, length);
+    frame->length = Cbor_WriterLength(&writer);
+    if (frame->length == 0)
+    {
+        vPortFree(frame);
+        return false;
+    }
+    NodeUtilities_QueueFrameToRoot(frame, ubyCommand);
+    return true;
+#endif
 }
 
 bool NodeUtilities_LoadAllNodeGroups()
@@ -246,25 +349,6 @@ void NodeUtilities_SendDataToGroup(uint8_t *ubyGroupMacAddr, char *cptrDataToSen
     }
 }
 
-void NodeUtilities_ParseArrVal(cJSON *cjVals, uint8_t *arrvals)
-{
-    cJSON *Iterator = NULL;
-    uint8_t count = 0;
-    cJSON_ArrayForEach(Iterator, cjVals)
-    {
-        if (cJSON_IsNumber(Iterator))
-        {
-            //ESP_LOGI(TAG, "Number %d, ", Iterator->valueint);
-            arrvals[count] = (uint8_t)Iterator->valueint;
-            count++;
-        }
-        else
-        {
-            ESP_LOGI(TAG, "Invalid Number");
-        }
-    }
-}
-
 void NodeUtilities_SendToNode(uint8_t *macOfNode, char *dataToSend)
 {
     mwifi_data_type_t data_type = {.communicate = MWIFI_COMMUNICATE_UNICAST, .compression = true};
@@ -353,9 +437,6 @@ void NodeUtilities_overrideNodeType(uint8_t nodeType)
 void NodeUtilities_initiateGatewayNode()
 {
     ESP_LOGW(TAG, "I am SpacrGateway");
-    ubyNodeCommandStartValue = GATEWAY_NODE_COMMAND_RANGE_STARTS;
-    structptrCommand = GWCommand;
-    ubyNumOfCommands = sizeof(GWCommand) / sizeof(NodeCmnds_t);
     devType = 4;
     Initialize_Gateway();
 }
@@ -363,9 +444,6 @@ void NodeUtilities_initiateGatewayNode()
 void NodeUtilities_initiatePowerNode()
 {
     ESP_LOGW(TAG, "I am SpacrPower");
-    ubyNodeCommandStartValue = POWER_NODE_COMMAND_RANGE_STARTS;
-    structptrCommand = SPCommand;
-    ubyNumOfCommands = sizeof(SPCommand) / sizeof(NodeCmnds_t);
     devType = 1;
     //initialising values here for and loading previously stored values
     SP_Init();
@@ -374,9 +452,6 @@ void NodeUtilities_initiatePowerNode()
 void NodeUtilities_initiateSpacrIO()
 {
     ESP_LOGW(TAG, "I am SpacrIO");
-    ubyNodeCommandStartValue = IO_NODE_COMMAND_RANGE_STARTS;
-    structptrCommand = SIOCommand;
-    ubyNumOfCommands = sizeof(SIOCommand) / sizeof(NodeCmnds_t);
     devType = 2;
     SIO_Init();
 }
@@ -384,9 +459,6 @@ void NodeUtilities_initiateSpacrIO()
 void NodeUtilities_initiateContactor()
 {
     ESP_LOGW(TAG, "I am SpacrContactor");
-    ubyNodeCommandStartValue = CONTACTOR_NODE_COMMAND_RANGE_STARTS;
-    structptrCommand = SCCommand;
-    ubyNumOfCommands = sizeof(SCCommand) / sizeof(NodeCmnds_t);
     devType = 3;
     //Initialising things here for spacr contactor
     SC_Init();
@@ -394,7 +466,6 @@ void NodeUtilities_initiateContactor()
 
 void NodeUtilities_WhoAmI()
 {
-    ubyBaseNodeNumOfCommands = sizeof(NodeCommand) / sizeof(NodeCmnds_t);
     uint8_t nodeType = 0;
     beginWiper();
     //checking if node ovveride exists
@@ -402,6 +473,7 @@ void NodeUtilities_WhoAmI()
     if (nvs_open(nvsStorage, NVS_READWRITE, &nvsHandle) == ESP_OK)
     {
         nvs_get_u8(nvsHandle, "nodeType", &nodeType);
+        nvs_get_u8(nvsHandle, "uplinkEnc", &uplinkEncoding);
         nvs_close(nvsHandle);
     }
     //GW required changes: temp change for the Node to act as a GW
@@ -9,7 +9,9 @@ uint8_t PublishSensorData(uint32_t uwValue, char *cptrString, uint8_t *ubyptrMac
     ESP_LOGI(TAG, "PublishSensorData Function Called");
     if (strcmp(orgID, "") == 0)
         return 2;
-    RootUtilities_SendDataToAWS(sensorLogTopic, cptrString);
+    if (StatusAggregator_Update(cptrString))
+        return 2;
+    RootUtilities_SendDataToAWS(AWS_TOPIC_SENSOR_DATA, cptrString);
     return 2;
 }
 
@@ -18,16 +20,21 @@ uint8_t PublishControlData(uint32_t uwValue, char *cptrString, uint8_t *ubyptrMa
     ESP_LOGI(TAG, "PublishControlData Function Called");
     if (strcmp(orgID, "") == 0)
         return 2;
-    RootUtilities_SendDataToAWS(controlLogTopic, cptrString);
+    RootUtilities_SendDataToAWS(AWS_TOPIC_CONTROL_DATA, cptrString);
     return 2;
 }
 
+//uwValue is the correlation id of the command for a compact ack, cptrString its detail. 0 if the node echoes the command.
+//ubyptrMacs is the node which sent the ack
 uint8_t PublishNodeControlSuccess(uint32_t uwValue, char *cptrString, uint8_t *ubyptrMacs)
 {
     ESP_LOGI(TAG, "PublishNodeControlSuccess Function Called");
     if (strcmp(orgID, "") == 0)
         return 2;
-    RootUtilities_SendDataToAWS(controlLogTopicSuccess, cptrString);
+    if (uwValue != 0)
+        AckTracker_Publish(uwValue, true, cptrString, ubyptrMacs);
+    else
+        RootUtilities_SendDataToAWS(AWS_TOPIC_CONTROL_SUCCESS, cptrString);
     return 2;
 }
 
@@ -36,7 +43,10 @@ uint8_t PublishNodeControlFail(uint32_t uwValue, char *cptrString, uint8_t *ubyp
     ESP_LOGI(TAG, "PublishNodeControlFail Function Called");
     if (strcmp(orgID, "") == 0)
         return 2;
-    RootUtilities_SendDataToAWS(controlLogTopicFail, cptrString);
+    if (uwValue != 0)
+        AckTracker_Publish(uwValue, false, cptrString, ubyptrMacs);
+    else
+        RootUtilities_SendDataToAWS(AWS_TOPIC_CONTROL_FAIL, cptrString);
     return 2;
 }
 
@@ -272,8 +282,56 @@ uint8_t AddOrgInfo(uint32_t uwValue, char *cptrString, uint8_t *ubyptrNodeMacs)
 uint8_t MessageToAWS(uint32_t uwValue, char *cptrString, uint8_t *ubyptrMacs)
 {
     ESP_LOGI(TAG, "MessageToAWS Function Called");
-    RootUtilities_SendDataToAWS(logTopic, cptrString);
+    RootUtilities_SendDataToAWS(AWS_TOPIC_LOGS, cptrString);
     return 2;
 }
 
+//uwValue is the id of the topic (AWSTopicId_t), cptrString "cbor" or "json"
+uint8_t SetTopicEncoding(uint32_t uwValue, char *cptrString, uint8_t *ubyptrMacs)
+{
+    ESP_LOGI(TAG, "SetTopicEncoding Function Called");
+    if (uwValue >= AWS_TOPIC_COUNT)
+        return 0;
+    uint8_t encoding = (strcmp(cptrString, "cbor") == 0) ? UPLINK_ENCODING_CBOR : UPLINK_ENCODING_JSON;
+    nvs_handle nvsHandle;
+    if (nvs_open(nvsStorage, NVS_READWRITE, &nvsHandle) != ESP_OK)
+        return 0;
+    uint8_t topicEncoding[AWS_TOPIC_COUNT];
+    memcpy(topicEncoding, AWSTopicEncoding, sizeof(topicEncoding));
+    topicEncoding[uwValue] = encoding;
+    if (nvs_set_blob(nvsHandle, "topicEnc", topicEncoding, sizeof(topicEncoding)) != ESP_OK)
+    {
+        nvs_close(nvsHandle);
+        return 0;
+    }
+    if (nvs_commit(nvsHandle) != ESP_OK)
+    {
+        nvs_close(nvsHandle);
+        return 0;
+    }
+    nvs_close(nvsHandle);
+    AWSTopicEncoding[uwValue] = encoding;
+    return 1;
+}
+
+//uwValue is the number of seconds between the snapshots of the node status, 0 to publish every status as it comes
+uint8_t SetSnapshotInterval(uint32_t uwValue, char *cptrString, uint8_t *ubyptrMacs)
+{
+    ESP_LOGI(TAG, "SetSnapshotInterval Function Called");
+    if (StatusAggregator_SetInterval(uwValue) != ESP_OK)
+        return 0;
+    return 1;
+}
+
+//uwValue 1 to publish the acks of the nodes as the original commands, 0 to publish them compact
+uint8_t SetAckExpansion(uint32_t uwValue, char *cptrString, uint8_t *ubyptrMacs)
+{
+    ESP_LOGI(TAG, "SetAckExpansion Function Called");
+    if (uwValue > 1)
+        return 0;
+    if (AckTracker_SetExpansion(uwValue == 1) != ESP_OK)
+        return 0;
+    return 1;
+}
+
 #endif
\ No newline at end of file
@@ -6,7 +6,8 @@ static const char *TAG = "RootOperations";
 void RootOperations_RootReadTask(void *arg)
 {
     mdf_err_t ret = MDF_OK;
-    char *data = MDF_MALLOC(MWIFI_PAYLOAD_LEN);
+    MsgBuffer *buffer = NULL;
+    char *data = NULL;
     size_t size = MWIFI_PAYLOAD_LEN;
     mwifi_data_type_t data_type = {0};
     uint8_t src_addr[MWIFI_ADDR_LEN] = {0};
@@ -20,8 +21,15 @@ void RootOperations_RootReadTask(void *arg)
             vTaskDelay(500 / portTICK_RATE_MS);
             continue;
         }
+        //the message is read straight into a buffer of rootReadPool, which is queued as it is. while all the buffers
+        //are held the task waits for one, and the messages wait in the mesh
+        if (buffer == NULL && (buffer = MsgBuffer_Acquire(&rootReadPool, portMAX_DELAY)) == NULL)
+        {
+            vTaskDelay(100 / portTICK_RATE_MS); //the pool is not created yet
+            continue;
+        }
+        data = (char *)buffer->data + MWIFI_ADDR_LEN;
         size = MWIFI_PAYLOAD_LEN;
-        memset(data, 0, MWIFI_PAYLOAD_LEN);
         ret = mwifi_root_read(src_addr, &data_type, data, &size, portMAX_DELAY);
         MDF_ERROR_CONTINUE(ret != MDF_OK, "<%s> mwifi_root_recv", mdf_err_to_name(ret));
 
@@ -30,15 +38,29 @@ void RootOperations_RootReadTask(void *arg)
             ret = mupgrade_root_handle(src_addr, data, size);
             MDF_ERROR_CONTINUE(ret != MDF_OK, "<%s> mupgrade_root_handle", mdf_err_to_name(ret));
         }
+        else if (size > 0 && UPLINK_FRAME_IS_CBOR((uint8_t)data[0]))
+        {
+            // CBOR frames only carry messages to AWS, they are published from here
+            RootUtilities_ProcessUplinkFrame((const uint8_t *)data, size, src_addr);
+        }
         else
         {
-            char *cptrData = (char *)pvPortMalloc((size + 1) * sizeof(char));
-            memset(cptrData, 0, size + 1);
-            strcpy(cptrData, data);
-            if (xQueueSendToBack(rootCommandQueue, &cptrData, (TickType_t)0) != pdPASS)
+            data[size] = '\0';
+            //the node is kept with the message, for its acks
+            memcpy(buffer->data, src_addr, MWIFI_ADDR_LEN);
+            buffer->topicLength = MWIFI_ADDR_LEN;
+            buffer->payloadOffset = MWIFI_ADDR_LEN;
+            buffer->length = MWIFI_ADDR_LEN + size + 1;
+            buffer->payloadLength = size;
+            //acks of the nodes go ahead of the sensor data and the logs. the buffer is released by the consumer
+            if (CommandLanes_Send(rootCommandQueue, CommandLanes_OfCommand(CommandParser_PeekCommand(data)), buffer))
+            {
+                buffer = NULL;
+            }
+            else
             {
                 ESP_LOGE(TAG, "Queue is full");
-                vPortFree(cptrData);
+                //the buffer is used for the next message
                 //Report back to AWS here letting us know that the queue is full and to wait for the next command
                 //The queue most likely will neveer fill up but you never know
             }
@@ -47,7 +69,7 @@ void RootOperations_RootReadTask(void *arg)
 
     MDF_LOGW("Root read task is exit");
 
-    MDF_FREE(data);
+    MsgBuffer_Release(buffer);
     vTaskDelete(NULL);
 }
 
@@ -79,106 +101,191 @@ void RootOperations_RootGroupReadTask(void *arg) // This is a read task for root
     vTaskDelete(NULL);
 }
 
+//commands to nodes waiting to be sent in one write
+typedef struct
+{
+    char *payloads[ROOT_COALESCE_MAX_NODES];    //topics of the commands, each one is reported if the write fails
+    char *commands[ROOT_COALESCE_MAX_NODES];    //command text inside each payload, the same for all of them
+    mesh_addr_t nodeAddrs[ROOT_COALESCE_MAX_NODES];
+    uint8_t count;
+} RootOperations_NodeBatch_t;
+
+static RootOperations_NodeBatch_t nodeBatch;
+static uint32_t coalescedWrites = 0;
+static uint32_t coalescedCommands = 0;
+
+/**
+ * @brief reads the node and the command text of a command from AWS
+ * @param nodeAddr[out] the node
+ * @return the command text inside payload, or NULL if the topic is not valid or the node is not in the routing table.
+ * then the command is reported to the fail topic and freed
+ */
+static char *RootOperations_ParseNodeCommand(char *payload, mesh_addr_t *nodeAddr)
+{
+    MeshStruct_t structRootWrite = {.ubyNodeMac = nodeAddr->addr};
+    if (!RootUtilities_ParseNodeAddressAndData(&structRootWrite, payload))
+    {
+        RootUtilities_SendDataToAWS(AWS_TOPIC_CONTROL_FAIL, payload);
+        vPortFree(payload);
+        return NULL;
+    }
+    return structRootWrite.cReceivedData;
+}
+
+//true if the command can go in the batch: same command text, to a node which is not in the batch yet
+static bool RootOperations_FitsInBatch(const RootOperations_NodeBatch_t *batch, const char *cptrCommand, const mesh_addr_t *nodeAddr)
+{
+    if (batch->count >= ROOT_COALESCE_MAX_NODES || strcmp(cptrCommand, batch->commands[0]) != 0)
+        return false;
+    for (uint8_t i = 0; i < batch->count; i++)
+    {
+        if (memcmp(batch->nodeAddrs[i].addr, nodeAddr->addr, MWIFI_ADDR_LEN) == 0)
+            return false;
+    }
+    return true;
+}
+
+//each node of a write gets its own correlation id, the command carries the one of the first node. the payloads are
+//freed by the downlink queue once the commands are sent or reported
+static void RootOperations_SendBatch(RootOperations_NodeBatch_t *batch)
+{
+    uint16_t ids[ROOT_COALESCE_MAX_NODES];
+    uint16_t id = AckTracker_Track(batch->commands[0], (const uint8_t *)batch->nodeAddrs, batch->count);
+    for (uint8_t i = 0; i < batch->count; i++)
+    {
+        ids[i] = AckTracker_Tag(batch->payloads[i], &batch->commands[i], id) ? id : 0;
+    }
+    if (batch->count == 1)
+    {
+        DownlinkQueue_Send(batch->nodeAddrs[0].addr, batch->payloads[0], batch->commands[0], ids[0]);
+    }
+    else if (DownlinkQueue_SendGroup(batch->nodeAddrs, batch->count, batch->payloads, batch->commands, ids))
+    {
+        coalescedWrites++;
+        coalescedCommands += batch->count;
+        ESP_LOGI(TAG, "%d commands sent in one write. %u commands in %u coalesced writes so far", batch->count, coalescedCommands, coalescedWrites);
+    }
+    batch->count = 0;
+}
+
+/**
+ * commands to nodes from AWS, one topic per node. The cloud sends the same command to each node of a room one after
+ * the other, so the commands with the same text which come within ROOT_COALESCE_WINDOW_MS of the first one are sent
+ * with one mwifi_root_write to all their nodes. The window only starts when another command is already waiting, a
+ * lone command is sent at once. A command which does not fit in the batch starts the next one.
+ * The writes do not block: the commands to a node which can not be reached wait in the downlink queue and are retried
+ * between the commands to the other nodes
+ */
 void RootOperations_ProcessNodeCommands()
 {
+    RootOperations_NodeBatch_t *batch = &nodeBatch;
     char *payload = NULL;
+    char *nextPayload = NULL;
+    mesh_addr_t nodeAddr;
     while (true)
     {
         if (nodeCommandQueue != NULL)
         {
-            if (xQueueReceive(nodeCommandQueue, &payload, (TickType_t)0))
+            //sleeps until a command comes or a waiting command is due, unless one is left from the last batch
+            payload = (nextPayload != NULL) ? nextPayload : CommandLanes_Receive(nodeCommandQueue, DownlinkQueue_Process(), NULL);
+            nextPayload = NULL;
+            if (payload == NULL)
+                continue;
+            //the command is sent from the payload itself, without copy
+            char *cptrCommand = RootOperations_ParseNodeCommand(payload, &nodeAddr);
+            if (cptrCommand == NULL)
+                continue;
+            batch->payloads[0] = payload;
+            batch->commands[0] = cptrCommand;
+            batch->nodeAddrs[0] = nodeAddr;
+            batch->count = 1;
+
+            //while commands keep coming, takes the same command to other nodes until the window is over
+            TickType_t windowEnd = xTaskGetTickCount() + ROOT_COALESCE_WINDOW_MS / portTICK_RATE_MS;
+            bool burst = CommandLanes_Waiting(nodeCommandQueue) > 0;
+            while (burst && batch->count < ROOT_COALESCE_MAX_NODES)
             {
-                MeshStruct_t *structRootWrite = malloc(sizeof(MeshStruct_t));
-                structRootWrite->ubyNodeMac = malloc(MWIFI_ADDR_LEN * sizeof(uint8_t));
-                structRootWrite->cReceivedData = (char *)malloc((strlen(payload) + 1) * sizeof(char));
-                memset(structRootWrite->cReceivedData, 0, strlen(payload));
-                bool parsedAndSent = RootUtilities_ParseNodeAddressAndData(structRootWrite, payload);
-                if (parsedAndSent)
+                TickType_t now = xTaskGetTickCount();
+                TickType_t wait = ((int32_t)(windowEnd - now) > 0) ? (windowEnd - now) : 0;
+                if ((payload = CommandLanes_Receive(nodeCommandQueue, wait, NULL)) == NULL)
+                    break;
+                if ((cptrCommand = RootOperations_ParseNodeCommand(payload, &nodeAddr)) == NULL)
+                    continue;
+                if (!RootOperations_FitsInBatch(batch, cptrCommand, &nodeAddr))
                 {
-                    if (!RootUtilities_RootWrite(structRootWrite))
-                        parsedAndSent = false;
+                    nextPayload = payload;
+                    break;
                 }
-                if (!parsedAndSent)
-                    RootUtilities_SendDataToAWS(controlLogTopicFail, payload);
-                free(structRootWrite->cReceivedData);
-                free(structRootWrite->ubyNodeMac);
-                free(structRootWrite);
-                vPortFree(payload);
-                ESP_LOGI(TAG, "Stack for task '%s': %d bytes", pcTaskGetTaskName(NULL), uxTaskGetStackHighWaterMark(NULL));
+                batch->payloads[batch->count] = payload;
+                batch->commands[batch->count] = cptrCommand;
+                batch->nodeAddrs[batch->count] = nodeAddr;
+                batch->count++;
             }
+            RootOperations_SendBatch(batch);
+            DownlinkQueue_PrintMetrics();
+            ESP_LOGI(TAG, "Stack for task '%s': %d bytes", pcTaskGetTaskName(NULL), uxTaskGetStackHighWaterMark(NULL));
+        }
+        else
+        {
+            vTaskDelay(100 / portTICK_RATE_MS); //the queue is not created yet
         }
-        vTaskDelay(10 / portTICK_RATE_MS); //Leave this for watchdog
     }
 }
 
 void RootOperations_ProcessRootCommands()
 {
+    static CommandMessage_t message;
+    MsgBuffer *buffer = NULL;
     char *payload = NULL;
-    uint8_t *ubyptrNodeMacs = NULL;
-    bool macsUsed = false;
     while (true)
     {
         if (rootCommandQueue != NULL)
         {
-            if (xQueueReceive(rootCommandQueue, &payload, (TickType_t)0))
+            //sleeps until a command comes, or it is time to check for a status snapshot
+            if ((buffer = CommandLanes_Receive(rootCommandQueue, STATUS_AGGREGATOR_POLL_INTERVAL / portTICK_RATE_MS, NULL)) != NULL)
             {
-                cJSON *json = cJSON_Parse(payload);
-
-                if (json == NULL)
+                //parsed and published from the buffer it was read into
+                payload = (char *)buffer->data + buffer->payloadOffset;
+                if (!CommandParser_Parse(payload, &message))
                 {
-                    const char *error_ptr = cJSON_GetErrorPtr();
-                    if (error_ptr != NULL)
-                    {
-                        ESP_LOGE(TAG, "Error while parsing RootOperations_ProcessRootCommands");
-                    }
-                    RootUtilities_SendDataToAWS(controlLogTopicFail, payload);
+                    ESP_LOGE(TAG, "Error while parsing RootOperations_ProcessRootCommands");
+                    RootUtilities_SendDataToAWS(AWS_TOPIC_CONTROL_FAIL, payload);
                 }
-                else
+                else if (COMMAND_FIELDS_HAVE(&message, COMMAND_FIELD_CMND | COMMAND_FIELD_VAL | COMMAND_FIELD_STR))
                 {
-                    //heap_caps_check_integrity_all(true);
-                    cJSON *cjCommand = cJSON_GetObjectItemCaseSensitive(json, "cmnd");
-                    if (cJSON_IsNumber(cjCommand))
+                    int value = CommandParser_ValueInt(message.value);
+                    uint8_t *ubyptrNodeMacs = NULL;
+                    if ((message.fields & COMMAND_FIELD_MACS) && (value > 0) && (message.macBytes == value * MWIFI_ADDR_LEN))
                     {
-                        cJSON *cjValue = cJSON_GetObjectItemCaseSensitive(json, "val");
-                        if (cJSON_IsNumber(cjValue))
-                        {
-                            cJSON *cjString = cJSON_GetObjectItemCaseSensitive(json, "str");
-                            if (cJSON_IsString(cjString) && (cjString->valuestring != NULL))
-                            {
-                                cJSON *cjMacs = cJSON_GetObjectItemCaseSensitive(json, "macs");
-                                if (cJSON_IsArray(cjMacs))
-                                {
-                                    if ((cjValue->valueint > 0) && (cJSON_GetArraySize(cjMacs) == cjValue->valueint * MWIFI_ADDR_LEN))
-                                    {
-                                        macsUsed = true;
-                                        ubyptrNodeMacs = malloc(cjValue->valueint * MWIFI_ADDR_LEN * sizeof(uint8_t));
-                                        ubyptrNodeMacs = RootUtilities_ParseMacAddress(cjMacs, ubyptrNodeMacs);
-                                    }
-                                }
-                                uint8_t returnVal = RootUtilities_ValidateAndExecuteCommand((uint8_t)cjCommand->valueint, cjValue->valueint, cjString->valuestring, ubyptrNodeMacs);
-                                if (returnVal == 1)
-                                    RootUtilities_SendDataToAWS(controlLogTopicSuccess, payload);
-                                else if (returnVal == 0)
-                                    RootUtilities_SendDataToAWS(controlLogTopicFail, payload);
-                                goto RootOperations_ProcessRootCommands_End;
-                            }
-                        }
+                        ubyptrNodeMacs = message.macs;
                     }
-                    RootUtilities_SendDataToAWS(controlLogTopicFail, payload);
+                    else if ((message.command == enumRootCmndKey_PublishNodeControlSuccess || message.command == enumRootCmndKey_PublishNodeControlFail) &&
+                             buffer->topicLength == MWIFI_ADDR_LEN)
+                    {
+                        //the ack of a node: the node which sent it, for the acks of a group write
+                        ubyptrNodeMacs = buffer->data + buffer->topicOffset;
+                    }
+                    uint8_t returnVal = RootUtilities_ValidateAndExecuteCommand((uint8_t)message.command, value, message.string, ubyptrNodeMacs);
+                    if (returnVal == 1)
+                        RootUtilities_SendDataToAWS(AWS_TOPIC_CONTROL_SUCCESS, payload);
+                    else if (returnVal == 0)
+                        RootUtilities_SendDataToAWS(AWS_TOPIC_CONTROL_FAIL, payload);
                 }
-            RootOperations_ProcessRootCommands_End:
-                heap_caps_check_integrity_all(true);
-                cJSON_Delete(json);
-                vPortFree(payload);
-                if (macsUsed)
+                else
                 {
-                    macsUsed = false;
-                    free(ubyptrNodeMacs);
+                    RootUtilities_SendDataToAWS(AWS_TOPIC_CONTROL_FAIL, payload);
                 }
+                heap_caps_check_integrity_all(true);
+                CommandParser_Release(&message);
+                MsgBuffer_Release(buffer);
                 ESP_LOGI(TAG, "Stack for task under RootOperations_ProcessRootCommands'%s': %d bytes", pcTaskGetTaskName(NULL), uxTaskGetStackHighWaterMark(NULL));
             }
         }
-        vTaskDelay(10 / portTICK_RATE_MS); //Leave this for watchdog
+        else
+        {
+            vTaskDelay(100 / portTICK_RATE_MS); //the queue is not created yet
+        }
+        StatusAggregator_Poll();
     }
 }
 #endif
\ No newline at end of file
@@ -1,67 +1,51 @@
 #ifdef ROOT
 #include "Includes/root_utilities.h"
 #include "gw_includes/ota_agent.h"
+#include "includes/aws.h"
 #include "errno.h"
-
-//*********************ROOT COMMANDS********************************
-RootCmnds_t RootCommand[enumRootCmndKey_TotalNumOfCommands] = {
-    {enumRootCmndKey_RestartRoot, RestartRoot},
-    {enumRootCmndKey_TestRoot, TestRoot},
-    {enumRootCmndKey_UpdateRootFW, UpdateRootFW},
-    {enumRootCmndKey_TestGroup, TestGroup},
-    {enumRootCmndKey_SendGroupCmd, SendGroupCmd},
-    {enumRootCmndKey_AddOrgInfo, AddOrgInfo},
-    {enumRootCmndKey_PublishSensorData, PublishSensorData},
-    {enumRootCmndKey_PublishControlData, PublishControlData},
-    {enumRootCmndKey_MessageToAWS, MessageToAWS},
-    {enumRootCmndKey_UpdateNodeFW, UpdateNodeFW},
-    {enumRootCmndKey_CreateGroup, CreateGroup},
-    {enumRootCmndKey_DeleteGroup, DeleteGroup},
-    {enumRootCmndKey_PublishNodeControlSuccess, PublishNodeControlSuccess},
-    {enumRootCmndKey_PublishNodeControlFail, PublishNodeControlFail}};
-
-//*********************ROOT COMMANDS********************************
+#include "includes/command_registry.h"
 
 //*********ROOT Global variables****************
 char orgID[25] = "";
-char *sensorLogTopic = NULL;
-char *controlLogTopic = NULL;
-char *logTopic = NULL;
-char *controlLogTopicSuccess = NULL;
-char *controlLogTopicFail = NULL;
+char AWSTopics[AWS_TOPIC_COUNT][AWS_TOPIC_MAX_LENGTH];
+MsgBufferPool AWSPublishPool;
+MsgBufferPool rootReadPool;
+MsgBufferPool rootAWSCommandPool;
+uint8_t AWSTopicEncoding[AWS_TOPIC_COUNT] = {UPLINK_ENCODING_JSON};
 //*********ROOT Global variables****************
 
 static const char *TAG = "RootUtility";
 
-QueueHandle_t nodeCommandQueue;
-QueueHandle_t rootCommandQueue;
-QueueHandle_t AWSPublishQueue;
+CommandLanes_t *nodeCommandQueue;
+CommandLanes_t *rootCommandQueue;
+CommandLanes_t *AWSPublishQueue;
+UBaseType_t AWSPublishQueueHighWater = 0; //max number of messages waiting in AWSPublishQueue
+uint32_t AWSPublishQueueFull = 0;         //number of messages which did not fit in AWSPublishQueue
+uint32_t AWSPublishDropped = 0;           //number of messages which could not be queued nor kept in the journal
 
+/**
+ * @brief reads the topic of a command to a node: <prefix>/<mac of the node>{<command>}
+ * The mac is decoded into structRootWrite->ubyNodeMac, and cReceivedData is set to the command inside cptrRcvdData,
+ * which is not modified. Reentrant
+ * @return true if the topic is valid and the node is in the routing table
+ */
 bool RootUtilities_ParseNodeAddressAndData(MeshStruct_t *structRootWrite, char *cptrRcvdData)
 {
-    // getting the node address, the first strtok is ignored
-    strtok(cptrRcvdData, "/");
-    char *cptrData = NULL;
-    // second strtok is the node mac in string
-    char *nodeMacStr = strtok(NULL, "{");
+    // the mac starts after the first '/', several '/' count as one
+    const char *nodeMacStr = strchr(cptrRcvdData, '/');
     structRootWrite->ubyNumOfNodes = 1;
-    // Verify the Node Mac Address
-    if (nodeMacStr)
+    if (nodeMacStr != NULL)
     {
-        if (Utilities_StringToMac(nodeMacStr, structRootWrite->ubyNodeMac) == true)
+        while (*nodeMacStr == '/')
+            nodeMacStr++;
+        // the command starts at the first '{' after the mac
+        char *cptrData = strchr(nodeMacStr, '{');
+        if (cptrData != NULL && cptrData[1] != '\0' && Utilities_ParseMac(nodeMacStr, structRootWrite->ubyNodeMac) != NULL)
         {
             //regardless if node exists or not we want to parse the data
             bool nodeVerified = RootUtilities_NodeAddressVerification(structRootWrite);
-            // Last part of string is the data to send
-            cptrData = strtok(NULL, "");
-            if (cptrData)
-            {
-                // Adding '{' at the beginning of the Json
-                memmove(structRootWrite->cReceivedData + 1, cptrData, strlen(cptrData));
-                *structRootWrite->cReceivedData = '{';
-                cptrData = NULL;
-                return nodeVerified;
-            }
+            structRootWrite->cReceivedData = cptrData;
+            return nodeVerified;
         }
     }
     // Report back to a error topic saying in valid node address received
@@ -69,25 +53,322 @@ bool RootUtilities_ParseNodeAddressAndData(MeshStruct_t *structRootWrite, char *
     return false;
 }
 
-void RootUtilities_SendDataToAWS(char *cptrTopic, char *cptrPayload)
+//results of the commands are published before the sensor data, and the logs last
+static CommandLane_t RootUtilities_LaneOfTopic(AWSTopicId_t topic)
 {
-    ESP_LOGI(TAG, "RootUtilities_SendDataToAWS receieved %s", cptrPayload);
-    AWSPub_t *stuctAWSPub = pvPortMalloc(sizeof(AWSPub_t));
-    stuctAWSPub->cptrPayload = (char *)pvPortMalloc((strlen(cptrPayload) + 1) * sizeof(char));
-    stuctAWSPub->cptrTopic = (char *)pvPortMalloc((strlen(cptrTopic) + 1) * sizeof(char));
-    memset(stuctAWSPub->cptrPayload, 0, strlen(cptrPayload));
-    memset(stuctAWSPub->cptrTopic, 0, strlen(cptrTopic));
-    strcpy(stuctAWSPub->cptrPayload, cptrPayload);
-    strcpy(stuctAWSPub->cptrTopic, cptrTopic);
+    switch (topic)
+    {
+    case AWS_TOPIC_SENSOR_DATA:
+        return COMMAND_LANE_STATUS;
+    case AWS_TOPIC_LOGS:
+        return COMMAND_LANE_BULK;
+    default:
+        return COMMAND_LANE_CONTROL;
+    }
+}
+
+//keep a message which can not be queued in the journal, until AWS_AWSTask sends it
+static void RootUtilities_JournalToAWS(AWSTopicId_t topic, const void *vptrPayload, size_t length)
+{
+    esp_err_t err = UplinkJournal_Append(AWSTopics[topic], vptrPayload, length);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Message of %d bytes dropped, the journal could not keep it: %s", length, esp_err_to_name(err));
+        AWSPublishDropped++;
+    }
+}
 
-    if (xQueueSendToBack(AWSPublishQueue, &stuctAWSPub, (TickType_t)0) != pdPASS)
+//queue a message claimed from AWSPublishPool. if the queue is full it is kept in the journal until AWS_AWSTask has emptied the queue
+static void RootUtilities_QueueSlotToAWS(MsgBuffer *slot)
+{
+    if (CommandLanes_Send(AWSPublishQueue, RootUtilities_LaneOfTopic(slot->tag), slot))
+    {
+        UBaseType_t depth = CommandLanes_Waiting(AWSPublishQueue);
+        if (depth > AWSPublishQueueHighWater)
+        {
+            AWSPublishQueueHighWater = depth;
+        }
+        return;
+    }
+
+    ESP_LOGE(TAG, "Queue is full");
+    AWSPublishQueueFull++;
+    RootUtilities_JournalToAWS(slot->tag, slot->data, slot->payloadLength);
+    MsgBuffer_Release(slot);
+    //Report back to AWS here letting us know that the queue is full
+}
+
+/**
+ * @brief  publish a message as it is, text or CBOR
+ * @param topic[in] id of the topic
+ * @param vptrPayload[in] the message
+ * @param length[in] length of the message in bytes, without a NUL
+ */
+void RootUtilities_SendBinaryToAWS(AWSTopicId_t topic, const void *vptrPayload, size_t length)
+{
+    //claim a slot and copy the payload once. the slot goes back to the pool when the message is published.
+    //a message longer than the slots gets a buffer of its own
+    MsgBuffer *slot;
+    if (length < AWSPublishPool.bufferSize)
+        slot = MsgBuffer_Acquire(&AWSPublishPool, 0);
+    else
+        slot = MsgBuffer_AcquireHeap(length + 1);
+    if (slot == NULL)
     {
         ESP_LOGE(TAG, "Queue is full");
-        vPortFree(stuctAWSPub->cptrPayload);
-        vPortFree(stuctAWSPub->cptrTopic);
-        vPortFree(stuctAWSPub);
-        //Report back to AWS here letting us know that the queue is full
+        AWSPublishQueueFull++;
+        RootUtilities_JournalToAWS(topic, vptrPayload, length);
+        return;
+    }
+    slot->tag = topic;
+    memcpy(slot->data, vptrPayload, length);
+    slot->data[length] = '\0';
+    slot->length = length + 1;
+    slot->payloadLength = length;
+    RootUtilities_QueueSlotToAWS(slot);
+}
+
+/**
+ * @brief  publish a message made by the root on a topic which takes CBOR: a frame with the message as its data,
+ *         written from the cJSON object, else the text. encoded in the slot, so nothing is copied
+ * @param json[in] the message, or NULL to send cptrPayload
+ * @return false if it did not fit, the caller publishes the text instead
+ */
+static bool RootUtilities_SendCborToAWS(AWSTopicId_t topic, const cJSON *json, const char *cptrPayload)
+{
+    MsgBuffer *slot = MsgBuffer_Acquire(&AWSPublishPool, 0);
+    if (slot == NULL)
+    {
+        return false;
+    }
+
+    CborWriter_t writer;
+    Cbor_InitWriter(&writer, slot->data, AWSPublishPool.bufferSize);
+    Cbor_PutMap(&writer, 1);
+    Cbor_PutUint(&writer, UPLINK_FRAME_KEY_DATA);
+    bool encoded = true;
+    if (json != NULL)
+    {
+        encoded = Cbor_PutJson(&writer, json);
+    }
+    else
+    {
+        Cbor_PutString(&writer, cptrPayload);
+    }
+
+    size_t length = Cbor_WriterLength(&writer);
+    if (!encoded || length == 0)
+    {
+        MsgBuffer_Release(slot);
+        return false;
+    }
+    slot->tag = topic;
+    slot->length = length;
+    slot->payloadLength = length;
+    RootUtilities_QueueSlotToAWS(slot);
+    return true;
+}
+
+void RootUtilities_SendDataToAWS(AWSTopicId_t topic, char *cptrPayload)
+{
+    ESP_LOGI(TAG, "RootUtilities_SendDataToAWS receieved %s", cptrPayload);
+    if (AWSTopicEncoding[topic] == UPLINK_ENCODING_CBOR && RootUtilities_SendCborToAWS(topic, NULL, cptrPayload))
+    {
+        return;
+    }
+    RootUtilities_SendBinaryToAWS(topic, cptrPayload, strlen(cptrPayload));
+}
+
+/**
+ * @brief  publish a message built by the root as a cJSON object. encoded straight from the object on the topics
+ *         which take CBOR, the text is only printed for the others
+ * @param json[in] the message, still owned by the caller
+ */
+void RootUtilities_SendJsonToAWS(AWSTopicId_t topic, const cJSON *json)
+{
+    if (AWSTopicEncoding[topic] == UPLINK_ENCODING_CBOR && RootUtilities_SendCborToAWS(topic, json, NULL))
+    {
+        return;
+    }
+    char *cptrPayload = cJSON_PrintUnformatted(json);
+    if (cptrPayload == NULL)
+    {
+        ESP_LOGE(TAG, "Could not print the message");
+        return;
+    }
+    RootUtilities_SendBinaryToAWS(topic, cptrPayload, strlen(cptrPayload));
+    free(cptrPayload);
+}
+
+/**
+ * @brief  publish a CBOR frame from a node (see cbor.h). it is forwarded as it is to the topics which take CBOR, and
+ *         converted to the JSON messages the nodes sent before for the others
+ * @param ubyptrFrame[in] the frame, as read from the mesh
+ * @param size[in] length of the frame
+ * @param ubyptrSourceMac[in] the node which sent it, for its acks
+ * @return false if the frame is malformed or its command is not a publish
+ */
+bool RootUtilities_ProcessUplinkFrame(const uint8_t *ubyptrFrame, size_t size, const uint8_t *ubyptrSourceMac)
+{
+    CborReader_t reader;
+    Cbor_InitReader(&reader, ubyptrFrame, size);
+    uint8_t type;
+    uint64_t pairs = 0;
+    uint64_t command = 0;
+    uint64_t value = 0;
+    size_t dataOffset = 0;
+    if (!Cbor_ReadHead(&reader, &type, &pairs) || type != CBOR_TYPE_MAP)
+    {
+        reader.error = true;
+    }
+    for (uint64_t i = 0; i < pairs && !reader.error; i++)
+    {
+        uint64_t key;
+        if (!Cbor_ReadUint(&reader, &key))
+        {
+            break;
+        }
+        if (key == UPLINK_FRAME_KEY_CMND)
+        {
+            Cbor_ReadUint(&reader, &command);
+        }
+        else if (key == UPLINK_FRAME_KEY_VAL)
+        {
+            Cbor_ReadUint(&reader, &value);
+        }
+        else
+        {
+            if (key == UPLINK_FRAME_KEY_DATA)
+            {
+                dataOffset = reader.offset;
+            }
+            Cbor_Skip(&reader);
+        }
+    }
+    if (reader.error || dataOffset == 0)
+    {
+        ESP_LOGE(TAG, "Malformed uplink frame of %d bytes", size);
+        return false;
+    }
+
+    AWSTopicId_t topic;
+    switch (command)
+    {
+    case enumRootCmndKey_PublishSensorData:
+        topic = AWS_TOPIC_SENSOR_DATA;
+        break;
+    case enumRootCmndKey_PublishControlData:
+        topic = AWS_TOPIC_CONTROL_DATA;
+        break;
+    case enumRootCmndKey_MessageToAWS:
+        topic = AWS_TOPIC_LOGS;
+        break;
+    case enumRootCmndKey_PublishNodeControlSuccess:
+        topic = AWS_TOPIC_CONTROL_SUCCESS;
+        break;
+    case enumRootCmndKey_PublishNodeControlFail:
+        topic = AWS_TOPIC_CONTROL_FAIL;
+        break;
+    default:
+        ESP_LOGW(TAG, "Uplink frame with command %d is not a publish", (int)command);
+        return false;
+    }
+    //as the JSON publish commands, only the logs are sent before the org is set
+    if (topic != AWS_TOPIC_LOGS && strcmp(orgID, "") == 0)
+    {
+        return true;
+    }
+
+    Cbor_InitReader(&reader, ubyptrFrame, size);
+    reader.offset = dataOffset;
+    uint64_t length;
+    Cbor_ReadHead(&reader, &type, &length);
+
+    if ((topic == AWS_TOPIC_CONTROL_SUCCESS || topic == AWS_TOPIC_CONTROL_FAIL) && value != 0)
+    {
+        //compact ack of a command with a correlation id, the data is its detail
+        char cptrDetail[ACK_TRACKER_DETAIL_SIZE] = "";
+        if (type == CBOR_TYPE_TEXT && length < sizeof(cptrDetail))
+        {
+            memcpy(cptrDetail, ubyptrFrame + reader.offset, length);
+            cptrDetail[length] = '\0';
+        }
+        AckTracker_Publish((uint16_t)value, topic == AWS_TOPIC_CONTROL_SUCCESS, cptrDetail, ubyptrSourceMac);
+        return true;
     }
+
+    if (topic == AWS_TOPIC_SENSOR_DATA && StatusAggregator_GetInterval() != 0 && type != CBOR_TYPE_BYTES)
+    {
+        //status messages go to the snapshots as JSON, whatever the encoding of the topic
+        char cptrStatus[STATUS_AGGREGATOR_ENTRY_SIZE];
+        CborReader_t statusReader = reader;
+        statusReader.offset = dataOffset;
+        bool converted;
+        if (type == CBOR_TYPE_TEXT)
+        {
+            converted = length < sizeof(cptrStatus);
+            if (converted)
+            {
+                memcpy(cptrStatus, ubyptrFrame + reader.offset, length);
+                cptrStatus[length] = '\0';
+            }
+        }
+        else
+        {
+            converted = Cbor_ToJson(&statusReader, cptrStatus, sizeof(cptrStatus));
+        }
+        if (converted && StatusAggregator_Update(cptrStatus))
+        {
+            return true;
+        }
+    }
+
+    if (AWSTopicEncoding[topic] == UPLINK_ENCODING_CBOR)
+    {
+        RootUtilities_SendBinaryToAWS(topic, ubyptrFrame, size);
+        return true;
+    }
+
+    if (type == CBOR_TYPE_TEXT)
+    {
+        //the text is the message
+        RootUtilities_SendBinaryToAWS(topic, ubyptrFrame + reader.offset, length);
+        return true;
+    }
+
+    MsgBuffer *slot = MsgBuffer_Acquire(&AWSPublishPool, 0);
+    if (slot == NULL)
+    {
+        //kept as CBOR, the backend tells the encodings apart by the first byte
+        RootUtilities_SendBinaryToAWS(topic, ubyptrFrame, size);
+        return true;
+    }
+    char *cptrJson = (char *)slot->data;
+    size_t jsonSize = AWSPublishPool.bufferSize;
+    size_t prefix = 0;
+    if (type == CBOR_TYPE_BYTES)
+    {
+        //binary data was sent as hex text in a JSON message
+        prefix = snprintf(cptrJson, jsonSize, "{\"cmnd\":%u,\"val\":%u,\"str\":", (unsigned)command, (unsigned)value);
+    }
+    reader.offset = dataOffset;
+    if (!Cbor_ToJson(&reader, cptrJson + prefix, jsonSize - prefix - 1))
+    {
+        //kept as CBOR, like when there is no slot
+        ESP_LOGW(TAG, "Uplink frame too long to publish as JSON: %d bytes", size);
+        MsgBuffer_Release(slot);
+        RootUtilities_SendBinaryToAWS(topic, ubyptrFrame, size);
+        return true;
+    }
+    if (type == CBOR_TYPE_BYTES)
+    {
+        strcat(cptrJson, "}");
+    }
+    slot->tag = topic;
+    slot->payloadLength = strlen(cptrJson);
+    slot->length = slot->payloadLength + 1;
+    RootUtilities_QueueSlotToAWS(slot);
+    return true;
 }
 
 //0 = dead, 1 = alive, 2 = restarting, 3 = Firmware updates, 4 = Firmware update failed
@@ -101,36 +382,44 @@ bool RootUtilities_SendStatusUpdate(char *devID, uint8_t status)
         return false;
     cJSON_AddItemToObject(rootData, "devID", devMacStr);
     cJSON_AddNumberToObject(rootData, "status", status);
-    char *dataToSend = cJSON_PrintUnformatted(rootData);
-    RootUtilities_SendDataToAWS(logTopic, dataToSend);
+    RootUtilities_SendJsonToAWS(AWS_TOPIC_LOGS, rootData);
     cJSON_Delete(rootData);
-    free(dataToSend);
     return true;
 }
 
 void RootUtilities_CreateQueues()
 {
     //created a queue with maxumum of 10 commands, and a item size of a char pointer
-    nodeCommandQueue = xQueueCreate(10, sizeof(char *));
+    nodeCommandQueue = CommandLanes_Create("ProcessNodeCmnds", 10);
     if (nodeCommandQueue == NULL)
     {
         ESP_LOGE(TAG, "Could not create node queue");
         //need to restart and let the backend know
     }
 
-    rootCommandQueue = xQueueCreate(25, sizeof(char *));
-    if (rootCommandQueue == NULL)
+    rootCommandQueue = CommandLanes_Create("ProcessRootCmnds", 25);
+    if (rootCommandQueue == NULL || MsgBuffer_InitPool(&rootReadPool, "RootRead", ROOT_READ_POOL_SIZE, MWIFI_ADDR_LEN + MWIFI_PAYLOAD_LEN + 1) != ESP_OK ||
+        MsgBuffer_InitPool(&rootAWSCommandPool, "RootAWSCommand", ROOT_AWS_COMMAND_POOL_SIZE, MWIFI_PAYLOAD_LEN + 1) != ESP_OK)
     {
         ESP_LOGE(TAG, "Could not create root queue");
         //need to restart and let the backend know
     }
 
-    AWSPublishQueue = xQueueCreate(25, sizeof(AWSPub_t *));
-    if (AWSPublishQueue == NULL)
+    //one slot for each queued message, each message in flight and the one being published
+    AWSPublishQueue = CommandLanes_Create("AWSPublish", AWS_PUBLISH_QUEUE_LENGTH);
+    if (AWSPublishQueue == NULL || MsgBuffer_InitPool(&AWSPublishPool, "AWSPublish", AWS_PUBLISH_QUEUE_LENGTH + AWS_PUBLISH_WINDOW + 1, AWS_PUBLISH_PAYLOAD_SIZE) != ESP_OK)
     {
         ESP_LOGE(TAG, "Could not create root queue");
         //need to restart and let the backend know
     }
+
+    //messages which can not be published are kept in flash, if the partition table has a journal
+    UplinkJournal_Init();
+    //latest status of each node, published in snapshots when the backend sets an interval
+    StatusAggregator_Init();
+    RoutingIndex_Init();
+    //ids of the commands to the nodes, so the nodes answer with compact acks
+    AckTracker_Init();
 }
 
 void RootUtilities_loadOrgInfo()
@@ -155,37 +444,47 @@ void RootUtilities_loadOrgInfo()
     ESP_LOGI(TAG, "This is the org ID %s", orgID);
 }
 
+//encoding of each topic, set by the backend with SetTopicEncoding. JSON if it was never set
+void RootUtilities_LoadTopicEncoding()
+{
+    nvs_handle nvsHandle;
+    if (nvs_open(nvsStorage, NVS_READWRITE, &nvsHandle) != ESP_OK)
+        return;
+    size_t sizeOfEncoding = sizeof(AWSTopicEncoding);
+    if (nvs_get_blob(nvsHandle, "topicEnc", AWSTopicEncoding, &sizeOfEncoding) != ESP_OK)
+    {
+        memset(AWSTopicEncoding, UPLINK_ENCODING_JSON, sizeof(AWSTopicEncoding));
+    }
+    nvs_close(nvsHandle);
+}
+
 uint8_t RootUtilities_ValidateAndExecuteCommand(uint8_t ubyCommand, uint32_t uwValue, char *cptrString, uint8_t *ubyptrMacs)
 {
     ESP_LOGI(TAG, "Command Received: %d", ubyCommand);
 #ifdef GATEWAY_ETH
-    if(ubyCommand > (ROOT_NODE_COMMAND_RANGE_STARTS + COMMAND_VALUE_SPAN))
+    const CommandRegistry_Entry_t *entry = CommandRegistry_Lookup(ubyCommand, COMMAND_NODE_ROOT | COMMAND_NODE_GATEWAY, COMMAND_SOURCE_ANY);
+#else
+    const CommandRegistry_Entry_t *entry = CommandRegistry_Lookup(ubyCommand, COMMAND_NODE_ROOT, COMMAND_SOURCE_ANY);
+#endif
+    if (entry == NULL)
     {
-        NodeStruct_t *structNodeReceived = malloc(sizeof(NodeStruct_t));
-        structNodeReceived->cptrString = cptrString;
-        structNodeReceived->dValue = uwValue;
-        structNodeReceived->ubyCommand = ubyCommand;
-        bool result = SecondaryUtilities_ValidateAndExecuteCommand(structNodeReceived);
-        free(structNodeReceived);
-        if(result)
-        {
-            return 1;
-        }
+        // Send incorrect Command Received Error
+        ESP_LOGW(TAG, "Incorrect Command Received.");
+        return 0;
     }
-#endif
-    if ((ubyCommand >= ROOT_NODE_COMMAND_RANGE_STARTS) && (ubyCommand < (ROOT_NODE_COMMAND_RANGE_STARTS + COMMAND_VALUE_SPAN)))
+    if (!CommandRegistry_CheckArguments(entry, cptrString, NULL, ubyptrMacs))
     {
-        for (uint8_t ubyIndex = 0; ubyIndex < enumRootCmndKey_TotalNumOfCommands; ubyIndex++)
-        {
-            if (RootCommand[ubyIndex].ubyKey == ubyCommand)
-            {
-                return RootCommand[ubyIndex].root_fun(uwValue, cptrString, ubyptrMacs);
-            }
-        }
+        return (entry->response == COMMAND_RESPONSE_NONE) ? 2 : 0;
     }
-    // Send incorrect Command Received Error
-    ESP_LOGW(TAG, "Incorrect Command Received.");
-    return 0;
+#ifdef GATEWAY_ETH
+    // the GW commands are executed by the root itself
+    if (entry->root_fun == NULL)
+    {
+        NodeStruct_t structNodeReceived = {.ubyCommand = ubyCommand, .dValue = uwValue, .cptrString = cptrString};
+        return entry->node_fun(&structNodeReceived) ? 1 : 0;
+    }
+#endif
+    return entry->root_fun(uwValue, cptrString, ubyptrMacs);
 }
 
 void RootUtilities_PrepareJsonAndSendDataToGroup(uint16_t ubyCommand, uint32_t uwValue, char *cptrString, MeshStruct_t *structRootWrite)
@@ -224,54 +523,18 @@ void RootUtilities_SendDataToGroup(MeshStruct_t *structRootWrite)
     }
 }
 
+//every target of the command has to be in the routing table
 bool RootUtilities_NodeAddressVerification(MeshStruct_t *structRootWrite)
 {
-    ESP_LOGI(TAG, "Free Heap Before: %d", xPortGetFreeHeapSize());
-    ssize_t routing_table_size = esp_mesh_get_routing_table_size();
-    // ESP_LOGI(TAG, "Routing Table Size is: %d", routing_table_size);
-    mesh_addr_t *routing_table = malloc(routing_table_size * sizeof(mesh_addr_t) + 1);
-    mdf_err_t ret = esp_mesh_get_routing_table(routing_table, routing_table_size * sizeof(mesh_addr_t),
-                                               &routing_table_size);
-    MDF_ERROR_ASSERT(ret);
-    uint8_t ubyCompareEligibilityIndex[routing_table_size];
-    bool bReturnFlag = false;
-    uint8_t ubyNodeCount = 0;
     for (uint8_t k = 0; k < structRootWrite->ubyNumOfNodes; k++)
     {
-        uint8_t ubyAddressIndex = 0;
-        memset(ubyCompareEligibilityIndex, 1, routing_table_size * sizeof(uint8_t));
-        int iLoopIndex = MWIFI_ADDR_LEN - 1;
-        for (int j = MWIFI_ADDR_LEN - 1; j >= 0; j--)
-        {
-            for (uint8_t i = 1; i < routing_table_size; i++)
-            {
-                if ((routing_table[i].addr[j] == structRootWrite->ubyNodeMac[j + (k * MWIFI_ADDR_LEN)]) && (ubyCompareEligibilityIndex[i] != 0))
-                {
-                    ubyCompareEligibilityIndex[i] = i;
-                    if (iLoopIndex == j)
-                    {
-                        ubyAddressIndex++;
-                        iLoopIndex--;
-                    }
-                }
-                else
-                {
-                    ubyCompareEligibilityIndex[i] = 0;
-                }
-            }
-        }
-        if (ubyAddressIndex == MWIFI_ADDR_LEN)
+        if (!RoutingIndex_Contains(&structRootWrite->ubyNodeMac[k * MWIFI_ADDR_LEN]))
         {
-            ubyNodeCount++;
+            ESP_LOGW(TAG, "Node " MACSTR " is not in the routing table", MAC2STR(&structRootWrite->ubyNodeMac[k * MWIFI_ADDR_LEN]));
+            return false;
         }
     }
-    if (ubyNodeCount == structRootWrite->ubyNumOfNodes)
-    {
-        bReturnFlag = true;
-    }
-    free(routing_table);
-    ESP_LOGI(TAG, "Free Heap After: %d", xPortGetFreeHeapSize());
-    return bReturnFlag;
+    return true;
 }
 
 esp_err_t RootUtilities_httpEventHandler(esp_http_client_event_t *evt)
@@ -630,7 +893,7 @@ void RootUtilities_UpgradeNodeCenceFirmware(MeshStruct_t *structRootWrite)
                     char extractedString[50];
                     strncpy(extractedString, start, end - start);
                     extractedString[end - start] = '\0';
-                    RootUtilities_PrepareJsonAndSend(222, total_size, extractedString, structRootWriteFW);
+                    RootUtilities_PrepareJsonAndSend(enumGatewayCmndKey_GW_OTA_Begin, total_size, extractedString, structRootWriteFW);
                 }
 
                 // calculate the wait time needed for NODE to erase it's partitions before writing FW data
@@ -644,7 +907,7 @@ void RootUtilities_UpgradeNodeCenceFirmware(MeshStruct_t *structRootWrite)
             {
                 // this command includes information about the total packet count the NODE should have received.
                 // need to notify this is the end of the OTA
-                RootUtilities_PrepareJsonAndSend(224, total_packet_count, "End OTA", structRootWriteFW);
+                RootUtilities_PrepareJsonAndSend(enumGatewayCmndKey_GW_OTA_End, total_packet_count, "End OTA", structRootWriteFW);
             }
 
             // generic OTA data. This command type has the FW information sent to the NODE
@@ -908,24 +1171,4 @@ bool RootUtilities_RootWrite(MeshStruct_t *structRootWrite)
     }
 }
 
-uint8_t *RootUtilities_ParseMacAddress(cJSON *cjMacs, uint8_t *ubyptrNodeMacs)
-{
-    cJSON *Iterator = NULL;
-    uint8_t count = 0;
-    cJSON_ArrayForEach(Iterator, cjMacs)
-    {
-        if (cJSON_IsNumber(Iterator) && Iterator->valueint >= 0x00 && Iterator->valueint <= 0xff)
-        {
-            ubyptrNodeMacs[count] = (uint8_t)Iterator->valueint;
-            count++;
-        }
-        else
-        {
-            ESP_LOGI(TAG, "invalid mac address pair detected");
-            return NULL;
-        }
-    }
-    return ubyptrNodeMacs;
-}
-
 #endif
\ No newline at end of file
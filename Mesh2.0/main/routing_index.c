@@ -0,0 +1,165 @@
+#ifdef ROOT
+#include "includes/routing_index.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "mwifi.h"
+#include <string.h>
+
+/**
+ * Set of the MACs of the routing table of the root, looked up in constant time by the address verification of the
+ * commands from AWS.
+ *
+ * The routing table events of the mesh only give the new size of the table, so an event marks the set stale and it
+ * is built again from esp_mesh_get_routing_table at the next lookup. Many nodes joining at once cost one build.
+ * The set is also built again every ROUTING_INDEX_RECONCILE_INTERVAL, in case an event was missed.
+ * Open addressing with linear probing. The set is always built from scratch, so nothing is ever removed from it.
+ */
+
+static const char *TAG = "RoutingIndex";
+
+#define ROUTING_INDEX_MASK (ROUTING_INDEX_SLOTS - 1)
+
+static uint8_t (*slots)[MWIFI_ADDR_LEN] = NULL;    // all zero: empty slot
+static mesh_addr_t *routingTable = NULL;           // copy of the routing table while the set is built
+static SemaphoreHandle_t indexMutex = NULL;
+static volatile bool stale = true;
+static int64_t lastBuild = 0;
+static RoutingIndex_Metrics_t metrics = {0};
+
+// the first bytes of the MACs of a site are mostly the same, the last ones are mixed in
+static uint32_t RoutingIndex_Hash(const uint8_t *ubyptrMac)
+{
+    uint32_t hash = ((uint32_t)ubyptrMac[2] << 24) | ((uint32_t)ubyptrMac[3] << 16) | ((uint32_t)ubyptrMac[4] << 8) | ubyptrMac[5];
+    hash ^= (uint32_t)ubyptrMac[0] << 8 | ubyptrMac[1];
+    hash *= 2654435761u;
+    return hash >> 16;
+}
+
+static bool RoutingIndex_IsEmpty(const uint8_t *slot)
+{
+    static const uint8_t empty[MWIFI_ADDR_LEN] = {0};
+    return memcmp(slot, empty, MWIFI_ADDR_LEN) == 0;
+}
+
+// must hold indexMutex
+static void RoutingIndex_Build()
+{
+    int tableSize = 0;
+    if (esp_mesh_get_routing_table(routingTable, ROUTING_INDEX_MAX_NODES * sizeof(mesh_addr_t), &tableSize) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Could not read the routing table");
+        tableSize = 0;
+    }
+
+    memset(slots, 0, ROUTING_INDEX_SLOTS * MWIFI_ADDR_LEN);
+    metrics.nodes = 0;
+    // the first entry is the root itself, commands are not forwarded to it
+    for (int i = 1; i < tableSize; i++)
+    {
+        const uint8_t *mac = routingTable[i].addr;
+        if (RoutingIndex_IsEmpty(mac))
+        {
+            continue;
+        }
+        uint32_t slot = RoutingIndex_Hash(mac) & ROUTING_INDEX_MASK;
+        while (!RoutingIndex_IsEmpty(slots[slot]) && memcmp(slots[slot], mac, MWIFI_ADDR_LEN) != 0)
+        {
+            slot = (slot + 1) & ROUTING_INDEX_MASK;
+        }
+        if (RoutingIndex_IsEmpty(slots[slot]))
+        {
+            memcpy(slots[slot], mac, MWIFI_ADDR_LEN);
+            metrics.nodes++;
+        }
+    }
+    metrics.generation++;
+    lastBuild = esp_timer_get_time();
+    stale = false;
+    ESP_LOGD(TAG, "Routing index %d built with %d nodes", metrics.generation, metrics.nodes);
+}
+
+esp_err_t RoutingIndex_Init()
+{
+    if (slots != NULL)
+    {
+        return ESP_OK;
+    }
+
+    indexMutex = xSemaphoreCreateMutex();
+    slots = calloc(ROUTING_INDEX_SLOTS, MWIFI_ADDR_LEN);
+    routingTable = malloc(ROUTING_INDEX_MAX_NODES * sizeof(mesh_addr_t));
+    if (indexMutex == NULL || slots == NULL || routingTable == NULL)
+    {
+        ESP_LOGE(TAG, "Could not allocate the routing index");
+        free(slots);
+        free(routingTable);
+        slots = NULL;
+        routingTable = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    stale = true;
+    return ESP_OK;
+}
+
+/**
+ * @brief  the routing table changed. called from the mesh events, the set is built again at the next lookup
+ */
+void RoutingIndex_Invalidate()
+{
+    metrics.events++;
+    stale = true;
+}
+
+/**
+ * @brief  whether a node is in the routing table of the root
+ * @param ubyptrMac[in] MWIFI_ADDR_LEN bytes
+ */
+bool RoutingIndex_Contains(const uint8_t *ubyptrMac)
+{
+    if (slots == NULL || RoutingIndex_IsEmpty(ubyptrMac))
+    {
+        return false;
+    }
+
+    xSemaphoreTake(indexMutex, portMAX_DELAY);
+    if (!stale && (esp_timer_get_time() - lastBuild) > (int64_t)ROUTING_INDEX_RECONCILE_INTERVAL * 1000000)
+    {
+        metrics.reconciliations++;
+        stale = true;
+    }
+    if (stale)
+    {
+        RoutingIndex_Build();
+    }
+
+    bool found = false;
+    uint32_t slot = RoutingIndex_Hash(ubyptrMac) & ROUTING_INDEX_MASK;
+    while (!RoutingIndex_IsEmpty(slots[slot]))
+    {
+        if (memcmp(slots[slot], ubyptrMac, MWIFI_ADDR_LEN) == 0)
+        {
+            found = true;
+            break;
+        }
+        slot = (slot + 1) & ROUTING_INDEX_MASK;
+    }
+    metrics.lookups++;
+    if (!found)
+    {
+        metrics.misses++;
+    }
+    xSemaphoreGive(indexMutex);
+    return found;
+}
+
+uint32_t RoutingIndex_Generation()
+{
+    return metrics.generation;
+}
+
+void RoutingIndex_GetMetrics(RoutingIndex_Metrics_t *metricsCopy)
+{
+    *metricsCopy = metrics;
+}
+
+#endif
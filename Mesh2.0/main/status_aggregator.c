@@ -0,0 +1,383 @@
+#ifdef ROOT
+#include "includes/status_aggregator.h"
+#include "includes/root_utilities.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <string.h>
+
+/**
+ * Aggregation of the status messages of the nodes into periodic snapshots.
+ *
+ * The messages published to the sensor data topic are JSON objects naming their node in "devID", and optionally their
+ * type ("devType", else "cmnd") and a "channel". The latest message of each node, type and channel is kept in a table,
+ * and every interval the ones which changed are published together in a snapshot:
+ *      {"snapshot":<sequence>,"part":<n>,"devices":[<message>,<message>,...]}
+ * A snapshot bigger than a publish is split in parts. Messages flagged as urgent (a true or non zero "urgent",
+ * "fault" or "powerLoss") are published at once, as are the ones which can not be kept. The gateways send one status
+ * per channel of their CN board, with the fault bits of the channel in "fault", and "powerLoss" when they lose power
+ * (Send_GW_Status_to_AWS). The power nodes send their "current" without a channel, one entry per node.
+ *
+ * The table has room for STATUS_AGGREGATOR_CHANNELS_PER_NODE entries per node of the mesh, its entries only point to
+ * the messages, which are allocated at their length up to STATUS_AGGREGATOR_MAX_BYTES.
+ *
+ * The interval is set by the backend (SetSnapshotInterval) and kept in NVS. 0 publishes every message as it comes,
+ * which is the default: the snapshots change what the backend reads on the sensor data topic, it turns them on.
+ */
+
+static const char *TAG = "StatusAggregator";
+
+typedef struct
+{
+    char *key;                  // devID/type/channel, followed by the message in the same allocation. NULL if not used
+    char *message;
+    uint32_t hash;
+    uint16_t size;              // of the allocation
+    bool changed;               // not published yet
+    int64_t updatedAt;
+} StatusAggregator_Entry_t;
+
+static const char *urgentKeys[] = {"urgent", "fault", "powerLoss"};
+
+static StatusAggregator_Entry_t *entries = NULL;
+static SemaphoreHandle_t aggregatorMutex = NULL;
+static uint32_t interval = STATUS_AGGREGATOR_DEFAULT_INTERVAL;
+static int64_t lastSnapshot = 0;
+static uint32_t snapshotSequence = 0;
+static uint16_t changedCount = 0;
+static StatusAggregator_Metrics_t metrics = {0};
+static char snapshot[AWS_PUBLISH_PAYLOAD_SIZE];     // only used by StatusAggregator_Poll
+
+// FNV-1a
+static uint32_t StatusAggregator_Hash(const char *cptrKey)
+{
+    uint32_t hash = 2166136261u;
+    while (*cptrKey)
+    {
+        hash = (hash ^ (uint8_t)*cptrKey++) * 16777619u;
+    }
+    return hash;
+}
+
+static bool StatusAggregator_IsSet(const cJSON *item)
+{
+    if (item == NULL)
+        return false;
+    if (cJSON_IsBool(item))
+        return cJSON_IsTrue(item);
+    if (cJSON_IsNumber(item))
+        return item->valuedouble != 0;
+    if (cJSON_IsString(item))
+        return item->valuestring[0] != '\0';
+    return true;
+}
+
+/**
+ * @brief  key of the table of a status message, and whether it is urgent
+ * @return false if the message is not a JSON object with a devID
+ */
+static bool StatusAggregator_ParseMessage(const char *cptrMessage, char *cptrKey, bool *urgent)
+{
+    cJSON *json = cJSON_Parse(cptrMessage);
+    if (!cJSON_IsObject(json))
+    {
+        cJSON_Delete(json);
+        return false;
+    }
+
+    bool parsed = false;
+    cJSON *cjDevID = cJSON_GetObjectItemCaseSensitive(json, "devID");
+    if (cJSON_IsString(cjDevID) && cjDevID->valuestring[0] != '\0')
+    {
+        // devID/type/channel, the type and channel empty if the message has none
+        int length = snprintf(cptrKey, STATUS_AGGREGATOR_KEY_LENGTH, "%s/", cjDevID->valuestring);
+        cJSON *cjType = cJSON_GetObjectItemCaseSensitive(json, "devType");
+        cJSON *cjCommand = cJSON_GetObjectItemCaseSensitive(json, "cmnd");
+        if (length < STATUS_AGGREGATOR_KEY_LENGTH)
+        {
+            if (cJSON_IsString(cjType))
+                length += snprintf(cptrKey + length, STATUS_AGGREGATOR_KEY_LENGTH - length, "%s", cjType->valuestring);
+            else if (cJSON_IsNumber(cjType))
+                length += snprintf(cptrKey + length, STATUS_AGGREGATOR_KEY_LENGTH - length, "%d", cjType->valueint);
+            else if (cJSON_IsNumber(cjCommand))
+                length += snprintf(cptrKey + length, STATUS_AGGREGATOR_KEY_LENGTH - length, "c%d", cjCommand->valueint);
+        }
+        cJSON *cjChannel = cJSON_GetObjectItemCaseSensitive(json, "channel");
+        if (length < STATUS_AGGREGATOR_KEY_LENGTH)
+        {
+            if (cJSON_IsNumber(cjChannel))
+                length += snprintf(cptrKey + length, STATUS_AGGREGATOR_KEY_LENGTH - length, "/%d", cjChannel->valueint);
+            else
+                length += snprintf(cptrKey + length, STATUS_AGGREGATOR_KEY_LENGTH - length, "/");
+        }
+        parsed = (length > 0 && length < STATUS_AGGREGATOR_KEY_LENGTH);
+    }
+
+    *urgent = false;
+    for (uint8_t i = 0; i < sizeof(urgentKeys) / sizeof(urgentKeys[0]); i++)
+    {
+        if (StatusAggregator_IsSet(cJSON_GetObjectItemCaseSensitive(json, urgentKeys[i])))
+        {
+            *urgent = true;
+        }
+    }
+    cJSON_Delete(json);
+    return parsed;
+}
+
+// the entry of key, else a free one, else the oldest one which was published. NULL if all are waiting for a snapshot
+static StatusAggregator_Entry_t *StatusAggregator_FindEntry(const char *cptrKey, uint32_t hash)
+{
+    StatusAggregator_Entry_t *freeEntry = NULL;
+    StatusAggregator_Entry_t *oldestEntry = NULL;
+    for (uint16_t i = 0; i < STATUS_AGGREGATOR_MAX_ENTRIES; i++)
+    {
+        StatusAggregator_Entry_t *entry = &entries[i];
+        if (entry->key == NULL)
+        {
+            if (freeEntry == NULL)
+                freeEntry = entry;
+            continue;
+        }
+        if (entry->hash == hash && strcmp(entry->key, cptrKey) == 0)
+        {
+            return entry;
+        }
+        if (!entry->changed && (oldestEntry == NULL || entry->updatedAt < oldestEntry->updatedAt))
+        {
+            oldestEntry = entry;
+        }
+    }
+    return (freeEntry != NULL) ? freeEntry : oldestEntry;
+}
+
+esp_err_t StatusAggregator_Init()
+{
+    if (entries != NULL)
+    {
+        return ESP_OK;
+    }
+
+    aggregatorMutex = xSemaphoreCreateMutex();
+    entries = calloc(STATUS_AGGREGATOR_MAX_ENTRIES, sizeof(StatusAggregator_Entry_t));
+    if (aggregatorMutex == NULL || entries == NULL)
+    {
+        ESP_LOGE(TAG, "Could not allocate the status table");
+        free(entries);
+        entries = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    nvs_handle nvsHandle;
+    if (nvs_open(nvsStorage, NVS_READWRITE, &nvsHandle) == ESP_OK)
+    {
+        nvs_get_u32(nvsHandle, "snapInterval", &interval);
+        nvs_close(nvsHandle);
+    }
+    lastSnapshot = esp_timer_get_time();
+    ESP_LOGI(TAG, "Snapshot interval: %d s", interval);
+    return ESP_OK;
+}
+
+/**
+ * @brief  keep a status message for the next snapshot
+ * @param cptrMessage[in] JSON text of the message
+ * @return true if it is kept. false if it has to be published now: aggregation is off, the message is urgent, or it
+ *         can not be kept
+ */
+bool StatusAggregator_Update(const char *cptrMessage)
+{
+    if (entries == NULL || interval == 0)
+    {
+        return false;
+    }
+
+    char key[STATUS_AGGREGATOR_KEY_LENGTH];
+    bool urgent;
+    if (strlen(cptrMessage) >= STATUS_AGGREGATOR_ENTRY_SIZE || !StatusAggregator_ParseMessage(cptrMessage, key, &urgent))
+    {
+        metrics.passedThrough++;
+        return false;
+    }
+
+    uint32_t hash = StatusAggregator_Hash(key);
+    size_t keyLength = strlen(key);
+    size_t size = keyLength + strlen(cptrMessage) + 2;
+    xSemaphoreTake(aggregatorMutex, portMAX_DELAY);
+    StatusAggregator_Entry_t *entry = StatusAggregator_FindEntry(key, hash);
+    if (entry == NULL)
+    {
+        xSemaphoreGive(aggregatorMutex);
+        metrics.passedThrough++;
+        return false;
+    }
+
+    bool sameKey = entry->key != NULL && entry->hash == hash && strcmp(entry->key, key) == 0;
+    uint32_t released = (entry->key != NULL) ? entry->size : 0;
+    char *buffer = entry->key;
+    if (metrics.bytes - released + size > STATUS_AGGREGATOR_MAX_BYTES ||
+        (size != entry->size && (buffer = realloc(entry->key, size)) == NULL))
+    {
+        // the older state of the node must not be published after this one
+        if (sameKey && entry->changed)
+        {
+            entry->changed = false;
+            changedCount--;
+            metrics.replaced++;
+        }
+        xSemaphoreGive(aggregatorMutex);
+        metrics.passedThrough++;
+        return false;
+    }
+
+    if (entry->key == NULL)
+    {
+        metrics.entries++;
+    }
+    metrics.bytes = metrics.bytes - released + size;
+    if (entry->changed)
+    {
+        metrics.replaced++;
+        changedCount--;
+    }
+    // an entry given to another key was published, it is not changed
+    memcpy(buffer, key, keyLength + 1);
+    entry->key = buffer;
+    entry->message = buffer + keyLength + 1;
+    entry->hash = hash;
+    entry->size = size;
+    strcpy(entry->message, cptrMessage);
+    entry->updatedAt = esp_timer_get_time();
+    // an urgent message is published now, the table only keeps it as the latest state
+    entry->changed = !urgent;
+    if (urgent)
+    {
+        metrics.urgent++;
+    }
+    else
+    {
+        changedCount++;
+        metrics.updates++;
+    }
+    xSemaphoreGive(aggregatorMutex);
+    return !urgent;
+}
+
+static void StatusAggregator_PublishPart(size_t length)
+{
+    snapshot[length] = '\0';
+    RootUtilities_SendDataToAWS(AWS_TOPIC_SENSOR_DATA, snapshot);
+    metrics.snapshots++;
+}
+
+/**
+ * @brief  publish a snapshot of the changed states once the interval is over. called often by a root task
+ */
+void StatusAggregator_Poll()
+{
+    if (entries == NULL)
+    {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    if (changedCount == 0)
+    {
+        lastSnapshot = now;
+        return;
+    }
+    // also flushes what is left when the interval is set to 0
+    if (interval != 0 && (now - lastSnapshot) < (int64_t)interval * 1000000)
+    {
+        return;
+    }
+
+    xSemaphoreTake(aggregatorMutex, portMAX_DELAY);
+    uint8_t part = 0;
+    size_t length = 0;
+    size_t start = 0;
+    for (uint16_t i = 0; i < STATUS_AGGREGATOR_MAX_ENTRIES; i++)
+    {
+        StatusAggregator_Entry_t *entry = &entries[i];
+        if (entry->key == NULL || !entry->changed)
+        {
+            continue;
+        }
+        size_t messageLength = strlen(entry->message);
+        // room for the message, a comma and the closing "]}"
+        if (length > 0 && length + messageLength + 4 > sizeof(snapshot))
+        {
+            length += sprintf(snapshot + length, "]}");
+            StatusAggregator_PublishPart(length);
+            length = 0;
+            part++;
+        }
+        if (length == 0)
+        {
+            length = sprintf(snapshot, "{\"snapshot\":%u,\"part\":%u,\"devices\":[", snapshotSequence, part);
+            start = length;
+        }
+        if (length > start)
+        {
+            snapshot[length++] = ',';
+        }
+        memcpy(snapshot + length, entry->message, messageLength);
+        length += messageLength;
+        entry->changed = false;
+    }
+    if (length > 0)
+    {
+        length += sprintf(snapshot + length, "]}");
+        StatusAggregator_PublishPart(length);
+    }
+    changedCount = 0;
+    snapshotSequence++;
+    lastSnapshot = now;
+    xSemaphoreGive(aggregatorMutex);
+    ESP_LOGD(TAG, "Snapshot %d published in %d parts", snapshotSequence - 1, part + 1);
+}
+
+/**
+ * @brief  set the seconds between snapshots, kept over restarts. 0 publishes every status message as it comes
+ */
+esp_err_t StatusAggregator_SetInterval(uint32_t seconds)
+{
+    if (seconds > STATUS_AGGREGATOR_MAX_INTERVAL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    nvs_handle nvsHandle;
+    esp_err_t err = nvs_open(nvsStorage, NVS_READWRITE, &nvsHandle);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    err = nvs_set_u32(nvsHandle, "snapInterval", seconds);
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(nvsHandle);
+    }
+    nvs_close(nvsHandle);
+    if (err == ESP_OK)
+    {
+        interval = seconds;
+    }
+    return err;
+}
+
+uint32_t StatusAggregator_GetInterval()
+{
+    return interval;
+}
+
+void StatusAggregator_GetMetrics(StatusAggregator_Metrics_t *metricsCopy)
+{
+    *metricsCopy = metrics;
+}
+
+void StatusAggregator_PrintMetrics()
+{
+    ESP_LOGI(TAG, "updates: %d, replaced: %d, urgent: %d, passed through: %d, snapshots: %d, entries: %d/%d, bytes: %d",
+             metrics.updates, metrics.replaced, metrics.urgent, metrics.passedThrough, metrics.snapshots, metrics.entries,
+             STATUS_AGGREGATOR_MAX_ENTRIES, metrics.bytes);
+}
+
+#endif
@@ -0,0 +1,541 @@
+#if defined(ROOT) || defined(GATEWAY_SIM7080)
+#include "includes/uplink_journal.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "rom/crc.h"
+#include <string.h>
+
+/**
+ * Append only journal of the messages which could not be sent to AWS.
+ *
+ * The journal lives in the first UPLINK_JOURNAL_MAX_SIZE of the "reserved" data partition, which is in the partition
+ * table of the devices already in the field: the table can not be changed by an OTA. It is used as a ring of sectors. Each sector starts with a header, followed by 4 byte aligned records.
+ * A record is written as WRITING, then VALID once the topic and payload are in flash, and marked CONSUMED once it
+ * has been delivered. Only 1 bits are cleared by these updates, so a sector is erased only when the head of the
+ * journal comes back to it. If the sector still has VALID records then (journal full), they are dropped.
+ *
+ * The GW has no wall clock, so the time of a record is the journal time: the newest time found in flash at start up,
+ * plus the uptime. UPLINK_JOURNAL_TTL therefore counts powered on time only.
+ */
+
+static const char *TAG = "UplinkJournal";
+
+#define UPLINK_JOURNAL_MAGIC                0x4C4E524A  // "JRNL"
+
+#define UPLINK_JOURNAL_STATE_FREE           0xFF
+#define UPLINK_JOURNAL_STATE_WRITING        0xFE
+#define UPLINK_JOURNAL_STATE_VALID          0xFC
+#define UPLINK_JOURNAL_STATE_CONSUMED       0xF8
+
+#define UPLINK_JOURNAL_ALIGN(x)             (((x) + 3) & ~3)
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t sequence;                      // incremented each time the head moves to a new sector
+    uint32_t eraseCount;                    // number of times this sector was erased
+    uint32_t reserved;
+} UplinkJournal_SectorHeader_t;
+
+typedef struct
+{
+    uint8_t state;
+    uint8_t topicLength;
+    uint16_t payloadLength;
+    uint32_t time;                          // journal time, in seconds
+    uint32_t crc;                           // of the topic and the payload
+} UplinkJournal_RecordHeader_t;
+
+#define UPLINK_JOURNAL_FIRST_RECORD         sizeof(UplinkJournal_SectorHeader_t)
+
+static const esp_partition_t *journalPartition = NULL;
+static SemaphoreHandle_t journalMutex = NULL;
+static uint16_t sectorCount = 0;
+
+static uint16_t headSector = 0;             // where the next record is written
+static uint32_t headOffset = 0;
+static uint32_t headSequence = 0;
+static uint16_t tailSector = 0;             // oldest record which may not be consumed yet
+static uint32_t tailOffset = 0;
+static uint32_t timeBase = 0;
+
+static bool peeked = false;                 // a record was returned by UplinkJournal_Peek and not consumed yet
+static UplinkJournal_Position_t peekPosition = {0};
+
+static UplinkJournal_Metrics_t metrics = {0};
+
+static uint32_t UplinkJournal_Now()
+{
+    return timeBase + (uint32_t)(esp_timer_get_time() / 1000000);
+}
+
+static esp_err_t UplinkJournal_Read(uint16_t sector, uint32_t offset, void *data, size_t size)
+{
+    return esp_partition_read(journalPartition, sector * UPLINK_JOURNAL_SECTOR_SIZE + offset, data, size);
+}
+
+static esp_err_t UplinkJournal_Write(uint16_t sector, uint32_t offset, const void *data, size_t size)
+{
+    return esp_partition_write(journalPartition, sector * UPLINK_JOURNAL_SECTOR_SIZE + offset, data, size);
+}
+
+static esp_err_t UplinkJournal_SetState(uint16_t sector, uint32_t offset, uint8_t state)
+{
+    return UplinkJournal_Write(sector, offset, &state, sizeof(state));
+}
+
+static bool UplinkJournal_RecordIsSane(const UplinkJournal_RecordHeader_t *record, uint32_t offset)
+{
+    return record->topicLength <= UPLINK_JOURNAL_MAX_TOPIC && record->payloadLength <= UPLINK_JOURNAL_MAX_PAYLOAD &&
+           offset + UPLINK_JOURNAL_ALIGN(sizeof(UplinkJournal_RecordHeader_t) + record->topicLength + record->payloadLength) <= UPLINK_JOURNAL_SECTOR_SIZE;
+}
+
+static uint32_t UplinkJournal_RecordSize(const UplinkJournal_RecordHeader_t *record)
+{
+    return UPLINK_JOURNAL_ALIGN(sizeof(UplinkJournal_RecordHeader_t) + record->topicLength + record->payloadLength);
+}
+
+/**
+ * @brief  walk the records of a sector from an offset, until the free space
+ * @param sector[in] the sector
+ * @param offset[in] first record to look at
+ * @param validRecords[out] (optional) number of VALID records found
+ * @param newestTime[in,out] (optional) newest record time found
+ * @return offset of the free space, or UPLINK_JOURNAL_SECTOR_SIZE if the sector is full or the rest is unreadable
+ */
+static uint32_t UplinkJournal_ScanSector(uint16_t sector, uint32_t offset, uint32_t *validRecords, uint32_t *newestTime)
+{
+    UplinkJournal_RecordHeader_t record;
+    while (offset + sizeof(record) <= UPLINK_JOURNAL_SECTOR_SIZE)
+    {
+        if (UplinkJournal_Read(sector, offset, &record, sizeof(record)) != ESP_OK)
+        {
+            return UPLINK_JOURNAL_SECTOR_SIZE;
+        }
+        if (record.state == UPLINK_JOURNAL_STATE_FREE)
+        {
+            return offset;
+        }
+        if (!UplinkJournal_RecordIsSane(&record, offset))
+        {
+            // a write was cut off before the lengths reached flash. nothing after it can be trusted
+            return UPLINK_JOURNAL_SECTOR_SIZE;
+        }
+        if (record.state == UPLINK_JOURNAL_STATE_VALID && validRecords != NULL)
+        {
+            (*validRecords)++;
+        }
+        if (newestTime != NULL && record.time != 0xFFFFFFFF && record.time > *newestTime)
+        {
+            *newestTime = record.time;
+        }
+        offset += UplinkJournal_RecordSize(&record);
+    }
+    return UPLINK_JOURNAL_SECTOR_SIZE;
+}
+
+/**
+ * @brief  erase a sector and make it the head of the journal. the records it still holds are dropped
+ */
+static esp_err_t UplinkJournal_StartSector(uint16_t sector)
+{
+    UplinkJournal_SectorHeader_t header;
+    uint32_t eraseCount = 0;
+    if (UplinkJournal_Read(sector, 0, &header, sizeof(header)) == ESP_OK && header.magic == UPLINK_JOURNAL_MAGIC)
+    {
+        uint32_t dropped = 0;
+        UplinkJournal_ScanSector(sector, UPLINK_JOURNAL_FIRST_RECORD, &dropped, NULL);
+        if (dropped > 0)
+        {
+            ESP_LOGW(TAG, "Journal full, dropping %d messages", dropped);
+            metrics.overwritten += dropped;
+            metrics.pending -= (dropped < metrics.pending) ? dropped : metrics.pending;
+        }
+        eraseCount = header.eraseCount + 1;
+    }
+
+    if (tailSector == sector)
+    {
+        tailSector = (sector + 1) % sectorCount;
+        tailOffset = UPLINK_JOURNAL_FIRST_RECORD;
+    }
+    if (peeked && peekPosition.sector == sector)
+    {
+        peeked = false;
+    }
+
+    esp_err_t err = esp_partition_erase_range(journalPartition, sector * UPLINK_JOURNAL_SECTOR_SIZE, UPLINK_JOURNAL_SECTOR_SIZE);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Could not erase sector %d: %s", sector, esp_err_to_name(err));
+        return err;
+    }
+    metrics.erases++;
+
+    header.magic = UPLINK_JOURNAL_MAGIC;
+    header.sequence = ++headSequence;
+    header.eraseCount = eraseCount;
+    header.reserved = 0xFFFFFFFF;
+    err = UplinkJournal_Write(sector, 0, &header, sizeof(header));
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    headSector = sector;
+    headOffset = UPLINK_JOURNAL_FIRST_RECORD;
+    return ESP_OK;
+}
+
+/**
+ * @brief  find the journal partition and rebuild the head and tail from the sector headers.
+ *         if the partition table of the device has no journal, the journal is disabled
+ * @return ESP_OK if the journal can be used
+ */
+esp_err_t UplinkJournal_Init()
+{
+    if (journalPartition != NULL)
+    {
+        return ESP_OK;
+    }
+
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, UPLINK_JOURNAL_PARTITION_LABEL);
+    if (partition == NULL || partition->size < 2 * UPLINK_JOURNAL_SECTOR_SIZE)
+    {
+        ESP_LOGW(TAG, "No '%s' partition, messages will not be kept while the uplink is down", UPLINK_JOURNAL_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    journalMutex = xSemaphoreCreateMutex();
+    if (journalMutex == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    journalPartition = partition;
+    sectorCount = ((partition->size < UPLINK_JOURNAL_MAX_SIZE) ? partition->size : UPLINK_JOURNAL_MAX_SIZE) / UPLINK_JOURNAL_SECTOR_SIZE;
+
+    // the head is the sector with the newest sequence, the tail the sector after it (the oldest one)
+    bool found = false;
+    uint32_t newestTime = 0;
+    for (uint16_t sector = 0; sector < sectorCount; sector++)
+    {
+        UplinkJournal_SectorHeader_t header;
+        if (UplinkJournal_Read(sector, 0, &header, sizeof(header)) != ESP_OK || header.magic != UPLINK_JOURNAL_MAGIC)
+        {
+            continue;
+        }
+        if (!found || header.sequence > headSequence)
+        {
+            headSequence = header.sequence;
+            headSector = sector;
+        }
+        found = true;
+        UplinkJournal_ScanSector(sector, UPLINK_JOURNAL_FIRST_RECORD, &metrics.pending, &newestTime);
+    }
+
+    if (!found)
+    {
+        ESP_LOGI(TAG, "Formatting the journal, %d sectors", sectorCount);
+        tailSector = 0;
+        esp_err_t err = UplinkJournal_StartSector(0);
+        if (err != ESP_OK)
+        {
+            journalPartition = NULL;
+            return err;
+        }
+    }
+    else
+    {
+        headOffset = UplinkJournal_ScanSector(headSector, UPLINK_JOURNAL_FIRST_RECORD, NULL, NULL);
+        tailSector = (headSector + 1) % sectorCount;
+        tailOffset = UPLINK_JOURNAL_FIRST_RECORD;
+    }
+
+    // restart the clock a second after the newest record, so that the order of the records is kept
+    timeBase = newestTime + 1;
+    ESP_LOGI(TAG, "Journal ready: %d sectors, %d messages pending", sectorCount, metrics.pending);
+    return ESP_OK;
+}
+
+bool UplinkJournal_IsAvailable()
+{
+    return journalPartition != NULL;
+}
+
+/**
+ * @brief  keep a message in flash until it can be sent
+ * @param cptrTopic[in] topic of the message. can be empty when the sender has one topic
+ * @param vptrPayload[in] the message, a text or a binary (CBOR) frame
+ * @param payloadLength[in] length of the message in bytes, without a NUL
+ * @return ESP_OK if the message is in flash
+ */
+esp_err_t UplinkJournal_Append(const char *cptrTopic, const void *vptrPayload, size_t payloadLength)
+{
+    if (journalPartition == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    size_t topicLength = strlen(cptrTopic);
+    const uint8_t *ubyptrPayload = (const uint8_t *)vptrPayload;
+    if (topicLength > UPLINK_JOURNAL_MAX_TOPIC || payloadLength > UPLINK_JOURNAL_MAX_PAYLOAD)
+    {
+        ESP_LOGE(TAG, "Message too long for the journal: %d bytes", topicLength + payloadLength);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    UplinkJournal_RecordHeader_t record;
+    record.state = UPLINK_JOURNAL_STATE_WRITING;
+    record.topicLength = topicLength;
+    record.payloadLength = payloadLength;
+    record.time = UplinkJournal_Now();
+    record.crc = crc32_le(0, (const uint8_t *)cptrTopic, topicLength);
+    record.crc = crc32_le(record.crc, ubyptrPayload, payloadLength);
+    uint32_t recordSize = UplinkJournal_RecordSize(&record);
+
+    xSemaphoreTake(journalMutex, portMAX_DELAY);
+    esp_err_t err = ESP_OK;
+    if (headOffset + recordSize > UPLINK_JOURNAL_SECTOR_SIZE)
+    {
+        err = UplinkJournal_StartSector((headSector + 1) % sectorCount);
+    }
+
+    uint32_t offset = headOffset;
+    if (err == ESP_OK)
+    {
+        err = UplinkJournal_Write(headSector, offset, &record, sizeof(record));
+    }
+    if (err == ESP_OK && topicLength > 0)
+    {
+        err = UplinkJournal_Write(headSector, offset + sizeof(record), cptrTopic, topicLength);
+    }
+    if (err == ESP_OK && payloadLength > 0)
+    {
+        err = UplinkJournal_Write(headSector, offset + sizeof(record) + topicLength, ubyptrPayload, payloadLength);
+    }
+    if (err == ESP_OK)
+    {
+        err = UplinkJournal_SetState(headSector, offset, UPLINK_JOURNAL_STATE_VALID);
+    }
+
+    if (err == ESP_OK)
+    {
+        metrics.appended++;
+        metrics.pending++;
+    }
+    else
+    {
+        ESP_LOGE(TAG, "Could not write to the journal: %s", esp_err_to_name(err));
+    }
+    // the space is skipped even after a failed write, it may hold part of the record
+    headOffset = offset + recordSize;
+    xSemaphoreGive(journalMutex);
+    return err;
+}
+
+/**
+ * @brief  read the oldest pending message, without removing it. expired and corrupted messages are dropped on the way.
+ *         call UplinkJournal_Consume once it is sent
+ * @param cptrTopic[out] NUL terminated topic, topicSize should be > UPLINK_JOURNAL_MAX_TOPIC
+ * @param cptrPayload[out] NUL terminated message, payloadSize should be > UPLINK_JOURNAL_MAX_PAYLOAD
+ * @param ptrPayloadLength[out] length of the message without the NUL, needed for binary messages. can be NULL
+ * @param ptrPosition[out] where the message is, for UplinkJournal_ConsumeAt once it is delivered. can be NULL
+ * @return ESP_OK if a message was read, ESP_ERR_NOT_FOUND if the journal is empty
+ */
+esp_err_t UplinkJournal_Peek(char *cptrTopic, size_t topicSize, char *cptrPayload, size_t payloadSize, size_t *ptrPayloadLength,
+                             UplinkJournal_Position_t *ptrPosition)
+{
+    if (journalPartition == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    xSemaphoreTake(journalMutex, portMAX_DELAY);
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    peeked = false;
+    while (metrics.pending > 0 && !(tailSector == headSector && tailOffset >= headOffset))
+    {
+        UplinkJournal_RecordHeader_t record;
+        if (tailOffset + sizeof(record) > UPLINK_JOURNAL_SECTOR_SIZE ||
+            UplinkJournal_Read(tailSector, tailOffset, &record, sizeof(record)) != ESP_OK ||
+            record.state == UPLINK_JOURNAL_STATE_FREE || !UplinkJournal_RecordIsSane(&record, tailOffset))
+        {
+            // end of this sector
+            if (tailSector == headSector)
+            {
+                break;
+            }
+            tailSector = (tailSector + 1) % sectorCount;
+            tailOffset = UPLINK_JOURNAL_FIRST_RECORD;
+            continue;
+        }
+
+        uint32_t recordSize = UplinkJournal_RecordSize(&record);
+        if (record.state != UPLINK_JOURNAL_STATE_VALID)
+        {
+            if (record.state == UPLINK_JOURNAL_STATE_WRITING)
+            {
+                metrics.corrupted++;
+            }
+            tailOffset += recordSize;
+            continue;
+        }
+
+        bool drop = false;
+        if (record.topicLength >= topicSize || record.payloadLength >= payloadSize)
+        {
+            ESP_LOGE(TAG, "Message of %d bytes does not fit the buffer", record.payloadLength);
+            metrics.corrupted++;
+            drop = true;
+        }
+        else if (UplinkJournal_Now() - record.time > UPLINK_JOURNAL_TTL)
+        {
+            metrics.expired++;
+            drop = true;
+        }
+        else if (UplinkJournal_Read(tailSector, tailOffset + sizeof(record), cptrTopic, record.topicLength) != ESP_OK ||
+                 UplinkJournal_Read(tailSector, tailOffset + sizeof(record) + record.topicLength, cptrPayload, record.payloadLength) != ESP_OK ||
+                 crc32_le(crc32_le(0, (const uint8_t *)cptrTopic, record.topicLength), (const uint8_t *)cptrPayload, record.payloadLength) != record.crc)
+        {
+            ESP_LOGE(TAG, "Corrupted message in sector %d", tailSector);
+            metrics.corrupted++;
+            drop = true;
+        }
+
+        if (drop)
+        {
+            UplinkJournal_SetState(tailSector, tailOffset, UPLINK_JOURNAL_STATE_CONSUMED);
+            metrics.pending--;
+            tailOffset += recordSize;
+            continue;
+        }
+
+        cptrTopic[record.topicLength] = '\0';
+        cptrPayload[record.payloadLength] = '\0';
+        if (ptrPayloadLength != NULL)
+        {
+            *ptrPayloadLength = record.payloadLength;
+        }
+        peeked = true;
+        peekPosition.sector = tailSector;
+        peekPosition.offset = tailOffset;
+        peekPosition.size = recordSize;
+        peekPosition.crc = record.crc;
+        if (ptrPosition != NULL)
+        {
+            *ptrPosition = peekPosition;
+        }
+        err = ESP_OK;
+        break;
+    }
+    xSemaphoreGive(journalMutex);
+    return err;
+}
+
+/**
+ * @brief  mark a peeked message consumed, if it is still in flash: the journal may have been full since it was peeked
+ * @param delivered[in] counted as drained if true, as discarded if false
+ */
+static esp_err_t UplinkJournal_Remove(const UplinkJournal_Position_t *position, bool delivered)
+{
+    if (journalPartition == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(journalMutex, portMAX_DELAY);
+    UplinkJournal_RecordHeader_t record;
+    esp_err_t err = UplinkJournal_Read(position->sector, position->offset, &record, sizeof(record));
+    if (err == ESP_OK && (record.state != UPLINK_JOURNAL_STATE_VALID || record.crc != position->crc))
+    {
+        // overwritten, or consumed already
+        err = ESP_ERR_NOT_FOUND;
+    }
+    if (err == ESP_OK)
+    {
+        err = UplinkJournal_SetState(position->sector, position->offset, UPLINK_JOURNAL_STATE_CONSUMED);
+        if (position->sector == tailSector && position->offset == tailOffset)
+        {
+            tailOffset += position->size;
+        }
+        if (delivered)
+        {
+            metrics.drained++;
+        }
+        else
+        {
+            metrics.discarded++;
+        }
+        if (metrics.pending > 0)
+        {
+            metrics.pending--;
+        }
+    }
+    if (peeked && peekPosition.sector == position->sector && peekPosition.offset == position->offset)
+    {
+        peeked = false;
+    }
+    xSemaphoreGive(journalMutex);
+    return err;
+}
+
+/**
+ * @brief  remove the message returned by the last UplinkJournal_Peek
+ */
+esp_err_t UplinkJournal_Consume()
+{
+    if (!peeked)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    UplinkJournal_Position_t position = peekPosition;
+    return UplinkJournal_Remove(&position, true);
+}
+
+/**
+ * @brief  remove a message once it is delivered, for a sender which keeps the message in flight after UplinkJournal_Peek
+ * @param position[in] as given by UplinkJournal_Peek
+ * @return ESP_ERR_NOT_FOUND if the message was dropped from the journal meanwhile
+ */
+esp_err_t UplinkJournal_ConsumeAt(const UplinkJournal_Position_t *position)
+{
+    return UplinkJournal_Remove(position, true);
+}
+
+/**
+ * @brief  remove a message which the sender can not deliver (unknown topic), so it does not hold back the next ones
+ * @param position[in] as given by UplinkJournal_Peek
+ */
+esp_err_t UplinkJournal_Discard(const UplinkJournal_Position_t *position)
+{
+    return UplinkJournal_Remove(position, false);
+}
+
+uint32_t UplinkJournal_Pending()
+{
+    return metrics.pending;
+}
+
+void UplinkJournal_GetMetrics(UplinkJournal_Metrics_t *journalMetrics)
+{
+    if (journalMutex != NULL)
+    {
+        xSemaphoreTake(journalMutex, portMAX_DELAY);
+    }
+    *journalMetrics = metrics;
+    if (journalMutex != NULL)
+    {
+        xSemaphoreGive(journalMutex);
+    }
+}
+
+void UplinkJournal_PrintMetrics()
+{
+    UplinkJournal_Metrics_t journalMetrics;
+    UplinkJournal_GetMetrics(&journalMetrics);
+    ESP_LOGI(TAG, "appended: %d, drained: %d, pending: %d, expired: %d, overwritten: %d, corrupted: %d, discarded: %d, erases: %d",
+             journalMetrics.appended, journalMetrics.drained, journalMetrics.pending, journalMetrics.expired,
+             journalMetrics.overwritten, journalMetrics.corrupted, journalMetrics.discarded, journalMetrics.erases);
+}
+
+#endif
@@ -34,18 +34,47 @@ void Utilities_GetDeviceMac(char *macString)
 	}
 }
 
-bool Utilities_StringToMac(const char *strmac, uint8_t *mac)
+static int8_t Utilities_HexDigit(char c)
 {
-	// validate valid mac exists
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
 
-	if (6 == sscanf(strmac, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx", &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5]))
-	{
-		return true;
-	}
-	else
-	{
-		return false;
+// reads a mac address in standard format e.g. 8c:aa:b5:b8:c2:ec at the start of strmac, with one or two digits per byte.
+// reentrant, strmac is not modified. returns the character after the mac, or NULL if there is no mac
+const char *Utilities_ParseMac(const char *strmac, uint8_t *mac)
+{
+	for (uint8_t i = 0; i < 6; i++)
+	{
+		if (i > 0 && *strmac++ != ':')
+			return NULL;
+		int8_t high = Utilities_HexDigit(*strmac);
+		if (high < 0)
+			return NULL;
+		strmac++;
+		int8_t low = Utilities_HexDigit(*strmac);
+		if (low < 0)
+		{
+			mac[i] = high;
+		}
+		else
+		{
+			mac[i] = (high << 4) | low;
+			strmac++;
+		}
 	}
+	return strmac;
+}
+
+bool Utilities_StringToMac(const char *strmac, uint8_t *mac)
+{
+	// validate valid mac exists
+	return Utilities_ParseMac(strmac, mac) != NULL;
 }
 
 bool Utilities_MacToString(const uint8_t *mac, char *strmac, size_t size)
@@ -109,34 +138,22 @@ bool Utilities_ValidateHexString(char *macStr, int length)
 }
 
 // for validating mac addresses in standard format e.g. 8c:aa:b5:b8:c2:ec
-bool Utilities_ValidateMacAddress(char *macAdd)
+bool Utilities_ValidateMacAddress(const char *macAdd)
 {
-	const char delim[2] = ":";
-	char hexString[13] = "";
-	int counter = 0;
-	char *token;
-
-	token = strtok(macAdd, delim);
-
-	while (token != NULL)
+	uint8_t mac[6];
+	const char *end = Utilities_ParseMac(macAdd, mac);
+	if (end == NULL || *end != '\0' || (end - macAdd) != 17)
 	{
-		ESP_LOGI(TAG, "TOKEN: %s", token);
-		if (counter > 5)
-		{
-			ESP_LOGI(TAG, "Too many colons");
-			return false;
-		}
-		if (!(strlen(token) == 2))
-		{
-			ESP_LOGI(TAG, "Invalid token");
-			return false;
-		}
-		strcat(hexString, token);
-		token = strtok(NULL, delim);
-		counter++;
+		ESP_LOGI(TAG, "Invalid mac address");
+		return false;
 	}
-
-	return Utilities_ValidateHexString(hexString, 12);
+	// the mac can not be 0
+	for (uint8_t i = 0; i < 6; i++)
+	{
+		if (mac[i] != 0)
+			return true;
+	}
+	return false;
 }
 void print_system_info_timercb(void *timer)
 {
@@ -0,0 +1,129 @@
+import json
+import math
+import struct
+import sys
+
+# decodes the messages published by the root (and the frames of the nodes) to the JSON the backend takes.
+# a message starting with a CBOR map (0xA0-0xBF) is a frame {0: cmnd, 1: val, 2: data}, anything else is JSON text.
+# same output as the root gives for a topic set to JSON: the data of the frame, with byte strings as
+# {"cmnd": X, "val": V, "str": "HEX"}
+
+FRAME_KEY_CMND = 0
+FRAME_KEY_VAL = 1
+FRAME_KEY_DATA = 2
+MAX_DEPTH = 8
+
+
+class CborError(Exception):
+    pass
+
+
+class CborReader:
+    def __init__(self, data):
+        self.data = bytes(data)
+        self.offset = 0
+
+    def take(self, length):
+        if self.offset + length > len(self.data):
+            raise CborError("truncated at byte %d" % self.offset)
+        chunk = self.data[self.offset:self.offset + length]
+        self.offset += length
+        return chunk
+
+    def head(self):
+        initial = self.take(1)[0]
+        major, info = initial >> 5, initial & 0x1F
+        if info < 24:
+            return major, info, info
+        if info > 27:
+            raise CborError("indefinite or reserved length at byte %d" % (self.offset - 1))
+        return major, info, int.from_bytes(self.take(1 << (info - 24)), "big")
+
+    def item(self, depth=0):
+        if depth > MAX_DEPTH:
+            raise CborError("nested deeper than %d" % MAX_DEPTH)
+        major, info, value = self.head()
+        if major == 0:
+            return value
+        if major == 1:
+            return -1 - value
+        if major == 2:
+            return self.take(value)
+        if major == 3:
+            return self.take(value).decode("utf-8")
+        if major == 4:
+            return [self.item(depth + 1) for _ in range(value)]
+        if major == 5:
+            result = {}
+            for _ in range(value):
+                key = self.item(depth + 1)
+                result[key if isinstance(key, str) else str(key)] = self.item(depth + 1)
+            return result
+        if major == 6:
+            return self.item(depth + 1)
+        if info == 25:
+            return struct.unpack(">e", value.to_bytes(2, "big"))[0]
+        if info == 26:
+            return struct.unpack(">f", value.to_bytes(4, "big"))[0]
+        if info == 27:
+            return struct.unpack(">d", value.to_bytes(8, "big"))[0]
+        return {20: False, 21: True}.get(value)
+
+
+def to_json_value(value):
+    if isinstance(value, bytes):
+        return value.hex().upper()
+    if isinstance(value, float) and not math.isfinite(value):
+        return None
+    if isinstance(value, list):
+        return [to_json_value(item) for item in value]
+    if isinstance(value, dict):
+        return {key: to_json_value(item) for key, item in value.items()}
+    return value
+
+
+def is_frame(payload):
+    return len(payload) > 0 and (payload[0] >> 5) == 5
+
+
+def decode_frame(payload):
+    reader = CborReader(payload)
+    frame = reader.item()
+    if not isinstance(frame, dict) or str(FRAME_KEY_DATA) not in frame:
+        raise CborError("not an uplink frame")
+    if reader.offset != len(payload):
+        raise CborError("%d bytes after the frame" % (len(payload) - reader.offset))
+    return frame.get(str(FRAME_KEY_CMND)), frame.get(str(FRAME_KEY_VAL)), frame[str(FRAME_KEY_DATA)]
+
+
+def decode_message(payload):
+    """payload as published (bytes). returns the JSON text the backend takes"""
+    if not is_frame(payload):
+        return payload.decode("utf-8")
+    cmnd, val, data = decode_frame(payload)
+    if isinstance(data, str):
+        return data
+    if isinstance(data, bytes):
+        data = {"cmnd": cmnd, "val": val, "str": data}
+    return json.dumps(to_json_value(data), separators=(",", ":"))
+
+
+def main():
+    # one message per line, as hex (eg: copied from the MQTT test client), or a file of one binary message
+    if len(sys.argv) > 1:
+        for name in sys.argv[1:]:
+            with open(name, "rb") as file:
+                print(decode_message(file.read()))
+        return
+    for line in sys.stdin:
+        line = line.strip()
+        if not line:
+            continue
+        try:
+            print(decode_message(bytes.fromhex(line)))
+        except (ValueError, CborError) as error:
+            print("error: %s" % error, file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,865 @@
+#include "SIM7080_AT.h"
+#include "SIM7080_lib.h"
+#include "esp_timer.h"
+#include <inttypes.h>
+
+static const char *TAG = "SIM7080_AT";
+
+// classification of a line recieved while a command is in flight
+typedef enum SIM7080_AT_line_t
+{
+    AT_LINE_INFO = 0,   // part of the response of the command (echo, information lines, empty lines)
+    AT_LINE_BINARY,     // "<prefix>: <length>" followed by <length> raw bytes
+    AT_LINE_PAYLOAD,    // the modem is ready to accept the payload of the command
+    AT_LINE_FINAL,      // successful final result
+    AT_LINE_ERROR,      // unsuccessful final result
+    AT_LINE_URC,        // unsolicited message, not related to the command
+    AT_LINE_STALE,      // late final result of a command which timed out
+
+} SIM7080_AT_line_t;
+
+static QueueHandle_t AT_pending_queue                           = NULL;
+static SemaphoreHandle_t AT_lock                                = NULL;
+static SIM7080_AT_cmd_t *AT_in_flight[SIM7080_AT_MAX_IN_FLIGHT] = {0};
+static uint8_t AT_in_flight_head                                = 0;
+static uint8_t AT_in_flight_count                               = 0;
+static uint8_t AT_pipeline_depth                                = 1;
+static SIM7080_AT_metrics_t AT_metrics[SIM7080_AT_METRICS_ENTRIES];
+static uint8_t AT_metrics_count                                 = 0;
+
+// after a timeout the modem may still send the result of the expired command. nothing is written until the result of
+// the sync command shows where the responses are: the final results which come before the "+CMEE:" line of the last
+// sync command written are dropped. a sync command which expires is written again, up to SIM7080_AT_SYNC_ATTEMPTS
+static SIM7080_AT_cmd_t AT_sync_cmd                             = {.message = (const uint8_t *)"AT+CMEE?", .length = 8, .timeout = SIM7080_AT_SYNC_TIMEOUT};
+static bool AT_resync                                           = false;
+static uint8_t AT_sync_written                                  = 0;
+static uint8_t AT_sync_markers                                  = 0;
+static uint32_t AT_stale_results                                = 0;
+
+/**
+ * @brief  check if a line begins with the given characters
+ * @param line      pointer to the line
+ * @param length    length of the line
+ * @param prefix    characters to match
+ * @return          true if the line begins with the prefix
+ */
+static bool SIM7080_AT_starts_with(const uint8_t *line, uint16_t length, const char *prefix)
+{
+    size_t prefix_length = strlen(prefix);
+    if (length < prefix_length)
+    {
+        return false;
+    }
+    return memcmp(line, prefix, prefix_length) == 0;
+}
+
+/**
+ * @brief  derive the response prefix of a command. "AT+CFSRFILE=3,..." gives "+CFSRFILE". Plain "AT" and data payloads give ""
+ * @param cmd   the command
+ */
+static void SIM7080_AT_get_prefix(SIM7080_AT_cmd_t *cmd)
+{
+    uint8_t i = 0;
+    memset(cmd->prefix, 0, SIM7080_AT_PREFIX_SIZE);
+
+    if (cmd->length < 4 || cmd->message[0] != 'A' || cmd->message[1] != 'T' || cmd->message[2] != '+')
+    {
+        return;
+    }
+
+    for (uint16_t pos = 2; pos < cmd->length && i < SIM7080_AT_PREFIX_SIZE - 1; pos++)
+    {
+        uint8_t c = cmd->message[pos];
+        if (c == '=' || c == '?' || c == '\r' || c == '\0')
+        {
+            break;
+        }
+        cmd->prefix[i++] = c;
+    }
+}
+
+/**
+ * @brief  the name under which the metrics of a command are recorded
+ */
+static const char *SIM7080_AT_get_key(const SIM7080_AT_cmd_t *cmd)
+{
+    if (cmd->prefix[0] != '\0')
+    {
+        return cmd->prefix;
+    }
+    if (cmd->length >= 2 && cmd->message[0] == 'A' && cmd->message[1] == 'T')
+    {
+        return "AT";
+    }
+    return "DATA";
+}
+
+/**
+ * @brief  parse the decimal number following "<prefix>: "
+ * @return the number, or 0 if there is none
+ */
+static uint32_t SIM7080_AT_get_length(const SIM7080_AT_cmd_t *cmd, const uint8_t *line, uint16_t length)
+{
+    uint32_t value = 0;
+    uint16_t pos = strlen(cmd->prefix) + 1;
+
+    // skip the spaces after the ":"
+    while (pos < length && line[pos] == ' ')
+    {
+        pos++;
+    }
+    while (pos < length && line[pos] >= '0' && line[pos] <= '9')
+    {
+        value = (value * 10) + (line[pos] - '0');
+        pos++;
+    }
+    return value;
+}
+
+/**
+ * @brief  copy data to the response buffer of a command. Data which does not fit is dropped
+ */
+static void SIM7080_AT_append(SIM7080_AT_cmd_t *cmd, const uint8_t *data, uint16_t length, bool add_line_end)
+{
+    if (cmd->response == NULL || cmd->response_size == 0)
+    {
+        return;
+    }
+
+    uint16_t space = cmd->response_size - cmd->response_length;
+    uint16_t copy_length = (length < space) ? length : space;
+    memcpy(cmd->response + cmd->response_length, data, copy_length);
+    cmd->response_length += copy_length;
+
+    if (add_line_end && (cmd->response_size - cmd->response_length) >= 2)
+    {
+        cmd->response[cmd->response_length++] = '\r';
+        cmd->response[cmd->response_length++] = '\n';
+    }
+}
+
+/**
+ * @brief  decide where a line belongs to, with respect to the oldest command in flight
+ */
+static SIM7080_AT_line_t SIM7080_AT_classify(const SIM7080_AT_cmd_t *cmd, const uint8_t *line, uint16_t length)
+{
+    // 1. empty lines separate the parts of a response
+    if (length == 0)
+    {
+        return AT_LINE_INFO;
+    }
+
+    // 2. final results. a binary final result (eg: "+SHREAD: <length>") completes after its raw bytes
+    if (cmd->final_prefix != NULL && SIM7080_AT_starts_with(line, length, cmd->final_prefix))
+    {
+        return (cmd->flags & SIM7080_AT_FLAG_BINARY) ? AT_LINE_BINARY : AT_LINE_FINAL;
+    }
+    if (length == 2 && line[0] == 'O' && line[1] == 'K')
+    {
+        return (cmd->final_prefix == NULL) ? AT_LINE_FINAL : AT_LINE_INFO;
+    }
+    if ((length == 5 && memcmp(line, "ERROR", 5) == 0) || SIM7080_AT_starts_with(line, length, "+CME ERROR") || SIM7080_AT_starts_with(line, length, "+CMS ERROR"))
+    {
+        return AT_LINE_ERROR;
+    }
+
+    // 3. the modem is waiting for data
+    if (cmd->payload_prefix != NULL && !cmd->payload_sent && SIM7080_AT_starts_with(line, length, cmd->payload_prefix))
+    {
+        return AT_LINE_PAYLOAD;
+    }
+
+    // 4. "+XXX:" lines belong to the command only if they carry its prefix
+    size_t prefix_length = strlen(cmd->prefix);
+    if (line[0] == '+' && prefix_length > 0 && length > prefix_length && line[prefix_length] == ':' && memcmp(line, cmd->prefix, prefix_length) == 0)
+    {
+        return (cmd->flags & SIM7080_AT_FLAG_BINARY) ? AT_LINE_BINARY : AT_LINE_INFO;
+    }
+
+    // 5. the known unsolicited messages, with or without a '+', and the other "+XXX:" lines are unsolicited
+    if (line[0] == '+' || SIM7080_URC_match(line, length) != NULL)
+    {
+        return AT_LINE_URC;
+    }
+
+    // 6. echo of the command and other information lines
+    return AT_LINE_INFO;
+}
+
+/**
+ * @brief  remove the oldest command from the in-flight list. AT_lock must be held
+ */
+static SIM7080_AT_cmd_t *SIM7080_AT_pop_in_flight(esp_err_t result)
+{
+    SIM7080_AT_cmd_t *cmd = AT_in_flight[AT_in_flight_head];
+    AT_in_flight[AT_in_flight_head] = NULL;
+    AT_in_flight_head = (AT_in_flight_head + 1) % SIM7080_AT_MAX_IN_FLIGHT;
+    AT_in_flight_count--;
+
+    cmd->result = result;
+    cmd->done_time = esp_timer_get_time();
+    if (cmd->response != NULL && cmd->response_length < cmd->response_size)
+    {
+        cmd->response[cmd->response_length] = '\0';
+    }
+
+    // record the metrics of the command
+    const char *key = SIM7080_AT_get_key(cmd);
+    SIM7080_AT_metrics_t *entry = NULL;
+    for (uint8_t i = 0; i < AT_metrics_count; i++)
+    {
+        if (strncmp(AT_metrics[i].prefix, key, SIM7080_AT_PREFIX_SIZE) == 0)
+        {
+            entry = &AT_metrics[i];
+            break;
+        }
+    }
+    if (entry == NULL && AT_metrics_count < SIM7080_AT_METRICS_ENTRIES)
+    {
+        entry = &AT_metrics[AT_metrics_count++];
+        memset(entry, 0, sizeof(SIM7080_AT_metrics_t));
+        strncpy(entry->prefix, key, SIM7080_AT_PREFIX_SIZE - 1);
+    }
+    if (entry != NULL)
+    {
+        int64_t latency = cmd->done_time - cmd->sent_time;
+        entry->count++;
+        entry->errors += (result == ESP_FAIL) ? 1 : 0;
+        entry->timeouts += (result == ESP_ERR_TIMEOUT) ? 1 : 0;
+        entry->queue_time_total += cmd->sent_time - cmd->submit_time;
+        entry->latency_total += latency;
+        if (entry->count == 1 || latency < entry->latency_min)
+        {
+            entry->latency_min = latency;
+        }
+        if (latency > entry->latency_max)
+        {
+            entry->latency_max = latency;
+        }
+    }
+
+    return cmd;
+}
+
+/**
+ * @brief  notify the owner of a completed command. AT_lock must not be held
+ */
+static void SIM7080_AT_finish(SIM7080_AT_cmd_t *cmd)
+{
+    TaskHandle_t waiter = cmd->waiter;
+    SIM7080_AT_callback_t callback = cmd->callback;
+
+    if (SIM_Get_Context()->log.print_log_info)
+    {
+        ESP_LOGI(TAG, "%s %s: queued %" PRId64 " us, latency %" PRId64 " us", SIM7080_AT_get_key(cmd), esp_err_to_name(cmd->result),
+                 cmd->sent_time - cmd->submit_time, cmd->done_time - cmd->sent_time);
+    }
+
+    if (waiter == NULL)
+    {
+        // asynchronous command. the callback is allowed to free the command, so it is the last access
+        cmd->state = SIM7080_AT_DONE;
+        if (callback != NULL)
+        {
+            callback(cmd);
+        }
+    }
+    else
+    {
+        // blocking command. the command lives on the stack of the waiter until the state is changed
+        if (callback != NULL)
+        {
+            callback(cmd);
+        }
+        cmd->state = SIM7080_AT_DONE;
+        xTaskNotifyGive(waiter);
+    }
+}
+
+/**
+ * @brief  reset the fields handled by the engine before a command is queued
+ */
+static void SIM7080_AT_reset(SIM7080_AT_cmd_t *cmd, TaskHandle_t waiter)
+{
+    cmd->state              = SIM7080_AT_PENDING;
+    cmd->result             = ESP_FAIL;
+    cmd->response_length    = 0;
+    cmd->binary_length      = 0;
+    cmd->binary_received    = 0;
+    cmd->binary_final       = false;
+    cmd->payload_sent       = false;
+    cmd->submit_time        = esp_timer_get_time();
+    cmd->sent_time          = cmd->submit_time;
+    cmd->done_time          = 0;
+    cmd->waiter             = waiter;
+    SIM7080_AT_get_prefix(cmd);
+    if (cmd->response != NULL && cmd->response_size > 0)
+    {
+        cmd->response[0] = '\0';
+    }
+}
+
+/**
+ * @brief  write bytes to the modem. Semaphore_UART_Resource must be held
+ */
+static void SIM7080_AT_write(const uint8_t *data, uint16_t length, bool add_cr)
+{
+    SIM7080_t *modem = SIM_Get_Context();
+
+    if (uart_write_bytes(modem->config.uart_port, (const char *)data, length) != length)
+    {
+        if (modem->log.print_log_info)
+        {
+            ESP_LOGE(TAG, "Tx Error, all data not pushed to UART");
+        }
+    }
+    if (add_cr)
+    {
+        uart_write_bytes(modem->config.uart_port, "\r", 1);
+    }
+
+    if (modem->log.print_Tx_info)
+    {
+        ESP_LOGI(TAG, "Tx: %.*s", length, (const char *)data);
+    }
+}
+
+/**
+ * @brief  check if a command can be written while the commands in the in-flight list wait for their results. AT_lock must be held.
+ *  a command waiting for its prompt blocks the pipeline, else the modem would take the next command as its payload
+ */
+static bool SIM7080_AT_can_write(const SIM7080_AT_cmd_t *cmd)
+{
+    if (AT_in_flight_count == 0)
+    {
+        return true;
+    }
+    if (AT_in_flight_count >= AT_pipeline_depth || !(cmd->flags & SIM7080_AT_FLAG_PIPELINE))
+    {
+        return false;
+    }
+    for (uint8_t i = 0; i < AT_in_flight_count; i++)
+    {
+        const SIM7080_AT_cmd_t *in_flight = AT_in_flight[(AT_in_flight_head + i) % SIM7080_AT_MAX_IN_FLIGHT];
+        if (!(in_flight->flags & SIM7080_AT_FLAG_PIPELINE) || (in_flight->payload_prefix != NULL && !in_flight->payload_sent))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief  write as many pending commands as the pipeline allows
+ */
+static void SIM7080_AT_dispatch(void)
+{
+    SIM7080_t *modem = SIM_Get_Context();
+    SIM7080_AT_cmd_t *cmd = NULL;
+
+    // 1. holding the UART resource keeps the order on the wire the same as the order of the in-flight list
+    if (xSemaphoreTake(modem->comm.Semaphore_UART_Resource, portMAX_DELAY) != pdTRUE)
+    {
+        return;
+    }
+
+    while (1)
+    {
+        // 2. after a timeout, only the sync command is written, once the expired commands are out of the in-flight list
+        xSemaphoreTake(AT_lock, portMAX_DELAY);
+        if (AT_resync)
+        {
+            bool write_sync = (AT_in_flight_count == 0);
+            if (write_sync)
+            {
+                SIM7080_AT_reset(&AT_sync_cmd, NULL);
+                AT_sync_written++;
+                AT_in_flight[AT_in_flight_head] = &AT_sync_cmd;
+                AT_in_flight_count = 1;
+                AT_sync_cmd.state = SIM7080_AT_IN_FLIGHT;
+            }
+            xSemaphoreGive(AT_lock);
+            if (write_sync)
+            {
+                SIM7080_AT_write(AT_sync_cmd.message, AT_sync_cmd.length, true);
+            }
+            break;
+        }
+
+        // 3. check if the next pending command can be written now
+        if (xQueuePeek(AT_pending_queue, &cmd, 0) != pdTRUE || !SIM7080_AT_can_write(cmd))
+        {
+            xSemaphoreGive(AT_lock);
+            break;
+        }
+        xQueueReceive(AT_pending_queue, &cmd, 0);
+
+        // 4. move it to the in-flight list
+        AT_in_flight[(AT_in_flight_head + AT_in_flight_count) % SIM7080_AT_MAX_IN_FLIGHT] = cmd;
+        AT_in_flight_count++;
+        cmd->state = SIM7080_AT_IN_FLIGHT;
+        cmd->sent_time = esp_timer_get_time();
+        xSemaphoreGive(AT_lock);
+
+        // 5. write it to the modem
+        SIM7080_AT_write(cmd->message, cmd->length, !(cmd->flags & SIM7080_AT_FLAG_NO_CR));
+    }
+
+    xSemaphoreGive(modem->comm.Semaphore_UART_Resource);
+}
+
+/**
+ * @brief  write the payload of a command after the modem asked for it. the next pipeline command can follow right after.
+ *  payload_sent is changed while the UART resource is held, so no other command is written between the prompt and the payload
+ */
+static void SIM7080_AT_send_payload(SIM7080_AT_cmd_t *cmd)
+{
+    SIM7080_t *modem = SIM_Get_Context();
+    if (xSemaphoreTake(modem->comm.Semaphore_UART_Resource, portMAX_DELAY) == pdTRUE)
+    {
+        SIM7080_AT_write(cmd->payload, cmd->payload_length, false);
+        cmd->payload_sent = true;
+        xSemaphoreGive(modem->comm.Semaphore_UART_Resource);
+    }
+    SIM7080_AT_dispatch();
+}
+
+/**
+ * @brief  add a command to the pending queue and write it if the pipeline allows
+ */
+static esp_err_t SIM7080_AT_enqueue(SIM7080_AT_cmd_t *cmd, TaskHandle_t waiter)
+{
+    SIM7080_t *modem = SIM_Get_Context();
+
+    // 1. check if the engine is ready and the command is valid
+    if (AT_pending_queue == NULL || cmd == NULL || cmd->message == NULL || cmd->length == 0)
+    {
+        if (modem->log.print_log_info)
+        {
+            ESP_LOGE(TAG, "AT engine not initialized or invalid command");
+        }
+        return ESP_FAIL;
+    }
+
+    // 2. reset the fields handled by the engine
+    SIM7080_AT_reset(cmd, waiter);
+
+    // 3. add it to the pending queue
+    if (xQueueSend(AT_pending_queue, &cmd, cmd->timeout / portTICK_RATE_MS) != pdTRUE)
+    {
+        cmd->state = SIM7080_AT_IDLE;
+        if (modem->log.print_log_info)
+        {
+            ESP_LOGE(TAG, "AT pending queue is full");
+        }
+        return ESP_FAIL;
+    }
+
+    // 4. write it right away if the modem is free
+    SIM7080_AT_dispatch();
+    return ESP_OK;
+}
+
+/**
+ * @brief  initialize the AT command engine. Called once from SIM7080_setup
+ * @param pipeline_depth    the maximum number of SIM7080_AT_FLAG_PIPELINE commands written before their results arrive
+ * @return ESP_OK if success, else ESP_FAIL
+ */
+esp_err_t SIM7080_AT_engine_init(uint8_t pipeline_depth)
+{
+    if (AT_pending_queue != NULL)
+    {
+        return ESP_OK;
+    }
+
+    // 1. check the pipeline depth
+    if (pipeline_depth == 0)
+    {
+        pipeline_depth = 1;
+    }
+    if (pipeline_depth > SIM7080_AT_MAX_IN_FLIGHT)
+    {
+        pipeline_depth = SIM7080_AT_MAX_IN_FLIGHT;
+    }
+    AT_pipeline_depth = pipeline_depth;
+
+    // 2. create the lock which protects the in-flight list and the metrics
+    AT_lock = xSemaphoreCreateMutex();
+    if (AT_lock == NULL)
+    {
+        return ESP_FAIL;
+    }
+
+    // 3. create the queue of commands waiting to be written
+    AT_pending_queue = xQueueCreate(SIM7080_AT_PENDING_LENGTH, sizeof(SIM7080_AT_cmd_t *));
+    if (AT_pending_queue == NULL)
+    {
+        vSemaphoreDelete(AT_lock);
+        AT_lock = NULL;
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief  queue a command without waiting for its result. The result is delivered through cmd->callback
+ * @param cmd   the command. Must stay valid until it is completed
+ * @return ESP_OK if the command is queued, else ESP_FAIL
+ */
+esp_err_t SIM7080_AT_submit(SIM7080_AT_cmd_t *cmd)
+{
+    return SIM7080_AT_enqueue(cmd, NULL);
+}
+
+/**
+ * @brief  queue a command without waiting for its result. The calling task collects the result later with SIM7080_AT_wait.
+ *  this allows a task to keep several commands in flight
+ * @param cmd   the command. Must stay valid until SIM7080_AT_wait returns
+ * @return ESP_OK if the command is queued, else ESP_FAIL
+ */
+esp_err_t SIM7080_AT_start(SIM7080_AT_cmd_t *cmd)
+{
+    return SIM7080_AT_enqueue(cmd, xTaskGetCurrentTaskHandle());
+}
+
+/**
+ * @brief  block the calling task until a command queued with SIM7080_AT_start is completed.
+ *  the task is woken by a task notification, so there is no polling between the steps
+ * @param cmd   the command
+ * @return ESP_OK if the modem replied with the expected final result, ESP_FAIL if it replied with an error, ESP_ERR_TIMEOUT if it did not reply
+ */
+esp_err_t SIM7080_AT_wait(SIM7080_AT_cmd_t *cmd)
+{
+    // every queued command is completed by the receiving task, either with a result or with a timeout
+    while (cmd->state != SIM7080_AT_DONE)
+    {
+        ulTaskNotifyTake(pdTRUE, SIM7080_AT_MAX_WAIT_TICKS);
+    }
+
+    return cmd->result;
+}
+
+/**
+ * @brief  queue a command and block the calling task until it is completed
+ * @param cmd   the command
+ * @return ESP_OK if the modem replied with the expected final result, ESP_FAIL if it replied with an error, ESP_ERR_TIMEOUT if it did not reply
+ */
+esp_err_t SIM7080_AT_execute(SIM7080_AT_cmd_t *cmd)
+{
+    if (SIM7080_AT_start(cmd) != ESP_OK)
+    {
+        return ESP_FAIL;
+    }
+
+    return SIM7080_AT_wait(cmd);
+}
+
+/**
+ * @brief  fail all the commands which are not yet written to the modem
+ * @return the number of commands removed
+ */
+uint8_t SIM7080_AT_flush(void)
+{
+    SIM7080_AT_cmd_t *cmd = NULL;
+    uint8_t removed = 0;
+
+    if (AT_pending_queue == NULL)
+    {
+        return removed;
+    }
+
+    while (xQueueReceive(AT_pending_queue, &cmd, 0) == pdTRUE)
+    {
+        cmd->result = ESP_FAIL;
+        cmd->done_time = esp_timer_get_time();
+        SIM7080_AT_finish(cmd);
+        removed++;
+    }
+
+    return removed;
+}
+
+/**
+ * @brief  handle one complete line recieved from the modem. the line ending "\r\n" is already removed.
+ *  the line is given to the oldest command in flight, or to the pre_process_recieved_message handler if it is unsolicited
+ * @param line      pointer to the line. must be NUL terminated
+ * @param length    length of the line
+ * @return the number of raw bytes which follow the line and belong to the same command (0 in most cases)
+ */
+uint32_t SIM7080_AT_process_line(const uint8_t *line, uint16_t length)
+{
+    SIM7080_t *modem = SIM_Get_Context();
+    SIM7080_AT_cmd_t *completed = NULL;
+    SIM7080_AT_cmd_t *payload_cmd = NULL;
+    SIM7080_AT_line_t type = AT_LINE_URC;
+    uint32_t binary_length = 0;
+
+    if (modem->log.print_Rx_info && length > 0)
+    {
+        ESP_LOGI(TAG, "Rx: %.*s", length, (const char *)line);
+    }
+
+    // 1. find the owner of the line
+    xSemaphoreTake(AT_lock, portMAX_DELAY);
+    if (AT_in_flight_count > 0)
+    {
+        SIM7080_AT_cmd_t *cmd = AT_in_flight[AT_in_flight_head];
+        type = SIM7080_AT_classify(cmd, line, length);
+        if (cmd == &AT_sync_cmd)
+        {
+            // the final results before the "+CMEE:" line of the last sync command are late results of expired commands
+            if (type == AT_LINE_INFO && SIM7080_AT_starts_with(line, length, "+CMEE:"))
+            {
+                AT_sync_markers++;
+            }
+            else if ((type == AT_LINE_FINAL || type == AT_LINE_ERROR) && AT_sync_markers < AT_sync_written)
+            {
+                type = AT_LINE_STALE;
+            }
+        }
+
+        if (type != AT_LINE_URC)
+        {
+            SIM7080_AT_append(cmd, line, length, true);
+        }
+
+        switch (type)
+        {
+        case AT_LINE_BINARY:
+            binary_length = SIM7080_AT_get_length(cmd, line, length);
+            cmd->binary_length = binary_length;
+            cmd->binary_final = (cmd->final_prefix != NULL && SIM7080_AT_starts_with(line, length, cmd->final_prefix));
+            if (cmd->binary_final && binary_length == 0)
+            {
+                completed = SIM7080_AT_pop_in_flight(ESP_OK);
+            }
+            break;
+        case AT_LINE_PAYLOAD:
+            payload_cmd = cmd;
+            break;
+        case AT_LINE_FINAL:
+            completed = SIM7080_AT_pop_in_flight(ESP_OK);
+            break;
+        case AT_LINE_ERROR:
+            completed = SIM7080_AT_pop_in_flight(ESP_FAIL);
+            break;
+        case AT_LINE_STALE:
+            AT_stale_results++;
+            break;
+        default:
+            break;
+        }
+        if (completed == &AT_sync_cmd)
+        {
+            AT_resync = false;
+            AT_sync_written = 0;
+            AT_sync_markers = 0;
+        }
+    }
+    xSemaphoreGive(AT_lock);
+
+    // 2. act on the line outside of the lock
+    if (type == AT_LINE_URC && length > 0 && modem->comm.pre_process_recieved_message != NULL)
+    {
+        modem->comm.pre_process_recieved_message((uint8_t *)line);
+    }
+    if (payload_cmd != NULL)
+    {
+        SIM7080_AT_send_payload(payload_cmd);
+    }
+    if (completed != NULL)
+    {
+        SIM7080_AT_finish(completed);
+        SIM7080_AT_dispatch();
+    }
+
+    return binary_length;
+}
+
+/**
+ * @brief  handle raw bytes announced by a SIM7080_AT_FLAG_BINARY line. the bytes are copied to the binary buffer
+ *  (or the response, if there is no binary buffer) of the oldest command in flight
+ */
+void SIM7080_AT_process_binary(const uint8_t *data, uint16_t length)
+{
+    SIM7080_AT_cmd_t *completed = NULL;
+
+    xSemaphoreTake(AT_lock, portMAX_DELAY);
+    if (AT_in_flight_count > 0)
+    {
+        SIM7080_AT_cmd_t *cmd = AT_in_flight[AT_in_flight_head];
+        if (cmd->binary != NULL)
+        {
+            uint32_t space = (cmd->binary_received < cmd->binary_size) ? (cmd->binary_size - cmd->binary_received) : 0;
+            uint32_t copy_length = (length < space) ? length : space;
+            memcpy(cmd->binary + cmd->binary_received, data, copy_length);
+        }
+        else
+        {
+            SIM7080_AT_append(cmd, data, length, false);
+        }
+        cmd->binary_received += length;
+
+        // a binary final result is complete once all of its bytes are recieved
+        if (cmd->binary_final && cmd->binary_received >= cmd->binary_length)
+        {
+            completed = SIM7080_AT_pop_in_flight(ESP_OK);
+        }
+    }
+    xSemaphoreGive(AT_lock);
+
+    if (completed != NULL)
+    {
+        SIM7080_AT_finish(completed);
+        SIM7080_AT_dispatch();
+    }
+}
+
+/**
+ * @brief  handle an incomplete line which may be a prompt. the modem does not end prompts such as "> " with "\r\n"
+ * @return true if the data was consumed as a prompt
+ */
+bool SIM7080_AT_process_partial(const uint8_t *data, uint16_t length)
+{
+    SIM7080_AT_cmd_t *payload_cmd = NULL;
+
+    xSemaphoreTake(AT_lock, portMAX_DELAY);
+    if (AT_in_flight_count > 0)
+    {
+        SIM7080_AT_cmd_t *cmd = AT_in_flight[AT_in_flight_head];
+        if (cmd->payload_prefix != NULL && !cmd->payload_sent && SIM7080_AT_starts_with(data, length, cmd->payload_prefix))
+        {
+            SIM7080_AT_append(cmd, data, length, true);
+            payload_cmd = cmd;
+        }
+    }
+    xSemaphoreGive(AT_lock);
+
+    if (payload_cmd != NULL)
+    {
+        SIM7080_AT_send_payload(payload_cmd);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief  complete the commands whose timeout expired. Called periodically by the receiving task.
+ *  the modem may still answer the oldest command after its timeout, so the commands behind it expire with it and the
+ *  engine writes the sync command before anything else
+ * @return the number of ticks until the next timeout expires (capped at SIM7080_AT_MAX_WAIT_TICKS)
+ */
+TickType_t SIM7080_AT_check_timeouts(void)
+{
+    TickType_t wait = SIM7080_AT_MAX_WAIT_TICKS;
+    SIM7080_AT_cmd_t *completed[SIM7080_AT_MAX_IN_FLIGHT];
+    uint8_t completed_count = 0;
+
+    if (AT_lock == NULL)
+    {
+        return wait;
+    }
+
+    // 1. only the oldest command can be waiting on the modem, the rest are behind it
+    xSemaphoreTake(AT_lock, portMAX_DELAY);
+    if (AT_in_flight_count > 0)
+    {
+        SIM7080_AT_cmd_t *cmd = AT_in_flight[AT_in_flight_head];
+        int64_t remaining = (cmd->sent_time + ((int64_t)cmd->timeout * 1000)) - esp_timer_get_time();
+        if (remaining <= 0)
+        {
+            // 2. a late result could complete the wrong command. the modem may still be busy with the expired command, so
+            //    the sync command is written again until it is answered or out of attempts (the modem is silent)
+            if (cmd != &AT_sync_cmd || AT_sync_written >= SIM7080_AT_SYNC_ATTEMPTS)
+            {
+                AT_resync = (cmd != &AT_sync_cmd);
+                AT_sync_written = 0;
+                AT_sync_markers = 0;
+            }
+            while (AT_in_flight_count > 0)
+            {
+                completed[completed_count++] = SIM7080_AT_pop_in_flight(ESP_ERR_TIMEOUT);
+            }
+        }
+        else
+        {
+            TickType_t ticks = (remaining / 1000) / portTICK_RATE_MS + 1;
+            wait = (ticks < wait) ? ticks : wait;
+        }
+    }
+    xSemaphoreGive(AT_lock);
+
+    // 3. notify the owners of the expired commands
+    for (uint8_t i = 0; i < completed_count; i++)
+    {
+        if (SIM_Get_Context()->log.print_log_info)
+        {
+            ESP_LOGE(TAG, "%s timed out after %u ms", SIM7080_AT_get_key(completed[i]), completed[i]->timeout);
+        }
+        SIM7080_AT_finish(completed[i]);
+    }
+
+    // 4. write the sync command, or the pending commands if the sync command expired
+    if (completed_count > 0)
+    {
+        SIM7080_AT_dispatch();
+    }
+
+    return wait;
+}
+
+/**
+ * @brief  copy the latency metrics of the commands
+ * @param metrics       array to copy the metrics to
+ * @param max_entries   size of the array
+ * @return the number of entries copied
+ */
+uint8_t SIM7080_AT_get_metrics(SIM7080_AT_metrics_t *metrics, uint8_t max_entries)
+{
+    uint8_t count = 0;
+    if (AT_lock == NULL || metrics == NULL)
+    {
+        return count;
+    }
+
+    xSemaphoreTake(AT_lock, portMAX_DELAY);
+    count = (AT_metrics_count < max_entries) ? AT_metrics_count : max_entries;
+    memcpy(metrics, AT_metrics, count * sizeof(SIM7080_AT_metrics_t));
+    xSemaphoreGive(AT_lock);
+
+    return count;
+}
+
+/**
+ * @brief  print the latency metrics of every command sent since the last reset
+ */
+void SIM7080_AT_print_metrics(void)
+{
+    SIM7080_AT_metrics_t metrics[SIM7080_AT_METRICS_ENTRIES];
+    uint8_t count = SIM7080_AT_get_metrics(metrics, SIM7080_AT_METRICS_ENTRIES);
+
+    ESP_LOGI(TAG, "late results dropped: %u", AT_stale_results);
+    ESP_LOGI(TAG, "%-16s %6s %6s %6s %10s %10s %10s %10s", "command", "count", "error", "t/out", "queue_avg", "lat_avg", "lat_min", "lat_max");
+    for (uint8_t i = 0; i < count; i++)
+    {
+        ESP_LOGI(TAG, "%-16s %6u %6u %6u %10" PRId64 " %10" PRId64 " %10" PRId64 " %10" PRId64, metrics[i].prefix, metrics[i].count, metrics[i].errors, metrics[i].timeouts,
+                 metrics[i].queue_time_total / metrics[i].count, metrics[i].latency_total / metrics[i].count, metrics[i].latency_min, metrics[i].latency_max);
+    }
+}
+
+/**
+ * @brief  clear the latency metrics
+ */
+void SIM7080_AT_reset_metrics(void)
+{
+    if (AT_lock == NULL)
+    {
+        return;
+    }
+
+    xSemaphoreTake(AT_lock, portMAX_DELAY);
+    memset(AT_metrics, 0, sizeof(AT_metrics));
+    AT_metrics_count = 0;
+    xSemaphoreGive(AT_lock);
+}
@@ -0,0 +1,157 @@
+#include "SIM7080_URC.h"
+#include "esp_log.h"
+#include <string.h>
+
+static const char *TAG = "SIM7080_URC";
+
+#define SIM7080_URC_NONE                    0xFF
+
+// one character of the prefix trie. the children of a node are linked through next_sibling
+typedef struct SIM7080_URC_node_t
+{
+    uint8_t character;
+    uint8_t first_child;
+    uint8_t next_sibling;
+    uint8_t entry;                          // index of the table entry whose prefix ends at this node, or SIM7080_URC_NONE
+
+} SIM7080_URC_node_t;
+
+static SIM7080_URC_node_t URC_nodes[SIM7080_URC_MAX_NODES];
+static uint8_t URC_node_count                       = 0;
+static const SIM7080_URC_entry_t *URC_table         = NULL;
+
+/**
+ * @brief  find the child of a node with the given character
+ * @return index of the child, or SIM7080_URC_NONE
+ */
+static uint8_t SIM7080_URC_find_child(uint8_t node, uint8_t character)
+{
+    uint8_t child = URC_nodes[node].first_child;
+    while (child != SIM7080_URC_NONE && URC_nodes[child].character != character)
+    {
+        child = URC_nodes[child].next_sibling;
+    }
+    return child;
+}
+
+/**
+ * @brief  add a new node to the trie
+ * @return index of the node, or SIM7080_URC_NONE if the trie is full
+ */
+static uint8_t SIM7080_URC_add_child(uint8_t node, uint8_t character)
+{
+    if (URC_node_count >= SIM7080_URC_MAX_NODES)
+    {
+        return SIM7080_URC_NONE;
+    }
+
+    uint8_t child = URC_node_count++;
+    URC_nodes[child].character      = character;
+    URC_nodes[child].first_child    = SIM7080_URC_NONE;
+    URC_nodes[child].next_sibling   = URC_nodes[node].first_child;
+    URC_nodes[child].entry          = SIM7080_URC_NONE;
+    URC_nodes[node].first_child     = child;
+    return child;
+}
+
+/**
+ * @brief  build the prefix trie of a table of unsolicited messages. Called once, before the first line is dispatched.
+ *  all the prefixes are matched in a single pass over the beginning of a line, so the cost of a line does not grow with the table
+ * @param table     the table. must stay valid while it is in use
+ * @param entries   number of entries in the table
+ * @return ESP_OK if success, else ESP_FAIL (too many entries, or the prefixes do not fit in SIM7080_URC_MAX_NODES)
+ */
+esp_err_t SIM7080_URC_build(const SIM7080_URC_entry_t *table, uint8_t entries)
+{
+    // 1. reset the trie to only the root
+    URC_table                   = NULL;
+    URC_node_count              = 1;
+    URC_nodes[0].character      = 0;
+    URC_nodes[0].first_child    = SIM7080_URC_NONE;
+    URC_nodes[0].next_sibling   = SIM7080_URC_NONE;
+    URC_nodes[0].entry          = SIM7080_URC_NONE;
+
+    if (table == NULL || entries > SIM7080_URC_MAX_ENTRIES)
+    {
+        return ESP_FAIL;
+    }
+
+    // 2. add the characters of every prefix. common beginnings share their nodes
+    for (uint8_t i = 0; i < entries; i++)
+    {
+        uint8_t node = 0;
+        for (const char *c = table[i].prefix; *c != '\0'; c++)
+        {
+            uint8_t child = SIM7080_URC_find_child(node, (uint8_t)*c);
+            if (child == SIM7080_URC_NONE)
+            {
+                child = SIM7080_URC_add_child(node, (uint8_t)*c);
+                if (child == SIM7080_URC_NONE)
+                {
+                    ESP_LOGE(TAG, "URC table does not fit in %d nodes", SIM7080_URC_MAX_NODES);
+                    return ESP_FAIL;
+                }
+            }
+            node = child;
+        }
+
+        if (node == 0 || URC_nodes[node].entry != SIM7080_URC_NONE)
+        {
+            ESP_LOGE(TAG, "Empty or duplicate URC prefix: %s", table[i].prefix);
+            return ESP_FAIL;
+        }
+        URC_nodes[node].entry = i;
+    }
+
+    URC_table = table;
+    return ESP_OK;
+}
+
+/**
+ * @brief  find the table entry of a line
+ * @param line      pointer to the line
+ * @param length    length of the line
+ * @return the entry with the longest prefix the line begins with, or NULL if there is none
+ */
+const SIM7080_URC_entry_t *SIM7080_URC_match(const uint8_t *line, uint16_t length)
+{
+    const SIM7080_URC_entry_t *match = NULL;
+    uint8_t node = 0;
+
+    if (URC_table == NULL)
+    {
+        return NULL;
+    }
+
+    for (uint16_t pos = 0; pos < length; pos++)
+    {
+        node = SIM7080_URC_find_child(node, line[pos]);
+        if (node == SIM7080_URC_NONE)
+        {
+            break;
+        }
+        if (URC_nodes[node].entry != SIM7080_URC_NONE)
+        {
+            match = &URC_table[URC_nodes[node].entry];
+        }
+    }
+
+    return match;
+}
+
+/**
+ * @brief  give a line to the handler of its table entry
+ * @param line      pointer to the line. must be NUL terminated
+ * @param length    length of the line
+ * @return the result of the handler, or ESP_OK if the line is not recognized
+ */
+esp_err_t SIM7080_URC_dispatch(uint8_t *line, uint16_t length)
+{
+    const SIM7080_URC_entry_t *match = SIM7080_URC_match(line, length);
+    if (match == NULL || match->handler == NULL)
+    {
+        return ESP_OK;
+    }
+
+    return match->handler(line, length);
+}
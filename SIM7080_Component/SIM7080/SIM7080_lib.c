@@ -2,6 +2,7 @@
 
 static const char *TAG = "SIM7080_lib";
 SIM7080_t Modem = {0};
+static SIM7080_ring_t Rx_ring = {0};
 
 /**
  * @brief   Get the SIM context. The context memory space
@@ -21,7 +22,7 @@ SIM7080_t *SIM_Get_Context(void)
  * @param character     characters to match
  * @return              true if the matching character is found, false if not
  */
-esp_err_t SIM7080_Strcmp_Data(uint8_t *data, uint8_t data_length, const char *character)
+esp_err_t SIM7080_Strcmp_Data(uint8_t *data, uint16_t data_length, const char *character)
 {
     uint16_t character_size = strlen(character);
 
@@ -86,11 +87,13 @@ esp_err_t SIM7080_setup(SIM7080_t *SIM_module)
     {
         return result;
     }
-    result = uart_driver_install(Modem.config.uart_port, Modem.config.uart_buffer_size * 2, 0, 0, NULL, 0);
+    QueueHandle_t UART_event_queue = NULL;
+    result = uart_driver_install(Modem.config.uart_port, Modem.config.uart_buffer_size * 2, Modem.config.uart_buffer_size, Modem.config.queue_length, &UART_event_queue, 0);
     if (result != ESP_OK)
     {
         return result;
     }
+    Modem.comm.UART_event_queue = UART_event_queue;
 
         // 6. create semaphore to share UART resource
     Modem.comm.Semaphore_UART_Resource = xSemaphoreCreateBinary();
@@ -101,16 +104,35 @@ esp_err_t SIM7080_setup(SIM7080_t *SIM_module)
     }
     xSemaphoreGive(Modem.comm.Semaphore_UART_Resource);
 
-    // 5. intialize the UART_Rx queue
-    Modem.comm.Recieve_queue = xQueueCreate(Modem.config.queue_length, Modem.config.uart_buffer_size * sizeof(uint8_t));
-    if (Modem.comm.Recieve_queue == NULL)
+    // 7. create the mutex which serializes the users of the shared recieved_message buffer
+    Modem.comm.Semaphore_Legacy_Command = xSemaphoreCreateMutex();
+    if (Modem.comm.Semaphore_Legacy_Command == NULL)
     {
         result = ESP_FAIL;
         return result;
     }
 
-    // 6. begin the UART Receive tasks
+    // 8. allocate the receive ring buffer
+    Rx_ring.size    = Modem.config.uart_buffer_size * 2;
+    Rx_ring.buffer  = (uint8_t *)malloc(Rx_ring.size + 1);
+    Rx_ring.scratch = (uint8_t *)malloc(Modem.config.uart_buffer_size + 1);
+    if (Rx_ring.buffer == NULL || Rx_ring.scratch == NULL)
+    {
+        free(Rx_ring.buffer);
+        free(Rx_ring.scratch);
+        memset(&Rx_ring, 0, sizeof(SIM7080_ring_t));
+        result = ESP_FAIL;
+        return result;
+    }
 
+    // 9. initialize the AT command engine
+    result = SIM7080_AT_engine_init(Modem.config.pipeline_depth);
+    if (result != ESP_OK)
+    {
+        return result;
+    }
+
+    // 10. begin the UART Receive tasks
     xTaskCreate(SIM7080_Receive_Data, "SIM7080_Receive_Data", 4096, NULL, 10, NULL);
 
     Modem.intialized = true;
@@ -213,229 +235,94 @@ esp_err_t SIM7080_FS_write_file(SIM7080_FS_t * File)
         return ESP_FAIL;
     }
 
-    // 4. create the dynamic memory location
-    uint8_t recieve_message[Modem.config.uart_buffer_size];
-    char *command_buffer = (char *)malloc((file_size) * sizeof(char));
-    if (command_buffer == NULL)
-    {
-        if (Modem.log.print_log_info)
-        {
-            ESP_LOGE(TAG, "Failed to allocate dynamic memory");
-        }
-        return ESP_FAIL;
-    }
-
-
+    // 4. prepare the command buffer. the file name is max 50 characters
+    char command_buffer[100];
+    SIM7080_AT_cmd_t cmd = {0};
+    esp_err_t result = ESP_FAIL;
 
     // 5. (if needed) check if the file already exist
     if (File->check_file_availability)
     {
-        memset(command_buffer, 0, file_size * sizeof(char));
-        sprintf(command_buffer, "AT+CFSGFIS=%d,\"%s\"", File->directory, File->file_name);
-        consume_SIM7080_message((uint8_t *)command_buffer, strlen(command_buffer));
-
-
-        memset(recieve_message, 0, Modem.config.uart_buffer_size);
-        if (xQueueReceive(Modem.comm.Recieve_queue, recieve_message, 1000 / portTICK_RATE_MS) != pdTRUE)
+        cmd.length  = sprintf(command_buffer, "AT+CFSGFIS=%d,\"%s\"", File->directory, File->file_name);
+        cmd.message = (uint8_t *)command_buffer;
+        cmd.timeout = 1000;
+        result = SIM7080_AT_execute(&cmd);
+        if (result == ESP_ERR_TIMEOUT)
         {
             // if a failure occured, return fail
             if (Modem.log.print_log_info)
             {
                 ESP_LOGE(TAG, "failed to receive message from SIM");
             }
-            free(command_buffer);
             return ESP_FAIL;
         }
-        else
-        {
-            // got the message, now check if it contains a "OK" message
-            if (SIM7080_Strcmp_Data((uint8_t *)recieve_message, sizeof(recieve_message), "OK") == ESP_OK)
-            {
-                if (Modem.log.print_log_info)
-                {
-                    ESP_LOGE(TAG, "SIM7080 the specified file already exists");
-                }
-                free(command_buffer);
-                return ESP_FAIL;
-            }
-        }
-    }
-
-    // 6. copy the required data
-    memset(command_buffer, 0, file_size * sizeof(char));
-    sprintf(command_buffer, "AT+CFSWFILE=%d,\"%s\",%d,%d,%d", File->directory, File->file_name, File->mode, file_size, File->timeout);
-    consume_SIM7080_message((uint8_t *)command_buffer, strlen(command_buffer));
-
-
-    // 7. wait for the SIM to respond
-    memset(recieve_message, 0, Modem.config.uart_buffer_size);
-    if (xQueueReceive(Modem.comm.Recieve_queue, recieve_message, 1000 / portTICK_RATE_MS) != pdTRUE)
-    {
-        // if a failure occured, return fail
-        if (Modem.log.print_log_info)
-        {
-            ESP_LOGE(TAG, "failed to receive message from SIM");
-        }
-        free(command_buffer);
-        return ESP_FAIL;
-    }
-    else
-    {
-        // got the message, now check if it contains a "DOWNLOAD" message
-        if (SIM7080_Strcmp_Data((uint8_t *)recieve_message, sizeof(recieve_message), "DOWNLOAD") == ESP_FAIL)
+        else if (result == ESP_OK)
         {
+            // the modem replied "OK", so the file has a size
             if (Modem.log.print_log_info)
             {
-                ESP_LOGE(TAG, "SIM7080 initializing write task failed");
+                ESP_LOGE(TAG, "SIM7080 the specified file already exists");
             }
-            free(command_buffer);
             return ESP_FAIL;
         }
     }
-    // 8. proceed to writing the contents of the file
-    if (Modem.log.print_log_info)
-    {
-        ESP_LOGI(TAG, "SIM7080 writing contents of the file to SIM memory");
-    }
-
-    // 9. reset the dynamic memory and copy the contents to it
-    memset(command_buffer, 0, file_size * sizeof(char));
-    memcpy(command_buffer, File->start_pos, file_size);
 
-    // 10. send the file data to the SIM
-    consume_SIM7080_message((uint8_t *)command_buffer, strlen(command_buffer));
+    // 6. write the file. the contents are sent by the engine as soon as the modem replies "DOWNLOAD"
+    memset(&cmd, 0, sizeof(SIM7080_AT_cmd_t));
+    cmd.length          = sprintf(command_buffer, "AT+CFSWFILE=%d,\"%s\",%d,%d,%d", File->directory, File->file_name, File->mode, file_size, File->timeout);
+    cmd.message         = (uint8_t *)command_buffer;
+    cmd.timeout         = 1000 + File->timeout + 500;
+    cmd.payload_prefix  = "DOWNLOAD";
+    cmd.payload         = (const uint8_t *)File->start_pos;
+    cmd.payload_length  = file_size;
+    result = SIM7080_AT_execute(&cmd);
 
-    // reset the memory of the recieveData buffer
-    memset(recieve_message, 0, Modem.config.uart_buffer_size);
-
-    // wait for the feedback
-    if (xQueueReceive(Modem.comm.Recieve_queue, recieve_message, (File->timeout + 500) / portTICK_RATE_MS) != pdTRUE)
+    // 7. check the feedback
+    if (!cmd.payload_sent)
     {
-        // if a failure occured, return fail
         if (Modem.log.print_log_info)
         {
-            ESP_LOGE(TAG, "failed to receive message from SIM");
+            ESP_LOGE(TAG, "SIM7080 initializing write task failed");
         }
-        free(command_buffer);
         return ESP_FAIL;
     }
-    else
-    {
-        // got the message, now check if it contains a "OK" message
-        if (SIM7080_Strcmp_Data((uint8_t *)recieve_message, sizeof(recieve_message), "OK") == ESP_FAIL)
-        {
-            if (Modem.log.print_log_info)
-            {
-                ESP_LOGE(TAG, "SIM7080 write task failed");
-            }
-            free(command_buffer);
-            return ESP_FAIL;
-        }
-    }
-
-    // task completed successfully. clear resources and return success
-    free(command_buffer);
-    return ESP_OK;
-}
-
-esp_err_t send_msg_receive_interrupt(uint8_t *message, uint16_t transmit_message_size, uint8_t amount_of_commands_expected, uint16_t timeout, uint8_t recieve_message[], uint16_t recieve_message_size)
-{
-        // 1. check if the Modem is initialized before proceeding furthur
-    if (!Modem.intialized)
-    {
-        if (Modem.log.print_log_info)
-        {
-            ESP_LOGE(TAG, "Modem not initialized");
-        }
-        return ESP_FAIL;
-    }
-
-    // 2. prepare the message and consume it to the Tx Queue
-    if (consume_SIM7080_message((uint8_t *)message, transmit_message_size))
+    if (result != ESP_OK)
     {
         if (Modem.log.print_log_info)
         {
-            ESP_LOGE(TAG, "failed to add message to Tx queue");
+            ESP_LOGE(TAG, "SIM7080 write task failed");
         }
         return ESP_FAIL;
     }
 
-    // 3. begin task
-    SIM7080_msg_rcv_task_params_t param = {0};
-    param.total_messages = amount_of_commands_expected;
-    param.timeout = timeout;
-    param.recv_msg = recieve_message;
-    param.recv_msg_size = recieve_message_size;
-    param.recv_command_1 = "AT+CGATT";
-    param.recv_command_2 = "OK";
-
-    xTaskCreate(send_msg_receive_task, "send_msg_receive_task", 4096, &param, 10, NULL);
+    // task completed successfully
     return ESP_OK;
 }
 
-
-//TODO: still have to fix this code
-void send_msg_receive_task(void *pvParameters)
+/**
+ * @brief  Send a message to the SIM module and wait for the response. If there is no response after the timeout, returns false
+ *  the complete response (echo, information lines and the final result) is copied to Modem.comm.recieved_message
+ * @param message pointer to the command to be sent
+ * @param transmit_message_size  the length of the command to be sent
+ * @param amount_of_commands_expected kept for compatibility. the response is now complete when the final result code arrives
+ * @param timeout  time in milliseconds for timeout to occur
+ * @return ESP_OK if the modem responded, ESP_FAIL if error
+ */
+esp_err_t send_msg_receive_polling(uint8_t *message, uint16_t transmit_message_size, uint8_t amount_of_commands_expected, uint32_t timeout)
 {
-    SIM7080_msg_rcv_task_params_t *param     = (SIM7080_msg_rcv_task_params_t *)pvParameters;
-    uint8_t recieve_message[param->recv_msg_size];
-    memset(recieve_message, 0, param->recv_msg_size);
-    while (1)
-    {
-
-        
-        if (xQueuePeek(Modem.comm.Recieve_queue, recieve_message, param->timeout / portTICK_RATE_MS) == pdTRUE)
-        {
-            // if a message is recieved
-            if (SIM7080_Strcmp_Data((uint8_t *)recieve_message, sizeof(recieve_message), param->recv_command_1) == ESP_OK)
-            {
-                ESP_LOGW(TAG, "Data intended for the current task");
-                memset(recieve_message, 0, param->recv_msg_size);
-                if (xQueueReceive(Modem.comm.Recieve_queue, recieve_message, 200 / portTICK_RATE_MS) == pdTRUE)
-                {
-                    if (SIM7080_Strcmp_Data((uint8_t *)recieve_message, sizeof(recieve_message), param->recv_command_2) == ESP_OK)
-                    {
-                        ESP_LOGW(TAG, "SUCCESS, recieved data: %s", (char*)recieve_message);
-                    }
-                    else
-                    {
-                        ESP_LOGE(TAG, "FAIL, recieved data: %s", (char*)recieve_message);
-                    }
-                }
-                else
-                {
-                    ESP_LOGE(TAG, "failed to xQueueReceive");
-                }
-            }
-            else
-            {
-                ESP_LOGE(TAG, "test point 1");
-            }
-        }
-        else
-        {
-            // if a filure occured
-            if (Modem.log.print_log_info)
-            {
-                ESP_LOGE(TAG, "send_msg_receive_task: failed to receive message from SIM");
-            }
-
-        }
-        vTaskDelay(100 / portTICK_RATE_MS);
-        vTaskDelete(NULL);
-
-    }
+    return send_msg_receive_until(message, transmit_message_size, NULL, timeout);
 }
 
 /**
- * @brief  Send a message to the SIM module and wait for the response. If there is no response after the timeout, returns false
+ * @brief  Send a message to the SIM module and wait for a line starting with final_prefix. "OK" is treated as an intermediate line.
+ *  use this for commands which report their result later, such as "AT+HTTPTOFS" ("+HTTPTOFS:")
  * @param message pointer to the command to be sent
  * @param transmit_message_size  the length of the command to be sent
- * @param amount_of_commands_expected the amount of messages the Modem will respond. the return will be the information of the last message
+ * @param final_prefix  the beginning of the final line. if NULL, the command completes on "OK"/"ERROR"
  * @param timeout  time in milliseconds for timeout to occur
- * @return ESP_OK if success, ESP_FAIL if error
+ * @return ESP_OK if the modem responded, ESP_FAIL if error
  */
-esp_err_t send_msg_receive_polling(uint8_t *message, uint16_t transmit_message_size, uint8_t amount_of_commands_expected, uint32_t timeout)
+esp_err_t send_msg_receive_until(uint8_t *message, uint16_t transmit_message_size, const char *final_prefix, uint32_t timeout)
 {
     // 1. check if the Modem is initialized before proceeding furthur
     if (!Modem.intialized)
@@ -447,20 +334,8 @@ esp_err_t send_msg_receive_polling(uint8_t *message, uint16_t transmit_message_s
         return ESP_FAIL;
     }
 
-    // 2. check if the Modem is busy executing a previous command. if so, wait a max timeout time for the modem to be free
-    if (Modem.is_busy)
-    {
-        TickType_t start_tick = xTaskGetTickCount();
-        TickType_t elapsed_ticks = start_tick;
-        while (((elapsed_ticks - start_tick) < (timeout * portTICK_RATE_MS)) && Modem.is_busy)
-        {
-            elapsed_ticks = xTaskGetTickCount();
-            vTaskDelay(100 / portTICK_RATE_MS);
-        }
-    }
-
-    // 3. check if the modem is still busy after waiting (if previously was busy)
-    if (Modem.is_busy)
+    // 2. the callers share recieved_message. wait a max timeout time for the previous caller to finish
+    if (xSemaphoreTake(Modem.comm.Semaphore_Legacy_Command, timeout / portTICK_RATE_MS) != pdTRUE)
     {
         if (Modem.log.print_log_info)
         {
@@ -468,73 +343,35 @@ esp_err_t send_msg_receive_polling(uint8_t *message, uint16_t transmit_message_s
         }
         return ESP_FAIL;
     }
-
-    // 2. set modem status as busy
     Modem.is_busy = true;
 
-    // 2. reset the memory of the recieve_message. the size of this array should be the size expected by the queue, which is the Modem.config.uart_buffer_size
+    // 3. reset the memory of the recieve_message. the size of this array is Modem.config.uart_buffer_size
     memset(Modem.comm.recieved_message, 0, Modem.config.uart_buffer_size);
 
-    // 3. prepare the message and consume it to the Tx Queue
-    if (consume_SIM7080_message((uint8_t *)message, transmit_message_size) != ESP_OK)
+    // 4. send the command and wait for the final result
+    SIM7080_AT_cmd_t cmd    = {0};
+    cmd.message             = message;
+    cmd.length              = transmit_message_size;
+    cmd.timeout             = timeout;
+    cmd.final_prefix        = final_prefix;
+    cmd.response            = Modem.comm.recieved_message;
+    cmd.response_size       = Modem.config.uart_buffer_size - 1;
+    esp_err_t result        = SIM7080_AT_execute(&cmd);
+
+    Modem.is_busy = false;
+    xSemaphoreGive(Modem.comm.Semaphore_Legacy_Command);
+
+    // 5. an "ERROR" reply is still a response. the callers check the content of recieved_message
+    if (result == ESP_ERR_TIMEOUT || cmd.response_length == 0)
     {
-        // if a filure occured, return fail
         if (Modem.log.print_log_info)
         {
-            ESP_LOGE(TAG, "failed to send UART message to SIM");
+            ESP_LOGE(TAG, "failed to receive message from SIM");
         }
         return ESP_FAIL;
     }
 
-    // 4. handle the recieved messages from Modem as needed
-    for (uint8_t i = 0; i < amount_of_commands_expected; i++)
-    {
-        if (i == amount_of_commands_expected - 1)
-        {
-            // this is the last command to wait for
-            // wait for a response to arrive from the SIM module. (max waititng time is the timeout provided in the arguements)
-            if (xQueueReceive(Modem.comm.Recieve_queue, Modem.comm.recieved_message, timeout / portTICK_RATE_MS) == pdTRUE)
-            {
-                // if a message is recieved, return success
-                Modem.is_busy = false;
-                return ESP_OK;
-            }
-            else
-            {
-                // if a filure occured, return fail
-                if (Modem.log.print_log_info)
-                {
-                    ESP_LOGE(TAG, "failed to receive message from SIM");
-                }
-
-                Modem.is_busy = false;
-                return ESP_FAIL;
-            }
-        }
-        else
-        {
-            // this is not the last message to be expected. a generic timeout of 1 second is applied
-            // recieved data is not passed to a buffer
-            if (xQueueReceive(Modem.comm.Recieve_queue, Modem.comm.recieved_message, 1000 / portTICK_RATE_MS) != pdTRUE)
-            {
-                // if a filure occured, return fail
-                if (Modem.log.print_log_info)
-                {
-                    ESP_LOGE(TAG, "failed to receive message from SIM");
-                }
-
-                Modem.is_busy = false;
-                return ESP_FAIL;
-            }
-
-            // reset the memory of the recieveData buffer
-            memset(Modem.comm.recieved_message, 0 ,Modem.config.uart_buffer_size);
-        }
-    }
-
-    // the script is not supposed to reach this position. but for code completion, added a return fail status
-    Modem.is_busy = false;
-    return ESP_FAIL;
+    return ESP_OK;
 }
 
 /**
@@ -600,69 +437,240 @@ esp_err_t consume_SIM7080_message(uint8_t *message, size_t length)
 
 
 /**
- * @brief  constantly polls for any incoming data from SIM module and if there are any, sends to process them
+ * @brief  copy everything the UART driver holds to the ring buffer
+ * @return the number of bytes copied
  */
-void SIM7080_Receive_Data(void *pvParameters)
+static uint32_t SIM7080_Ring_Fill(void)
 {
-    if(Modem.log.print_log_info)
+    uint32_t copied = 0;
+    size_t available = 0;
+
+    // the free space may wrap around the end of the buffer, so at most two reads are needed
+    for (uint8_t i = 0; i < 2; i++)
     {
-        ESP_LOGI(TAG, "SIM7080_Receive_Data");
+        uart_get_buffered_data_len(Modem.config.uart_port, &available);
+        uint32_t free_space = Rx_ring.size - (Rx_ring.head - Rx_ring.tail);
+        uint32_t index      = Rx_ring.head % Rx_ring.size;
+        uint32_t length     = Rx_ring.size - index;
+
+        length = (free_space < length) ? free_space : length;
+        length = (available < length) ? available : length;
+        if (length == 0)
+        {
+            break;
+        }
+
+        int read_length = uart_read_bytes(Modem.config.uart_port, Rx_ring.buffer + index, length, 0);
+        if (read_length <= 0)
+        {
+            break;
+        }
+        Rx_ring.head += read_length;
+        copied += read_length;
     }
 
-    int16_t recv_data_length = 0;
-    uint8_t *recvbuf = (uint8_t *)malloc(Modem.config.uart_buffer_size);
-    while (1)
+    return copied;
+}
+
+/**
+ * @brief  get a view of the bytes between two positions of the ring buffer. a region which wraps around the end of the buffer
+ *  is copied to the scratch buffer (truncated to its size). the view is always NUL terminated
+ * @param start     the position of the first byte
+ * @param length    [in/out] the number of bytes
+ * @return pointer to the first byte
+ */
+static uint8_t *SIM7080_Ring_View(uint32_t start, uint16_t *length)
+{
+    uint32_t index = start % Rx_ring.size;
+
+    // 1. contiguous region. the byte after it is overwritten: the consumed line ending, the extra byte of the buffer, or
+    //    a byte the caller restores
+    if (index + *length <= Rx_ring.size)
+    {
+        Rx_ring.buffer[index + *length] = '\0';
+        return Rx_ring.buffer + index;
+    }
+
+    // 2. the region wraps around, copy the two parts
+    if (*length > Modem.config.uart_buffer_size)
     {
-        // 1. Initialize the receiving buffer and set it to all zeros
-        
-        if(recvbuf == NULL)
+        *length = Modem.config.uart_buffer_size;
+    }
+    uint32_t first_part = Rx_ring.size - index;
+    memcpy(Rx_ring.scratch, Rx_ring.buffer + index, first_part);
+    memcpy(Rx_ring.scratch + first_part, Rx_ring.buffer, *length - first_part);
+    Rx_ring.scratch[*length] = '\0';
+    return Rx_ring.scratch;
+}
+
+/**
+ * @brief  check if the data at a position of the ring buffer begins with the given characters
+ */
+static bool SIM7080_Ring_Starts_With(uint32_t start, uint16_t length, const char *prefix)
+{
+    uint16_t prefix_length = strlen(prefix);
+    if (length < prefix_length)
+    {
+        return false;
+    }
+    for (uint16_t i = 0; i < prefix_length; i++)
+    {
+        if (Rx_ring.buffer[(start + i) % Rx_ring.size] != (uint8_t)prefix[i])
         {
-            ESP_LOGE(TAG, "Error allocating dynamic memory");
+            return false;
         }
-        memset(recvbuf, 0, Modem.config.uart_buffer_size);
-        
-        // 2. wait for the UART resource to be free
-        if (xSemaphoreTake(Modem.comm.Semaphore_UART_Resource, portMAX_DELAY) == pdTRUE)
+    }
+    return true;
+}
+
+/**
+ * @brief  find the next "\n" between Rx_ring.scan and Rx_ring.head
+ * @return true if found. the position of it is stored in Rx_ring.scan
+ */
+static bool SIM7080_Ring_Find_Line_End(void)
+{
+    while (Rx_ring.scan != Rx_ring.head)
+    {
+        uint32_t index  = Rx_ring.scan % Rx_ring.size;
+        uint32_t length = Rx_ring.head - Rx_ring.scan;
+        if (index + length > Rx_ring.size)
         {
-            // 3. get the length of data in the fifo buffer and copy it to the recvbuf
-            recv_data_length = uart_read_bytes(Modem.config.uart_port, recvbuf, Modem.config.uart_buffer_size, 15);
+            length = Rx_ring.size - index;
+        }
 
-            // 4. Release the semaphore when done
-            xSemaphoreGive(Modem.comm.Semaphore_UART_Resource);
+        uint8_t *line_end = memchr(Rx_ring.buffer + index, '\n', length);
+        if (line_end != NULL)
+        {
+            Rx_ring.scan += line_end - (Rx_ring.buffer + index);
+            return true;
         }
+        Rx_ring.scan += length;
+    }
+    return false;
+}
 
-        // 5. if there is any data to be read the recv_data_length will not be zero
-        if (recv_data_length > 0)
-        {    
-            esp_err_t add_recv_data_to_Recieve_queue = ESP_OK;
-            if (Modem.comm.pre_process_recieved_message != NULL)
+/**
+ * @brief  split the content of the ring buffer into lines and raw payloads and hand them to the AT engine
+ */
+static void SIM7080_Ring_Frame(void)
+{
+    while (Rx_ring.tail != Rx_ring.head)
+    {
+        // 1. raw payload announced by the previous line (eg: "+CFSRFILE: <length>"). handed over without copying
+        if (Rx_ring.binary_remaining > 0)
+        {
+            uint32_t index  = Rx_ring.tail % Rx_ring.size;
+            uint32_t length = Rx_ring.head - Rx_ring.tail;
+            length = (Rx_ring.binary_remaining < length) ? Rx_ring.binary_remaining : length;
+            length = ((Rx_ring.size - index) < length) ? (Rx_ring.size - index) : length;
+
+            SIM7080_AT_process_binary(Rx_ring.buffer + index, length);
+            Rx_ring.binary_remaining -= length;
+            Rx_ring.tail += length;
+            Rx_ring.scan = Rx_ring.tail;
+            continue;
+        }
+
+        // 2. look for the end of the line
+        if (!SIM7080_Ring_Find_Line_End())
+        {
+            uint16_t length = Rx_ring.head - Rx_ring.tail;
+
+            // prompts such as "> " are not followed by "\r\n"
+            if (length <= SIM7080_PROMPT_MAX_LENGTH && SIM7080_AT_process_partial(SIM7080_Ring_View(Rx_ring.tail, &length), length))
             {
-                add_recv_data_to_Recieve_queue = Modem.comm.pre_process_recieved_message(recvbuf);
+                Rx_ring.tail = Rx_ring.head;
+                Rx_ring.scan = Rx_ring.head;
             }
+            // a line which fills the whole buffer is handed over as it is. the byte after it is received data, not a
+            // line ending, so it is restored once the view is no longer used
+            else if ((Rx_ring.head - Rx_ring.tail) == Rx_ring.size)
+            {
+                length = Modem.config.uart_buffer_size;
+                uint32_t next_index = (Rx_ring.tail + length) % Rx_ring.size;
+                uint8_t next_byte = Rx_ring.buffer[next_index];
+                SIM7080_AT_process_line(SIM7080_Ring_View(Rx_ring.tail, &length), length);
+                Rx_ring.buffer[next_index] = next_byte;
+                Rx_ring.tail += length;
+                Rx_ring.scan = Rx_ring.tail;
+                continue;
+            }
+            break;
+        }
+
+        // 3. the "\r" before the "\n" is not part of the line
+        uint32_t line_end = Rx_ring.scan;
+        uint16_t length = line_end - Rx_ring.tail;
+        if (length > 0 && Rx_ring.buffer[(line_end - 1) % Rx_ring.size] == '\r')
+        {
+            length--;
+        }
+
+        // 4. the MQTT payload of "+SMSUB:" is in quotes and may contain line endings. the message ends with a closing quote
+        if (SIM7080_Ring_Starts_With(Rx_ring.tail, length, "+SMSUB:") &&
+            Rx_ring.buffer[(Rx_ring.tail + length - 1) % Rx_ring.size] != '"' && (Rx_ring.head - Rx_ring.tail) < Rx_ring.size)
+        {
+            Rx_ring.scan = line_end + 1;
+            continue;
+        }
 
-            // 4. add it to the UART_Rx queue if needed
-            if (add_recv_data_to_Recieve_queue == ESP_OK)
+        // 5. hand over the line and consume it, including the "\r\n"
+        Rx_ring.binary_remaining = SIM7080_AT_process_line(SIM7080_Ring_View(Rx_ring.tail, &length), length);
+        Rx_ring.tail = line_end + 1;
+        Rx_ring.scan = Rx_ring.tail;
+    }
+}
+
+/**
+ * @brief  waits for the data events of the UART driver, moves the data to the ring buffer and hands the framed lines to the AT engine
+ */
+void SIM7080_Receive_Data(void *pvParameters)
+{
+    if(Modem.log.print_log_info)
+    {
+        ESP_LOGI(TAG, "SIM7080_Receive_Data");
+    }
+
+    uart_event_t event;
+    while (1)
+    {
+        // 1. expire the timed out commands and wait for the next UART event, at most until the next timeout
+        if (xQueueReceive(Modem.comm.UART_event_queue, &event, SIM7080_AT_check_timeouts()) != pdTRUE)
+        {
+            continue;
+        }
+
+        switch (event.type)
+        {
+        case UART_DATA:
+        {
+            // 2. move the data to the ring buffer and frame it. if the ring is full, framing frees space for the rest
+            while (SIM7080_Ring_Fill() > 0)
             {
-                if (xQueueSend(Modem.comm.Recieve_queue, recvbuf, 1) != pdTRUE)
-                {
-                    if (Modem.log.print_log_info)
-                    {
-                        ESP_LOGE(TAG, "Queue error consumung the recieved message");
-                    }
-                }
-                // print data if needed
-                if (Modem.log.print_Rx_info)
-                {
-                    ESP_LOGI(TAG, "Rx raw data:\n%s", recvbuf);
-                }
+                SIM7080_Ring_Frame();
             }
+        }
+        break;
 
-            // 7. clear out the uart buffer
-            uart_flush(Modem.config.uart_port);
+        case UART_FIFO_OVF:
+        case UART_BUFFER_FULL:
+        {
+            // 3. bytes are lost. drop everything, including the partial line, and start over at the next line
+            Rx_ring.overflows++;
+            if (Modem.log.print_log_info)
+            {
+                ESP_LOGE(TAG, "UART overflow (%u), input flushed", Rx_ring.overflows);
+            }
+            uart_flush_input(Modem.config.uart_port);
+            xQueueReset(Modem.comm.UART_event_queue);
+            Rx_ring.tail                = Rx_ring.head;
+            Rx_ring.scan                = Rx_ring.head;
+            Rx_ring.binary_remaining    = 0;
         }
+        break;
 
-        vTaskDelay(10 / portTICK_RATE_MS);
+        default:
+        break;
+        }
     }
-    // 8. free memory resources
-    free(recvbuf);
 }
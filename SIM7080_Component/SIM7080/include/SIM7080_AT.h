@@ -0,0 +1,102 @@
+#ifndef SIM7080_AT_H
+#define SIM7080_AT_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+
+// engine limits
+#define SIM7080_AT_MAX_IN_FLIGHT            4       // upper bound of the pipeline depth
+#define SIM7080_AT_PENDING_LENGTH           16      // commands waiting to be written to the modem
+#define SIM7080_AT_PREFIX_SIZE              16      // "+CFSRFILE" style response prefixes
+#define SIM7080_AT_METRICS_ENTRIES          32      // one entry per distinct command prefix
+#define SIM7080_AT_MAX_WAIT_TICKS           (1000 / portTICK_RATE_MS)
+#define SIM7080_AT_SYNC_TIMEOUT             1000    // ms. "AT+CMEE?" written after a timeout, before the next command
+#define SIM7080_AT_SYNC_ATTEMPTS            5
+
+// command flags
+#define SIM7080_AT_FLAG_NONE                0x00
+#define SIM7080_AT_FLAG_NO_CR               0x01    // do not terminate the message with "\r"
+#define SIM7080_AT_FLAG_BINARY              0x02    // the "<prefix>: <length>" line is followed by <length> raw bytes
+#define SIM7080_AT_FLAG_PIPELINE            0x04    // may be written while other pipeline commands are still in flight
+
+typedef enum SIM7080_AT_state
+{
+    SIM7080_AT_IDLE = 0,
+    SIM7080_AT_PENDING,
+    SIM7080_AT_IN_FLIGHT,
+    SIM7080_AT_DONE,
+
+} SIM7080_AT_state;
+
+struct SIM7080_AT_cmd_t;
+typedef void (*SIM7080_AT_callback_t)(struct SIM7080_AT_cmd_t *cmd);
+
+/**
+ * one AT command handled by the engine. The memory of the command must stay valid until it is completed.
+ * a command is complete when its final result code ("OK", "ERROR", "+CME ERROR", or final_prefix) arrives or the timeout expires
+ */
+typedef struct SIM7080_AT_cmd_t
+{
+    // filled by the caller
+    const uint8_t *message;                 // the command, without the terminating "\r"
+    uint16_t length;                        // length of the command
+    uint8_t flags;                          // SIM7080_AT_FLAG_x
+    uint32_t timeout;                       // in milliseconds, measured from the moment the command is written
+    const char *final_prefix;               // if set, "OK" is intermediate and the command completes on this line (eg: "+HTTPTOFS:"), or after its raw bytes with SIM7080_AT_FLAG_BINARY (eg: "+SHREAD:")
+    const char *payload_prefix;             // if set, payload is written as soon as this line/prompt arrives. (eg: ">" or "DOWNLOAD")
+    const uint8_t *payload;                 // the data which follows the payload_prefix
+    uint16_t payload_length;                // length of the payload
+    uint8_t *response;                      // (optional) buffer for the transcript of the response. each line is terminated by "\r\n"
+    uint16_t response_size;                 // size of the response buffer
+    uint8_t *binary;                        // (optional) buffer for the raw bytes of a SIM7080_AT_FLAG_BINARY command. if NULL, they go to the response
+    uint32_t binary_size;                   // size of the binary buffer
+    SIM7080_AT_callback_t callback;         // (optional) called from the receiving task on completion
+    void *arg;                              // (optional) user argument for the callback
+
+    // filled by the engine
+    volatile SIM7080_AT_state state;
+    esp_err_t result;                       // ESP_OK, ESP_FAIL (modem replied ERROR) or ESP_ERR_TIMEOUT
+    uint16_t response_length;               // number of bytes copied to the response buffer
+    uint32_t binary_length;                 // number of raw bytes announced by the modem
+    uint32_t binary_received;               // number of raw bytes recieved. bytes beyond binary_size are dropped
+    bool binary_final;                      // the raw bytes belong to the final result (final_prefix with SIM7080_AT_FLAG_BINARY)
+    bool payload_sent;
+    int64_t submit_time;                    // esp_timer time stamps, in micro seconds
+    int64_t sent_time;
+    int64_t done_time;
+    TaskHandle_t waiter;
+    char prefix[SIM7080_AT_PREFIX_SIZE];    // "+CSQ" for "AT+CSQ". Responses beginning with this belong to the command
+
+} SIM7080_AT_cmd_t;
+
+typedef struct SIM7080_AT_metrics_t
+{
+    char prefix[SIM7080_AT_PREFIX_SIZE];
+    uint32_t count;
+    uint32_t errors;
+    uint32_t timeouts;
+    int64_t queue_time_total;               // time spent waiting to be written, in micro seconds
+    int64_t latency_total;                  // time between writing the command and its final result, in micro seconds
+    int64_t latency_min;
+    int64_t latency_max;
+
+} SIM7080_AT_metrics_t;
+
+esp_err_t SIM7080_AT_engine_init(uint8_t pipeline_depth);
+esp_err_t SIM7080_AT_submit(SIM7080_AT_cmd_t *cmd);
+esp_err_t SIM7080_AT_start(SIM7080_AT_cmd_t *cmd);
+esp_err_t SIM7080_AT_wait(SIM7080_AT_cmd_t *cmd);
+esp_err_t SIM7080_AT_execute(SIM7080_AT_cmd_t *cmd);
+uint8_t SIM7080_AT_flush(void);
+uint32_t SIM7080_AT_process_line(const uint8_t *line, uint16_t length);
+void SIM7080_AT_process_binary(const uint8_t *data, uint16_t length);
+bool SIM7080_AT_process_partial(const uint8_t *data, uint16_t length);
+TickType_t SIM7080_AT_check_timeouts(void);
+uint8_t SIM7080_AT_get_metrics(SIM7080_AT_metrics_t *metrics, uint8_t max_entries);
+void SIM7080_AT_print_metrics(void);
+void SIM7080_AT_reset_metrics(void);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef SIM7080_URC_H
+#define SIM7080_URC_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+// matcher limits
+#define SIM7080_URC_MAX_NODES               128     // total characters of all the prefixes in the table, without common beginnings
+#define SIM7080_URC_MAX_ENTRIES             32
+
+typedef esp_err_t (*SIM7080_URC_handler_t)(uint8_t *line, uint16_t length);
+
+/**
+ * one recognized unsolicited message. A line is given to the handler of the longest prefix it begins with
+ */
+typedef struct SIM7080_URC_entry_t
+{
+    const char *prefix;                     // eg: "+SMSUB:" or "+APP PDP: 0,DEACTIVE"
+    SIM7080_URC_handler_t handler;
+
+} SIM7080_URC_entry_t;
+
+esp_err_t SIM7080_URC_build(const SIM7080_URC_entry_t *table, uint8_t entries);
+const SIM7080_URC_entry_t *SIM7080_URC_match(const uint8_t *line, uint16_t length);
+esp_err_t SIM7080_URC_dispatch(uint8_t *line, uint16_t length);
+
+#endif
@@ -4,19 +4,11 @@
 #include "string.h"
 #include "driver/uart.h"
 #include "esp_log.h"
+#include "SIM7080_AT.h"
+#include "SIM7080_URC.h"
 
+#define SIM7080_PROMPT_MAX_LENGTH   16      // incomplete lines up to this length are checked for prompts
 
-typedef struct SIM7080_msg_rcv_task_params_t
-{
-    uint8_t total_messages;
-    uint16_t timeout;
-    uint8_t* recv_msg;
-    uint16_t recv_msg_size;
-    const char * recv_command_1;
-    const char * recv_command_2;
-
-
-}__attribute__((packed)) SIM7080_msg_rcv_task_params_t;
 
 typedef struct SIM7080_config_t
 {
@@ -26,6 +18,7 @@ typedef struct SIM7080_config_t
     uint8_t wakeup_pin;
     uint16_t uart_buffer_size;
     uint8_t queue_length; 				 
+    uint8_t pipeline_depth;             // max number of SIM7080_AT_FLAG_PIPELINE commands in flight
 
 } __attribute__((packed)) SIM7080_config_t;
 
@@ -41,13 +34,31 @@ typedef struct SIM7080_log_t
 typedef struct SIM7080_communication_t
 {
     SemaphoreHandle_t   Semaphore_UART_Resource;
-    QueueHandle_t       Recieve_queue; 
+    SemaphoreHandle_t   Semaphore_Legacy_Command;   // serializes the users of recieved_message
+    QueueHandle_t       UART_event_queue;           // data/overflow events of the UART driver
     uint8_t*            recieved_message;
-    esp_err_t (*pre_process_recieved_message)(uint8_t* recvbuf);	 
+    esp_err_t (*pre_process_recieved_message)(uint8_t* recvbuf);    // called with every unsolicited line (NUL terminated)
 
 } __attribute__((packed)) SIM7080_communication_t;
 
 
+/**
+ * receive ring buffer. lines are handed to the AT engine as views into the buffer, without copying.
+ * the positions are free running counters, the index in the buffer is position % size
+ */
+typedef struct SIM7080_ring_t
+{
+    uint8_t *buffer;                // size + 1 bytes. the extra byte terminates a line which ends at the end of the buffer
+    uint8_t *scratch;               // lines which wrap around the end of the buffer are copied here
+    uint32_t size;
+    uint32_t head;                  // bytes written by the UART
+    uint32_t tail;                  // bytes consumed by the AT engine
+    uint32_t scan;                  // position where the search for the next "\n" continues
+    uint32_t binary_remaining;      // raw bytes which belong to the command in flight
+    uint32_t overflows;
+
+} SIM7080_ring_t;
+
 typedef struct SIM7080_t
 {
     SIM7080_config_t config;
@@ -93,7 +104,7 @@ typedef struct SIM7080_FS_t
 
 
 esp_err_t SIM7080_setup(SIM7080_t *SIM_module);
-esp_err_t SIM7080_Strcmp_Data(uint8_t *data, uint8_t data_length, const char *character);
+esp_err_t SIM7080_Strcmp_Data(uint8_t *data, uint16_t data_length, const char *character);
 esp_err_t SIM7080_FS_write_file(SIM7080_FS_t * File);
 esp_err_t set_internet_status(bool state);
 esp_err_t set_log_status(bool print_Tx_info, bool print_Rx_info, bool print_log_info);
@@ -103,7 +114,6 @@ void SIM7080_Transmit_Data(void *pvParameters);
 void SIM7080_Receive_Data(void *pvParameters);
 esp_err_t consume_SIM7080_message(uint8_t *message, size_t length);
 esp_err_t send_msg_receive_polling(uint8_t *message, uint16_t transmit_message_size, uint8_t amount_of_commands_expected, uint32_t timeout);
-esp_err_t send_msg_receive_interrupt(uint8_t *message, uint16_t transmit_message_size, uint8_t amount_of_commands_expected, uint16_t timeout, uint8_t recieve_message[], uint16_t recieve_message_size);
-void send_msg_receive_task(void *pvParameters);
+esp_err_t send_msg_receive_until(uint8_t *message, uint16_t transmit_message_size, const char *final_prefix, uint32_t timeout);
 
 #endif